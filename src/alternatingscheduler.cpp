@@ -0,0 +1,185 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QScreen>
+#include <QByteArrayList>
+
+#include "alternatingscheduler.hpp"
+#include "log.hpp"
+
+
+AlternatingScheduler::AlternatingScheduler() :
+    _getSyncValues(nullptr),
+    _waitForSbc(nullptr),
+    _display(nullptr),
+    _drawable(0),
+    _lastSwapNsecs(-1),
+    _refreshNsecs(1e9 / 60.0),
+    _refreshCount(0),
+    _pendingView(-1),
+    _swaps(0),
+    _missedRefreshes(0),
+    _phaseErrors(0)
+{
+    _timer.start();
+}
+
+void AlternatingScheduler::initialize(QOpenGLContext* context, QWindow* window)
+{
+    _getSyncValues = nullptr;
+    _waitForSbc = nullptr;
+#if QT_CONFIG(xcb) && QT_CONFIG(xcb_glx_plugin)
+    // GLX functions that are not part of the OML extension
+    typedef int (*QueryContextFunc)(void* display, void* context, int attribute, int* value);
+    typedef const char* (*QueryExtensionsStringFunc)(void* display, int screen);
+    const int GLX_SCREEN = 0x800C;
+
+    auto x11App = qGuiApp->nativeInterface<QNativeInterface::QX11Application>();
+    auto glxContext = context->nativeInterface<QNativeInterface::QGLXContext>();
+    if (x11App && glxContext) {
+        _display = x11App->display();
+        _drawable = window->winId();
+        // glXGetProcAddress() returns non-null pointers for any name starting
+        // with "glX", so the extension string is the only reliable check
+        auto queryContext = reinterpret_cast<QueryContextFunc>(context->getProcAddress("glXQueryContext"));
+        auto queryExtensionsString = reinterpret_cast<QueryExtensionsStringFunc>(context->getProcAddress("glXQueryExtensionsString"));
+        int screen = 0;
+        const char* extensions = nullptr;
+        if (queryContext && queryExtensionsString
+                && queryContext(_display, glxContext->nativeContext(), GLX_SCREEN, &screen) == 0) {
+            extensions = queryExtensionsString(_display, screen);
+        }
+        if (extensions && QByteArray(extensions).split(' ').contains("GLX_OML_sync_control")) {
+            _getSyncValues = reinterpret_cast<GetSyncValuesFunc>(context->getProcAddress("glXGetSyncValuesOML"));
+            _waitForSbc = reinterpret_cast<WaitForSbcFunc>(context->getProcAddress("glXWaitForSbcOML"));
+            qint64 msc;
+            if (!_getSyncValues || !_waitForSbc || !querySyncValues(&msc)) {
+                _getSyncValues = nullptr;
+                _waitForSbc = nullptr;
+            }
+        }
+    }
+#else
+    Q_UNUSED(context);
+#endif
+    qreal refreshRate = window->screen() ? window->screen()->refreshRate() : 0.0;
+    if (refreshRate > 0.0)
+        _refreshNsecs = 1e9 / refreshRate;
+    LOG_DEBUG("alternating scheduler: refresh count from %s, refresh rate %g Hz",
+            _getSyncValues ? "GLX_OML_sync_control" : "swap timing", 1e9 / _refreshNsecs);
+    reset();
+}
+
+bool AlternatingScheduler::querySyncValues(qint64* msc)
+{
+    qint64 ust, sbc;
+    return _getSyncValues(_display, _drawable, &ust, msc, &sbc);
+}
+
+bool AlternatingScheduler::querySwapCompleteMsc(qint64* msc)
+{
+    // A target swap count of 0 waits until all swaps issued so far have
+    // completed, and returns the refresh count at which the last one did.
+    // Reading the current refresh count instead would be off by one when
+    // the swap is still queued or a refresh has already passed since.
+    qint64 ust, sbc;
+    return _waitForSbc(_display, _drawable, 0, &ust, msc, &sbc);
+}
+
+void AlternatingScheduler::reset()
+{
+    _lastSwapNsecs = -1;
+    _pendingView = -1;
+}
+
+int AlternatingScheduler::nextView()
+{
+    // Without sync values after a reset, the refresh count is relative to
+    // the first swap, so its parity is arbitrary but consistent
+    if (_pendingView < 0)
+        _pendingView = int((_refreshCount + 1) & 1);
+    return _pendingView;
+}
+
+void AlternatingScheduler::swapped()
+{
+    qint64 now = _timer.nsecsElapsed();
+    qint64 refreshes = 1;
+    if (_getSyncValues) {
+        qint64 msc;
+        if (querySwapCompleteMsc(&msc)) {
+            if (_lastSwapNsecs >= 0)
+                refreshes = msc - _refreshCount;
+            _refreshCount = msc;
+        } else {
+            LOG_WARNING("alternating scheduler: cannot get sync values, falling back to swap timing");
+            _getSyncValues = nullptr;
+            _waitForSbc = nullptr;
+        }
+    }
+    if (!_getSyncValues) {
+        if (_lastSwapNsecs >= 0)
+            refreshes = qMax(qint64(1), qRound64((now - _lastSwapNsecs) / _refreshNsecs));
+        _refreshCount += refreshes;
+    }
+    _swaps++;
+    if (_lastSwapNsecs >= 0 && refreshes > 1) {
+        _missedRefreshes += refreshes - 1;
+        LOG_FIREHOSE("alternating scheduler: missed %lld refreshes", refreshes - 1);
+    }
+    if (_pendingView >= 0 && _pendingView != int(_refreshCount & 1)) {
+        _phaseErrors++;
+        LOG_DEBUG("alternating scheduler: eye phase error at refresh %lld, correcting", _refreshCount);
+    }
+    _lastSwapNsecs = now;
+    // the next swap should hit the next refresh
+    _pendingView = int((_refreshCount + 1) & 1);
+}
+
+bool AlternatingScheduler::usesSyncValues() const
+{
+    return _getSyncValues;
+}
+
+unsigned long long AlternatingScheduler::swaps() const
+{
+    return _swaps;
+}
+
+unsigned long long AlternatingScheduler::missedRefreshes() const
+{
+    return _missedRefreshes;
+}
+
+unsigned long long AlternatingScheduler::phaseErrors() const
+{
+    return _phaseErrors;
+}
+
+void AlternatingScheduler::logStatistics() const
+{
+    if (_swaps == 0)
+        return;
+    LOG_INFO("alternating output: %llu swaps, %llu missed refreshes, %llu eye phase errors (refresh count from %s)",
+            _swaps, _missedRefreshes, _phaseErrors,
+            _getSyncValues ? "GLX_OML_sync_control" : "swap timing");
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+#include <QWindow>
+
+class QOpenGLContext;
+
+
+/* Decides which view Output_Alternating shows with the next buffer swap.
+ * The eye follows the parity of the display refresh count, not the number of
+ * rendered frames, so that a missed refresh does not swap the eyes for
+ * shutter glasses until the next miss. The refresh count comes from
+ * GLX_OML_sync_control where the GLX extension string lists it: it is the
+ * count at which the last swap completed, as reported by glXWaitForSbcOML().
+ * Otherwise it is estimated from the time between buffer swaps and the screen
+ * refresh rate.
+ * When a swap hits a refresh of the wrong parity, this is counted as an eye
+ * phase error, and the next view is chosen from the actual refresh count,
+ * which corrects the phase. */
+
+class AlternatingScheduler
+{
+private:
+    // GLX_OML_sync_control (without including the X11 and GLX headers)
+    typedef int (*GetSyncValuesFunc)(void* display, unsigned long drawable,
+            qint64* ust, qint64* msc, qint64* sbc);
+    typedef int (*WaitForSbcFunc)(void* display, unsigned long drawable,
+            qint64 targetSbc, qint64* ust, qint64* msc, qint64* sbc);
+    GetSyncValuesFunc _getSyncValues;
+    WaitForSbcFunc _waitForSbc;
+    void* _display;
+    unsigned long _drawable;
+
+    QElapsedTimer _timer;
+    qint64 _lastSwapNsecs;      // time of the last swap, or -1 after reset()
+    double _refreshNsecs;       // duration of one display refresh
+    qint64 _refreshCount;       // refresh count at the last swap
+    int _pendingView;           // view rendered for the next swap, or -1
+
+    // statistics
+    unsigned long long _swaps;
+    unsigned long long _missedRefreshes;
+    unsigned long long _phaseErrors;
+
+    bool querySyncValues(qint64* msc);
+    bool querySwapCompleteMsc(qint64* msc);
+
+public:
+    AlternatingScheduler();
+
+    // Must be called with the context current, for the given window
+    void initialize(QOpenGLContext* context, QWindow* window);
+    // Start a new sequence of swaps, e.g. when alternation starts again
+    void reset();
+
+    // The view (0 or 1) to render for the next swap
+    int nextView();
+    // Report that the buffer swap was done
+    void swapped();
+
+    bool usesSyncValues() const;
+    unsigned long long swaps() const;
+    unsigned long long missedRefreshes() const;
+    unsigned long long phaseErrors() const;
+    void logStatistics() const;
+};
@@ -22,8 +22,13 @@
 #include <QFontMetrics>
 #include <QTextLayout>
 #include <QPainter>
+#include <QTimer>
+#include <QGuiApplication>
+#include <QScreen>
 
 #include "bino.hpp"
+#include "gpuprofiler.hpp"
+#include "tracer.hpp"
 #include "log.hpp"
 #include "tools.hpp"
 #include "metadata.hpp"
@@ -36,17 +41,40 @@ Bino::Bino(const Screen& screen, bool swapEyes) :
     _videoSink(nullptr),
     _audioOutput(nullptr),
     _player(nullptr),
+    _nextPlayer(nullptr),
+    _playbackRate(1.0),
+    _fileIOMode(FileIO_Backend),
+    _imageSource(nullptr),
+    _slideshowDuration(0),
+    _frameSource(nullptr),
+    _sequenceFps(24.0f),
+    _sequenceMemoryBudget(0),
     _audioInput(nullptr),
     _videoInput(nullptr),
     _captureSession(nullptr),
+    _shmCapture(nullptr),
+    _shmFrameTimestamp(0),
+    _shmRenderedTimestamp(0),
     _lastFrameInputMode(Input_Unknown),
     _lastFrameSurroundMode(Surround_Unknown),
+    _stateChangePending(false),
     _screen(screen),
+    _framePrecision(Precision_Auto),
+    _gpuBudget(0.0f),
+    _minResolutionScale(1.0f),
+    _maxResolutionScale(1.0f),
+    _frameTexFormat(0),
+    _haveAnisotropicFiltering(false),
+    _statBytesUploaded(0),
     _frameIsNew(false),
     _swapEyes(swapEyes)
 {
     Q_ASSERT(!binoSingleton);
     binoSingleton = this;
+    _frameTexMiB[0] = 0.0;
+    _frameTexMiB[1] = 0.0;
+    _slideshowTimer.setSingleShot(true);
+    connect(&_slideshowTimer, &QTimer::timeout, [=]() { Playlist::instance()->mediaEnded(); });
 }
 
 Bino::~Bino()
@@ -54,9 +82,13 @@ Bino::~Bino()
     delete _videoSink;
     delete _audioOutput;
     delete _player;
+    delete _nextPlayer;
+    delete _imageSource;
+    delete _frameSource;
     delete _audioInput;
     delete _videoInput;
     delete _captureSession;
+    delete _shmCapture;
     binoSingleton = nullptr;
 }
 
@@ -71,26 +103,37 @@ void Bino::initializeOutput(const QAudioDevice& audioOutputDevice)
     connect(_videoSink, &VideoSink::newVideoFrame, [=]() { emit newVideoFrame(); });
     _audioOutput = new QAudioOutput;
     _audioOutput->setDevice(audioOutputDevice);
+    _imageSource = new ImageSource;
+    if (_screen.aspectRatio <= 0.0f) {
+        // GUI mode: there is no point in decoding images at a much higher
+        // resolution than the screen can show. The factor 2 leaves room for
+        // the halves of side-by-side and top-bottom stereo images.
+        QScreen* screen = QGuiApplication::primaryScreen();
+        if (screen)
+            _imageSource->setMaximumSize(screen->size() * screen->devicePixelRatio() * 2);
+    }
+    connect(_imageSource, &ImageSource::imageReady, [=](const QString& fileName, const StillImage& stillImage) {
+            if (!_imageUrl.isEmpty() && fileName == _imageUrl.toLocalFile())
+                showImage(stillImage);
+            });
 }
 
-void Bino::startPlaylistMode()
+QMediaPlayer* Bino::createPlayer()
 {
-    if (playlistMode()) {
-        return;
-    }
-    if (captureMode()) {
-        stopCaptureMode();
-    }
-
-    connect(Playlist::instance(), SIGNAL(mediaChanged(PlaylistEntry)), this, SLOT(mediaChanged(PlaylistEntry)));
-
-    _player = new QMediaPlayer;
-    _player->setVideoOutput(_videoSink);
-    _player->setAudioOutput(_audioOutput);
-    _player->connect(_player, &QMediaPlayer::errorOccurred,
+    QMediaPlayer* player = new QMediaPlayer;
+    player->setPlaybackRate(_playbackRate);
+    player->connect(player, &QMediaPlayer::errorOccurred,
             [=](QMediaPlayer::Error /* error */, const QString& errorString) {
             LOG_WARNING("%s", qPrintable(tr("Media player error: %1").arg(errorString)));
             });
+    return player;
+}
+
+// Connect _player to our outputs and to the play list.
+void Bino::activatePlayer()
+{
+    _player->setVideoOutput(_videoSink);
+    _player->setAudioOutput(_audioOutput);
     _player->connect(_player, &QMediaPlayer::playbackStateChanged,
             [=](QMediaPlayer::PlaybackState state) {
             LOG_DEBUG("Playback state changed to %s",
@@ -101,12 +144,152 @@ void Bino::startPlaylistMode()
             if (state == QMediaPlayer::StoppedState)
                 Playlist::instance()->mediaEnded();
             });
+    _player->connect(_player, &QMediaPlayer::mediaStatusChanged,
+            [=](QMediaPlayer::MediaStatus status) {
+            // As soon as the current media plays smoothly, start preparing the next one
+            if (status == QMediaPlayer::BufferedMedia)
+                prerollNextEntry();
+            // The track lists may only be complete now
+            if (status == QMediaPlayer::LoadedMedia)
+                emit tracksChanged();
+            });
+    _player->connect(_player, &QMediaPlayer::tracksChanged, [=]() { emit tracksChanged(); });
+}
+
+void Bino::setFileIOMode(FileIOMode mode)
+{
+    _fileIOMode = mode;
+}
+
+void Bino::setSlideshowDuration(int milliseconds)
+{
+    _slideshowDuration = milliseconds;
+}
+
+void Bino::setImageSequenceOptions(float fps, qint64 memoryBudget)
+{
+    _sequenceFps = fps;
+    _sequenceMemoryBudget = memoryBudget;
+}
+
+void Bino::setRawVideoFormat(const RawVideoFormat& format)
+{
+    _rawVideoFormat = format;
+}
+
+void Bino::setShmOutputName(const QString& name)
+{
+    _shmOutputName = name;
+}
+
+QString Bino::shmOutputName() const
+{
+    return _shmOutputName;
+}
+
+void Bino::setFramePrecision(FramePrecision precision)
+{
+    _framePrecision = precision;
+}
+
+FramePrecision Bino::framePrecision() const
+{
+    return _framePrecision;
+}
+
+void Bino::setQualityGovernor(float gpuBudget, float minResolutionScale, float maxResolutionScale)
+{
+    _gpuBudget = gpuBudget;
+    _minResolutionScale = minResolutionScale;
+    _maxResolutionScale = maxResolutionScale;
+}
+
+float Bino::gpuBudget() const
+{
+    return _gpuBudget;
+}
+
+float Bino::minResolutionScale() const
+{
+    return _minResolutionScale;
+}
+
+float Bino::maxResolutionScale() const
+{
+    return _maxResolutionScale;
+}
+
+bool Bino::frameIsNew() const
+{
+    return _frameIsNew;
+}
+
+unsigned int Bino::frameTextureFormat() const
+{
+    return _frameTexFormat;
+}
+
+const RenderQuality& Bino::renderQuality() const
+{
+    return _renderQuality;
+}
+
+void Bino::setRenderQuality(const RenderQuality& quality)
+{
+    if (quality != _renderQuality) {
+        _renderQuality = quality;
+        // convert the current frame again, and invalidate the views rendered from it
+        _frameIsNew = true;
+    }
+}
+
+void Bino::setDisplayLut(const CubeLut& lut)
+{
+    _displayLut = lut;
+}
+
+const CubeLut& Bino::displayLut() const
+{
+    return _displayLut;
+}
+
+void Bino::setPlayerSource(QMediaPlayer* player, const QUrl& url)
+{
+    if (_fileIOMode != FileIO_Backend && url.isLocalFile()) {
+        // The device is owned by the player, so that it lives exactly as long as
+        // the player might use it.
+        BufferedFile* device = new BufferedFile(url.toLocalFile(), _fileIOMode, player);
+        if (device->open(QIODevice::ReadOnly)) {
+            player->setSourceDevice(device, url);
+            return;
+        }
+        LOG_DEBUG("cannot open %s for buffered reading: %s", qPrintable(url.toString()), qPrintable(device->errorString()));
+        delete device;
+    }
+    player->setSource(url);
+}
+
+void Bino::startPlaylistMode()
+{
+    if (playlistMode()) {
+        return;
+    }
+    if (captureMode()) {
+        stopCaptureMode();
+    }
+
+    connect(Playlist::instance(), SIGNAL(mediaChanged(PlaylistEntry)), this, SLOT(mediaChanged(PlaylistEntry)));
+
+    _player = createPlayer();
+    activatePlayer();
 
     emit stateChanged();
 }
 
 void Bino::stopPlaylistMode()
 {
+    discardNextPlayer();
+    stopFrameSource();
     if (_player) {
         delete _player;
         _player = nullptr;
@@ -140,8 +323,33 @@ void Bino::startCaptureMode(
     emit stateChanged();
 }
 
+void Bino::startShmCaptureMode(const QString& name, InputMode inputMode, SurroundMode surroundMode)
+{
+    if (playlistMode())
+        stopPlaylistMode();
+    if (captureMode())
+        stopCaptureMode();
+
+    _videoSink->newUrl(QUrl(), inputMode, surroundMode);
+    _shmCapture = new ShmCapture(name);
+    connect(_shmCapture, &ShmCapture::frameReady, [=](const RawFrame& frame, qint64 timestamp) {
+            _shmFrameTimestamp = timestamp;
+            _videoSink->processNewRawFrame(frame);
+            });
+    _shmCapture->start();
+
+    emit stateChanged();
+}
+
 void Bino::stopCaptureMode()
 {
+    if (_shmCapture) {
+        delete _shmCapture;
+        _shmCapture = nullptr;
+        _shmFrameTimestamp = 0;
+        _shmRenderedTimestamp = 0;
+        emit stateChanged();
+    }
     if (_captureSession) {
         delete _captureSession;
         _captureSession = nullptr;
@@ -162,15 +370,219 @@ bool Bino::playlistMode() const
 
 bool Bino::captureMode() const
 {
-    return _captureSession;
+    return _captureSession || _shmCapture;
+}
+
+void Bino::selectTracks(QMediaPlayer* player, const PlaylistEntry& entry,
+        const QList<QMediaMetaData>& audioTracks,
+        const QList<QMediaMetaData>& subtitleTracks)
+{
+    if (entry.videoTrack >= 0) {
+        player->setActiveVideoTrack(entry.videoTrack);
+    }
+    if (entry.audioTrack >= 0) {
+        player->setActiveAudioTrack(entry.audioTrack);
+    } else if (Playlist::instance()->preferredAudio() != QLocale::AnyLanguage) {
+        int audioTrack = -1;
+        for (int i = 0; i < int(audioTracks.length()); i++) {
+            QLocale audioLanguage = audioTracks[i].value(QMediaMetaData::Language).toLocale();
+            if (audioLanguage == Playlist::instance()->preferredAudio()) {
+                audioTrack = i;
+                break;
+            }
+        }
+        if (audioTrack >= 0) {
+            player->setActiveAudioTrack(audioTrack);
+        }
+    }
+    if (entry.subtitleTrack >= 0) {
+        player->setActiveSubtitleTrack(entry.subtitleTrack);
+    } else if (entry.subtitleTrack == PlaylistEntry::NoTrack) {
+        // do nothing
+    } else if (subtitleTracks.size() > 0 && Playlist::instance()->wantSubtitle()) {
+        int subtitleTrack = 0;
+        for (int i = 0; i < int(subtitleTracks.length()); i++) {
+            QLocale subtitleLanguage = subtitleTracks[i].value(QMediaMetaData::Language).toLocale();
+            if (subtitleLanguage == Playlist::instance()->preferredSubtitle()) {
+                subtitleTrack = i;
+                break;
+            }
+        }
+        player->setActiveSubtitleTrack(subtitleTrack);
+    }
+}
+
+void Bino::prerollNextEntry()
+{
+    int nextIndex = Playlist::instance()->nextIndex();
+    if (nextIndex < 0)
+        return;
+    PlaylistEntry entry = Playlist::instance()->entries()[nextIndex];
+    if (entry.noMedia() || (_nextPlayer && entry == _nextEntry))
+        return;
+    if (ImageSource::isImage(entry.url)) {
+        _imageSource->prefetch(entry.url.toLocalFile());
+        return;
+    }
+    if (ImageSequence::isSequence(entry.url) || RawVideo::isRawVideo(entry.url))
+        return;
+
+    LOG_DEBUG("prerolling next play list entry %s", qPrintable(entry.url.toString()));
+    discardNextPlayer();
+    QMediaPlayer* player = createPlayer();
+    player->connect(player, &QMediaPlayer::mediaStatusChanged,
+            [=](QMediaPlayer::MediaStatus status) {
+            if (status == QMediaPlayer::LoadedMedia) {
+                // The track lists are known now, so we can select tracks without
+                // probing the media again. Then wait on the first frame, unless
+                // this player became the active one in the meantime.
+                player->disconnect(player, &QMediaPlayer::mediaStatusChanged, nullptr, nullptr);
+                selectTracks(player, entry, player->audioTracks(), player->subtitleTracks());
+                if (player == _nextPlayer)
+                    player->pause();
+                else
+                    activatePlayer();
+            }
+            });
+    setPlayerSource(player, entry.url);
+    _nextPlayer = player;
+    _nextEntry = entry;
+}
+
+void Bino::discardNextPlayer()
+{
+    if (_nextPlayer) {
+        delete _nextPlayer;
+        _nextPlayer = nullptr;
+        _nextEntry = PlaylistEntry();
+    }
+}
+
+void Bino::showImage(const StillImage& stillImage)
+{
+    _videoSink->processNewImage(stillImage.image, stillImage.extImage);
+    if (_slideshowDuration > 0)
+        _slideshowTimer.start(_slideshowDuration);
+    // prepare the play list neighbors
+    prerollNextEntry();
+    int prevIndex = Playlist::instance()->previousIndex();
+    if (prevIndex >= 0) {
+        const PlaylistEntry& prevEntry = Playlist::instance()->entries()[prevIndex];
+        if (ImageSource::isImage(prevEntry.url))
+            _imageSource->prefetch(prevEntry.url.toLocalFile());
+    }
+    emit stateChanged();
+}
+
+// Make sure that the media player does not play anything anymore,
+// but keep a prerolled next player.
+void Bino::idlePlayer()
+{
+    if (!_player->source().isEmpty() || _player->sourceDevice()) {
+        QMediaPlayer* oldPlayer = _player;
+        oldPlayer->disconnect();
+        oldPlayer->setVideoOutput(nullptr);
+        oldPlayer->setAudioOutput(nullptr);
+        oldPlayer->deleteLater(); // we might have been called from one of its signals
+        _player = createPlayer();
+        activatePlayer();
+    }
+}
+
+void Bino::stopFrameSource()
+{
+    if (_frameSource) {
+        _frameSource->disconnect();
+        _frameSource->pause();
+        _frameSource->deleteLater(); // we might have been called from one of its signals
+        _frameSource = nullptr;
+    }
+}
+
+void Bino::startFrameSource()
+{
+    connect(_frameSource, &FrameSource::finished, [=]() {
+            emit stateChanged();
+            Playlist::instance()->mediaEnded();
+            });
+    if (_frameSource->open()) {
+        _frameSource->play();
+    } else {
+        // open() has reported the error; continue with the next play list
+        // entry once the current play list change is handled
+        QMetaObject::invokeMethod(_frameSource, &FrameSource::finished, Qt::QueuedConnection);
+    }
 }
 
 void Bino::mediaChanged(PlaylistEntry entry)
 {
     if (!playlistMode())
         return;
+    _slideshowTimer.stop();
+    _imageUrl = QUrl();
+    stopFrameSource();
     if (entry.noMedia()) {
+        discardNextPlayer();
         _player->stop();
+    } else if (ImageSequence::isSequence(entry.url)) {
+        // Image sequences bypass the media player
+        idlePlayer();
+        _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
+        ImageSequence* imageSequence = new ImageSequence(entry.url.toLocalFile(), _sequenceFps, _sequenceMemoryBudget);
+        if (imageSequence->isStereo() && entry.inputMode == Input_Unknown)
+            _videoSink->inputMode = Input_Alternating_LR;
+        connect(imageSequence, &ImageSequence::frameReady, [=](const QImage& image, const QImage& extImage) {
+                _videoSink->processNewImage(image, extImage);
+                });
+        _frameSource = imageSequence;
+        startFrameSource();
+    } else if (RawVideo::isRawVideo(entry.url)) {
+        // Raw video files bypass the media player, and their frames are not copied
+        idlePlayer();
+        _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
+        RawVideo* rawVideo = new RawVideo(entry.url.toLocalFile(), _rawVideoFormat);
+        connect(rawVideo, &RawVideo::frameReady, [=](const RawFrame& frame) {
+                _videoSink->processNewRawFrame(frame);
+                });
+        connect(rawVideo, &RawVideo::imageReady, [=](const QImage& image) {
+                _videoSink->processNewImage(image);
+                });
+        _frameSource = rawVideo;
+        startFrameSource();
+    } else if (ImageSource::isImage(entry.url)) {
+        // Still images bypass the media player
+        idlePlayer();
+        _imageUrl = entry.url;
+        _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
+        StillImage stillImage;
+        if (_imageSource->get(entry.url.toLocalFile(), stillImage))
+            showImage(stillImage);
+    } else if (_nextPlayer && entry == _nextEntry) {
+        // Gapless transition: swap in the prerolled player. Our video sink keeps
+        // the last frame of the old player until the first new frame arrives.
+        LOG_DEBUG("switching to prerolled player for %s", qPrintable(entry.url.toString()));
+        QMediaPlayer* oldPlayer = _player;
+        oldPlayer->disconnect();
+        oldPlayer->setVideoOutput(nullptr);
+        oldPlayer->setAudioOutput(nullptr);
+        oldPlayer->deleteLater(); // we might have been called from one of its signals
+        bool loaded = (_nextPlayer->mediaStatus() != QMediaPlayer::LoadingMedia);
+        _player = _nextPlayer;
+        _nextPlayer = nullptr;
+        _nextEntry = PlaylistEntry();
+        if (loaded) {
+            // otherwise the player will be activated once it is loaded
+            _player->disconnect(_player, &QMediaPlayer::mediaStatusChanged, nullptr, nullptr);
+            activatePlayer();
+        }
+        _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
+        _player->play();
+        // The prerolled player is usually buffered already, so the status
+        // change that starts the preroll of the following entry will not come
+        if (loaded && (_player->mediaStatus() == QMediaPlayer::BufferedMedia
+                    || _player->mediaStatus() == QMediaPlayer::LoadedMedia)) {
+            prerollNextEntry();
+        }
     } else {
         // QMediaPlayer does not work with simply setting a new source via setSource().
         // Apparently we at least need to flush all buffers with setSource(QUrl()) first.
@@ -179,42 +591,10 @@ void Bino::mediaChanged(PlaylistEntry entry)
         // the QMediaPlayer before setting the new URL. Not exactly elegant...
         stopPlaylistMode();
         startPlaylistMode();
-        _player->setSource(entry.url);
+        setPlayerSource(_player, entry.url);
         MetaData metaData;
         metaData.detectCached(entry.url);
-        if (entry.videoTrack >= 0) {
-            _player->setActiveVideoTrack(entry.videoTrack);
-        }
-        if (entry.audioTrack >= 0) {
-            _player->setActiveAudioTrack(entry.audioTrack);
-        } else if (Playlist::instance()->preferredAudio() != QLocale::AnyLanguage) {
-            int audioTrack = -1;
-            for (int i = 0; i < int(metaData.audioTracks.length()); i++) {
-                QLocale audioLanguage = metaData.audioTracks[i].value(QMediaMetaData::Language).toLocale();
-                if (audioLanguage == Playlist::instance()->preferredAudio()) {
-                    audioTrack = i;
-                    break;
-                }
-            }
-            if (audioTrack >= 0) {
-                _player->setActiveVideoTrack(entry.audioTrack);
-            }
-        }
-        if (entry.subtitleTrack >= 0) {
-            _player->setActiveSubtitleTrack(entry.subtitleTrack);
-        } else if (entry.subtitleTrack == PlaylistEntry::NoTrack) {
-            // do nothing
-        } else if (metaData.subtitleTracks.size() > 0 && Playlist::instance()->wantSubtitle()) {
-            int subtitleTrack = 0;
-            for (int i = 0; i < int(metaData.subtitleTracks.length()); i++) {
-                QLocale subtitleLanguage = metaData.subtitleTracks[i].value(QMediaMetaData::Language).toLocale();
-                if (subtitleLanguage == Playlist::instance()->preferredSubtitle()) {
-                    subtitleTrack = i;
-                    break;
-                }
-            }
-            _player->setActiveSubtitleTrack(subtitleTrack);
-        }
+        selectTracks(_player, entry, metaData.audioTracks, metaData.subtitleTracks);
         _player->play();
         _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
     }
@@ -232,21 +612,43 @@ void Bino::seek(qint64 milliseconds)
 {
     if (!playlistMode())
         return;
-    _player->setPosition(_player->position() + milliseconds);
+    if (_frameSource)
+        _frameSource->setPosition(_frameSource->position() + milliseconds);
+    else
+        _player->setPosition(_player->position() + milliseconds);
+}
+
+void Bino::step(int frames)
+{
+    if (!playlistMode())
+        return;
+    if (_frameSource) {
+        _frameSource->step(frames);
+        emit stateChanged();
+    }
 }
 
 void Bino::setPosition(float pos)
 {
     if (!playlistMode())
         return;
-    _player->setPosition(pos * _player->duration());
+    if (_frameSource)
+        _frameSource->setPosition(pos * _frameSource->duration());
+    else
+        _player->setPosition(pos * _player->duration());
 }
 
 void Bino::togglePause()
 {
     if (!playlistMode())
         return;
-    if (_player->playbackState() == QMediaPlayer::PlayingState) {
+    if (_frameSource) {
+        if (_frameSource->isPlaying())
+            _frameSource->pause();
+        else
+            _frameSource->play();
+        emit stateChanged();
+    } else if (_player->playbackState() == QMediaPlayer::PlayingState) {
         _player->pause();
         emit stateChanged();
     } else if (_player->playbackState() == QMediaPlayer::PausedState) {
@@ -259,7 +661,12 @@ void Bino::pause()
 {
     if (!playlistMode())
         return;
-    if (_player->playbackState() == QMediaPlayer::PlayingState) {
+    if (_frameSource) {
+        if (_frameSource->isPlaying()) {
+            _frameSource->pause();
+            emit stateChanged();
+        }
+    } else if (_player->playbackState() == QMediaPlayer::PlayingState) {
         _player->pause();
         emit stateChanged();
     }
@@ -269,7 +676,12 @@ void Bino::play()
 {
     if (!playlistMode())
         return;
-    if (_player->playbackState() != QMediaPlayer::PlayingState) {
+    if (_frameSource) {
+        if (!_frameSource->isPlaying()) {
+            _frameSource->play();
+            emit stateChanged();
+        }
+    } else if (_player->playbackState() != QMediaPlayer::PlayingState) {
         _player->play();
         emit stateChanged();
     }
@@ -304,6 +716,15 @@ void Bino::stop()
 {
     if (!playlistMode())
         return;
+    if (!_imageUrl.isEmpty()) {
+        _slideshowTimer.stop();
+        _imageUrl = QUrl();
+        emit stateChanged();
+    }
+    if (_frameSource) {
+        stopFrameSource();
+        emit stateChanged();
+    }
     if (_player->playbackState() == QMediaPlayer::StoppedState) {
         _player->stop();
         emit stateChanged();
@@ -369,6 +790,16 @@ void Bino::setSurroundMode(SurroundMode mode)
     LOG_DEBUG("setting surround mode to %s", surroundModeToString(mode));
 }
 
+void Bino::setPlaybackRate(double rate)
+{
+    _playbackRate = rate;
+    if (_player)
+        _player->setPlaybackRate(rate);
+    if (_nextPlayer)
+        _nextPlayer->setPlaybackRate(rate);
+    LOG_DEBUG("setting playback rate to %g", rate);
+}
+
 bool Bino::swapEyes() const
 {
     return _swapEyes;
@@ -381,23 +812,47 @@ bool Bino::muted() const
 
 bool Bino::paused() const
 {
+    if (playlistMode() && _frameSource)
+        return !_frameSource->isPlaying() && !_frameSource->isFinished();
     return (playlistMode() && _player->playbackState() == QMediaPlayer::PausedState);
 }
 
 bool Bino::playing() const
 {
-    return (playlistMode() && _player->playbackState() == QMediaPlayer::PlayingState);
+    if (playlistMode() && _frameSource)
+        return _frameSource->isPlaying();
+    return (playlistMode() && (!_imageUrl.isEmpty() || _player->playbackState() == QMediaPlayer::PlayingState));
+}
+
+bool Bino::canStep() const
+{
+    return playlistMode() && _frameSource;
+}
+
+float Bino::frameRate() const
+{
+    if (playlistMode() && _frameSource)
+        return _frameSource->fps();
+    else if (playlistMode())
+        return _player->metaData().value(QMediaMetaData::VideoFrameRate).toFloat();
+    return 0.0f;
 }
 
 bool Bino::stopped() const
 {
-    return (playlistMode() && _player->playbackState() == QMediaPlayer::StoppedState);
+    if (playlistMode() && _frameSource)
+        return _frameSource->isFinished();
+    return (playlistMode() && _imageUrl.isEmpty() && _player->playbackState() == QMediaPlayer::StoppedState);
 }
 
 QUrl Bino::url() const
 {
     QUrl url;
-    if (playing() || paused())
+    if (!_imageUrl.isEmpty())
+        url = _imageUrl;
+    else if (_frameSource)
+        url = _frameSource->url();
+    else if (playing() || paused())
         url = _player->source();
     return url;
 }
@@ -432,6 +887,21 @@ int Bino::subtitleTrack() const
     return t;
 }
 
+bool Bino::playerTracks(QList<QMediaMetaData>* videoTracks, QList<QMediaMetaData>* audioTracks,
+        QList<QMediaMetaData>* subtitleTracks) const
+{
+    if (!playlistMode() || _frameSource || !_imageUrl.isEmpty())
+        return false;
+    QMediaPlayer::MediaStatus status = _player->mediaStatus();
+    if (status == QMediaPlayer::NoMedia || status == QMediaPlayer::LoadingMedia
+            || status == QMediaPlayer::InvalidMedia)
+        return false;
+    *videoTracks = _player->videoTracks();
+    *audioTracks = _player->audioTracks();
+    *subtitleTracks = _player->subtitleTracks();
+    return true;
+}
+
 InputMode Bino::inputMode() const
 {
     return _videoSink->inputMode;
@@ -460,15 +930,22 @@ SurroundMode Bino::assumeSurroundMode() const
 void Bino::serializeStaticData(QDataStream& ds) const
 {
     ds << _screen;
+    ds << int(_framePrecision);
+    ds << _gpuBudget << _minResolutionScale << _maxResolutionScale;
 }
 
 void Bino::deserializeStaticData(QDataStream& ds)
 {
+    int framePrecision;
     ds >> _screen;
+    ds >> framePrecision;
+    _framePrecision = FramePrecision(framePrecision);
+    ds >> _gpuBudget >> _minResolutionScale >> _maxResolutionScale;
 }
 
 void Bino::serializeDynamicData(QDataStream& ds) const
 {
+    Tracer::begin("serialize", _frame.number);
     ds << _frameIsNew;
     if (_frameIsNew) {
         ds << _frame;
@@ -478,10 +955,13 @@ void Bino::serializeDynamicData(QDataStream& ds) const
         }
     }
     ds << _swapEyes;
+    Tracer::end("serialize", _frame.number);
 }
 
 void Bino::deserializeDynamicData(QDataStream& ds)
 {
+    // the frame number is only known when the frame has been read
+    Tracer::begin("deserialize");
     ds >> _frameIsNew;
     if (_frameIsNew) {
         ds >> _frame;
@@ -491,6 +971,7 @@ void Bino::deserializeDynamicData(QDataStream& ds)
         }
     }
     ds >> _swapEyes;
+    Tracer::end("deserialize", _frame.number);
 }
 
 bool Bino::wantExit() const
@@ -501,7 +982,7 @@ bool Bino::wantExit() const
 bool Bino::initProcess()
 {
     bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
-    bool haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+    _haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
     LOG_DEBUG("Using OpenGL in the %s variant", isGLES ? "ES" : "Desktop");
 
     // Qt-based OpenGL initialization
@@ -662,7 +1143,7 @@ bool Bino::initProcess()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    if (haveAnisotropicFiltering)
+    if (_haveAnisotropicFiltering)
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
     glGenTextures(1, &_extFrameTex);
     glBindTexture(GL_TEXTURE_2D, _extFrameTex);
@@ -670,7 +1151,7 @@ bool Bino::initProcess()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    if (haveAnisotropicFiltering)
+    if (_haveAnisotropicFiltering)
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
     CHECK_GL();
 
@@ -681,10 +1162,15 @@ bool Bino::initProcess()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    if (haveAnisotropicFiltering)
+    if (_haveAnisotropicFiltering)
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
     CHECK_GL();
 
+    // Transfer function lookup textures
+    _toLinearTex = createTransferFunctionTexture(this, true);
+    _toNonlinearTex = createTransferFunctionTexture(this, false);
+    CHECK_GL();
+
     // Screen geometry
     glGenVertexArrays(1, &_screenVao);
     glBindVertexArray(_screenVao);
@@ -713,22 +1199,24 @@ bool Bino::initProcess()
     return true;
 }
 
-void Bino::rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall, int yuvSpace)
+void Bino::rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall, int yuvSpace, bool linearInput)
 {
     if (_colorPrg.isLinked()
             && _colorPrgPlaneFormat == planeFormat
             && _colorPrgYuvValueRangeSmall == yuvValueRangeSmall
-            && _colorPrgYuvSpace == yuvSpace)
+            && _colorPrgYuvSpace == yuvSpace
+            && _colorPrgLinearInput == linearInput)
         return;
 
-    LOG_DEBUG("rebuilding color conversion program for plane format %d, value range %s, yuv space %s",
-            planeFormat, yuvValueRangeSmall ? "small" : "full", yuvSpace ? "true" : "false");
+    LOG_DEBUG("rebuilding color conversion program for plane format %d, value range %s, yuv space %s, linear input %s",
+            planeFormat, yuvValueRangeSmall ? "small" : "full", yuvSpace ? "true" : "false", linearInput ? "true" : "false");
     bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
     QString colorVS = readFile(":src/shader-color.vert.glsl");
     QString colorFS = readFile(":src/shader-color.frag.glsl");
     colorFS.replace("$PLANE_FORMAT", QString::number(planeFormat));
     colorFS.replace("$VALUE_RANGE_SMALL", yuvValueRangeSmall ? "true" : "false");
     colorFS.replace("$YUV_SPACE", QString::number(yuvSpace));
+    colorFS.replace("$LINEAR_INPUT", linearInput ? "true" : "false");
     if (isGLES) {
         colorVS.prepend("#version 320 es\n");
         colorFS.prepend("#version 320 es\n"
@@ -744,6 +1232,7 @@ void Bino::rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall,
     _colorPrgPlaneFormat = planeFormat;
     _colorPrgYuvValueRangeSmall = yuvValueRangeSmall;
     _colorPrgYuvSpace = yuvSpace;
+    _colorPrgLinearInput = linearInput;
 }
 
 void Bino::rebuildViewPrgIfNecessary(SurroundMode surroundMode, bool nonLinearOutput)
@@ -849,6 +1338,10 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
     int h = frame.height;
     int planeFormat; // see shader-color.frag.glsl
     int planeCount;
+    bool linearInput = false;
+    bool highPrecisionInput = false; // more than 8 bits per component
+    Tracer::begin("upload", frame.number);
+    GpuProfiler::instance()->begin(GpuProfiler::Stage_Upload);
     // reset swizzling for plane0; might be changed below depending in the format
     glBindTexture(GL_TEXTURE_2D, _planeTexs[0]);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
@@ -856,11 +1349,27 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_BLUE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
     if (frame.storage == VideoFrame::Storage_Image) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame.image.constBits());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
+        if (frame.image.format() == QImage::Format_RGBX16FPx4) {
+            // half float data, e.g. from OpenEXR image sequences; this is linear RGB
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, frame.image.constBits());
+            linearInput = true;
+            highPrecisionInput = true;
+        } else if (frame.image.format() == QImage::Format_RGBX64 && !isGLES) {
+            // 16 bit data, e.g. from PNG or TIFF image sequences
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, w, h, 0, GL_RGBA, GL_UNSIGNED_SHORT, frame.image.constBits());
+            highPrecisionInput = true;
+        } else {
+            // 8 bit data; on OpenGL ES, which lacks 16 bit normalized textures,
+            // also 16 bit data reduced to 8 bit (convertToFormat() is a no-op otherwise).
+            // The sRGB texture format lets the hardware convert to linear RGB.
+            QImage img = frame.image.convertToFormat(QImage::Format_RGB32);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.constBits());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
+            linearInput = true;
+        }
         planeFormat = 1;
         planeCount = 1;
     } else {
@@ -870,10 +1379,15 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
         } else {
             planeData = { frame.bits[0].data(), frame.bits[1].data(), frame.bits[2].data() };
         }
+        // For 8 bit RGB data whose color channels are the first three bytes, the sRGB texture
+        // format lets the hardware convert to linear RGB. It only decodes the R, G and B
+        // channels, before swizzling, so formats with color in the alpha byte (ARGB, XRGB,
+        // ABGR, XBGR) use a plain texture, and these and the other formats need the lookup
+        // texture in the shader.
         if (frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888
                 || frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888_Premultiplied
                 || frame.pixelFormat == QVideoFrameFormat::Format_XRGB8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ALPHA);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_GREEN);
@@ -883,16 +1397,17 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
         } else if (frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888
                 || frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888_Premultiplied
                 || frame.pixelFormat == QVideoFrameFormat::Format_BGRX8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
             planeFormat = 1;
             planeCount = 1;
+            linearInput = true;
         } else if (frame.pixelFormat == QVideoFrameFormat::Format_ABGR8888
                 || frame.pixelFormat == QVideoFrameFormat::Format_XBGR8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ALPHA);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_BLUE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_GREEN);
@@ -901,9 +1416,10 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
             planeCount = 1;
         } else if (frame.pixelFormat == QVideoFrameFormat::Format_RGBA8888
                 || frame.pixelFormat == QVideoFrameFormat::Format_RGBX8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
             planeFormat = 1;
             planeCount = 1;
+            linearInput = true;
         } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV420P) {
             glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
             glBindTexture(GL_TEXTURE_2D, _planeTexs[1]);
@@ -941,6 +1457,7 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, w / 2, h / 2, 0, GL_RG, GL_UNSIGNED_SHORT, planeData[1]);
             planeFormat = 4;
             planeCount = 2;
+            highPrecisionInput = true;
         } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y8) {
             glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
             planeFormat = 5;
@@ -949,36 +1466,87 @@ void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
             glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, w, h, 0, GL_RED, GL_UNSIGNED_SHORT, planeData[0]);
             planeFormat = 5;
             planeCount = 1;
+            highPrecisionInput = true;
         } else {
             LOG_FATAL("Unhandled pixel format");
             std::exit(1);
         }
     }
+    GpuProfiler::instance()->end(GpuProfiler::Stage_Upload);
+    Tracer::end("upload", frame.number);
+    if (frame.storage == VideoFrame::Storage_Image) {
+        _statBytesUploaded += frame.image.sizeInBytes();
+    } else {
+        for (int p = 0; p < frame.planeCount; p++)
+            _statBytesUploaded += frame.bytesPerPlane[p];
+    }
     // 2. Convert plane textures into linear RGB in the frame texture
+    Tracer::begin("convert", frame.number);
+    FramePrecision precision = _framePrecision;
+    if (precision == Precision_Auto)
+        precision = (highPrecisionInput ? Precision_16Bit : Precision_Float11);
+    GLenum frameTexFormat = (precision == Precision_Float11 ? GL_R11F_G11F_B10F
+            : precision == Precision_10Bit ? GL_RGB10_A2
+            : isGLES ? GL_RGBA16F : GL_RGBA16);
+    // the render quality may reduce the size of the frame texture
+    int tw = qMax(1, qRound(w * _renderQuality.resolutionScale));
+    int th = qMax(1, qRound(h * _renderQuality.resolutionScale));
+    if (frameTexFormat != _frameTexFormat) {
+        LOG_INFO("frame textures: %s, %.1f MiB for two %dx%d textures",
+                intermediateTextureFormatName(frameTexFormat),
+                2.0 * intermediateTextureMiB(frameTexFormat, tw, th), tw, th);
+        _frameTexFormat = frameTexFormat;
+    }
     glBindTexture(GL_TEXTURE_2D, frameTex);
-    if (isGLES)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, w, h, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullptr);
-    else
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, w, h, 0, GL_BGRA, GL_UNSIGNED_SHORT, nullptr);
+    allocateIntermediateTexture(this, frameTexFormat, tw, th);
+    _frameTexMiB[frameTex == _frameTex ? 0 : 1] = intermediateTextureMiB(frameTexFormat, tw, th);
     glBindFramebuffer(GL_FRAMEBUFFER, _frameFbo);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameTex, 0);
-    glViewport(0, 0, w, h);
+    glViewport(0, 0, tw, th);
     glDisable(GL_DEPTH_TEST);
-    rebuildColorPrgIfNecessary(planeFormat, frame.yuvValueRangeSmall, frame.yuvSpace);
+    rebuildColorPrgIfNecessary(planeFormat, frame.yuvValueRangeSmall, frame.yuvSpace, linearInput);
     glUseProgram(_colorPrg.programId());
     for (int p = 0; p < planeCount; p++) {
         _colorPrg.setUniformValue(qPrintable(QString("plane") + QString::number(p)), p);
         glActiveTexture(GL_TEXTURE0 + p);
         glBindTexture(GL_TEXTURE_2D, _planeTexs[p]);
     }
+    _colorPrg.setUniformValue("toLinearLut", 3);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, _toLinearTex);
+    glActiveTexture(GL_TEXTURE0);
     glBindVertexArray(_quadVao);
+    GpuProfiler::instance()->begin(GpuProfiler::Stage_Color);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    GpuProfiler::instance()->end(GpuProfiler::Stage_Color);
     glBindTexture(GL_TEXTURE_2D, frameTex);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _renderQuality.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    if (_haveAnisotropicFiltering)
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, _renderQuality.anisotropy);
+    if (_renderQuality.mipmaps) {
+        GpuProfiler::instance()->begin(GpuProfiler::Stage_FrameMipmaps);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GpuProfiler::instance()->end(GpuProfiler::Stage_FrameMipmaps);
+    }
+    Tracer::end("convert", frame.number);
 }
 
-void Bino::preRenderProcess(int screenWidth, int screenHeight,
-        int* viewCountPtr, int* viewWidthPtr, int* viewHeightPtr, float* frameDisplayAspectRatioPtr, bool* surroundPtr)
+void Bino::emitStateChangedLater()
+{
+    // We are called from within the render path, so we must not update the GUI
+    // directly. Instead, deliver the notification after the current frame is
+    // finished, and coalesce multiple requests into a single signal.
+    if (_stateChangePending)
+        return;
+    _stateChangePending = true;
+    QTimer::singleShot(0, this, [=]() {
+            _stateChangePending = false;
+            emit stateChanged();
+            });
+}
+
+void Bino::frameGeometry(int screenWidth, int screenHeight,
+        int* viewCountPtr, int* viewWidthPtr, int* viewHeightPtr, float* frameDisplayAspectRatioPtr, bool* surroundPtr) const
 {
     Q_ASSERT(_frame.inputMode != Input_Unknown);
 
@@ -1041,6 +1609,17 @@ void Bino::preRenderProcess(int screenWidth, int screenHeight,
         *frameDisplayAspectRatioPtr = frameDisplayAspectRatio;
     if (surroundPtr)
         *surroundPtr = (_frame.surroundMode != Surround_Off);
+}
+
+void Bino::preRenderProcess(int screenWidth, int screenHeight,
+        int* viewCountPtr, int* viewWidthPtr, int* viewHeightPtr, float* frameDisplayAspectRatioPtr, bool* surroundPtr)
+{
+    int viewWidth, viewHeight;
+    frameGeometry(screenWidth, screenHeight, viewCountPtr, &viewWidth, &viewHeight, frameDisplayAspectRatioPtr, surroundPtr);
+    if (viewWidthPtr)
+        *viewWidthPtr = viewWidth;
+    if (viewHeightPtr)
+        *viewHeightPtr = viewHeight;
 
     /* We need to get new frame data into a texture that is suitable for
      * rendering the screen: _frameTex. */
@@ -1068,32 +1647,41 @@ void Bino::preRenderProcess(int screenWidth, int screenHeight,
         // Done.
         _frameIsNew = false;
     }
+    // A captured frame that was identical to its predecessor did not set
+    // _frameIsNew, but it is on screen after the next buffer swap, too.
+    if (_shmCapture && _shmFrameTimestamp > 0) {
+        _shmRenderedTimestamp = _shmFrameTimestamp;
+        _shmFrameTimestamp = 0;
+    }
     if (_frame.inputMode != _lastFrameInputMode
             || _frame.surroundMode != _lastFrameSurroundMode) {
-        emit stateChanged();
+        emitStateChangedLater();
     }
     _lastFrameInputMode = _frame.inputMode;
     _lastFrameSurroundMode = _frame.surroundMode;
 }
 
-void Bino::render(
-        const QMatrix4x4& projectionMatrix,
-        const QMatrix4x4& orientationMatrix,
-        const QMatrix4x4& viewMatrix,
-        int view, // 0 = left, 1 = right
-        int texWidth, int texHeight, unsigned int texture)
+bool Bino::softwareRenderProcess(const VideoFrame** frame, const VideoFrame** extFrame)
+{
+    *frame = &_frame;
+    // the user might have switched to alternating input without the extFrame
+    // being available, in that case fall back to the standard frame
+    *extFrame = (_extFrame.width == _frame.width && _extFrame.height == _frame.height ? &_extFrame : &_frame);
+    bool frameIsNew = _frameIsNew;
+    _frameIsNew = false;
+    if (_frame.inputMode != _lastFrameInputMode
+            || _frame.surroundMode != _lastFrameSurroundMode) {
+        emitStateChangedLater();
+    }
+    _lastFrameInputMode = _frame.inputMode;
+    _lastFrameSurroundMode = _frame.surroundMode;
+    return frameIsNew;
+}
+
+void Bino::viewSource(int view, unsigned int* frameTexPtr,
+        float* offsetX, float* factorX, float* offsetY, float* factorY,
+        float* frameAspectRatioPtr) const
 {
-    // Set up framebuffer object to render into
-    glBindTexture(GL_TEXTURE_2D, _depthTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, texWidth, texHeight,
-            0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
-    glEnable(GL_DEPTH_TEST);
-    glBindFramebuffer(GL_FRAMEBUFFER, _viewFbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-    // Set up view
-    glViewport(0, 0, texWidth, texHeight);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    // Set up input mode
     unsigned int frameTex = _frameTex;
     float frameAspectRatio = _frame.aspectRatio;
     float viewOffsetX = 0.0f;
@@ -1152,6 +1740,91 @@ void Bino::render(
             frameTex = _extFrameTex;
         break;
     }
+    *frameTexPtr = frameTex;
+    *offsetX = viewOffsetX;
+    *factorX = viewFactorX;
+    *offsetY = viewOffsetY;
+    *factorY = viewFactorY;
+    if (frameAspectRatioPtr)
+        *frameAspectRatioPtr = frameAspectRatio;
+}
+
+unsigned int Bino::subtitleTexture() const
+{
+    return _subtitleTex;
+}
+
+unsigned long long Bino::framesReceived() const
+{
+    return _videoSink ? _videoSink->totalFrameCounter : 0;
+}
+
+unsigned long long Bino::framesRepeated() const
+{
+    return _videoSink ? _videoSink->totalSkippedFrameCounter : 0;
+}
+
+qint64 Bino::frameNumber() const
+{
+    return _frame.number;
+}
+
+unsigned long long Bino::bytesUploaded() const
+{
+    return _statBytesUploaded;
+}
+
+double Bino::frameTextureMiB() const
+{
+    return _frameTexMiB[0] + _frameTexMiB[1];
+}
+
+bool Bino::avOffset(qint64* milliseconds) const
+{
+    if (!_player || _player->playbackState() == QMediaPlayer::StoppedState
+            || !_frame.qframe.isValid() || _frame.qframe.startTime() < 0)
+        return false;
+    *milliseconds = _frame.qframe.startTime() / 1000 - _player->position();
+    return true;
+}
+
+qint64 Bino::frameStartTime() const
+{
+    return _frame.qframe.isValid() ? _frame.qframe.startTime() : -1;
+}
+
+void Bino::framePresented()
+{
+    if (_shmCapture && _shmRenderedTimestamp > 0) {
+        _shmCapture->framePresented(_shmRenderedTimestamp);
+        _shmRenderedTimestamp = 0;
+    }
+}
+
+void Bino::render(
+        const QMatrix4x4& projectionMatrix,
+        const QMatrix4x4& orientationMatrix,
+        const QMatrix4x4& viewMatrix,
+        int view, // 0 = left, 1 = right
+        int texWidth, int texHeight, unsigned int texture)
+{
+    Tracer::begin("view", _frame.number);
+    GpuProfiler::instance()->begin(GpuProfiler::Stage_View);
+    // Set up framebuffer object to render into
+    glBindTexture(GL_TEXTURE_2D, _depthTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, texWidth, texHeight,
+            0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, _viewFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    // Set up view
+    glViewport(0, 0, texWidth, texHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Set up input mode
+    unsigned int frameTex;
+    float frameAspectRatio;
+    float viewOffsetX, viewFactorX, viewOffsetY, viewFactorY;
+    viewSource(view, &frameTex, &viewOffsetX, &viewFactorX, &viewOffsetY, &viewFactorY, &frameAspectRatio);
     LOG_FIREHOSE("Rendering view %d from %s frame texture fx=%g ox=%g fy=%g oy=%g",
             view, frameTex == _frameTex ? "standard" : "extended", viewFactorX, viewOffsetX, viewFactorY, viewOffsetY);
     // Determine if we are producing the final rendering result here (which is the
@@ -1177,6 +1850,7 @@ void Bino::render(
     _viewPrg.setUniformValue("orientationMatrix", orientationMatrix);
     _viewPrg.setUniformValue("frameTex", 0);
     _viewPrg.setUniformValue("subtitleTex", 1);
+    _viewPrg.setUniformValue("toNonlinearLut", 2);
     _viewPrg.setUniformValue("view_offset_x", viewOffsetX);
     _viewPrg.setUniformValue("view_factor_x", viewFactorX);
     _viewPrg.setUniformValue("view_offset_y", viewOffsetY);
@@ -1184,6 +1858,8 @@ void Bino::render(
     _viewPrg.setUniformValue("relative_width", relWidth);
     _viewPrg.setUniformValue("relative_height", relHeight);
     // Render scene
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, _toNonlinearTex);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, _subtitleTex);
     glActiveTexture(GL_TEXTURE0);
@@ -1200,11 +1876,13 @@ void Bino::render(
         // Reset filtering parameters to their defaults
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _renderQuality.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     } else {
         glBindVertexArray(_screenVao);
         glDrawElements(GL_TRIANGLES, _screen.indices.size(), GL_UNSIGNED_INT, 0);
     }
+    GpuProfiler::instance()->end(GpuProfiler::Stage_View);
+    Tracer::end("view", _frame.number);
 }
 
 void Bino::keyPressEvent(QKeyEvent* event)
@@ -1245,6 +1923,10 @@ void Bino::keyPressEvent(QKeyEvent* event)
         seek(-600000);
     } else if (event->key() == Qt::Key_PageUp) {
         seek(+600000);
+    } else if (event->key() == Qt::Key_BracketRight) {
+        step(+1);
+    } else if (event->key() == Qt::Key_BracketLeft) {
+        step(-1);
     } else if (event->key() == Qt::Key_N) {
         Playlist::instance()->next();
     } else if (event->key() == Qt::Key_P) {
@@ -1253,6 +1935,8 @@ void Bino::keyPressEvent(QKeyEvent* event)
         emit toggleFullscreen();
     } else if (event->key() == Qt::Key_E || event->key() == Qt::Key_F7) {
         toggleSwapEyes();
+    } else if (event->key() == Qt::Key_F3) {
+        emit toggleHud();
     } else {
         LOG_DEBUG("Unhandled key event: key=%d text='%s'", event->key(), qPrintable(event->text()));
         event->ignore();
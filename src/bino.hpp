@@ -30,10 +30,18 @@
 #include <QMediaPlayer>
 #include <QMediaCaptureSession>
 #include <QKeyEvent>
+#include <QTimer>
 
 #include "screen.hpp"
 #include "videosink.hpp"
 #include "playlist.hpp"
+#include "bufferedfile.hpp"
+#include "imagesource.hpp"
+#include "imagesequence.hpp"
+#include "rawvideo.hpp"
+#include "shmcapture.hpp"
+#include "cubelut.hpp"
+#include "qualitygovernor.hpp"
 
 
 class Bino : public QObject, QOpenGLExtraFunctions
@@ -47,19 +55,48 @@ private:
     QAudioOutput* _audioOutput;
     // for playing a play list:
     QMediaPlayer* _player;
+    // for gapless transitions: a second player that is prerolled with the next
+    // play list entry while the current one is playing
+    QMediaPlayer* _nextPlayer;
+    PlaylistEntry _nextEntry;
+    double _playbackRate;       // of both players
+    // how media files are read:
+    FileIOMode _fileIOMode;
+    // for showing still images without a media player:
+    ImageSource* _imageSource;
+    QUrl _imageUrl;             // the image that is shown or being decoded
+    int _slideshowDuration;     // in milliseconds; 0 means no automatic advance
+    QTimer _slideshowTimer;
+    // for playing image sequences and raw video files:
+    FrameSource* _frameSource;
+    float _sequenceFps;
+    qint64 _sequenceMemoryBudget;
+    RawVideoFormat _rawVideoFormat;
+    // for sending the output to other processes:
+    QString _shmOutputName;
+    // for display calibration:
+    CubeLut _displayLut;
     // for capturing audio/video:
     QAudioInput* _audioInput;
     QCamera* _videoInput;
     QMediaCaptureSession* _captureSession;
+    // for capturing frames from another process:
+    ShmCapture* _shmCapture;
+    qint64 _shmFrameTimestamp; // producer timestamp of the frame not yet rendered
+    qint64 _shmRenderedTimestamp; // producer timestamp of the frame rendered but not yet presented
     // for rendering subtitles:
     QImage _subtitleImg;
     QString _subtitleImgString;
     // for updating the GUI if necessary
     InputMode _lastFrameInputMode;
     SurroundMode _lastFrameSurroundMode;
+    bool _stateChangePending;
 
     /* Static data for rendering, initialized on the main process */
     Screen _screen;
+    FramePrecision _framePrecision;
+    float _gpuBudget;               // in milliseconds; 0 disables the quality governor
+    float _minResolutionScale, _maxResolutionScale;
 
     /* Static data for rendering, initialized in initProcess() */
     unsigned int _depthTex;
@@ -70,12 +107,20 @@ private:
     unsigned int _planeTexs[3];
     unsigned int _frameTex;
     unsigned int _extFrameTex;
+    unsigned int _frameTexFormat;   // internal format of the frame textures; 0 if not known yet
+    bool _haveAnisotropicFiltering;
+    RenderQuality _renderQuality;   // adapted by QualityGovernor
+    double _frameTexMiB[2];         // memory of _frameTex and _extFrameTex
+    unsigned long long _statBytesUploaded;
     unsigned int _subtitleTex;
+    unsigned int _toLinearTex;
+    unsigned int _toNonlinearTex;
     unsigned int _screenVao;
     QOpenGLShaderProgram _colorPrg;
     int _colorPrgPlaneFormat;
     bool _colorPrgYuvValueRangeSmall;
     int _colorPrgYuvSpace;
+    bool _colorPrgLinearInput;
     QOpenGLShaderProgram _viewPrg;
     SurroundMode _viewPrgSurroundMode;
     bool _viewPrgNonlinearOutput;
@@ -86,10 +131,23 @@ private:
     bool _frameIsNew;
     bool _swapEyes;
 
-    void rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall, int yuvSpace);
+    void rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall, int yuvSpace, bool linearInput);
     void rebuildViewPrgIfNecessary(SurroundMode surroundMode, bool nonLinearOutput);
     bool drawSubtitleToImage(int w, int h, const QString& string);
     void convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex);
+    void emitStateChangedLater();
+    QMediaPlayer* createPlayer();
+    void setPlayerSource(QMediaPlayer* player, const QUrl& url);
+    void activatePlayer();
+    void selectTracks(QMediaPlayer* player, const PlaylistEntry& entry,
+            const QList<QMediaMetaData>& audioTracks,
+            const QList<QMediaMetaData>& subtitleTracks);
+    void prerollNextEntry();
+    void discardNextPlayer();
+    void showImage(const StillImage& stillImage);
+    void idlePlayer();
+    void startFrameSource();
+    void stopFrameSource();
 
 public:
     Bino(const Screen& screen, bool swapEyes);
@@ -100,12 +158,27 @@ public:
     /* Initialization functions, to be called by main() before
      * starting either GUI or VR mode */
     void initializeOutput(const QAudioDevice& audioOutputDevice);
+    void setFileIOMode(FileIOMode mode);
+    void setSlideshowDuration(int milliseconds);
+    void setImageSequenceOptions(float fps, qint64 memoryBudget);
+    void setRawVideoFormat(const RawVideoFormat& format);
+    void setShmOutputName(const QString& name);
+    QString shmOutputName() const;
+    void setFramePrecision(FramePrecision precision);
+    FramePrecision framePrecision() const;
+    void setQualityGovernor(float gpuBudget, float minResolutionScale, float maxResolutionScale);
+    float gpuBudget() const;
+    float minResolutionScale() const;
+    float maxResolutionScale() const;
+    void setDisplayLut(const CubeLut& lut);
+    const CubeLut& displayLut() const;
     void startPlaylistMode();
     void stopPlaylistMode();
     void startCaptureMode(
             bool withAudioInput,
             const QAudioDevice& audioInputDevice,
             const QCameraDevice& videoInputDevice);
+    void startShmCaptureMode(const QString& name, InputMode inputMode, SurroundMode surroundMode);
     void stopCaptureMode();
     bool playlistMode() const;
     bool captureMode() const;
@@ -113,6 +186,7 @@ public:
     /* Interaction functions, can be called while in GUI or VR mode */
     void quit();
     void seek(qint64 milliseconds);
+    void step(int frames); // only for image sequences and raw video files
     void setPosition(float pos);
     void togglePause();
     void pause();
@@ -129,6 +203,8 @@ public:
     void setSubtitleTrack(int i);
     void setInputMode(InputMode mode);
     void setSurroundMode(SurroundMode mode);
+    // The speed of the media player, e.g. for the converter to slow it down
+    void setPlaybackRate(double rate);
 
     /* Functions necessary for GUI mode */
     bool swapEyes() const;
@@ -137,9 +213,14 @@ public:
     bool playing() const;
     bool stopped() const;
     QUrl url() const;
+    bool canStep() const;   // whether step() works for the current media
+    float frameRate() const; // frame rate of the current media, or 0 if unknown
     int videoTrack() const;
     int audioTrack() const;
     int subtitleTrack() const;
+    // The track lists of the media player, if it has loaded the current media
+    bool playerTracks(QList<QMediaMetaData>* videoTracks, QList<QMediaMetaData>* audioTracks,
+            QList<QMediaMetaData>* subtitleTracks) const;
     InputMode inputMode() const;                        // this might be unknown
     InputMode assumeInputMode() const;                  // this is never unknown
     bool assumeStereoInputMode() const;                 // is the assumed mode stereo?
@@ -154,7 +235,23 @@ public:
     bool wantExit() const;
 
     /* Functions shared by GUI and VR mode */
+    // the views of the current frame and their size for the given screen size
+    void frameGeometry(
+            int screenWidth = 0,
+            int screenHeight = 0,
+            int* viewCount = nullptr,
+            int* viewWidth = nullptr,
+            int* viewHeight = nullptr,
+            float* frameDisplayAspectRatio = nullptr,
+            bool* surround = nullptr) const;
     bool initProcess();
+    // whether there is a frame that the next preRenderProcess() call has to convert
+    bool frameIsNew() const;
+    // the internal format of the intermediate textures chosen for the current frame
+    unsigned int frameTextureFormat() const;
+    // the quality of the frame and view textures; a change converts the frame again
+    const RenderQuality& renderQuality() const;
+    void setRenderQuality(const RenderQuality& quality);
     void preRenderProcess(
             int screenWidth = 0,
             int screenHeight = 0,
@@ -169,14 +266,47 @@ public:
             const QMatrix4x4& viewMatrix,
             int view, // 0 = left, 1 = right
             int texWidth, int texHeight, unsigned int texture);
+    // For renderers that sample the frame directly instead of rendering a
+    // view (only without surround): the texture that contains the given view,
+    // the transformation of view texture coordinates into that texture, and
+    // optionally the aspect ratio of the view
+    void viewSource(int view, unsigned int* frameTex,
+            float* offsetX, float* factorX, float* offsetY, float* factorY,
+            float* frameAspectRatio = nullptr) const;
+    // The subtitle overlay for the current frame, in view texture coordinates
+    unsigned int subtitleTexture() const;
+    /* Statistics for the performance overlay */
+    // Number of complete frames received, and of those identical to their predecessor
+    unsigned long long framesReceived() const;
+    unsigned long long framesRepeated() const;
+    // Sequence number of the current frame, or -1
+    qint64 frameNumber() const;
+    // Number of bytes uploaded into the plane textures
+    unsigned long long bytesUploaded() const;
+    // Memory used by the frame textures, in MiB
+    double frameTextureMiB() const;
+    // Presentation time of the current frame minus the playback position of
+    // the media player. Returns false if this is not known.
+    bool avOffset(qint64* milliseconds) const;
+    // Presentation time of the current frame in microseconds, or -1 if unknown
+    qint64 frameStartTime() const;
+    // Report that the buffer swap after the last preRenderProcess() is done
+    void framePresented();
     void keyPressEvent(QKeyEvent* event);
 
+    /* Function for renderers that do not use the OpenGL state of this class
+     * (SoftwareRenderer and RhiRenderer): get the current frames and whether
+     * they changed since the last call */
+    bool softwareRenderProcess(const VideoFrame** frame, const VideoFrame** extFrame);
+
 public slots:
     void mediaChanged(PlaylistEntry entry);
 
 signals:
     void newVideoFrame();
     void toggleFullscreen();
+    void toggleHud();
     void stateChanged();
+    void tracksChanged();
     void wantQuit();
 };
@@ -0,0 +1,292 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include <QStorageInfo>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include "bufferedfile.hpp"
+#include "log.hpp"
+
+
+static const qint64 RingSize = 32 * 1024 * 1024;     // size of the read-ahead ring buffer
+static const qint64 ChunkSize = 1024 * 1024;         // size of a single read from the file
+static const qint64 KeepBehind = RingSize / 4;       // data kept behind the read position for small backward seeks
+
+const char* fileIOModeToString(FileIOMode mode)
+{
+    switch (mode) {
+    case FileIO_Backend:
+        return "backend";
+    case FileIO_Auto:
+        return "auto";
+    case FileIO_Mmap:
+        return "mmap";
+    case FileIO_Buffered:
+        return "buffered";
+    }
+    return nullptr;
+}
+
+FileIOMode fileIOModeFromString(const QString& s, bool* ok)
+{
+    FileIOMode mode = FileIO_Backend;
+    bool r = true;
+    if (s == "backend")
+        mode = FileIO_Backend;
+    else if (s == "auto")
+        mode = FileIO_Auto;
+    else if (s == "mmap")
+        mode = FileIO_Mmap;
+    else if (s == "buffered")
+        mode = FileIO_Buffered;
+    else
+        r = false;
+    if (ok)
+        *ok = r;
+    return mode;
+}
+
+BufferedFile::BufferedFile(const QString& fileName, FileIOMode mode, QObject* parent) :
+    QIODevice(parent),
+    _file(fileName),
+    _mode(mode == FileIO_Auto ? chooseMode(fileName) : mode),
+    _size(0),
+    _pos(0),
+    _map(nullptr),
+    _ioThread(nullptr),
+    _ringStart(0),
+    _ringEnd(0),
+    _abort(false),
+    _ioError(false),
+    _statBytesFromFile(0),
+    _statFileReadNsecs(0),
+    _statStalls(0),
+    _statStallNsecs(0),
+    _statSeeks(0)
+{
+}
+
+BufferedFile::~BufferedFile()
+{
+    if (isOpen())
+        close();
+}
+
+FileIOMode BufferedFile::chooseMode(const QString& fileName)
+{
+    // Memory mapping works well for local storage. On network file systems,
+    // page faults in the decoder thread would block it for a full round trip
+    // each time, so we read ahead in large chunks in our own thread instead.
+    QByteArray fsType = QStorageInfo(fileName).fileSystemType();
+    if (fsType.startsWith("nfs")
+            || fsType.startsWith("cifs")
+            || fsType.startsWith("smb")
+            || fsType.startsWith("fuse")
+            || fsType == "9p"
+            || fsType == "afs") {
+        return FileIO_Buffered;
+    }
+    return FileIO_Mmap;
+}
+
+bool BufferedFile::open(QIODevice::OpenMode mode)
+{
+    if ((mode & QIODevice::ReadWrite) != QIODevice::ReadOnly) {
+        setErrorString(tr("%1: only reading is supported").arg(_file.fileName()));
+        return false;
+    }
+    if (!_file.open(QIODevice::ReadOnly)) {
+        setErrorString(_file.errorString());
+        return false;
+    }
+    _size = _file.size();
+    _pos = 0;
+    if (_mode == FileIO_Mmap) {
+        _map = (_size > 0 ? _file.map(0, _size) : nullptr);
+        if (!_map) {
+            LOG_DEBUG("%s: cannot map file, falling back to buffered reading", qPrintable(_file.fileName()));
+            _mode = FileIO_Buffered;
+        }
+    }
+    if (_mode == FileIO_Buffered) {
+        _ring.resize(qMax(qMin(RingSize, _size), qint64(1)));
+        _ringStart = 0;
+        _ringEnd = 0;
+        _abort = false;
+        _ioError = false;
+        _ioThread = QThread::create([this]() { ioLoop(); });
+        _ioThread->start();
+    }
+    LOG_DEBUG("%s: serving via %s", qPrintable(_file.fileName()), fileIOModeToString(_mode));
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void BufferedFile::close()
+{
+    if (_ioThread) {
+        _mutex.lock();
+        _abort = true;
+        _spaceAvailable.wakeAll();
+        _dataAvailable.wakeAll();
+        _mutex.unlock();
+        _ioThread->wait();
+        delete _ioThread;
+        _ioThread = nullptr;
+        LOG_INFO("%s: read %.1f MiB at %.1f MiB/s, %d stalls (%.1f ms total), %d seeks outside the buffer",
+                qPrintable(_file.fileName()),
+                _statBytesFromFile / (1024.0 * 1024.0),
+                _statFileReadNsecs > 0 ? (_statBytesFromFile / (1024.0 * 1024.0)) / (_statFileReadNsecs / 1e9) : 0.0,
+                _statStalls, _statStallNsecs / 1e6, _statSeeks);
+        std::vector<char>().swap(_ring);
+    }
+    if (_map) {
+        _file.unmap(const_cast<uchar*>(_map));
+        _map = nullptr;
+    }
+    _file.close();
+    QIODevice::close();
+}
+
+bool BufferedFile::isSequential() const
+{
+    return false;
+}
+
+qint64 BufferedFile::size() const
+{
+    return _size;
+}
+
+bool BufferedFile::seek(qint64 pos)
+{
+    if (pos < 0 || pos > _size)
+        return false;
+    QIODevice::seek(pos);
+    QMutexLocker locker(&_mutex);
+    _pos = pos;
+    if (_mode == FileIO_Buffered && (_pos < _ringStart || _pos > _ringEnd)) {
+        // restart reading ahead at the new position
+        _statSeeks++;
+        _ringStart = _pos;
+        _ringEnd = _pos;
+        _spaceAvailable.wakeAll();
+    }
+    return true;
+}
+
+qint64 BufferedFile::readData(char* data, qint64 maxSize)
+{
+    if (_mode == FileIO_Mmap) {
+        qint64 n = qMin(maxSize, _size - _pos);
+        if (n <= 0)
+            return 0;
+        std::memcpy(data, _map + _pos, n);
+        _pos += n;
+        return n;
+    }
+
+    QMutexLocker locker(&_mutex);
+    if (_pos >= _size)
+        return 0;
+    if (_pos < _ringStart) {
+        _statSeeks++;
+        _ringStart = _pos;
+        _ringEnd = _pos;
+        _spaceAvailable.wakeAll();
+    }
+    if (_ringEnd <= _pos) {
+        // The I/O thread did not keep up: we have to wait
+        QElapsedTimer timer;
+        timer.start();
+        _statStalls++;
+        while (!_abort && !_ioError && _ringEnd <= _pos)
+            _dataAvailable.wait(&_mutex);
+        _statStallNsecs += timer.nsecsElapsed();
+        if (_ringEnd <= _pos)
+            return -1;
+    }
+    qint64 n = qMin(maxSize, _ringEnd - _pos);
+    qint64 ringSize = _ring.size();
+    qint64 offset = _pos % ringSize;
+    qint64 n0 = qMin(n, ringSize - offset);
+    std::memcpy(data, _ring.data() + offset, n0);
+    if (n0 < n)
+        std::memcpy(data + n0, _ring.data(), n - n0);
+    _pos += n;
+    _spaceAvailable.wakeAll();
+    return n;
+}
+
+qint64 BufferedFile::writeData(const char*, qint64)
+{
+    return -1;
+}
+
+void BufferedFile::ioLoop()
+{
+    std::vector<char> chunk(ChunkSize);
+    qint64 ringSize = _ring.size();
+    // If the ring is smaller than RingSize, it holds the complete file.
+    // Otherwise, we must not overwrite data that the reader still needs.
+    qint64 readAhead = (ringSize < RingSize ? ringSize : RingSize - KeepBehind);
+    for (;;) {
+        _mutex.lock();
+        while (!_abort && (_ringEnd >= _size || _ringEnd - _pos >= readAhead))
+            _spaceAvailable.wait(&_mutex);
+        if (_abort) {
+            _mutex.unlock();
+            break;
+        }
+        qint64 offset = _ringEnd;
+        qint64 n = qMin(qMin(ChunkSize, ringSize), _size - offset);
+        _mutex.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        qint64 r = (_file.seek(offset) ? _file.read(chunk.data(), n) : -1);
+        qint64 nsecs = timer.nsecsElapsed();
+
+        _mutex.lock();
+        _statFileReadNsecs += nsecs;
+        if (r <= 0) {
+            LOG_WARNING("%s", qPrintable(tr("%1: %2").arg(_file.fileName()).arg(_file.errorString())));
+            _ioError = true;
+            _dataAvailable.wakeAll();
+            _mutex.unlock();
+            break;
+        }
+        _statBytesFromFile += r;
+        if (offset == _ringEnd) {
+            // no seek happened in the meantime, so the data is still wanted
+            qint64 ringOffset = offset % ringSize;
+            qint64 r0 = qMin(r, ringSize - ringOffset);
+            std::memcpy(_ring.data() + ringOffset, chunk.data(), r0);
+            if (r0 < r)
+                std::memcpy(_ring.data(), chunk.data() + r0, r - r0);
+            _ringEnd += r;
+            _ringStart = qMax(_ringStart, _ringEnd - ringSize);
+            _dataAvailable.wakeAll();
+        }
+        _mutex.unlock();
+    }
+}
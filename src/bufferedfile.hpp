@@ -0,0 +1,94 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <QIODevice>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+
+/* How media files are read */
+enum FileIOMode {
+    FileIO_Backend,     // let the multimedia backend read the file itself
+    FileIO_Auto,        // choose between mmap and buffered based on the file system
+    FileIO_Mmap,        // memory-map the file
+    FileIO_Buffered     // read ahead into a large ring buffer in a separate thread
+};
+
+const char* fileIOModeToString(FileIOMode mode);
+FileIOMode fileIOModeFromString(const QString& s, bool* ok = nullptr);
+
+
+/* A QIODevice that serves a local file to QMediaPlayer::setSourceDevice(),
+ * either from a memory mapping or from a ring buffer that an I/O thread keeps
+ * filled ahead of the current read position. */
+
+class BufferedFile : public QIODevice
+{
+Q_OBJECT
+
+private:
+    QFile _file;
+    FileIOMode _mode;
+    qint64 _size;
+    qint64 _pos;
+    // for FileIO_Mmap:
+    const uchar* _map;
+    // for FileIO_Buffered:
+    QThread* _ioThread;
+    QMutex _mutex;
+    QWaitCondition _dataAvailable;  // signalled by the I/O thread
+    QWaitCondition _spaceAvailable; // signalled by the reader
+    std::vector<char> _ring;
+    qint64 _ringStart;              // file offset of the oldest valid byte in the ring
+    qint64 _ringEnd;                // file offset after the newest valid byte in the ring
+    bool _abort;
+    bool _ioError;
+    // statistics
+    qint64 _statBytesFromFile;
+    qint64 _statFileReadNsecs;
+    int _statStalls;
+    qint64 _statStallNsecs;
+    int _statSeeks;
+
+    void ioLoop();
+
+protected:
+    virtual qint64 readData(char* data, qint64 maxSize) override;
+    virtual qint64 writeData(const char* data, qint64 maxSize) override;
+
+public:
+    BufferedFile(const QString& fileName, FileIOMode mode, QObject* parent = nullptr);
+    virtual ~BufferedFile();
+
+    // Resolve FileIO_Auto for the given file
+    static FileIOMode chooseMode(const QString& fileName);
+
+    virtual bool open(QIODevice::OpenMode mode) override;
+    virtual void close() override;
+    virtual bool isSequential() const override;
+    virtual qint64 size() const override;
+    virtual bool seek(qint64 pos) override;
+};
@@ -288,6 +288,14 @@ void CommandInterpreter::processNextCommand()
         } else {
             Bino::instance()->seek(val);
         }
+    } else if (cmd.startsWith("step ")) {
+        bool ok;
+        int val = cmd.mid(5).toInt(&ok);
+        if (!ok) {
+            LOG_FATAL("%s", qPrintable(tr("Invalid argument in %1 line %2").arg(_file.fileName()).arg(_lineIndex)));
+        } else {
+            Bino::instance()->step(val);
+        }
     } else if (cmd.startsWith("set-swap-eyes ")) {
         int onoff = getOnOff(cmd.mid(14));
         if (onoff < 0) {
@@ -0,0 +1,115 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "contenthash.hpp"
+
+
+static const quint64 Prime1 = 0x9E3779B185EBCA87ULL;
+static const quint64 Prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const quint64 Prime3 = 0x165667B19E3779F9ULL;
+static const quint64 Prime4 = 0x85EBCA77C2B2AE63ULL;
+static const quint64 Prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 read64(const unsigned char* p)
+{
+    quint64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline quint32 read32(const unsigned char* p)
+{
+    quint32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline quint64 accumulate(quint64 acc, quint64 input)
+{
+    acc += input * Prime2;
+    acc = rotl(acc, 31);
+    return acc * Prime1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+    acc ^= accumulate(0, val);
+    return acc * Prime1 + Prime4;
+}
+
+quint64 contentHash(const void* data, size_t size, quint64 seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    quint64 h;
+
+    if (size >= 32) {
+        quint64 v1 = seed + Prime1 + Prime2;
+        quint64 v2 = seed + Prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - Prime1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = accumulate(v1, read64(p));
+            v2 = accumulate(v2, read64(p + 8));
+            v3 = accumulate(v3, read64(p + 16));
+            v4 = accumulate(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + Prime5;
+    }
+    h += size;
+
+    while (p + 8 <= end) {
+        h ^= accumulate(0, read64(p));
+        h = rotl(h, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= quint64(read32(p)) * Prime1;
+        h = rotl(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= quint64(*p) * Prime5;
+        h = rotl(h, 11) * Prime1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
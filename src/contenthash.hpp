@@ -0,0 +1,34 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include <QtGlobal>
+
+
+/* A fast 64 bit non-cryptographic hash of a block of memory, used to detect
+ * frames whose content is identical to their predecessor. This implements
+ * the XXH64 algorithm; its four independent accumulator lanes keep the CPU
+ * pipelines busy. Results depend on the byte order of the machine, which is
+ * fine since they are only compared within one process. */
+
+quint64 contentHash(const void* data, size_t size, quint64 seed = 0);
@@ -0,0 +1,396 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdio>
+
+#include <QtMath>
+#include <QFileInfo>
+
+#include "converter.hpp"
+#include "bino.hpp"
+#include "playlist.hpp"
+#include "imagesource.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+static const int WatchdogMilliseconds = 30000;
+static const qint64 MaxLagMilliseconds = 500;
+static const double MinPlaybackRate = 1.0 / 16.0;
+
+Converter::Converter(const QString& fileName, OutputMode outputMode, Backend backend, QObject* parent) :
+    QObject(parent),
+    _fileName(fileName),
+    _outputMode(outputMode),
+    _backend(backend),
+    _y4m(QFileInfo(fileName).suffix().toLower() == "y4m"),
+    _fbo(0),
+    _colorTex(0),
+    _width(0),
+    _height(0),
+    _frameCount(0),
+    _missingFrameCount(0),
+    _lastStartTime(-1),
+    _playbackRate(1.0),
+    _stepPending(false),
+    _lagLimit(MaxLagMilliseconds),
+    _success(false)
+{
+    _watchdog.setSingleShot(true);
+    _watchdog.setInterval(WatchdogMilliseconds);
+    connect(&_watchdog, &QTimer::timeout, [=]() {
+            LOG_FATAL("%s", qPrintable(tr("No video frame received within %1 seconds").arg(WatchdogMilliseconds / 1000)));
+            finish(false);
+            });
+}
+
+Converter::~Converter()
+{
+    if (_backend == Backend_OpenGL && _context.makeCurrent(&_surface)) {
+        glDeleteFramebuffers(1, &_fbo);
+        glDeleteTextures(1, &_colorTex);
+        _context.doneCurrent();
+    }
+}
+
+bool Converter::supportsOutputMode(OutputMode outputMode)
+{
+    return outputMode != Output_OpenGL_Stereo && outputMode != Output_Alternating;
+}
+
+bool Converter::supportsBackend(Backend backend)
+{
+#ifdef WITH_RHI
+    Q_UNUSED(backend);
+    return true;
+#else
+    return backend == Backend_OpenGL;
+#endif
+}
+
+bool Converter::initialize()
+{
+    if (_backend == Backend_OpenGL) {
+        _surface.setFormat(QSurfaceFormat::defaultFormat());
+        _surface.create();
+        _context.setFormat(QSurfaceFormat::defaultFormat());
+        if (!_context.create() || !_context.makeCurrent(&_surface)) {
+            LOG_FATAL("%s", qPrintable(tr("Cannot create an offscreen OpenGL context.")));
+            return false;
+        }
+        initializeOpenGLFunctions();
+        LOG_INFO("OpenGL Version:      %s", getOpenGLString(this, GL_VERSION));
+        LOG_INFO("OpenGL Renderer:     %s", getOpenGLString(this, GL_RENDERER));
+        if (!Bino::instance()->initProcess())
+            return false;
+        _renderer.initialize();
+        // render into an sRGB texture so that the hardware encodes the output
+        _renderer.setSRGBOutput(true);
+        glGenTextures(1, &_colorTex);
+        glGenFramebuffers(1, &_fbo);
+        CHECK_GL();
+    } else {
+#ifdef WITH_RHI
+        if (!_rhiRenderer.initialize(_backend == Backend_RHI_Vulkan ? RhiRenderer::API_Vulkan : RhiRenderer::API_OpenGL,
+                    Bino::instance()->framePrecision(), Bino::instance()->displayLut()))
+            return false;
+#endif
+    }
+
+    bool ok;
+    if (_fileName == "-") {
+        ok = _file.open(stdout, QIODevice::WriteOnly);
+    } else {
+        _file.setFileName(_fileName);
+        ok = _file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    if (!ok) {
+        LOG_FATAL("%s", qPrintable(tr("Cannot open %1: %2").arg(_fileName).arg(_file.errorString())));
+        return false;
+    }
+
+    // Convert each frame as soon as the video sink has it, before a later
+    // frame can replace it
+    connect(Bino::instance(), &Bino::newVideoFrame, this, [=]() { processFrame(); });
+    connect(Playlist::instance(), &Playlist::mediaChanged, this, [=]() {
+            _lastStartTime = -1;
+            _lagLimit = MaxLagMilliseconds;
+            });
+    connect(Playlist::instance(), &Playlist::finished, this, [=]() { finish(true); }, Qt::QueuedConnection);
+    // we advance to the next play list entry after each still image ourselves,
+    // and each entry is converted once
+    Bino::instance()->setSlideshowDuration(0);
+    Playlist::instance()->setLoopMode(Loop_Off);
+    _elapsedTimer.start();
+    _watchdog.start();
+    return true;
+}
+
+bool Converter::success() const
+{
+    return _success;
+}
+
+void Converter::computeOutputSize()
+{
+    int viewCount, viewWidth, viewHeight;
+    float aspectRatio;
+    Bino::instance()->frameGeometry(0, 0, &viewCount, &viewWidth, &viewHeight, &aspectRatio, nullptr);
+    // size of one view with square pixels, without losing resolution
+    int h = qMax(viewHeight, qRound(viewWidth / aspectRatio));
+    int w = qRound(h * aspectRatio);
+    OutputMode mode = (viewCount == 2 ? _outputMode : Output_Left);
+    switch (mode) {
+    case Output_Left_Right:
+    case Output_Right_Left:
+        w *= 2;
+        break;
+    case Output_Top_Bottom:
+    case Output_Bottom_Top:
+        h *= 2;
+        break;
+    case Output_HDMI_Frame_Pack:
+        // two views separated by a gap of 1/49 of the total height
+        h = 2 * h + h / 24;
+        break;
+    default:
+        break;
+    }
+    // Y4M 4:2:0 requires even dimensions
+    _width = (w + 1) / 2 * 2;
+    _height = (h + 1) / 2 * 2;
+    if (_backend == Backend_OpenGL) {
+        glBindTexture(GL_TEXTURE_2D, _colorTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, _renderer.srgbOutput() ? GL_SRGB8_ALPHA8 : GL_RGBA8,
+                _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _colorTex, 0);
+        _rgba.resize(size_t(_width) * _height * 4);
+    }
+    if (_y4m)
+        _yuv.resize(size_t(_width) * _height * 3 / 2);
+    LOG_INFO("converting %s to %s: %dx%d, output mode %s",
+            qPrintable(Bino::instance()->url().toString()), qPrintable(_fileName),
+            _width, _height, outputModeToString(mode));
+
+    if (_y4m) {
+        float fps = Bino::instance()->frameRate();
+        if (fps <= 0.0f)
+            fps = 25.0f;
+        // alternating input needs two frames per output frame
+        if (Bino::instance()->assumeInputMode() == Input_Alternating_LR
+                || Bino::instance()->assumeInputMode() == Input_Alternating_RL)
+            fps /= 2.0f;
+        QByteArray header = QString("YUV4MPEG2 W%1 H%2 F%3:1000 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n")
+            .arg(_width).arg(_height).arg(qRound(fps * 1000.0f)).toLatin1();
+        _file.write(header);
+    }
+}
+
+// The number of frames that the media player dropped between the previous
+// frame and the current one, according to their presentation times.
+int Converter::missingFrames()
+{
+    Bino* bino = Bino::instance();
+    qint64 startTime = bino->frameStartTime();
+    float fps = bino->frameRate();
+    int missing = 0;
+    if (startTime > _lastStartTime && _lastStartTime >= 0 && fps > 0.0f) {
+        double frameDuration = 1e6 / fps;
+        if (bino->assumeInputMode() == Input_Alternating_LR
+                || bino->assumeInputMode() == Input_Alternating_RL)
+            frameDuration *= 2.0;
+        double gap = (startTime - _lastStartTime) / frameDuration;
+        // a gap of more than ten seconds is a discontinuity, not a drop
+        if (gap < 10.0 * fps)
+            missing = qMax(qRound(gap) - 1, 0);
+    }
+    _lastStartTime = startTime;
+    return missing;
+}
+
+// The media player decodes in real time. If the conversion falls behind,
+// slow the player down so that it does not drop frames.
+void Converter::pace()
+{
+    qint64 offset;
+    if (!Bino::instance()->avOffset(&offset) || -offset <= _lagLimit || _playbackRate <= MinPlaybackRate)
+        return;
+    _playbackRate /= 2.0;
+    // the lag only shrinks after the frames that are already queued are converted
+    _lagLimit = -offset + MaxLagMilliseconds;
+    LOG_DEBUG("converter lags %lld ms behind the media player", static_cast<long long>(-offset));
+    Bino::instance()->setPlaybackRate(_playbackRate);
+}
+
+// Show the next frame of an image sequence or raw video file, or continue
+// with the next play list entry after its last frame.
+void Converter::stepFrameSource()
+{
+    _stepPending = false;
+    Bino* bino = Bino::instance();
+    if (!bino->canStep())
+        return;
+    // the frame source starts playing after showing its first frame
+    if (bino->playing())
+        bino->pause();
+    if (bino->stopped())
+        Playlist::instance()->mediaEnded();
+    else
+        bino->step(1);
+}
+
+void Converter::processFrame()
+{
+    if (!_file.isOpen())
+        return;
+    _watchdog.start();
+    if (_backend == Backend_OpenGL && !_context.makeCurrent(&_surface))
+        return;
+    Bino* bino = Bino::instance();
+    if (bino->canStep() && bino->playing()) {
+        // decode frames one at a time instead of in real time
+        bino->pause();
+    }
+    int missing = missingFrames();
+    if (_frameCount == 0) {
+        computeOutputSize();
+    } else {
+        // repeat the previous output frame in place of dropped frames
+        for (int i = 0; i < missing; i++) {
+            if (_backend == Backend_OpenGL)
+                writeFrame(_rgba.data(), true);
+#ifdef WITH_RHI
+            else
+                writeFrame(reinterpret_cast<const unsigned char*>(_rhiRgba.constData()), false);
+#endif
+        }
+        _missingFrameCount += missing;
+    }
+
+    if (_backend == Backend_OpenGL) {
+        OutputMode outputMode = _outputMode;
+        float outputAspectRatio;
+        bool frameIsStereo;
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        _renderer.renderViews(outputMode, 0, _width, _height, QQuaternion(), &outputAspectRatio, &frameIsStereo);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        // renderViews() rendered only the right view for Output_Right
+        _renderer.display(outputMode, outputMode == Output_Right ? 1 : 0, _width, _height, outputAspectRatio);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, _rgba.data());
+        CHECK_GL();
+        writeFrame(_rgba.data(), true);
+    } else {
+#ifdef WITH_RHI
+        const VideoFrame* frame;
+        const VideoFrame* extFrame;
+        bool frameIsNew = bino->softwareRenderProcess(&frame, &extFrame);
+        if (!_rhiRenderer.render(*frame, *extFrame, frameIsNew, _outputMode, bino->swapEyes(),
+                    _width, _height, QQuaternion(), _rhiRgba)) {
+            finish(false);
+            return;
+        }
+        writeFrame(reinterpret_cast<const unsigned char*>(_rhiRgba.constData()), false);
+#endif
+    }
+    _frameCount++;
+
+    if (_file.error() != QFileDevice::NoError) {
+        LOG_FATAL("%s", qPrintable(tr("Cannot write %1: %2").arg(_fileName).arg(_file.errorString())));
+        finish(false);
+    } else if (bino->canStep()) {
+        if (!_stepPending) {
+            _stepPending = true;
+            QTimer::singleShot(0, this, [=]() { stepFrameSource(); });
+        }
+    } else if (ImageSource::isImage(bino->url())) {
+        // a still image consists of a single frame
+        QTimer::singleShot(0, Playlist::instance(), &Playlist::mediaEnded);
+    } else {
+        pace();
+    }
+}
+
+void Converter::writeFrame(const unsigned char* rgba, bool bottomToTop)
+{
+    // glReadPixels() delivers the rows bottom to top, the QRhi readback top to bottom;
+    // both output formats are top to bottom
+    auto row = [=](int y) {
+        return rgba + size_t(bottomToTop ? _height - 1 - y : y) * _width * 4;
+    };
+    if (!_y4m) {
+        for (int y = 0; y < _height; y++)
+            _file.write(reinterpret_cast<const char*>(row(y)), _width * 4);
+        return;
+    }
+    // BT.601 limited range, chroma from the average of each 2x2 block
+    unsigned char* yPlane = _yuv.data();
+    unsigned char* uPlane = yPlane + size_t(_width) * _height;
+    unsigned char* vPlane = uPlane + size_t(_width / 2) * (_height / 2);
+    for (int y = 0; y < _height; y++) {
+        const unsigned char* src = row(y);
+        unsigned char* dst = yPlane + size_t(y) * _width;
+        for (int x = 0; x < _width; x++) {
+            int r = src[4 * x + 0], g = src[4 * x + 1], b = src[4 * x + 2];
+            dst[x] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        }
+    }
+    for (int y = 0; y < _height / 2; y++) {
+        const unsigned char* src0 = row(2 * y);
+        const unsigned char* src1 = row(2 * y + 1);
+        for (int x = 0; x < _width / 2; x++) {
+            int r = (src0[8 * x + 0] + src0[8 * x + 4] + src1[8 * x + 0] + src1[8 * x + 4] + 2) >> 2;
+            int g = (src0[8 * x + 1] + src0[8 * x + 5] + src1[8 * x + 1] + src1[8 * x + 5] + 2) >> 2;
+            int b = (src0[8 * x + 2] + src0[8 * x + 6] + src1[8 * x + 2] + src1[8 * x + 6] + 2) >> 2;
+            uPlane[size_t(y) * (_width / 2) + x] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            vPlane[size_t(y) * (_width / 2) + x] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+    }
+    _file.write("FRAME\n");
+    _file.write(reinterpret_cast<const char*>(_yuv.data()), _yuv.size());
+}
+
+void Converter::finish(bool success)
+{
+    if (!_file.isOpen())
+        return;
+    _watchdog.stop();
+    _file.close();
+    if (success && _frameCount == 0) {
+        LOG_FATAL("%s", qPrintable(tr("No video frames to convert")));
+        success = false;
+    }
+    _success = success;
+    if (_frameCount > 0) {
+        double seconds = _elapsedTimer.nsecsElapsed() / 1e9;
+        LOG_REQUESTED("converted %d frames in %.2f s (%.1f fps)", _frameCount, seconds, _frameCount / seconds);
+    }
+    if (_missingFrameCount > 0) {
+        LOG_WARNING("%s", qPrintable(tr("%1 frames were dropped by the media player and replaced by their predecessor")
+                    .arg(_missingFrameCount)));
+    }
+    emit finished();
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <vector>
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include "modes.hpp"
+#include "outputrenderer.hpp"
+#include "rhirenderer.hpp"
+
+
+/* Converts media into a different stereo layout without showing it: each
+ * frame is rendered in the chosen output mode into an offscreen framebuffer
+ * and written to a file or to standard output, either as YUV4MPEG2 (for
+ * file names ending in .y4m) or as raw RGBA. All play list entries are
+ * written in turn, with the output size and frame rate of the first one.
+ * Image sequences and raw video are stepped through frame by frame as fast as
+ * possible; other media are played by the media player, which is slowed down
+ * when the conversion cannot keep up. Frames that the media player drops
+ * nevertheless are replaced by repetitions of their predecessor, so that the
+ * output timing stays correct, and are reported.
+ * Rendering uses OpenGL by default, or QRhi with Vulkan or OpenGL if Bino was
+ * built with QRhi support. */
+
+class Converter : public QObject, protected QOpenGLExtraFunctions
+{
+Q_OBJECT
+
+public:
+    enum Backend {
+        Backend_OpenGL,
+        Backend_RHI_Vulkan,
+        Backend_RHI_OpenGL
+    };
+
+private:
+    QString _fileName;
+    OutputMode _outputMode;
+    Backend _backend;
+    bool _y4m;
+    QFile _file;
+    QOffscreenSurface _surface;
+    QOpenGLContext _context;
+    OutputRenderer _renderer;
+    unsigned int _fbo;
+    unsigned int _colorTex;
+    int _width, _height;        // output size, determined from the first frame
+    std::vector<unsigned char> _rgba;
+    std::vector<unsigned char> _yuv;
+#ifdef WITH_RHI
+    RhiRenderer _rhiRenderer;
+    QByteArray _rhiRgba;
+#endif
+    int _frameCount;
+    int _missingFrameCount;
+    qint64 _lastStartTime;      // presentation time of the last frame from the media player
+    double _playbackRate;
+    bool _stepPending;
+    qint64 _lagLimit;           // lag in milliseconds that slows the media player down
+    QElapsedTimer _elapsedTimer;
+    QTimer _watchdog;
+    bool _success;
+
+    void computeOutputSize();
+    void processFrame();
+    int missingFrames();
+    void stepFrameSource();
+    void pace();
+    void writeFrame(const unsigned char* rgba, bool bottomToTop);
+    void finish(bool success);
+
+public:
+    Converter(const QString& fileName, OutputMode outputMode, Backend backend = Backend_OpenGL, QObject* parent = nullptr);
+    virtual ~Converter();
+
+    // Whether the output mode produces a single image per frame
+    static bool supportsOutputMode(OutputMode outputMode);
+    // Whether the backend is available in this build
+    static bool supportsBackend(Backend backend);
+
+    // Create the OpenGL context or QRhi and open the output. Returns false on failure.
+    bool initialize();
+
+    // Whether the conversion succeeded, valid after finished()
+    bool success() const;
+
+signals:
+    void finished();
+};
@@ -0,0 +1,120 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QFile>
+#include <QTextStream>
+#include <QRegularExpression>
+
+#include "cubelut.hpp"
+
+
+CubeLut::CubeLut() :
+    size(0),
+    domainMin { 0.0f, 0.0f, 0.0f },
+    domainMax { 1.0f, 1.0f, 1.0f }
+{
+}
+
+static bool parseFloats(const QStringList& words, int n, float* values)
+{
+    if (words.size() != n + 1)
+        return false;
+    for (int i = 0; i < n; i++) {
+        bool ok;
+        values[i] = words[i + 1].toFloat(&ok);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+bool CubeLut::read(const QString& fileName, QString* errorMessage)
+{
+    static const QRegularExpression whitespace("\\s+");
+
+    *this = CubeLut();
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *errorMessage = tr("Cannot open %1: %2").arg(fileName).arg(file.errorString());
+        return false;
+    }
+    QTextStream in(&file);
+    int lut3dSize = 0;
+    size_t expectedValues = 0;
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && !in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        lineNumber++;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        QStringList words = line.split(whitespace);
+        if (words[0] == "TITLE") {
+            continue;
+        } else if (words[0] == "LUT_1D_SIZE") {
+            *errorMessage = tr("%1: 1D LUTs are not supported").arg(fileName);
+            return false;
+        } else if (words[0] == "LUT_3D_SIZE") {
+            ok = (words.size() == 2 && lut3dSize == 0);
+            if (ok)
+                lut3dSize = words[1].toInt(&ok);
+            ok = ok && lut3dSize >= 2 && lut3dSize <= 256;
+            if (ok) {
+                expectedValues = 3 * size_t(lut3dSize) * lut3dSize * lut3dSize;
+                data.reserve(expectedValues);
+            }
+        } else if (words[0] == "DOMAIN_MIN") {
+            ok = parseFloats(words, 3, domainMin);
+        } else if (words[0] == "DOMAIN_MAX") {
+            ok = parseFloats(words, 3, domainMax);
+        } else if (words[0] == "LUT_3D_INPUT_RANGE") {
+            float range[2];
+            ok = parseFloats(words, 2, range);
+            for (int i = 0; i < 3; i++) {
+                domainMin[i] = range[0];
+                domainMax[i] = range[1];
+            }
+        } else if (lut3dSize > 0 && words.size() == 3 && data.size() < expectedValues) {
+            for (int i = 0; ok && i < 3; i++)
+                data.push_back(words[i].toFloat(&ok));
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        *errorMessage = tr("%1: invalid line %2").arg(fileName).arg(lineNumber);
+        *this = CubeLut();
+        return false;
+    }
+    if (lut3dSize == 0 || data.size() != expectedValues) {
+        *errorMessage = tr("%1: incomplete 3D LUT").arg(fileName);
+        *this = CubeLut();
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (domainMax[i] <= domainMin[i]) {
+            *errorMessage = tr("%1: invalid domain").arg(fileName);
+            *this = CubeLut();
+            return false;
+        }
+    }
+    size = lut3dSize;
+    return true;
+}
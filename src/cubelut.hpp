@@ -0,0 +1,50 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <QCoreApplication>
+#include <QString>
+
+
+/* A 3D color lookup table in the .cube format (as written by most display
+ * calibration tools), for display calibration. The table maps non-linear
+ * RGB to corrected non-linear RGB. The data is stored with red changing
+ * fastest, which is the layout of both the file and of OpenGL 3D textures. */
+
+class CubeLut
+{
+    Q_DECLARE_TR_FUNCTIONS(CubeLut)
+
+public:
+    int size;                   // entries per dimension; 0 if the LUT is empty
+    float domainMin[3];
+    float domainMax[3];
+    std::vector<float> data;    // size^3 RGB triplets
+
+    CubeLut();
+
+    bool isEmpty() const { return size == 0; }
+
+    // Read a .cube file. On failure, the LUT is empty and an error message is set.
+    bool read(const QString& fileName, QString* errorMessage);
+};
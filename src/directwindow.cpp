@@ -0,0 +1,135 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QMessageBox>
+#include <QMouseEvent>
+#include <QScreen>
+
+#include "directwindow.hpp"
+#include "playlist.hpp"
+#include "log.hpp"
+
+
+DirectWindow::DirectWindow(OutputMode outputMode) :
+    QOpenGLWindow(QOpenGLWindow::NoPartialUpdate),
+    _output(outputMode, false)
+{
+    connect(Bino::instance(), &Bino::newVideoFrame, [=]() { update(); });
+    // Output_Alternating shows the next view after each buffer swap, which
+    // the swap interval synchronizes with the display refresh
+    connect(this, &QOpenGLWindow::frameSwapped, [=]() { if (_output.swapped()) update(); });
+    connect(Bino::instance(), &Bino::toggleFullscreen, [=]() { emit toggleFullscreen(); });
+    connect(Playlist::instance(), SIGNAL(mediaChanged(PlaylistEntry)), this, SLOT(mediaChanged(PlaylistEntry)));
+}
+
+DirectWindow::~DirectWindow()
+{
+    makeCurrent();
+    _output.cleanup();
+    doneCurrent();
+}
+
+bool DirectWindow::isOpenGLStereo() const
+{
+    return _output.isOpenGLStereo();
+}
+
+OutputMode DirectWindow::outputMode() const
+{
+    return _output.outputMode();
+}
+
+void DirectWindow::setOutputMode(enum OutputMode mode)
+{
+    _output.setOutputMode(mode);
+}
+
+bool DirectWindow::hudVisible() const
+{
+    return _output.hudVisible();
+}
+
+void DirectWindow::setHudVisible(bool visible)
+{
+    _output.setHudVisible(visible);
+    update();
+}
+
+void DirectWindow::initializeGL()
+{
+    QString errorMessage;
+    if (!_output.initialize(context(), this, &errorMessage)) {
+        LOG_FATAL("%s", qPrintable(errorMessage));
+        QMessageBox::critical(nullptr, QCoreApplication::translate("Widget", "Error"), errorMessage);
+        std::exit(1);
+    }
+}
+
+void DirectWindow::paintGL()
+{
+    // Support for HighDPI output
+    int width = QOpenGLWindow::width() * devicePixelRatio();
+    int height = QOpenGLWindow::height() * devicePixelRatio();
+
+    QPoint globalLowerLeft = mapToGlobal(QPoint(0, height - 1));
+    float fragOffsetX = globalLowerLeft.x();
+    float fragOffsetY = screen()->geometry().height() - 1 - globalLowerLeft.y();
+    _output.paint(defaultFramebufferObject(), width, height, fragOffsetX, fragOffsetY);
+}
+
+void DirectWindow::resizeGL(int, int)
+{
+    _output.invalidate();
+}
+
+void DirectWindow::keyPressEvent(QKeyEvent* e)
+{
+    Bino::instance()->keyPressEvent(e);
+}
+
+void DirectWindow::mousePressEvent(QMouseEvent* e)
+{
+    if (e->button() == Qt::RightButton) {
+        emit contextMenuRequested(e->globalPosition().toPoint());
+        return;
+    }
+    _output.startSurroundMovement(e->position());
+}
+
+void DirectWindow::mouseReleaseEvent(QMouseEvent*)
+{
+    _output.stopSurroundMovement();
+}
+
+void DirectWindow::mouseMoveEvent(QMouseEvent* e)
+{
+    // Support for HighDPI output
+    int width = QOpenGLWindow::width() * devicePixelRatio();
+    int height = QOpenGLWindow::height() * devicePixelRatio();
+
+    if (_output.moveSurround(e->position(), width, height))
+        update();
+}
+
+void DirectWindow::mediaChanged(PlaylistEntry)
+{
+    _output.resetSurround();
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QOpenGLWindow>
+
+#include "modes.hpp"
+#include "bino.hpp"
+#include "screenoutput.hpp"
+
+
+/* The counterpart of Widget that renders directly into a native window
+ * instead of into an FBO that is composited into the main window. This
+ * saves a full-screen copy and a frame of latency per buffer swap. It is
+ * embedded into the GUI with QWidget::createWindowContainer(). Since a
+ * QOpenGLWindow does not preserve its framebuffer, every paint redraws the
+ * output, but unchanged views are still reused. */
+
+class DirectWindow : public QOpenGLWindow
+{
+Q_OBJECT
+
+private:
+    ScreenOutput _output;
+
+public:
+    DirectWindow(OutputMode outputMode);
+    virtual ~DirectWindow();
+
+    bool isOpenGLStereo() const;
+    OutputMode outputMode() const;
+    void setOutputMode(OutputMode mode);
+    bool hudVisible() const;
+    void setHudVisible(bool visible);
+
+    virtual void initializeGL() override;
+    virtual void paintGL() override;
+    virtual void resizeGL(int w, int h) override;
+
+    virtual void keyPressEvent(QKeyEvent* e) override;
+    virtual void mousePressEvent(QMouseEvent* e) override;
+    virtual void mouseReleaseEvent(QMouseEvent* e) override;
+    virtual void mouseMoveEvent(QMouseEvent* e) override;
+
+public slots:
+    void mediaChanged(PlaylistEntry entry);
+
+signals:
+    void toggleFullscreen();
+    // A QWindow does not get QContextMenuEvents from the main window
+    void contextMenuRequested(const QPoint& globalPos);
+};
@@ -0,0 +1,58 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <QObject>
+#include <QUrl>
+
+
+/* Base class for media sources that do not need QMediaPlayer, such as image
+ * sequences or raw video files. They deliver frames at a fixed frame rate
+ * and allow frame-accurate positioning. Each subclass has its own signal to
+ * deliver frames, since the frame representations differ. */
+
+class FrameSource : public QObject
+{
+Q_OBJECT
+
+public:
+    FrameSource(QObject* parent = nullptr);
+    virtual ~FrameSource();
+
+    // Prepare the source. Returns false if it cannot be played.
+    virtual bool open() = 0;
+
+    virtual QUrl url() const = 0;
+    virtual bool isPlaying() const = 0;
+    virtual bool isFinished() const = 0;
+    virtual qint64 position() const = 0;    // in milliseconds
+    virtual qint64 duration() const = 0;    // in milliseconds
+    virtual float fps() const = 0;
+
+    virtual void play() = 0;
+    virtual void pause() = 0;
+    virtual void setPosition(qint64 milliseconds) = 0;
+    virtual void step(int frames) = 0;      // pause and move by the given number of frames
+
+signals:
+    void finished();
+};
@@ -0,0 +1,342 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QtMath>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include "gpuprofiler.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+static GpuProfiler* gpuProfilerSingleton = nullptr;
+
+static const int WindowFrames = 600;        // frames in the rolling statistics window
+static const int MaxQueriesPerFrame = 64;
+
+GpuProfiler::GpuProfiler(bool enabled, const QString& fileName) :
+    _requested(enabled),
+    _enabled(enabled),
+    _fileName(fileName),
+    _initialized(false),
+    _queryCounter(nullptr),
+    _getQueryObjectui64v(nullptr),
+    _slot(0),
+    _frameActive(false),
+    _measuredFrames(0),
+    _skippedFrames(0)
+{
+    for (int i = 0; i < SlotCount; i++) {
+        _slots[i].used = 0;
+        _slots[i].pending = false;
+    }
+    _cpuTimer.start();
+    for (int s = 0; s < StageCount; s++) {
+        _openQuery[s] = -1;
+        _openCpu[s] = 0;
+        _nextSample[s] = 0;
+        _stageFrames[s] = 0;
+    }
+    Q_ASSERT(!gpuProfilerSingleton);
+    gpuProfilerSingleton = this;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    if (_requested && _measuredFrames > 0) {
+        logStatistics();
+        if (!_fileName.isEmpty())
+            writeFile();
+    }
+    gpuProfilerSingleton = nullptr;
+}
+
+GpuProfiler* GpuProfiler::instance()
+{
+    return gpuProfilerSingleton;
+}
+
+const char* GpuProfiler::stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage_Frame:
+        return "frame";
+    case Stage_Upload:
+        return "upload";
+    case Stage_Color:
+        return "color";
+    case Stage_FrameMipmaps:
+        return "frame-mipmaps";
+    case Stage_View:
+        return "view";
+    case Stage_ViewMipmaps:
+        return "view-mipmaps";
+    case Stage_Display:
+        return "display";
+    case Stage_VRDevices:
+        return "vr-devices";
+    case StageCount:
+        break;
+    }
+    return nullptr;
+}
+
+bool GpuProfiler::isEnabled() const
+{
+    return _enabled;
+}
+
+void GpuProfiler::setEnabled(bool enabled)
+{
+    _enabled = enabled || _requested;
+}
+
+void GpuProfiler::initialize()
+{
+    if (_initialized)
+        return;
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (checkTimerQueryAvailability()) {
+        bool isGLES = context->isOpenGLES();
+        _queryCounter = reinterpret_cast<QueryCounterFunc>(
+                context->getProcAddress(isGLES ? "glQueryCounterEXT" : "glQueryCounter"));
+        _getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64vFunc>(
+                context->getProcAddress(isGLES ? "glGetQueryObjectui64vEXT" : "glGetQueryObjectui64v"));
+    }
+    if (!_queryCounter || !_getQueryObjectui64v) {
+        if (_requested)
+            LOG_WARNING("GPU profiler: timestamp queries are not available");
+        return;
+    }
+    initializeOpenGLFunctions();
+    _initialized = true;
+    if (_requested)
+        LOG_INFO("GPU profiler: enabled, statistics over %d frames", WindowFrames);
+}
+
+void GpuProfiler::cleanup()
+{
+    if (!_initialized)
+        return;
+    for (int i = 0; i < SlotCount; i++) {
+        if (_slots[i].queries.size() > 0)
+            glDeleteQueries(_slots[i].queries.size(), _slots[i].queries.constData());
+        _slots[i].queries.clear();
+        _slots[i].used = 0;
+        _slots[i].records.clear();
+        _slots[i].pending = false;
+    }
+    _frameActive = false;
+    _initialized = false;
+}
+
+int GpuProfiler::timestamp()
+{
+    FrameSlot& slot = _slots[_slot];
+    if (slot.used == MaxQueriesPerFrame)
+        return -1;
+    if (slot.used == slot.queries.size()) {
+        unsigned int query;
+        glGenQueries(1, &query);
+        slot.queries.append(query);
+    }
+    int index = slot.used++;
+    _queryCounter(slot.queries[index], GL_TIMESTAMP);
+    return index;
+}
+
+bool GpuProfiler::collect(FrameSlot& slot)
+{
+    if (slot.used == 0 || slot.records.size() == 0) {
+        slot.pending = false;
+        return true;
+    }
+    // Timestamps are written in order, so all results are available when the last one is
+    GLuint available = 0;
+    glGetQueryObjectuiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+    slot.pending = false;
+    double frameMs[StageCount];
+    double frameCpuMs[StageCount];
+    bool ran[StageCount];
+    for (int s = 0; s < StageCount; s++) {
+        frameMs[s] = 0.0;
+        frameCpuMs[s] = 0.0;
+        ran[s] = false;
+    }
+    for (int i = 0; i < slot.records.size(); i++) {
+        const FrameSlot::Record& r = slot.records[i];
+        GLuint64 t0 = 0, t1 = 0;
+        _getQueryObjectui64v(slot.queries[r.beginQuery], GL_QUERY_RESULT, &t0);
+        _getQueryObjectui64v(slot.queries[r.endQuery], GL_QUERY_RESULT, &t1);
+        frameMs[r.stage] += (t1 > t0 ? t1 - t0 : 0) / 1e6;
+        frameCpuMs[r.stage] += r.cpuNsecs / 1e6;
+        ran[r.stage] = true;
+    }
+    for (int s = 0; s < StageCount; s++) {
+        if (!ran[s])
+            continue;
+        if (_samples[s].size() < WindowFrames) {
+            _samples[s].append(frameMs[s]);
+            _cpuSamples[s].append(frameCpuMs[s]);
+        } else {
+            _samples[s][_nextSample[s]] = frameMs[s];
+            _cpuSamples[s][_nextSample[s]] = frameCpuMs[s];
+            _nextSample[s] = (_nextSample[s] + 1) % WindowFrames;
+        }
+        _stageFrames[s]++;
+    }
+    _measuredFrames++;
+    if (_requested && _measuredFrames % WindowFrames == 0)
+        logStatistics();
+    return true;
+}
+
+void GpuProfiler::beginFrame()
+{
+    if (!_enabled || !_initialized)
+        return;
+    FrameSlot& slot = _slots[_slot];
+    if (slot.pending && !collect(slot)) {
+        // the oldest slot is still in flight; try again with the next frame
+        _skippedFrames++;
+        return;
+    }
+    slot.used = 0;
+    slot.records.clear();
+    for (int s = 0; s < StageCount; s++)
+        _openQuery[s] = -1;
+    _frameActive = true;
+    begin(Stage_Frame);
+}
+
+void GpuProfiler::endFrame()
+{
+    if (!_frameActive)
+        return;
+    end(Stage_Frame);
+    _slots[_slot].pending = true;
+    _frameActive = false;
+    _slot = (_slot + 1) % SlotCount;
+}
+
+void GpuProfiler::begin(Stage stage)
+{
+    if (!_frameActive)
+        return;
+    _openQuery[stage] = timestamp();
+    _openCpu[stage] = _cpuTimer.nsecsElapsed();
+}
+
+void GpuProfiler::end(Stage stage)
+{
+    if (!_frameActive || _openQuery[stage] < 0)
+        return;
+    int endQuery = timestamp();
+    if (endQuery >= 0) {
+        FrameSlot::Record r = { stage, _openQuery[stage], endQuery, _cpuTimer.nsecsElapsed() - _openCpu[stage] };
+        _slots[_slot].records.append(r);
+    }
+    _openQuery[stage] = -1;
+}
+
+GpuProfiler::Statistics GpuProfiler::statistics(Stage stage) const
+{
+    Statistics stat = { 0, 0.0, 0.0, 0.0, 0.0 };
+    const QVector<float>& samples = _samples[stage];
+    if (samples.size() == 0)
+        return stat;
+    QVector<float> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (int i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+    stat.frames = sorted.size();
+    stat.minMs = sorted[0];
+    stat.meanMs = sum / sorted.size();
+    stat.p99Ms = sorted[qMax(0, qCeil(0.99 * sorted.size()) - 1)];
+    double cpuSum = 0.0;
+    for (int i = 0; i < _cpuSamples[stage].size(); i++)
+        cpuSum += _cpuSamples[stage][i];
+    stat.cpuMeanMs = cpuSum / _cpuSamples[stage].size();
+    return stat;
+}
+
+int GpuProfiler::history(Stage stage, float* gpuMs, int maxCount) const
+{
+    const QVector<float>& samples = _samples[stage];
+    int count = qMin(maxCount, int(samples.size()));
+    // in a full window, _nextSample is the index of the oldest sample
+    int newest = (samples.size() < WindowFrames ? samples.size() : _nextSample[stage]) - 1;
+    for (int i = 0; i < count; i++) {
+        int j = newest - (count - 1 - i);
+        if (j < 0)
+            j += samples.size();
+        gpuMs[i] = samples[j];
+    }
+    return count;
+}
+
+void GpuProfiler::logStatistics() const
+{
+    LOG_INFO("GPU profiler: %lld frames measured, %lld skipped because all query slots were in flight",
+            _measuredFrames, _skippedFrames);
+    for (int s = 0; s < StageCount; s++) {
+        Statistics stat = statistics(Stage(s));
+        if (stat.frames == 0)
+            continue;
+        LOG_INFO("GPU profiler: %-13s GPU min %7.3f ms, mean %7.3f ms, p99 %7.3f ms; CPU mean %7.3f ms; over the last %d frames",
+                stageName(Stage(s)), stat.minMs, stat.meanMs, stat.p99Ms, stat.cpuMeanMs, stat.frames);
+    }
+}
+
+void GpuProfiler::writeFile() const
+{
+    QJsonArray stages;
+    for (int s = 0; s < StageCount; s++) {
+        Statistics stat = statistics(Stage(s));
+        QJsonObject stage;
+        stage["name"] = stageName(Stage(s));
+        stage["frames"] = _stageFrames[s];
+        stage["window_frames"] = stat.frames;
+        stage["min_ms"] = stat.minMs;
+        stage["mean_ms"] = stat.meanMs;
+        stage["p99_ms"] = stat.p99Ms;
+        stage["cpu_mean_ms"] = stat.cpuMeanMs;
+        stages.append(stage);
+    }
+    QJsonObject root;
+    root["measured_frames"] = _measuredFrames;
+    root["skipped_frames"] = _skippedFrames;
+    root["stages"] = stages;
+    QFile file(_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || file.write(QJsonDocument(root).toJson()) < 0) {
+        LOG_WARNING("%s", qPrintable(QCoreApplication::translate("GpuProfiler", "Cannot write %1: %2").arg(_fileName).arg(file.errorString())));
+    }
+}
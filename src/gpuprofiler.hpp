@@ -0,0 +1,149 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QString>
+
+
+/* Measures the GPU time of the stages of the render pipeline with timestamp
+ * queries. Timestamps are used instead of GL_TIME_ELAPSED queries because
+ * those cannot be nested, and the QualityGovernor already brackets each
+ * frame with one.
+ * The queries of each frame go into one of a ring of SlotCount query slots,
+ * and the results of a frame are read when its slot comes round again. A
+ * slot is only reused once its results are available: if the GPU is more
+ * than SlotCount frames behind, the frame is skipped instead of waited for,
+ * so that profiling never stalls the pipeline and no results are lost.
+ * The CPU time that the render thread spends in each stage is measured, too.
+ * Per stage, the minimum, mean and 99th percentile of the GPU time per frame
+ * and the mean CPU time are computed over a rolling window of frames. If
+ * profiling was requested on the command line, they are logged periodically
+ * and at exit, and can be written to a JSON file. The performance overlay
+ * enables profiling while it is visible.
+ * When profiling is disabled, all functions return immediately.
+ * Apart from the constructor, destructor and statistics functions, all
+ * functions must be called with the OpenGL context current. */
+
+class GpuProfiler : protected QOpenGLExtraFunctions
+{
+public:
+    enum Stage {
+        Stage_Frame,            // all GPU work of the frame
+        Stage_Upload,           // plane texture upload
+        Stage_Color,            // conversion to linear RGB (_colorPrg)
+        Stage_FrameMipmaps,     // mipmap generation for the frame textures
+        Stage_View,             // rendering of a view (_viewPrg)
+        Stage_ViewMipmaps,      // mipmap generation for the view textures
+        Stage_Display,          // composition of the views (_displayPrg)
+        Stage_VRDevices,        // rendering of VR device models
+        StageCount
+    };
+
+    class Statistics
+    {
+    public:
+        int frames;             // number of frames in the window in which the stage ran
+        double minMs, meanMs, p99Ms;
+        double cpuMeanMs;
+    };
+
+private:
+    static const int SlotCount = 4;
+
+    // glQueryCounter and glGetQueryObjectui64v are not part of QOpenGLExtraFunctions
+    typedef void (QOPENGLF_APIENTRYP QueryCounterFunc)(GLuint id, GLenum target);
+    typedef void (QOPENGLF_APIENTRYP GetQueryObjectui64vFunc)(GLuint id, GLenum pname, GLuint64* params);
+
+    class FrameSlot
+    {
+    public:
+        class Record
+        {
+        public:
+            Stage stage;
+            int beginQuery;
+            int endQuery;
+            qint64 cpuNsecs;
+        };
+        QVector<unsigned int> queries;  // allocated as needed
+        int used;                       // number of queries issued in this frame
+        QVector<Record> records;
+        bool pending;                   // whether results still need to be read
+    };
+
+    bool _requested;                // whether profiling was requested on the command line
+    bool _enabled;
+    QString _fileName;              // for the JSON dump at exit; may be empty
+    bool _initialized;              // whether queries are available in the current context
+    QElapsedTimer _cpuTimer;
+    QueryCounterFunc _queryCounter;
+    GetQueryObjectui64vFunc _getQueryObjectui64v;
+    FrameSlot _slots[SlotCount];
+    int _slot;                      // slot of the current frame
+    bool _frameActive;
+    int _openQuery[StageCount];     // begin query of running stages, or -1
+    qint64 _openCpu[StageCount];    // CPU time at the begin of running stages
+    // rolling window of GPU and CPU times per frame, in milliseconds
+    QVector<float> _samples[StageCount];
+    QVector<float> _cpuSamples[StageCount];
+    int _nextSample[StageCount];
+    qint64 _stageFrames[StageCount]; // total number of frames in which the stage ran
+    qint64 _measuredFrames;
+    qint64 _skippedFrames;          // frames not measured because no slot was free
+
+    int timestamp();
+    bool collect(FrameSlot& slot);
+    void logStatistics() const;
+    void writeFile() const;
+
+public:
+    GpuProfiler(bool enabled, const QString& fileName);
+    ~GpuProfiler();
+
+    static GpuProfiler* instance();
+
+    static const char* stageName(Stage stage);
+
+    bool isEnabled() const;
+    // Enable or disable profiling at runtime. Profiling that was requested
+    // on the command line stays enabled.
+    void setEnabled(bool enabled);
+
+    void initialize();
+    void cleanup();
+
+    // Bracket one frame, and the stages within a frame. Stages outside of a
+    // frame are not measured. A stage that runs more than once per frame (e.g.
+    // one view per eye) is summed up.
+    void beginFrame();
+    void endFrame();
+    void begin(Stage stage);
+    void end(Stage stage);
+
+    // Statistics over the rolling window
+    Statistics statistics(Stage stage) const;
+    // Copy the GPU times of the most recent frames in which the stage ran,
+    // oldest first, and return their number
+    int history(Stage stage, float* gpuMs, int maxCount) const;
+};
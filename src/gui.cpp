@@ -32,6 +32,7 @@
 #include <QComboBox>
 #include <QActionGroup>
 #include <QMimeData>
+#include <QElapsedTimer>
 
 #include "gui.hpp"
 #include "playlist.hpp"
@@ -54,12 +55,45 @@ void Gui::addBinoAction(QAction* action, QMenu* menu)
     _widget->addAction(action);
 }
 
+OutputMode Gui::widgetOutputMode() const
+{
+    return _glWidget ? _glWidget->outputMode()
+        : _directWindow ? _directWindow->outputMode()
+        : _softwareWidget->outputMode();
+}
+
+void Gui::setWidgetOutputMode(OutputMode mode)
+{
+    if (_glWidget)
+        _glWidget->setOutputMode(mode);
+    else if (_directWindow)
+        _directWindow->setOutputMode(mode);
+    else
+        _softwareWidget->setOutputMode(mode);
+}
+
+void Gui::updateWidget()
+{
+    // the window container does not repaint the window it contains
+    if (_directWindow)
+        _directWindow->update();
+    else
+        _widget->update();
+}
+
 static Gui* GuiSingleton = nullptr;
 
-Gui::Gui(OutputMode outputMode, bool fullscreen) :
+Gui::Gui(OutputMode outputMode, bool fullscreen, bool softwareRendering, bool directOutput) :
     QMainWindow(),
-    _widget(new Widget(outputMode, this)),
-    _contextMenu(new QMenu(this))
+    _glWidget(softwareRendering || directOutput ? nullptr : new Widget(outputMode, this)),
+    _directWindow(softwareRendering || !directOutput ? nullptr : new DirectWindow(outputMode)),
+    _softwareWidget(softwareRendering ? new SoftwareWidget(outputMode, this) : nullptr),
+    _widget(_glWidget ? static_cast<QWidget*>(_glWidget)
+            : _directWindow ? QWidget::createWindowContainer(_directWindow, this)
+            : _softwareWidget),
+    _contextMenu(new QMenu(this)),
+    _trackMenuIsValid(false),
+    _hudTimer(new QTimer(this))
 {
     setWindowTitle("Bino");
     QPixmap icon;
@@ -414,6 +448,14 @@ Gui::Gui(OutputMode outputMode, bool fullscreen) :
     _mediaSeekBwd10MinsAction->setShortcuts({ Qt::Key_PageDown });
     connect(_mediaSeekBwd10MinsAction, SIGNAL(triggered()), this, SLOT(mediaSeekBwd10Mins()));
     addBinoAction(_mediaSeekBwd10MinsAction, mediaMenu);
+    _mediaStepFwdAction = new QAction(tr("Step one frame forward (image sequences, raw video)"), this);
+    _mediaStepFwdAction->setShortcuts({ Qt::Key_BracketRight });
+    connect(_mediaStepFwdAction, SIGNAL(triggered()), this, SLOT(mediaStepFwd()));
+    addBinoAction(_mediaStepFwdAction, mediaMenu);
+    _mediaStepBwdAction = new QAction(tr("Step one frame backwards (image sequences, raw video)"), this);
+    _mediaStepBwdAction->setShortcuts({ Qt::Key_BracketLeft });
+    connect(_mediaStepBwdAction, SIGNAL(triggered()), this, SLOT(mediaStepBwd()));
+    addBinoAction(_mediaStepBwdAction, mediaMenu);
 
     QMenu* viewMenu = addBinoMenu(tr("&View"));
     _viewToggleFullscreenAction = new QAction(tr("&Fullscreen"), this);
@@ -426,6 +468,15 @@ Gui::Gui(OutputMode outputMode, bool fullscreen) :
     _viewToggleSwapEyesAction->setCheckable(true);
     connect(_viewToggleSwapEyesAction, SIGNAL(triggered()), this, SLOT(viewToggleSwapEyes()));
     addBinoAction(_viewToggleSwapEyesAction, viewMenu);
+    _viewToggleHudAction = new QAction(tr("&Performance overlay"), this);
+    _viewToggleHudAction->setShortcuts({ Qt::Key_F3 });
+    _viewToggleHudAction->setCheckable(true);
+    _viewToggleHudAction->setEnabled(!_softwareWidget);
+    connect(_viewToggleHudAction, SIGNAL(triggered()), this, SLOT(viewToggleHud()));
+    addBinoAction(_viewToggleHudAction, viewMenu);
+    _hudTimer->setInterval(250);
+    connect(_hudTimer, &QTimer::timeout, [=]() { updateWidget(); });
+    connect(Bino::instance(), &Bino::toggleHud, [=]() { if (!_softwareWidget) _viewToggleHudAction->trigger(); });
 
     QMenu* helpMenu = addBinoMenu(tr("&Help"));
     QAction* helpAboutAction = new QAction(tr("&About..."), this);
@@ -434,8 +485,15 @@ Gui::Gui(OutputMode outputMode, bool fullscreen) :
 
     updateActions();
     connect(Bino::instance(), SIGNAL(stateChanged()), this, SLOT(updateActions()));
+    connect(Bino::instance(), SIGNAL(tracksChanged()), this, SLOT(invalidateTrackMenu()));
 
-    connect(_widget, SIGNAL(toggleFullscreen()), this, SLOT(viewToggleFullscreen()));
+    if (_directWindow) {
+        connect(_directWindow, SIGNAL(toggleFullscreen()), this, SLOT(viewToggleFullscreen()));
+        connect(_directWindow, &DirectWindow::contextMenuRequested, [=](const QPoint& pos) { _contextMenu->exec(pos); });
+        _widget->setFocusPolicy(Qt::StrongFocus);
+    } else {
+        connect(_widget, SIGNAL(toggleFullscreen()), this, SLOT(viewToggleFullscreen()));
+    }
     setCentralWidget(_widget);
     _widget->show();
 
@@ -639,7 +697,7 @@ void Gui::threeDSurround()
     QAction* a = _3dSurroundActionGroup->checkedAction();
     if (a) {
         Bino::instance()->setSurroundMode(static_cast<SurroundMode>(a->data().toInt()));
-        _widget->update();
+        updateWidget();
     }
 }
 
@@ -648,7 +706,7 @@ void Gui::threeDInput()
     QAction* a = _3dInputActionGroup->checkedAction();
     if (a) {
         Bino::instance()->setInputMode(static_cast<InputMode>(a->data().toInt()));
-        _widget->update();
+        updateWidget();
     }
 }
 
@@ -656,8 +714,8 @@ void Gui::threeDOutput()
 {
     QAction* a = _3dOutputActionGroup->checkedAction();
     if (a) {
-        _widget->setOutputMode(static_cast<OutputMode>(a->data().toInt()));
-        _widget->update();
+        setWidgetOutputMode(static_cast<OutputMode>(a->data().toInt()));
+        updateWidget();
     }
 }
 
@@ -721,6 +779,16 @@ void Gui::mediaSeekBwd10Mins()
     Bino::instance()->seek(-600000);
 }
 
+void Gui::mediaStepFwd()
+{
+    Bino::instance()->step(+1);
+}
+
+void Gui::mediaStepBwd()
+{
+    Bino::instance()->step(-1);
+}
+
 void Gui::viewToggleFullscreen()
 {
     if (windowState() & Qt::WindowFullScreen) {
@@ -737,7 +805,20 @@ void Gui::viewToggleFullscreen()
 void Gui::viewToggleSwapEyes()
 {
     Bino::instance()->toggleSwapEyes();
-    _widget->update();
+    updateWidget();
+}
+
+void Gui::viewToggleHud()
+{
+    bool visible = _viewToggleHudAction->isChecked();
+    if (_glWidget)
+        _glWidget->setHudVisible(visible);
+    else if (_directWindow)
+        _directWindow->setHudVisible(visible);
+    if (visible)
+        _hudTimer->start();
+    else
+        _hudTimer->stop();
 }
 
 void Gui::helpAbout()
@@ -757,18 +838,35 @@ void Gui::helpAbout()
             + QString("</p>"));
 }
 
-void Gui::updateActions()
+// Returns false if the track information could not be determined
+bool Gui::rebuildTrackMenu(const QUrl& url)
 {
-    LOG_DEBUG("updating Gui menu state");
-
-    _viewToggleSwapEyesAction->setChecked(Bino::instance()->swapEyes());
-    _mediaTogglePauseAction->setChecked(Bino::instance()->paused());
-    _mediaToggleVolumeMuteAction->setChecked(Bino::instance()->muted());
-
+    LOG_DEBUG("rebuilding Gui track menu");
+
+    // Remove the old track actions. Deleting them also removes them from their
+    // action group and from the widget; separators are owned by the menu.
+    QList<QAction*> oldActions;
+    for (int i = 0; i < _trackMenu->actions().size(); i++) {
+        QAction* a = _trackMenu->actions()[i];
+        if (!a->isSeparator())
+            oldActions.append(a);
+    }
     _trackMenu->clear();
-    QUrl url = Bino::instance()->url();
+    qDeleteAll(oldActions);
+
     MetaData metaData;
-    if (!url.isEmpty() && metaData.detectCached(url)) {
+    // still images, image sequences and raw video have no tracks, so do not bother probing them
+    bool haveTracks = (!url.isEmpty() && !ImageSource::isImage(url) && !ImageSequence::isSequence(url) && !RawVideo::isRawVideo(url));
+    bool probeFailed = false;
+    if (haveTracks) {
+        // prefer the track lists of the playing media player: they can be more
+        // complete than those of an earlier probe
+        if (url != Bino::instance()->url() || !Bino::instance()->playerTracks(
+                    &metaData.videoTracks, &metaData.audioTracks, &metaData.subtitleTracks)) {
+            probeFailed = !metaData.detectCached(url);
+        }
+    }
+    if (haveTracks && !probeFailed) {
         for (int i = 0; i < metaData.videoTracks.size(); i++) {
             QString s = QString(tr("Video track %1")).arg(i + 1);
             QLocale::Language l = static_cast<QLocale::Language>(metaData.videoTracks[i].value(QMediaMetaData::Language).toInt());
@@ -779,7 +877,6 @@ void Gui::updateActions()
             _trackVideoActionGroup->addAction(a)->setData(i);
             connect(a, SIGNAL(triggered()), this, SLOT(trackVideo()));
             addBinoAction(a, _trackMenu);
-            a->setChecked(Bino::instance()->videoTrack() == i);
         }
         if (metaData.videoTracks.size() > 0)
             _trackMenu->addSeparator();
@@ -793,7 +890,6 @@ void Gui::updateActions()
             _trackAudioActionGroup->addAction(a)->setData(i);
             connect(a, SIGNAL(triggered()), this, SLOT(trackAudio()));
             addBinoAction(a, _trackMenu);
-            a->setChecked(Bino::instance()->audioTrack() == i);
         }
         if (metaData.subtitleTracks.size() > 0) {
             if (metaData.audioTracks.size() > 0 || metaData.videoTracks.size() > 0)
@@ -803,7 +899,6 @@ void Gui::updateActions()
             _trackSubtitleActionGroup->addAction(a)->setData(-1);
             connect(a, SIGNAL(triggered()), this, SLOT(trackSubtitle()));
             addBinoAction(a, _trackMenu);
-            a->setChecked(Bino::instance()->subtitleTrack() < 0);
             for (int i = 0; i < metaData.subtitleTracks.size(); i++) {
                 QString s = QString(tr("Subtitle track %1")).arg(i + 1);
                 QLocale::Language l = static_cast<QLocale::Language>(metaData.subtitleTracks[i].value(QMediaMetaData::Language).toInt());
@@ -814,7 +909,6 @@ void Gui::updateActions()
                 _trackSubtitleActionGroup->addAction(a)->setData(i);
                 connect(a, SIGNAL(triggered()), this, SLOT(trackSubtitle()));
                 addBinoAction(a, _trackMenu);
-                a->setChecked(Bino::instance()->subtitleTrack() == i);
             }
         }
     } else {
@@ -822,6 +916,39 @@ void Gui::updateActions()
         a->setEnabled(false);
         addBinoAction(a, _trackMenu);
     }
+    return !probeFailed;
+}
+
+void Gui::updateActions()
+{
+    LOG_DEBUG("updating Gui menu state");
+    QElapsedTimer timer;
+    timer.start();
+
+    _viewToggleSwapEyesAction->setChecked(Bino::instance()->swapEyes());
+    _mediaTogglePauseAction->setChecked(Bino::instance()->paused());
+    _mediaToggleVolumeMuteAction->setChecked(Bino::instance()->muted());
+
+    QUrl url = Bino::instance()->url();
+    if (!_trackMenuIsValid || url != _trackMenuUrl) {
+        _trackMenuIsValid = rebuildTrackMenu(url);
+        _trackMenuUrl = url;
+    }
+    int videoTrack = Bino::instance()->videoTrack();
+    for (int i = 0; i < _trackVideoActionGroup->actions().size(); i++) {
+        QAction* a = _trackVideoActionGroup->actions()[i];
+        a->setChecked(a->data().toInt() == videoTrack);
+    }
+    int audioTrack = Bino::instance()->audioTrack();
+    for (int i = 0; i < _trackAudioActionGroup->actions().size(); i++) {
+        QAction* a = _trackAudioActionGroup->actions()[i];
+        a->setChecked(a->data().toInt() == audioTrack);
+    }
+    int subtitleTrack = qMax(Bino::instance()->subtitleTrack(), -1);
+    for (int i = 0; i < _trackSubtitleActionGroup->actions().size(); i++) {
+        QAction* a = _trackSubtitleActionGroup->actions()[i];
+        a->setChecked(a->data().toInt() == subtitleTrack);
+    }
     _trackVideoActionGroup->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
     _trackAudioActionGroup->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
     _trackSubtitleActionGroup->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
@@ -846,10 +973,11 @@ void Gui::updateActions()
         QAction* a = _3dOutputActionGroup->actions()[i];
         if (Bino::instance()->assumeStereoInputMode()) {
             a->setEnabled(true);
-            a->setChecked(a->data().toInt() == int(_widget->outputMode()));
+            a->setChecked(a->data().toInt() == int(widgetOutputMode()));
             OutputMode outputMode = static_cast<OutputMode>(a->data().toInt());
             if (outputMode == Output_OpenGL_Stereo)
-                a->setEnabled(_widget->isOpenGLStereo());
+                a->setEnabled((_glWidget && _glWidget->isOpenGLStereo())
+                        || (_directWindow && _directWindow->isOpenGLStereo()));
         } else {
             a->setEnabled(false);
             a->setChecked(false);
@@ -865,14 +993,23 @@ void Gui::updateActions()
     _mediaSeekBwd1MinAction->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
     _mediaSeekFwd10MinsAction->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
     _mediaSeekBwd10MinsAction->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
+    _mediaStepFwdAction->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
+    _mediaStepBwdAction->setEnabled(Bino::instance()->playlistMode() && !Bino::instance()->stopped());
 
-    _widget->update();
+    updateWidget();
+    LOG_DEBUG("updating Gui menu state took %g ms", timer.nsecsElapsed() / 1e6);
 }
 
 void Gui::setOutputMode(OutputMode mode)
 {
-    _widget->setOutputMode(mode);
-    _widget->update();
+    setWidgetOutputMode(mode);
+    updateWidget();
+}
+
+void Gui::invalidateTrackMenu()
+{
+    _trackMenuIsValid = false;
+    updateActions();
 }
 
 void Gui::setFullscreen(bool f)
@@ -917,9 +1054,9 @@ void Gui::contextMenuEvent(QContextMenuEvent* event)
 
 void Gui::moveEvent(QMoveEvent*)
 {
-    if (_widget->outputMode() == Output_Even_Odd_Rows
-            || _widget->outputMode() == Output_Even_Odd_Columns
-            || _widget->outputMode() == Output_Checkerboard) {
-        _widget->update();
+    if (widgetOutputMode() == Output_Even_Odd_Rows
+            || widgetOutputMode() == Output_Even_Odd_Columns
+            || widgetOutputMode() == Output_Checkerboard) {
+        updateWidget();
     }
 }
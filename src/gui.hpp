@@ -21,9 +21,13 @@
 #pragma once
 
 #include <QMainWindow>
+#include <QTimer>
+#include <QUrl>
 
 #include "modes.hpp"
 #include "widget.hpp"
+#include "directwindow.hpp"
+#include "softwarewidget.hpp"
 
 
 class Gui : public QMainWindow
@@ -31,7 +35,10 @@ class Gui : public QMainWindow
 Q_OBJECT
 
 private:
-    Widget* _widget;
+    Widget* _glWidget;                  // null if rendering in software or directly
+    DirectWindow* _directWindow;        // null unless rendering directly into a window
+    SoftwareWidget* _softwareWidget;    // null if rendering with OpenGL
+    QWidget* _widget;                   // the one that is used (or the container of the window)
 
     QMenu* _contextMenu;
 
@@ -40,6 +47,8 @@ private:
     QActionGroup* _trackVideoActionGroup;
     QActionGroup* _trackAudioActionGroup;
     QActionGroup* _trackSubtitleActionGroup;
+    QUrl _trackMenuUrl;        // the URL for which the track menu was built
+    bool _trackMenuIsValid;    // false if the menu must be rebuilt, e.g. after a failed probe
     QActionGroup* _3dSurroundActionGroup;
     QActionGroup* _3dInputActionGroup;
     QActionGroup* _3dOutputActionGroup;
@@ -55,11 +64,19 @@ private:
     QAction* _mediaSeekBwd1MinAction;
     QAction* _mediaSeekFwd10MinsAction;
     QAction* _mediaSeekBwd10MinsAction;
+    QAction* _mediaStepFwdAction;
+    QAction* _mediaStepBwdAction;
     QAction* _viewToggleFullscreenAction;
     QAction* _viewToggleSwapEyesAction;
+    QAction* _viewToggleHudAction;
+    QTimer* _hudTimer;          // refreshes the performance overlay while nothing else changes
 
     QMenu* addBinoMenu(const QString& title);
     void addBinoAction(QAction* action, QMenu* menu);
+    bool rebuildTrackMenu(const QUrl& url);
+    OutputMode widgetOutputMode() const;
+    void setWidgetOutputMode(OutputMode mode);
+    void updateWidget();
 
 public slots:
     void fileOpen();
@@ -90,11 +107,15 @@ public slots:
     void mediaSeekBwd1Min();
     void mediaSeekFwd10Mins();
     void mediaSeekBwd10Mins();
+    void mediaStepFwd();
+    void mediaStepBwd();
     void viewToggleFullscreen();
     void viewToggleSwapEyes();
+    void viewToggleHud();
     void helpAbout();
 
     void updateActions();
+    void invalidateTrackMenu();
 
 protected:
     virtual void dragEnterEvent(QDragEnterEvent*) override;
@@ -105,7 +126,7 @@ protected:
     virtual void moveEvent(QMoveEvent*) override;
 
 public:
-    Gui(OutputMode outputMode, bool fullscreen);
+    Gui(OutputMode outputMode, bool fullscreen, bool softwareRendering = false, bool directOutput = false);
 
     static Gui* instance();
 
@@ -0,0 +1,349 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QOpenGLContext>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QImage>
+#include <QVector2D>
+
+#include "hud.hpp"
+#include "bino.hpp"
+#include "gpuprofiler.hpp"
+#include "alternatingscheduler.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+static const qint64 PeriodNsecs = 500000000; // the numbers are updated twice per second
+static const int AtlasColumns = 16;
+static const int AtlasRows = 6;             // ASCII 32 to 126, plus a solid cell for rectangles
+static const int SolidCell = AtlasColumns * AtlasRows - 1;
+static const int Margin = 8;                // distance to the surface border and between elements
+static const int GraphHeight = 48;
+static const float GraphMaxMs = 50.0f;
+
+static const float textColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+static const float labelColor[4] = { 0.7f, 0.7f, 0.7f, 1.0f };
+static const float backgroundColor[4] = { 0.0f, 0.0f, 0.0f, 0.6f };
+static const float graphBackgroundColor[4] = { 0.2f, 0.2f, 0.2f, 0.6f };
+static const float graphGridColor[4] = { 0.5f, 0.5f, 0.5f, 0.6f };
+static const float graphBarColor[4] = { 0.3f, 0.9f, 0.3f, 0.9f };
+
+Hud::Hud() :
+    _initialized(false),
+    _atlasTex(0),
+    _atlasWidth(0),
+    _atlasHeight(0),
+    _glyphWidth(0),
+    _glyphHeight(0),
+    _vao(0),
+    _vbo(0),
+    _baseFramesReceived(0),
+    _baseFramesRepeated(0),
+    _framesShown(0),
+    _periodStart(0),
+    _periodPresents(0),
+    _periodFramesReceived(0),
+    _periodBytesUploaded(0),
+    _lastSwap(-1),
+    _intervalCount(0),
+    _nextInterval(0)
+{
+    _timer.start();
+}
+
+void Hud::reset()
+{
+    _baseFramesReceived = Bino::instance()->framesReceived();
+    _baseFramesRepeated = Bino::instance()->framesRepeated();
+    _framesShown = 0;
+    _periodStart = _timer.nsecsElapsed();
+    _periodPresents = 0;
+    _periodFramesReceived = _baseFramesReceived;
+    _periodBytesUploaded = Bino::instance()->bytesUploaded();
+    _lastSwap = -1;
+    _intervalCount = 0;
+    _nextInterval = 0;
+    _lines.clear();
+    _lines.append("measuring...");
+}
+
+void Hud::initialize()
+{
+    initializeOpenGLFunctions();
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+
+    // Shader program
+    QString vertexShaderSource = readFile(":src/shader-hud.vert.glsl");
+    QString fragmentShaderSource = readFile(":src/shader-hud.frag.glsl");
+    if (isGLES) {
+        vertexShaderSource.prepend("#version 320 es\n");
+        fragmentShaderSource.prepend("#version 320 es\n"
+                "precision mediump float;\n");
+    } else {
+        vertexShaderSource.prepend("#version 330\n");
+        fragmentShaderSource.prepend("#version 330\n");
+    }
+    _prg.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+    _prg.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
+    _prg.link();
+
+    // Glyph atlas: one cell per printable ASCII character in a fixed width font
+    QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    font.setPixelSize(14);
+    QFontMetrics metrics(font);
+    _glyphWidth = metrics.horizontalAdvance(QLatin1Char('M'));
+    _glyphHeight = metrics.height();
+    _atlasWidth = AtlasColumns * _glyphWidth;
+    _atlasHeight = AtlasRows * _glyphHeight;
+    QImage image(_atlasWidth, _atlasHeight, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    for (int c = 32; c < 127; c++) {
+        int cell = c - 32;
+        painter.drawText((cell % AtlasColumns) * _glyphWidth,
+                (cell / AtlasColumns) * _glyphHeight + metrics.ascent(),
+                QString(QLatin1Char(char(c))));
+    }
+    painter.fillRect((SolidCell % AtlasColumns) * _glyphWidth, (SolidCell / AtlasColumns) * _glyphHeight,
+            _glyphWidth, _glyphHeight, Qt::white);
+    painter.end();
+    // the scan lines of Format_Alpha8 are 4-byte aligned, which matches GL_UNPACK_ALIGNMENT
+    QImage coverage = image.convertToFormat(QImage::Format_Alpha8);
+    glGenTextures(1, &_atlasTex);
+    glBindTexture(GL_TEXTURE_2D, _atlasTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, _atlasWidth, _atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, coverage.constBits());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    // Vertex buffer, refilled for each frame
+    glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(0));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(4 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    CHECK_GL();
+
+    LOG_DEBUG("performance overlay: %dx%d glyph atlas with %dx%d cells",
+            _atlasWidth, _atlasHeight, _glyphWidth, _glyphHeight);
+    _initialized = true;
+}
+
+void Hud::cleanup()
+{
+    if (!_initialized)
+        return;
+    glDeleteTextures(1, &_atlasTex);
+    glDeleteBuffers(1, &_vbo);
+    glDeleteVertexArrays(1, &_vao);
+    _prg.removeAllShaders();
+    _initialized = false;
+}
+
+void Hud::paintStarted(bool newFrame)
+{
+    if (newFrame)
+        _framesShown++;
+}
+
+void Hud::swapped()
+{
+    qint64 now = _timer.nsecsElapsed();
+    _periodPresents++;
+    if (_lastSwap >= 0) {
+        _intervals[_nextInterval] = (now - _lastSwap) / 1e6f;
+        _nextInterval = (_nextInterval + 1) % HistoryLength;
+        _intervalCount = qMin(_intervalCount + 1, HistoryLength);
+    }
+    _lastSwap = now;
+}
+
+void Hud::addQuad(float x, float y, float w, float h, float s0, float t0, float s1, float t1, const float* color)
+{
+    const float corners[6][4] = {
+        { x,     y,     s0, t0 }, { x + w, y,     s1, t0 }, { x + w, y + h, s1, t1 },
+        { x,     y,     s0, t0 }, { x + w, y + h, s1, t1 }, { x,     y + h, s0, t1 }
+    };
+    for (int i = 0; i < 6; i++) {
+        _vertices.append(corners[i][0]);
+        _vertices.append(corners[i][1]);
+        _vertices.append(corners[i][2]);
+        _vertices.append(corners[i][3]);
+        _vertices.append(color[0]);
+        _vertices.append(color[1]);
+        _vertices.append(color[2]);
+        _vertices.append(color[3]);
+    }
+}
+
+void Hud::addRect(float x, float y, float w, float h, const float* color)
+{
+    // sample the center of the solid cell
+    float s = ((SolidCell % AtlasColumns) + 0.5f) * _glyphWidth / _atlasWidth;
+    float t = ((SolidCell / AtlasColumns) + 0.5f) * _glyphHeight / _atlasHeight;
+    addQuad(x, y, w, h, s, t, s, t, color);
+}
+
+void Hud::addText(float x, float y, const QString& text, const float* color)
+{
+    for (int i = 0; i < text.length(); i++) {
+        int c = text[i].unicode();
+        if (c == ' ')
+            continue;
+        if (c < 32 || c >= 127)
+            c = '?';
+        int cell = c - 32;
+        float s0 = float((cell % AtlasColumns) * _glyphWidth) / _atlasWidth;
+        float t0 = float((cell / AtlasColumns) * _glyphHeight) / _atlasHeight;
+        float s1 = s0 + float(_glyphWidth) / _atlasWidth;
+        float t1 = t0 + float(_glyphHeight) / _atlasHeight;
+        addQuad(x + i * _glyphWidth, y, _glyphWidth, _glyphHeight, s0, t0, s1, t1, color);
+    }
+}
+
+void Hud::addGraph(float x, float y, float w, float h, const QString& label,
+        const float* valuesMs, int count, float maxMs)
+{
+    addText(x, y, label, labelColor);
+    y += _glyphHeight;
+    addRect(x, y, w, h, graphBackgroundColor);
+    // grid lines every 10 ms
+    for (float ms = 10.0f; ms < maxMs; ms += 10.0f)
+        addRect(x, y + h - h * ms / maxMs, w, 1.0f, graphGridColor);
+    // one bar per value, the newest at the right
+    float barWidth = w / HistoryLength;
+    for (int i = 0; i < count; i++) {
+        float barHeight = h * qMin(valuesMs[i], maxMs) / maxMs;
+        addRect(x + w - (count - i) * barWidth, y + h - barHeight, barWidth, barHeight, graphBarColor);
+    }
+}
+
+void Hud::updateLines(double textureMiB, const AlternatingScheduler* scheduler)
+{
+    qint64 now = _timer.nsecsElapsed();
+    double seconds = (now - _periodStart) / 1e9;
+    unsigned long long framesReceived = Bino::instance()->framesReceived();
+    unsigned long long bytesUploaded = Bino::instance()->bytesUploaded();
+    unsigned long long received = framesReceived - _baseFramesReceived;
+    unsigned long long repeated = Bino::instance()->framesRepeated() - _baseFramesRepeated;
+    // new frames that never reached the screen; one frame may still be on its way
+    long long dropped = qMax(0LL, static_cast<long long>(received - repeated) - _framesShown - 1);
+
+    _lines.clear();
+    _lines.append(QString::asprintf("presented %6.1f fps   source %6.1f fps",
+                _periodPresents / seconds, (framesReceived - _periodFramesReceived) / seconds));
+    _lines.append(QString::asprintf("dropped %8lld       repeated %8llu", dropped, repeated));
+    _lines.append(QString::asprintf("upload %7.1f MB/s    textures %6.1f MiB",
+                (bytesUploaded - _periodBytesUploaded) / 1e6 / seconds, textureMiB));
+    qint64 avOffset;
+    if (Bino::instance()->avOffset(&avOffset))
+        _lines.append(QString::asprintf("A/V offset %+6lld ms", static_cast<long long>(avOffset)));
+    else
+        _lines.append("A/V offset     n/a");
+    if (scheduler) {
+        _lines.append(QString::asprintf("alternating: missed %6llu  phase err %4llu",
+                    scheduler->missedRefreshes(), scheduler->phaseErrors()));
+        _lines.append(QString::asprintf("  refresh count from %s",
+                    scheduler->usesSyncValues() ? "OML sync values" : "swap timing"));
+    }
+    _lines.append(QString());
+    _lines.append("stage          CPU ms   GPU ms  GPU p99");
+    bool haveStages = false;
+    for (int s = 0; s < GpuProfiler::StageCount; s++) {
+        GpuProfiler::Stage stage = GpuProfiler::Stage(s);
+        GpuProfiler::Statistics stat = GpuProfiler::instance()->statistics(stage);
+        if (stat.frames == 0)
+            continue;
+        _lines.append(QString::asprintf("%-13s %7.2f  %7.2f  %7.2f",
+                    GpuProfiler::stageName(stage), stat.cpuMeanMs, stat.meanMs, stat.p99Ms));
+        haveStages = true;
+    }
+    if (!haveStages)
+        _lines.append("(no GPU timer queries)");
+
+    _periodStart = now;
+    _periodPresents = 0;
+    _periodFramesReceived = framesReceived;
+    _periodBytesUploaded = bytesUploaded;
+}
+
+void Hud::prepare(double textureMiB, const AlternatingScheduler* scheduler)
+{
+    if (!_initialized)
+        initialize();
+    if (_timer.nsecsElapsed() - _periodStart >= PeriodNsecs)
+        updateLines(textureMiB, scheduler);
+
+    int columns = 0;
+    for (int i = 0; i < _lines.size(); i++)
+        columns = qMax(columns, int(_lines[i].length()));
+    float graphWidth = 2 * HistoryLength;
+    float contentWidth = qMax(columns * _glyphWidth, int(graphWidth));
+    float contentHeight = _lines.size() * _glyphHeight
+        + 2 * (Margin + _glyphHeight + GraphHeight);
+    float x = Margin + Margin;
+    float y = Margin + Margin;
+
+    _vertices.clear();
+    addRect(Margin, Margin, contentWidth + 2 * Margin, contentHeight + 2 * Margin, backgroundColor);
+    for (int i = 0; i < _lines.size(); i++) {
+        addText(x, y, _lines[i], textColor);
+        y += _glyphHeight;
+    }
+    y += Margin;
+    float values[HistoryLength];
+    for (int i = 0; i < _intervalCount; i++)
+        values[i] = _intervals[(_nextInterval - _intervalCount + i + HistoryLength) % HistoryLength];
+    addGraph(x, y, graphWidth, GraphHeight, QString::asprintf("frame interval, 0-%g ms", GraphMaxMs),
+            values, _intervalCount, GraphMaxMs);
+    y += _glyphHeight + GraphHeight + Margin;
+    int count = GpuProfiler::instance()->history(GpuProfiler::Stage_Frame, values, HistoryLength);
+    addGraph(x, y, graphWidth, GraphHeight, QString::asprintf("GPU frame time, 0-%g ms", GraphMaxMs),
+            values, count, GraphMaxMs);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(float), _vertices.constData(), GL_STREAM_DRAW);
+}
+
+void Hud::draw(int width, int height)
+{
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(_prg.programId());
+    _prg.setUniformValue("surface_size", QVector2D(width, height));
+    _prg.setUniformValue("atlas", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _atlasTex);
+    glBindVertexArray(_vao);
+    glDrawArrays(GL_TRIANGLES, 0, _vertices.size() / 8);
+    glDisable(GL_BLEND);
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVector>
+
+class AlternatingScheduler;
+
+
+/* An on-screen overlay with performance data: presented and source frame
+ * rates, dropped and repeated frames, upload rate, texture memory, A/V offset,
+ * the CPU and GPU times of the render stages as measured by GpuProfiler, and
+ * graphs of the recent frame intervals and GPU frame times.
+ * The text is drawn from a glyph atlas that is rendered once with QPainter;
+ * each frame only rebuilds a small vertex buffer with the glyph and graph
+ * quads, so that showing the overlay costs next to nothing. The numbers are
+ * updated twice per second to keep them readable.
+ * Apart from the constructor and reset(), all functions must be called with
+ * the OpenGL context current. */
+
+class Hud : protected QOpenGLExtraFunctions
+{
+private:
+    static const int HistoryLength = 120;
+
+    bool _initialized;
+    unsigned int _atlasTex;
+    int _atlasWidth, _atlasHeight;
+    int _glyphWidth, _glyphHeight;  // size of the glyph cells in pixels
+    QOpenGLShaderProgram _prg;
+    unsigned int _vao;
+    unsigned int _vbo;
+    QVector<float> _vertices;       // x, y, s, t, r, g, b, a per vertex
+
+    QElapsedTimer _timer;
+    // counters at the time of reset()
+    unsigned long long _baseFramesReceived, _baseFramesRepeated;
+    int _framesShown;               // new frames that reached the screen since reset()
+    // the current measurement period for the rates
+    qint64 _periodStart;
+    int _periodPresents;
+    unsigned long long _periodFramesReceived, _periodBytesUploaded;
+    // intervals between buffer swaps, in milliseconds
+    qint64 _lastSwap;
+    float _intervals[HistoryLength];
+    int _intervalCount, _nextInterval;
+    // the text, updated at the end of each period
+    QStringList _lines;
+
+    void initialize();
+    void addQuad(float x, float y, float w, float h, float s0, float t0, float s1, float t1, const float* color);
+    void addRect(float x, float y, float w, float h, const float* color);
+    void addText(float x, float y, const QString& text, const float* color);
+    void addGraph(float x, float y, float w, float h, const QString& label,
+            const float* valuesMs, int count, float maxMs);
+    void updateLines(double textureMiB, const AlternatingScheduler* scheduler);
+
+public:
+    Hud();
+
+    // Start new statistics, e.g. when the overlay becomes visible
+    void reset();
+    void cleanup();
+
+    // Call at the start of each paint, with Bino::frameIsNew()
+    void paintStarted(bool newFrame);
+    // Call after each buffer swap
+    void swapped();
+    // Build the overlay. The texture memory is that of the frame and view
+    // textures, in MiB. The scheduler is given while the output alternates
+    // between views, to show its statistics.
+    void prepare(double textureMiB, const AlternatingScheduler* scheduler = nullptr);
+    // Draw the prepared overlay into the current framebuffer
+    void draw(int width, int height);
+};
@@ -0,0 +1,388 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QImageReader>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+
+#include "imagesequence.hpp"
+#include "videoframe.hpp"
+#include "log.hpp"
+
+
+static const QRegularExpression numberPlaceholder("%(0?[0-9]*)d");
+static const int MaxDecodeAhead = 256;
+
+ImageSequence::ImageSequence(const QString& pattern, float fps, qint64 memoryBudget, QObject* parent) :
+    FrameSource(parent),
+    _pattern(pattern),
+    _stereo(pattern.contains("%v") || pattern.contains("%V")),
+    _fps(fps),
+    _memoryBudget(memoryBudget),
+    _firstFrame(0),
+    _frameCount(0),
+    _currentFrame(-1),
+    _playing(false),
+    _clockFrame(0),
+    _generation(0),
+    _frameBytes(0),
+    _showPending(false),
+    _statFramesShown(0),
+    _statLateFrames(0),
+    _statDecodeNsecs(0),
+    _statDecodedFrames(0),
+    _statWarned(false)
+{
+    _timer.setTimerType(Qt::PreciseTimer);
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, [=]() { tick(); });
+}
+
+ImageSequence::~ImageSequence()
+{
+    // the decoding tasks refer to this object
+    _threadPool.clear();
+    _threadPool.waitForDone();
+    logStatistics();
+}
+
+bool ImageSequence::isSequence(const QUrl& url)
+{
+    if (!url.isLocalFile())
+        return false;
+    QFileInfo fileInfo(url.toLocalFile());
+    return fileInfo.fileName().contains(numberPlaceholder) && !fileInfo.exists();
+}
+
+QString ImageSequence::fileName(int index, int view) const
+{
+    QString name = _pattern;
+    if (_stereo) {
+        name.replace("%v", view == 0 ? "L" : "R");
+        name.replace("%V", view == 0 ? "l" : "r");
+    }
+    QRegularExpressionMatch match;
+    int i = name.lastIndexOf(numberPlaceholder, -1, &match);
+    if (i >= 0) {
+        QString width = match.captured(1);
+        QString number = QString("%1").arg(_firstFrame + index, width.toInt(), 10,
+                width.startsWith('0') ? QLatin1Char('0') : QLatin1Char(' '));
+        name.replace(i, match.capturedLength(), number);
+    }
+    return name;
+}
+
+bool ImageSequence::open()
+{
+    // Find all frame numbers for which files of the first view exist
+    QString name = QFileInfo(_pattern).fileName();
+    if (_stereo) {
+        name.replace("%v", "L");
+        name.replace("%V", "l");
+    }
+    QRegularExpressionMatch match;
+    int i = name.lastIndexOf(numberPlaceholder, -1, &match);
+    if (i < 0)
+        return false;
+    QString width = match.captured(1);
+    QString numberRegExp = (width.startsWith('0') && width.toInt() > 0)
+        ? QString("([0-9]{%1,})").arg(width.toInt()) : QString("([0-9]+)");
+    QRegularExpression regExp(QRegularExpression::anchoredPattern(
+                QRegularExpression::escape(name.left(i))
+                + numberRegExp
+                + QRegularExpression::escape(name.mid(i + match.capturedLength()))));
+    QStringList entries = QDir(QFileInfo(_pattern).absolutePath()).entryList(QDir::Files);
+    int minNumber = -1;
+    int maxNumber = -1;
+    for (int j = 0; j < entries.size(); j++) {
+        QRegularExpressionMatch m = regExp.match(entries[j]);
+        if (m.hasMatch()) {
+            int number = m.captured(1).toInt();
+            if (minNumber < 0 || number < minNumber)
+                minNumber = number;
+            if (maxNumber < 0 || number > maxNumber)
+                maxNumber = number;
+        }
+    }
+    if (minNumber < 0) {
+        LOG_WARNING("%s", qPrintable(tr("%1: no matching files found").arg(_pattern)));
+        return false;
+    }
+    _firstFrame = minNumber;
+    _frameCount = maxNumber - minNumber + 1;
+    LOG_DEBUG("image sequence %s: %s, frames %d to %d at %g fps", qPrintable(_pattern),
+            _stereo ? "stereo" : "mono", minNumber, maxNumber, _fps);
+    seekToFrame(0);
+    return true;
+}
+
+QUrl ImageSequence::url() const
+{
+    return QUrl::fromLocalFile(_pattern);
+}
+
+bool ImageSequence::isStereo() const
+{
+    return _stereo;
+}
+
+bool ImageSequence::isPlaying() const
+{
+    return _playing;
+}
+
+bool ImageSequence::isFinished() const
+{
+    return !_playing && _frameCount > 0 && _currentFrame == _frameCount - 1;
+}
+
+float ImageSequence::fps() const
+{
+    return _fps;
+}
+
+int ImageSequence::frameCount() const
+{
+    return _frameCount;
+}
+
+int ImageSequence::currentFrame() const
+{
+    return _currentFrame;
+}
+
+qint64 ImageSequence::position() const
+{
+    return qMax(_currentFrame, 0) * 1000.0 / _fps;
+}
+
+qint64 ImageSequence::duration() const
+{
+    return _frameCount * 1000.0 / _fps;
+}
+
+void ImageSequence::play()
+{
+    if (_playing || _frameCount == 0)
+        return;
+    if (isFinished())
+        seekToFrame(0);
+    _playing = true;
+    resetClock();
+    scheduleTick();
+}
+
+void ImageSequence::pause()
+{
+    _playing = false;
+    _timer.stop();
+}
+
+void ImageSequence::seekToFrame(int index)
+{
+    if (_frameCount == 0)
+        return;
+    index = qBound(0, index, _frameCount - 1);
+    int last = index - 1 + decodeAhead();
+    if (_currentFrame >= 0 && qAbs(index - _currentFrame) <= decodeAhead()) {
+        // Nearby target, e.g. when stepping: keep the decoded frames that are
+        // still ahead. Pending decodes outside of the new window are
+        // discarded when they finish.
+        while (!_decoded.isEmpty() && _decoded.firstKey() < index)
+            _decoded.erase(_decoded.begin());
+        while (!_decoded.isEmpty() && _decoded.lastKey() > last)
+            _decoded.remove(_decoded.lastKey());
+    } else {
+        _generation++;
+        _threadPool.clear(); // remove decoding tasks that have not started yet
+        _decoded.clear();
+        _pending.clear();
+    }
+    _currentFrame = index - 1;
+    if (_decoded.contains(index)) {
+        _showPending = false;
+        showFrame(index);
+        resetClock();
+        scheduleTick();
+    } else {
+        _showPending = true;
+        scheduleDecoding();
+    }
+}
+
+void ImageSequence::setPosition(qint64 milliseconds)
+{
+    seekToFrame(milliseconds * _fps / 1000.0);
+}
+
+void ImageSequence::step(int frames)
+{
+    pause();
+    if (_frameCount == 0)
+        return;
+    int target = qBound(0, _currentFrame + frames, _frameCount - 1);
+    if (target == _currentFrame)
+        return;
+    if (target == _currentFrame + 1 && _decoded.contains(target))
+        showFrame(target);
+    else
+        seekToFrame(target);
+}
+
+bool ImageSequence::keepsUp() const
+{
+    if (_statDecodedFrames == 0)
+        return true;
+    double decodeSecsPerFrame = _statDecodeNsecs / 1e9 / _statDecodedFrames;
+    double possibleFps = _threadPool.maxThreadCount() / decodeSecsPerFrame;
+    return possibleFps >= _fps;
+}
+
+int ImageSequence::decodeAhead() const
+{
+    if (_frameBytes <= 0)
+        return 2;
+    return qBound(qint64(2), _memoryBudget / _frameBytes, qint64(MaxDecodeAhead));
+}
+
+void ImageSequence::scheduleDecoding()
+{
+    int first = _currentFrame + 1;
+    int last = qMin(_currentFrame + decodeAhead(), _frameCount - 1);
+    for (int index = first; index <= last; index++) {
+        if (_decoded.contains(index) || _pending.contains(index))
+            continue;
+        _pending.insert(index);
+        unsigned long long generation = _generation;
+        QString fileName0 = fileName(index, 0);
+        QString fileName1 = _stereo ? fileName(index, 1) : QString();
+        // earlier frames are more urgent
+        int priority = last - index;
+        _threadPool.start([=]() {
+                QElapsedTimer timer;
+                timer.start();
+                Frame frame;
+                for (int view = 0; view < (fileName1.isEmpty() ? 1 : 2); view++) {
+                    QImageReader reader(view == 0 ? fileName0 : fileName1);
+                    QImage image = reader.read();
+                    if (image.isNull()) {
+                        LOG_WARNING("%s", qPrintable(tr("%1: %2").arg(reader.fileName()).arg(reader.errorString())));
+                    } else {
+                        image.convertTo(VideoFrame::preferredImageFormat(image.format()));
+                    }
+                    (view == 0 ? frame.image : frame.extImage) = image;
+                }
+                qint64 nsecs = timer.nsecsElapsed();
+                QMetaObject::invokeMethod(this, [=]() { decoded(generation, index, frame, nsecs); }, Qt::QueuedConnection);
+                }, priority);
+    }
+}
+
+void ImageSequence::decoded(unsigned long long generation, int index, const Frame& frame, qint64 nsecs)
+{
+    if (generation != _generation)
+        return;
+    _pending.remove(index);
+    _statDecodeNsecs += nsecs;
+    _statDecodedFrames++;
+    if (!frame.image.isNull())
+        _frameBytes = frame.image.sizeInBytes() + frame.extImage.sizeInBytes();
+    if (index <= _currentFrame || index > _currentFrame + decodeAhead()) {
+        // outside of the current window after a nearby seek
+        scheduleDecoding();
+        return;
+    }
+    _decoded.insert(index, frame);
+    if (_showPending && index == _currentFrame + 1) {
+        _showPending = false;
+        showFrame(index);
+        // the frame was late or the position changed: continue playback from here
+        resetClock();
+        scheduleTick();
+    } else {
+        scheduleDecoding();
+    }
+}
+
+void ImageSequence::showFrame(int index)
+{
+    Frame frame = _decoded.take(index);
+    _currentFrame = index;
+    // frames before the current one are not needed anymore
+    while (!_decoded.isEmpty() && _decoded.firstKey() < index)
+        _decoded.erase(_decoded.begin());
+    if (!frame.image.isNull())
+        emit frameReady(frame.image, frame.extImage);
+    _statFramesShown++;
+    scheduleDecoding();
+}
+
+void ImageSequence::resetClock()
+{
+    _clock.start();
+    _clockFrame = _currentFrame;
+}
+
+// Start the timer for the frame after the current one. Its due time is
+// computed from the reference time, not from the previous tick.
+void ImageSequence::scheduleTick()
+{
+    if (!_playing)
+        return;
+    double dueMs = (_currentFrame + 1 - _clockFrame) * 1000.0 / _fps;
+    qint64 waitMs = qRound64(dueMs - _clock.nsecsElapsed() / 1e6);
+    _timer.start(qMax(qint64(0), waitMs));
+}
+
+void ImageSequence::tick()
+{
+    if (_currentFrame >= _frameCount - 1) {
+        pause();
+        emit finished();
+        return;
+    }
+    if (_decoded.contains(_currentFrame + 1)) {
+        showFrame(_currentFrame + 1);
+        scheduleTick();
+    } else if (!_showPending) {
+        // The frame is not ready: keep the current one on screen and show
+        // the next one as soon as it is decoded.
+        _statLateFrames++;
+        _showPending = true;
+        if (!_statWarned && _statDecodedFrames >= 2 * _threadPool.maxThreadCount() && !keepsUp()) {
+            double decodeSecsPerFrame = _statDecodeNsecs / 1e9 / _statDecodedFrames;
+            LOG_WARNING("%s", qPrintable(tr("Decoding of %1 does not keep up with %2 fps (about %3 fps possible)")
+                        .arg(_pattern).arg(_fps).arg(_threadPool.maxThreadCount() / decodeSecsPerFrame, 0, 'f', 1)));
+            _statWarned = true;
+        }
+    }
+}
+
+void ImageSequence::logStatistics()
+{
+    if (_statFramesShown == 0)
+        return;
+    LOG_INFO("image sequence %s: %d frames shown, %d late; %.1f ms average decode time with %d threads",
+            qPrintable(_pattern), _statFramesShown, _statLateFrames,
+            _statDecodedFrames > 0 ? _statDecodeNsecs / 1e6 / _statDecodedFrames : 0.0,
+            _threadPool.maxThreadCount());
+}
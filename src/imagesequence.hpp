@@ -0,0 +1,124 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QThreadPool>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSet>
+#include <QImage>
+#include <QUrl>
+
+#include "framesource.hpp"
+
+
+/* Plays numbered image sequences such as shot.%04d.png at a fixed frame rate.
+ * A %v in the file name is replaced by L and R (and %V by l and r) to form
+ * the two views of a stereo sequence.
+ * Frames are decoded ahead of the current position by a thread pool. The
+ * number of frames kept ahead is limited by a memory budget; seeking to a
+ * nearby frame keeps the decoded frames that are still ahead. Playback never
+ * skips frames: if a frame is not decoded in time, the previous frame stays
+ * on screen longer, and this is reported as a late frame. Frames are due at
+ * multiples of the frame duration from a reference time, so that rounding
+ * does not accumulate. */
+
+class ImageSequence : public FrameSource
+{
+Q_OBJECT
+
+private:
+    class Frame
+    {
+    public:
+        QImage image;
+        QImage extImage;
+    };
+
+    QString _pattern;           // file name pattern
+    bool _stereo;               // whether the pattern contains %v or %V
+    float _fps;
+    qint64 _memoryBudget;       // in bytes
+    int _firstFrame;            // number of the first frame
+    int _frameCount;
+    int _currentFrame;          // index of the frame on screen, or -1
+    bool _playing;
+    QTimer _timer;              // single shot, for the next frame
+    QElapsedTimer _clock;       // playback time reference
+    int _clockFrame;            // index of the frame that was shown at the reference time
+    QThreadPool _threadPool;
+    unsigned long long _generation; // incremented on every seek, to discard outdated decodes
+    QMap<int, Frame> _decoded;  // decoded frames ahead of the current one
+    QSet<int> _pending;         // frames being decoded
+    qint64 _frameBytes;         // memory required per frame, known after the first decode
+    bool _showPending;          // show the next frame as soon as it is decoded
+    // statistics
+    int _statFramesShown;
+    int _statLateFrames;
+    qint64 _statDecodeNsecs;
+    int _statDecodedFrames;
+    bool _statWarned;
+
+    QString fileName(int index, int view) const;
+    int decodeAhead() const;
+    void scheduleDecoding();
+    void decoded(unsigned long long generation, int index, const Frame& frame, qint64 nsecs);
+    void showFrame(int index);
+    void resetClock();
+    void scheduleTick();
+    void tick();
+    void logStatistics();
+
+public:
+    ImageSequence(const QString& pattern, float fps, qint64 memoryBudget, QObject* parent = nullptr);
+    virtual ~ImageSequence();
+
+    // Whether the URL refers to a local file name pattern with a frame number
+    // placeholder (%d or %0Nd)
+    static bool isSequence(const QUrl& url);
+
+    // Find the frames of the sequence. Returns false if there are none.
+    virtual bool open() override;
+
+    virtual QUrl url() const override;
+    virtual bool isPlaying() const override;
+    virtual bool isFinished() const override;
+    virtual qint64 position() const override;
+    virtual qint64 duration() const override;
+    virtual float fps() const override;
+
+    virtual void play() override;
+    virtual void pause() override;
+    virtual void setPosition(qint64 milliseconds) override;
+    virtual void step(int frames) override;
+
+    bool isStereo() const;
+    int frameCount() const;
+    int currentFrame() const;
+    void seekToFrame(int index);
+
+    // Whether decoding keeps up with the frame rate
+    bool keepsUp() const;
+
+signals:
+    void frameReady(const QImage& image, const QImage& extImage);
+};
@@ -0,0 +1,185 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QImageReader>
+#include <QFileInfo>
+#include <QFile>
+#include <QBuffer>
+#include <QThread>
+#include <QElapsedTimer>
+
+#include "imagesource.hpp"
+#include "imagesequence.hpp"
+#include "rawvideo.hpp"
+#include "mpo.hpp"
+#include "videoframe.hpp"
+#include "log.hpp"
+
+
+static const int CacheSizeKiB = 512 * 1024;
+
+ImageSource::ImageSource(QObject* parent) :
+    QObject(parent),
+    _cache(CacheSizeKiB)
+{
+}
+
+ImageSource::~ImageSource()
+{
+    // the decoding tasks refer to this object
+    _threadPool.clear();
+    _threadPool.waitForDone();
+}
+
+bool ImageSource::isImage(const QUrl& url)
+{
+    static QSet<QString> suffixes;
+    if (suffixes.isEmpty()) {
+        QList<QByteArray> formats = QImageReader::supportedImageFormats();
+        for (int i = 0; i < formats.size(); i++)
+            suffixes.insert(QString::fromLatin1(formats[i]).toLower());
+        // stereo variants of JPEG and PNG
+        suffixes.insert("jps");
+        suffixes.insert("pns");
+        // animations are better handled by the media player
+        suffixes.remove("gif");
+        suffixes.remove("mng");
+        // multi picture objects are handled by our own parser
+        suffixes.insert("mpo");
+    }
+    return url.isLocalFile() && suffixes.contains(QFileInfo(url.toLocalFile()).suffix().toLower())
+        && !ImageSequence::isSequence(url) && !RawVideo::isRawVideo(url);
+}
+
+void ImageSource::setMaximumSize(const QSize& size)
+{
+    if (size != _maxSize) {
+        _maxSize = size;
+        _cache.clear();
+    }
+}
+
+bool ImageSource::get(const QString& fileName, StillImage& stillImage)
+{
+    StillImage* cachedImage = _cache.object(fileName);
+    if (cachedImage) {
+        LOG_DEBUG("image source: %s is cached", qPrintable(fileName));
+        stillImage = *cachedImage;
+        return true;
+    }
+    decode(fileName, 1);
+    return false;
+}
+
+void ImageSource::prefetch(const QString& fileName)
+{
+    if (!_cache.contains(fileName))
+        decode(fileName, 0);
+}
+
+// Read an image, scaling it down while decoding if it is larger than maxSize
+static QImage readImage(QImageReader& reader, const QSize& maxSize, const QString& fileName)
+{
+    reader.setDecideFormatFromContent(true);
+    QSize size = reader.size();
+    if (maxSize.isValid() && size.isValid()
+            && (size.width() > maxSize.width() || size.height() > maxSize.height())) {
+        // Some formats (most importantly JPEG) can decode directly
+        // to a smaller size, which is much faster than a full decode
+        reader.setScaledSize(size.scaled(maxSize, Qt::KeepAspectRatio));
+    }
+    QImage image = reader.read();
+    if (image.isNull())
+        LOG_WARNING("%s", qPrintable(ImageSource::tr("%1: %2").arg(fileName).arg(reader.errorString())));
+    else
+        image.convertTo(VideoFrame::preferredImageFormat(image.format()));
+    return image;
+}
+
+// Decode the first two views of an MPO file concurrently.
+// Returns false if the file is not a valid MPO file.
+static bool readMPO(const QString& fileName, const QSize& maxSize, StillImage& stillImage)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray fileData;
+    const uchar* data = file.map(0, file.size());
+    if (!data) {
+        fileData = file.readAll();
+        data = reinterpret_cast<const uchar*>(fileData.constData());
+    }
+    QList<MPOImage> images;
+    if (!mpoFindImages(data, file.size(), images) || images.size() < 2)
+        return false;
+    LOG_DEBUG("image source: %s contains %d images", qPrintable(fileName), int(images.size()));
+
+    QByteArray leftData = QByteArray::fromRawData(reinterpret_cast<const char*>(data + images[0].offset), images[0].size);
+    QByteArray rightData = QByteArray::fromRawData(reinterpret_cast<const char*>(data + images[1].offset), images[1].size);
+    QThread* rightThread = QThread::create([&]() {
+            QBuffer buffer(&rightData);
+            QImageReader reader(&buffer, "jpeg");
+            stillImage.extImage = readImage(reader, maxSize, fileName);
+            });
+    rightThread->start();
+    QBuffer buffer(&leftData);
+    QImageReader reader(&buffer, "jpeg");
+    stillImage.image = readImage(reader, maxSize, fileName);
+    rightThread->wait();
+    delete rightThread;
+    if (stillImage.extImage.size() != stillImage.image.size())
+        stillImage.extImage = QImage();
+    return true;
+}
+
+void ImageSource::decode(const QString& fileName, int priority)
+{
+    if (_pending.contains(fileName))
+        return;
+    _pending.insert(fileName);
+    QSize maxSize = _maxSize;
+    _threadPool.start([=]() {
+            QElapsedTimer timer;
+            timer.start();
+            StillImage stillImage;
+            if (QFileInfo(fileName).suffix().toLower() != "mpo"
+                    || !readMPO(fileName, maxSize, stillImage)) {
+                QImageReader reader(fileName);
+                stillImage.image = readImage(reader, maxSize, fileName);
+            }
+            if (!stillImage.image.isNull()) {
+                LOG_DEBUG("image source: decoded %s (%dx%d%s) in %g ms", qPrintable(fileName),
+                        stillImage.image.width(), stillImage.image.height(),
+                        stillImage.extImage.isNull() ? "" : ", two views",
+                        timer.nsecsElapsed() / 1e6);
+            }
+            QMetaObject::invokeMethod(this, [=]() { decoded(fileName, stillImage); }, Qt::QueuedConnection);
+            }, priority);
+}
+
+void ImageSource::decoded(const QString& fileName, const StillImage& stillImage)
+{
+    _pending.remove(fileName);
+    if (!stillImage.image.isNull()) {
+        qsizetype cost = (stillImage.image.sizeInBytes() + stillImage.extImage.sizeInBytes()) / 1024;
+        _cache.insert(fileName, new StillImage(stillImage), qMax(qsizetype(1), cost));
+    }
+    emit imageReady(fileName, stillImage);
+}
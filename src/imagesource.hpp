@@ -0,0 +1,78 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QThreadPool>
+#include <QCache>
+#include <QSet>
+#include <QImage>
+#include <QUrl>
+
+
+/* A decoded still image. For MPO files, the second view is in extImage. */
+
+class StillImage
+{
+public:
+    QImage image;
+    QImage extImage;
+};
+
+
+/* Decodes still images (JPS, PNS, MPO, side-by-side JPEGs, ...) without going
+ * through QMediaPlayer. Decoding happens in a thread pool, decoded images
+ * are kept in a cache, and the play list neighbors of the current image
+ * can be prefetched so that switching between stills is instant. */
+
+class ImageSource : public QObject
+{
+Q_OBJECT
+
+private:
+    QThreadPool _threadPool;
+    QCache<QString, StillImage> _cache; // cost is in KiB
+    QSet<QString> _pending;         // files currently being decoded
+    QSize _maxSize;                 // larger images are scaled down while decoding
+
+    void decode(const QString& fileName, int priority);
+    void decoded(const QString& fileName, const StillImage& stillImage);
+
+public:
+    ImageSource(QObject* parent = nullptr);
+    virtual ~ImageSource();
+
+    // Whether the given URL refers to a still image that we can handle
+    static bool isImage(const QUrl& url);
+
+    // Set the maximum image size; an invalid size means no limit
+    void setMaximumSize(const QSize& size);
+
+    // If the image is in the cache, return true and set the image.
+    // Otherwise, start decoding it and emit imageReady() when done.
+    bool get(const QString& fileName, StillImage& stillImage);
+    // Decode the image into the cache in the background, with low priority
+    void prefetch(const QString& fileName);
+
+signals:
+    // The image is null if decoding failed
+    void imageReady(const QString& fileName, const StillImage& stillImage);
+};
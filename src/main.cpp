@@ -58,6 +58,13 @@
 #include "commandinterpreter.hpp"
 #include "modes.hpp"
 #include "bino.hpp"
+#include "readahead.hpp"
+#include "gpuprofiler.hpp"
+#include "tracer.hpp"
+#include "imagesequence.hpp"
+#include "rawvideo.hpp"
+#include "converter.hpp"
+#include "cubelut.hpp"
 
 
 void logQtMsg(QtMsgType type, const QMessageLogContext&, const QString& msg)
@@ -129,6 +136,13 @@ int main(int argc, char* argv[])
             QCommandLineParser::tr("Use OpenGL ES instead of Desktop OpenGL.") });
     parser.addOption({ "stereo",
             QCommandLineParser::tr("Use OpenGL quad-buffered stereo in GUI mode.")});
+    parser.addOption({ "software-rendering",
+            QCommandLineParser::tr("Render without OpenGL in GUI mode. This is the default if OpenGL 3.2 is not available.") });
+    parser.addOption({ "direct-output",
+            QCommandLineParser::tr("Render directly into a native window in GUI mode instead of composing a widget into the main window. This is the default when starting in fullscreen mode.") });
+    parser.addOption({ "swap-interval",
+            QCommandLineParser::tr("Set the number of display refreshes per buffer swap (0 disables vertical synchronization)."),
+            "n" });
     parser.addOption({ "vr",
             QCommandLineParser::tr("Start in VR mode instead of GUI mode.")});
     parser.addOption({ "vr-screen",
@@ -138,6 +152,41 @@ int main(int argc, char* argv[])
             "screen" });
     parser.addOption({ "capture",
             QCommandLineParser::tr("Capture video/audio input from camera and microphone.") });
+    parser.addOption({ "capture-shm",
+            QCommandLineParser::tr("Capture video frames from another process via the given shared memory frame ring."),
+            "name" });
+    parser.addOption({ "output-shm",
+            QCommandLineParser::tr("Send the displayed output to other processes via the given shared memory frame ring."),
+            "name" });
+    parser.addOption({ "frame-precision",
+            QCommandLineParser::tr("Set the precision of intermediate frame textures (%1).").arg("auto, float11, 10bit, 16bit"),
+            "precision" });
+    parser.addOption({ "gpu-budget",
+            QCommandLineParser::tr("Adapt the render quality so that the GPU time per frame stays within the given budget in milliseconds."),
+            "ms" });
+    parser.addOption({ "resolution-scale",
+            QCommandLineParser::tr("Set the bounds of the texture resolution scale used with --gpu-budget (default %1).").arg("0.5,1"),
+            "min,max" });
+    parser.addOption({ "profile",
+            QCommandLineParser::tr("Measure the GPU time of each render stage and log statistics.") });
+    parser.addOption({ "profile-file",
+            QCommandLineParser::tr("Measure the GPU time of each render stage and write statistics to the given JSON file at exit."),
+            "file" });
+    parser.addOption({ "trace-file",
+            QCommandLineParser::tr("Record the stages of the frame pipeline and write them to the given file in Chrome trace event format."),
+            "file" });
+    parser.addOption({ "frame-hash",
+            QCommandLineParser::tr("Set how frames identical to their predecessor are detected (%1).").arg("off, sampled, full"),
+            "mode" });
+    parser.addOption({ "display-lut",
+            QCommandLineParser::tr("Apply the given 3D LUT (.cube file) for display calibration to the output."),
+            "file" });
+    parser.addOption({ "convert",
+            QCommandLineParser::tr("Convert the input to the output mode without showing it, and write the result to the given file (.y4m: YUV4MPEG2, otherwise raw RGBA; -: standard output)."),
+            "file" });
+    parser.addOption({ "convert-backend",
+            QCommandLineParser::tr("Set the rendering backend for conversion (%1).").arg("opengl, rhi-vulkan, rhi-opengl"),
+            "backend" });
     parser.addOption({ "list-audio-outputs",
             QCommandLineParser::tr("List audio outputs.") });
     parser.addOption({ "list-audio-inputs",
@@ -171,6 +220,24 @@ int main(int argc, char* argv[])
     parser.addOption({ { "p", "playlist" },
             QCommandLineParser::tr("Load playlist."),
             "file" });
+    parser.addOption({ "read-ahead",
+            QCommandLineParser::tr("Set the amount of data to read ahead for upcoming playlist entries in MiB (default 32, 0 disables read-ahead)."),
+            "size" });
+    parser.addOption({ "file-io",
+            QCommandLineParser::tr("Set how media files are read (%1).").arg("backend, auto, mmap, buffered"),
+            "mode" });
+    parser.addOption({ "slideshow-duration",
+            QCommandLineParser::tr("Show each still image for the given number of seconds before advancing in the playlist (default 0: do not advance automatically)."),
+            "seconds" });
+    parser.addOption({ "sequence-fps",
+            QCommandLineParser::tr("Set the frame rate for image sequences (default 24)."),
+            "fps" });
+    parser.addOption({ "sequence-memory",
+            QCommandLineParser::tr("Set the memory used to decode image sequence frames ahead in MiB (default 1024)."),
+            "size" });
+    parser.addOption({ "raw-format",
+            QCommandLineParser::tr("Set the layout of raw video files as WIDTHxHEIGHT:FORMAT[:FPS] (formats: %1).").arg("yuv420p, yuv422p, yv12, nv12, p010, p016, gray, gray16, rgba, rgbx, bgra, bgrx, argb, xrgb, abgr, xbgr"),
+            "format" });
     parser.addOption({ { "l", "loop" },
             QCommandLineParser::tr("Set loop mode (%1).").arg("off, one, all"),
             "mode" });
@@ -378,6 +445,73 @@ int main(int argc, char* argv[])
         }
         playlist.setLoopMode(loopMode);
     }
+    int readAheadMiB = 32;
+    if (parser.isSet("read-ahead")) {
+        bool ok;
+        readAheadMiB = parser.value("read-ahead").toInt(&ok);
+        if (!ok || readAheadMiB < 0) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--read-ahead")));
+            return 1;
+        }
+    }
+    ReadAhead readAhead(qint64(readAheadMiB) * 1024 * 1024);
+    // in VR mode, only the main process writes the profile file
+    GpuProfiler gpuProfiler(parser.isSet("profile") || parser.isSet("profile-file"),
+            vrChildProcess ? QString() : parser.value("profile-file"));
+    // in VR mode, each child process writes its own trace file
+    Tracer tracer(vrChildProcess ? Tracer::childFileName(parser.value("trace-file")) : parser.value("trace-file"));
+    FileIOMode fileIOMode = FileIO_Backend;
+    if (parser.isSet("file-io")) {
+        bool ok;
+        fileIOMode = fileIOModeFromString(parser.value("file-io"), &ok);
+        if (!ok) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--file-io")));
+            return 1;
+        }
+    }
+    float slideshowDuration = 0.0f;
+    if (parser.isSet("slideshow-duration")) {
+        bool ok;
+        slideshowDuration = parser.value("slideshow-duration").toFloat(&ok);
+        if (!ok || slideshowDuration < 0.0f) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--slideshow-duration")));
+            return 1;
+        }
+    }
+    float sequenceFps = 24.0f;
+    if (parser.isSet("sequence-fps")) {
+        bool ok;
+        sequenceFps = parser.value("sequence-fps").toFloat(&ok);
+        if (!ok || sequenceFps <= 0.0f) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--sequence-fps")));
+            return 1;
+        }
+    }
+    int sequenceMemoryMiB = 1024;
+    if (parser.isSet("sequence-memory")) {
+        bool ok;
+        sequenceMemoryMiB = parser.value("sequence-memory").toInt(&ok);
+        if (!ok || sequenceMemoryMiB < 0) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--sequence-memory")));
+            return 1;
+        }
+    }
+    int swapInterval = -1;
+    if (parser.isSet("swap-interval")) {
+        bool ok;
+        swapInterval = parser.value("swap-interval").toInt(&ok);
+        if (!ok || swapInterval < 0) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--swap-interval")));
+            return 1;
+        }
+    }
+    RawVideoFormat rawVideoFormat;
+    if (parser.isSet("raw-format")) {
+        if (!RawVideoFormat::parse(parser.value("raw-format"), rawVideoFormat)) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--raw-format")));
+            return 1;
+        }
+    }
     int videoTrack = PlaylistEntry::DefaultTrack;
     int audioTrack = PlaylistEntry::DefaultTrack;
     int subtitleTrack = PlaylistEntry::DefaultTrack;
@@ -421,6 +555,8 @@ int main(int argc, char* argv[])
             QFileInfo fileInfo(parser.positionalArguments()[i]);
             if (fileInfo.exists()) {
                 url = QUrl::fromLocalFile(fileInfo.canonicalFilePath());
+            } else if (ImageSequence::isSequence(QUrl::fromLocalFile(fileInfo.absoluteFilePath()))) {
+                url = QUrl::fromLocalFile(fileInfo.absoluteFilePath());
             } else {
                 LOG_WARNING("%s", qPrintable(QCommandLineParser::tr("File does not exist: %1").arg(parser.positionalArguments()[i])));
                 continue;
@@ -441,10 +577,95 @@ int main(int argc, char* argv[])
             return 1;
         }
     }
-    if (parser.isSet("capture") && playlist.length() > 0) {
+    if ((parser.isSet("capture") || parser.isSet("capture-shm")) && playlist.length() > 0) {
         LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Cannot capture and play URL at the same time.")));
         return 1;
     }
+    if (parser.isSet("convert")) {
+        if (playlist.length() == 0) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Conversion requires an input.")));
+            return 1;
+        }
+        if (parser.isSet("vr") || parser.isSet("capture") || parser.isSet("capture-shm")
+                || !Converter::supportsOutputMode(outputMode)) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--convert")));
+            return 1;
+        }
+    }
+    Converter::Backend convertBackend = Converter::Backend_OpenGL;
+    if (parser.isSet("convert-backend")) {
+        QString b = parser.value("convert-backend");
+        if (b == "opengl")
+            convertBackend = Converter::Backend_OpenGL;
+        else if (b == "rhi-vulkan")
+            convertBackend = Converter::Backend_RHI_Vulkan;
+        else if (b == "rhi-opengl")
+            convertBackend = Converter::Backend_RHI_OpenGL;
+        else {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--convert-backend")));
+            return 1;
+        }
+        if (!Converter::supportsBackend(convertBackend)) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("This version of Bino was built without QRhi support.")));
+            return 1;
+        }
+    }
+    FramePrecision framePrecision = Precision_Auto;
+    if (parser.isSet("frame-precision")) {
+        bool ok;
+        framePrecision = framePrecisionFromString(parser.value("frame-precision"), &ok);
+        if (!ok) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--frame-precision")));
+            return 1;
+        }
+    }
+    float gpuBudget = 0.0f;
+    if (parser.isSet("gpu-budget")) {
+        bool ok;
+        gpuBudget = parser.value("gpu-budget").toFloat(&ok);
+        if (!ok || gpuBudget <= 0.0f) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--gpu-budget")));
+            return 1;
+        }
+    }
+    float minResolutionScale = 0.5f;
+    float maxResolutionScale = 1.0f;
+    if (parser.isSet("resolution-scale")) {
+        QStringList paramList = parser.value("resolution-scale").split(',');
+        bool ok0 = false, ok1 = false;
+        if (paramList.length() == 2) {
+            minResolutionScale = paramList[0].toFloat(&ok0);
+            maxResolutionScale = paramList[1].toFloat(&ok1);
+        }
+        if (!ok0 || !ok1 || minResolutionScale <= 0.0f
+                || minResolutionScale > maxResolutionScale || maxResolutionScale > 1.0f) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--resolution-scale")));
+            return 1;
+        }
+    }
+    if (parser.isSet("frame-hash")) {
+        QString m = parser.value("frame-hash");
+        if (m == "off") {
+            VideoFrame::setHashMode(VideoFrame::Hash_Off);
+        } else if (m == "sampled") {
+            VideoFrame::setHashMode(VideoFrame::Hash_Sampled);
+        } else if (m == "full") {
+            VideoFrame::setHashMode(VideoFrame::Hash_Full);
+        } else {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--frame-hash")));
+            return 1;
+        }
+    }
+    CubeLut displayLut;
+    if (parser.isSet("display-lut")) {
+        QString errorMessage;
+        if (!displayLut.read(parser.value("display-lut"), &errorMessage)) {
+            LOG_FATAL("%s", qPrintable(errorMessage));
+            return 1;
+        }
+        if (convertBackend != Converter::Backend_OpenGL)
+            LOG_WARNING("%s", qPrintable(QCommandLineParser::tr("Option %1 requires OpenGL and is ignored.").arg("--display-lut")));
+    }
 
     // List tracks
     if (parser.isSet("list-tracks")) {
@@ -540,7 +761,8 @@ int main(int argc, char* argv[])
     // Determine VR or GUI mode
     bool vrMainProcess = parser.isSet("vr");
     bool vrMode = (vrMainProcess || vrChildProcess);
-    bool guiMode = !vrMode;
+    bool convertMode = parser.isSet("convert");
+    bool guiMode = !vrMode && !convertMode;
 
     // Set the OpenGL context parameters
     QSurfaceFormat format;
@@ -549,6 +771,8 @@ int main(int argc, char* argv[])
     format.setBlueBufferSize(10);
     format.setAlphaBufferSize(0);
     format.setStencilBufferSize(0);
+    if (swapInterval >= 0)
+        format.setSwapInterval(swapInterval);
     if (parser.isSet("opengles"))
         format.setRenderableType(QSurfaceFormat::OpenGLES);
     if (QOpenGLContext::openGLModuleType() == QOpenGLContext::LibGLES
@@ -576,10 +800,20 @@ int main(int argc, char* argv[])
     // Initialize Bino (in VR mode: only from the main process!)
     Bino bino(screen, parser.isSet("swap-eyes"));
     if (guiMode || !vrChildProcess) {
+        bino.setFileIOMode(fileIOMode);
+        bino.setSlideshowDuration(qRound(slideshowDuration * 1000.0f));
+        bino.setImageSequenceOptions(sequenceFps, qint64(sequenceMemoryMiB) * 1024 * 1024);
+        bino.setRawVideoFormat(rawVideoFormat);
+        bino.setShmOutputName(parser.value("output-shm"));
+        bino.setFramePrecision(framePrecision);
+        bino.setQualityGovernor(gpuBudget, minResolutionScale, maxResolutionScale);
+        bino.setDisplayLut(displayLut);
         bino.initializeOutput(audioOutputDeviceIndex >= 0
                 ? audioOutputDevices[audioOutputDeviceIndex]
                 : QMediaDevices::defaultAudioOutput());
-        if (parser.isSet("capture")) {
+        if (parser.isSet("capture-shm")) {
+            bino.startShmCaptureMode(parser.value("capture-shm"), inputMode, surroundMode);
+        } else if (parser.isSet("capture")) {
             bino.startCaptureMode(audioInputDeviceIndex >= -1,
                     audioInputDeviceIndex >= 0
                     ? audioInputDevices[audioInputDeviceIndex]
@@ -592,8 +826,17 @@ int main(int argc, char* argv[])
         }
     }
 
-    // Start VR or GUI mode
-    if (vrMode) {
+    // Start VR, conversion, or GUI mode
+    if (convertMode) {
+        bino.setMute(true);
+        Converter converter(parser.value("convert"), outputMode, convertBackend);
+        if (!converter.initialize())
+            return 1;
+        QObject::connect(&converter, &Converter::finished, &app, &QApplication::quit, Qt::QueuedConnection);
+        playlist.start();
+        app.exec();
+        return converter.success() ? 0 : 1;
+    } else if (vrMode) {
 #ifdef WITH_QVR
         BinoQVRApp qvrapp;
         if (!manager.init(&qvrapp)) {
@@ -607,12 +850,33 @@ int main(int argc, char* argv[])
         return 1;
 #endif
     } else {
-        Gui gui(outputMode, parser.isSet("fullscreen"));
+        bool softwareRendering = parser.isSet("software-rendering");
+        if (!softwareRendering && !format.stereo()) {
+            QOpenGLContext context;
+            bool contextIsOk = (context.create()
+                    && (context.format().majorVersion() > 3
+                        || (context.format().majorVersion() == 3 && context.format().minorVersion() >= 2)));
+            if (!contextIsOk) {
+                LOG_WARNING("%s", qPrintable(QCommandLineParser::tr("OpenGL 3.2 is not available, falling back to software rendering.")));
+                softwareRendering = true;
+            }
+        }
+        if (softwareRendering && parser.isSet("output-shm"))
+            LOG_WARNING("%s", qPrintable(QCommandLineParser::tr("Option %1 requires OpenGL and is ignored.").arg("--output-shm")));
+        if (softwareRendering && parser.isSet("display-lut"))
+            LOG_WARNING("%s", qPrintable(QCommandLineParser::tr("Option %1 requires OpenGL and is ignored.").arg("--display-lut")));
+        // The output path is chosen once: switching between the widget and
+        // the native window would require recreating the OpenGL context and
+        // all its resources, so toggling fullscreen later keeps the path.
+        bool directOutput = (parser.isSet("direct-output") || parser.isSet("fullscreen"));
+        if (!softwareRendering)
+            LOG_INFO("output path: %s", directOutput ? "direct window" : "composed widget");
+        Gui gui(outputMode, parser.isSet("fullscreen"), softwareRendering, directOutput);
         gui.show();
-        // wait for several seconds to process all events before starting
-        // the playlist, because otherwise playing might be finished before
-        // the first frame rendering, e.g. if you just want to "play" an image
-        QGuiApplication::processEvents(QEventLoop::AllEvents, 3000);
+        // process pending events so that the window is shown before the
+        // playlist starts; still images do not go through the media player
+        // anymore, so there is no need to wait for the first rendering
+        QGuiApplication::processEvents();
         playlist.start();
         cmdInterpreter.start();
         return app.exec();
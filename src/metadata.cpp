@@ -24,6 +24,7 @@
 #include <QMap>
 
 #include "metadata.hpp"
+#include "tracer.hpp"
 #include "log.hpp"
 
 
@@ -41,6 +42,7 @@ bool MetaData::detectCached(const QUrl& url, QString* errMsg)
         return true;
 
     // detection via QMediaPlayer
+    Tracer::begin("metadata");
     QMediaPlayer player;
     bool failure = false;
     bool available = false;
@@ -59,6 +61,7 @@ bool MetaData::detectCached(const QUrl& url, QString* errMsg)
     if (failure) {
         if (errMsg)
             *errMsg = errorMessage;
+        Tracer::end("metadata");
         return false;
     }
 
@@ -69,5 +72,6 @@ bool MetaData::detectCached(const QUrl& url, QString* errMsg)
     subtitleTracks = player.subtitleTracks();
 
     cache.insert(url, *this);
+    Tracer::end("metadata");
     return true;
 }
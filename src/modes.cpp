@@ -511,3 +511,37 @@ LoopMode loopModeFromString(const QString& s, bool* ok)
         *ok = r;
     return mode;
 }
+
+const char* framePrecisionToString(FramePrecision precision)
+{
+    switch (precision) {
+    case Precision_Auto:
+        return "auto";
+    case Precision_Float11:
+        return "float11";
+    case Precision_10Bit:
+        return "10bit";
+    case Precision_16Bit:
+        return "16bit";
+    }
+    return nullptr;
+}
+
+FramePrecision framePrecisionFromString(const QString& s, bool* ok)
+{
+    FramePrecision precision = Precision_Auto;
+    bool r = true;
+    if (s == "auto")
+        precision = Precision_Auto;
+    else if (s == "float11")
+        precision = Precision_Float11;
+    else if (s == "10bit")
+        precision = Precision_10Bit;
+    else if (s == "16bit")
+        precision = Precision_16Bit;
+    else
+        r = false;
+    if (ok)
+        *ok = r;
+    return precision;
+}
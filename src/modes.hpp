@@ -108,3 +108,16 @@ enum LoopMode
 const char* loopModeToString(LoopMode mode);
 QString loopModeToStringUI(LoopMode mode);
 LoopMode loopModeFromString(const QString& s, bool* ok = nullptr);
+
+/* Precision of the intermediate frame and view textures that hold linear RGB */
+
+enum FramePrecision
+{
+    Precision_Auto,     // 16 bit for input with more than 8 bits, float11 otherwise
+    Precision_Float11,  // R11F_G11F_B10F: small floats, enough for 8 bit input
+    Precision_10Bit,    // RGB10_A2
+    Precision_16Bit     // RGBA16 (RGBA16F on OpenGL ES)
+};
+
+const char* framePrecisionToString(FramePrecision precision);
+FramePrecision framePrecisionFromString(const QString& s, bool* ok = nullptr);
@@ -0,0 +1,127 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "mpo.hpp"
+#include "log.hpp"
+
+
+static quint16 get16(const unsigned char* p, bool littleEndian)
+{
+    return littleEndian
+        ? quint16(p[0]) | (quint16(p[1]) << 8)
+        : (quint16(p[0]) << 8) | quint16(p[1]);
+}
+
+static quint32 get32(const unsigned char* p, bool littleEndian)
+{
+    return littleEndian
+        ? quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24)
+        : (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+// Parse the MP header and MP Index IFD at the given position.
+// All offsets in there are relative to the start of the MP header.
+static bool parseMPHeader(const unsigned char* data, qint64 size, qint64 mpHeader, qint64 mpEnd,
+        QList<MPOImage>& images)
+{
+    if (mpEnd - mpHeader < 8)
+        return false;
+    const unsigned char* h = data + mpHeader;
+    bool le;
+    if (h[0] == 'I' && h[1] == 'I' && h[2] == 0x2a && h[3] == 0x00)
+        le = true;
+    else if (h[0] == 'M' && h[1] == 'M' && h[2] == 0x00 && h[3] == 0x2a)
+        le = false;
+    else
+        return false;
+    qint64 ifd = mpHeader + get32(h + 4, le);
+    if (ifd + 2 > mpEnd)
+        return false;
+    int entryCount = get16(data + ifd, le);
+    if (ifd + 2 + 12 * qint64(entryCount) > mpEnd)
+        return false;
+    quint32 numberOfImages = 0;
+    qint64 mpEntries = -1;
+    qint64 mpEntriesSize = 0;
+    for (int i = 0; i < entryCount; i++) {
+        const unsigned char* e = data + ifd + 2 + 12 * i;
+        quint16 tag = get16(e, le);
+        quint32 count = get32(e + 4, le);
+        if (tag == 0xb001) {        // NumberOfImages
+            numberOfImages = get32(e + 8, le);
+        } else if (tag == 0xb002) { // MPEntry
+            mpEntriesSize = count;
+            mpEntries = mpHeader + get32(e + 8, le);
+        }
+    }
+    if (numberOfImages < 1 || mpEntries < 0
+            || mpEntriesSize < 16 * qint64(numberOfImages)
+            || mpEntries + 16 * qint64(numberOfImages) > mpEnd)
+        return false;
+    images.clear();
+    for (quint32 i = 0; i < numberOfImages; i++) {
+        const unsigned char* e = data + mpEntries + 16 * i;
+        MPOImage image;
+        image.size = get32(e + 4, le);
+        quint32 offset = get32(e + 8, le);
+        // the offset of the first image is zero; all others are relative to the MP header
+        image.offset = (i == 0 ? 0 : mpHeader + offset);
+        // an image needs at least its SOI marker
+        if (image.size < 2 || image.offset + image.size > size)
+            return false;
+        if (data[image.offset] != 0xff || data[image.offset + 1] != 0xd8)
+            return false;
+        images.append(image);
+    }
+    return true;
+}
+
+bool mpoFindImages(const unsigned char* data, qint64 size, QList<MPOImage>& images)
+{
+    if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+        return false;
+    // Walk the marker segments of the first image until the start of scan
+    qint64 pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xff)
+            return false;
+        unsigned char marker = data[pos + 1];
+        if (marker == 0xff) {     // fill byte
+            pos++;
+            continue;
+        }
+        if (marker == 0xda || marker == 0xd9) // start of scan or end of image
+            break;
+        qint64 segmentLength = get16(data + pos + 2, false);
+        qint64 segmentEnd = pos + 2 + segmentLength;
+        if (segmentLength < 2 || segmentEnd > size)
+            return false;
+        if (marker == 0xe2 && segmentLength >= 2 + 4 && std::memcmp(data + pos + 4, "MPF\0", 4) == 0) {
+            bool ok = parseMPHeader(data, size, pos + 8, segmentEnd, images);
+            if (!ok)
+                LOG_DEBUG("MPO: inconsistent MP index");
+            return ok;
+        }
+        pos = segmentEnd;
+    }
+    return false;
+}
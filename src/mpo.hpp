@@ -0,0 +1,41 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QList>
+
+
+/* Multi Picture Object (MPO) files, as written by 3D cameras, are JPEG files
+ * that have further JPEG images appended. The first image contains an APP2
+ * marker segment with an MP Index IFD that lists the offsets and sizes of all
+ * images (CIPA DC-007). Stereo cameras store the left view first and the
+ * right view second. */
+
+class MPOImage
+{
+public:
+    qint64 offset; // byte offset of the JPEG data in the file
+    qint64 size;   // size of the JPEG data in bytes
+};
+
+// Find the images contained in the MPO data. Returns false if the data does
+// not look like an MPO file or its MP index is inconsistent.
+bool mpoFindImages(const unsigned char* data, qint64 size, QList<MPOImage>& images);
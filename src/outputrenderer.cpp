@@ -0,0 +1,454 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QtMath>
+
+#include "outputrenderer.hpp"
+#include "bino.hpp"
+#include "gpuprofiler.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+OutputRenderer::OutputRenderer() :
+    _haveAnisotropicFiltering(false),
+    _viewTexelSnapX(0.0f),
+    _viewTexelSnapY(0.0f),
+    _viewsOutputMode(Output_Left),
+    _viewsWidth(0),
+    _viewsHeight(0),
+    _viewsSwapEyes(false),
+    _fusedViews(false),
+    _toNonlinearTex(0),
+    _displayLutTex(0),
+    _srgbOutput(false),
+    _displayPrgOutputMode(-1),
+    _displayPrgFusedViews(false)
+{
+    _viewValid[0] = false;
+    _viewValid[1] = false;
+}
+
+void OutputRenderer::initialize()
+{
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    _haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+    initializeOpenGLFunctions();
+
+    // View textures
+    glGenTextures(2, _viewTex);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, _viewTex[i]);
+        unsigned char nullBytes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        if (isGLES)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, 1, 1, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullBytes);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, 1, 1, 0, GL_RGBA, GL_UNSIGNED_SHORT, nullBytes);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        if (_haveAnisotropicFiltering)
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
+        _viewTexWidth[i] = 1;
+        _viewTexHeight[i] = 1;
+        _viewTexFormat[i] = 0;
+    }
+    CHECK_GL();
+
+    // Quad geometry
+    const float quadPositions[] = {
+        -1.0f, +1.0f, 0.0f,
+        +1.0f, +1.0f, 0.0f,
+        +1.0f, -1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f
+    };
+    const float quadTexCoords[] = {
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+        1.0f, 0.0f,
+        0.0f, 0.0f
+    };
+    static const unsigned short quadIndices[] = {
+        0, 3, 1, 1, 3, 2
+    };
+    glGenVertexArrays(1, &_quadVao);
+    glBindVertexArray(_quadVao);
+    GLuint quadPositionBuf;
+    glGenBuffers(1, &quadPositionBuf);
+    glBindBuffer(GL_ARRAY_BUFFER, quadPositionBuf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadPositions), quadPositions, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    GLuint quadTexCoordBuf;
+    glGenBuffers(1, &quadTexCoordBuf);
+    glBindBuffer(GL_ARRAY_BUFFER, quadTexCoordBuf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadTexCoords), quadTexCoords, GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(1);
+    GLuint quadIndexBuf;
+    glGenBuffers(1, &quadIndexBuf);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuf);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
+    CHECK_GL();
+
+    // Transfer function lookup texture
+    _toNonlinearTex = createTransferFunctionTexture(this, false);
+    CHECK_GL();
+
+    // Display calibration LUT
+    const CubeLut& displayLut = Bino::instance()->displayLut();
+    if (!displayLut.isEmpty()) {
+        glGenTextures(1, &_displayLutTex);
+        glBindTexture(GL_TEXTURE_3D, _displayLutTex);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, displayLut.size, displayLut.size, displayLut.size,
+                0, GL_RGB, GL_FLOAT, displayLut.data.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        CHECK_GL();
+    }
+}
+
+void OutputRenderer::setSRGBOutput(bool srgbOutput)
+{
+    _srgbOutput = srgbOutput;
+    _displayPrgOutputMode = -1; // force a rebuild of the display program
+}
+
+bool OutputRenderer::srgbOutput() const
+{
+    return _srgbOutput && Bino::instance()->displayLut().isEmpty();
+}
+
+double OutputRenderer::viewTextureMiB() const
+{
+    double mib = 0.0;
+    for (int v = 0; v < 2; v++)
+        if (_viewTexFormat[v] != 0)
+            mib += intermediateTextureMiB(_viewTexFormat[v], _viewTexWidth[v], _viewTexHeight[v]);
+    return mib;
+}
+
+void OutputRenderer::rebuildDisplayPrgIfNecessary(OutputMode outputMode, bool fusedViews)
+{
+    if (outputMode == Output_Right)
+        outputMode = Output_Left; // these are handled specially; see shader
+    if (_displayPrg.isLinked() && _displayPrgOutputMode == outputMode && _displayPrgFusedViews == fusedViews)
+        return;
+
+    LOG_DEBUG("rebuilding display program for output mode %s%s", outputModeToString(outputMode),
+            fusedViews ? " (single pass)" : "");
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    QString vertexShaderSource = readFile(":src/shader-display.vert.glsl");
+    QString fragmentShaderSource = readFile(":src/shader-display.frag.glsl");
+    fragmentShaderSource.replace("$OUTPUT_MODE", QString::number(int(outputMode)));
+    fragmentShaderSource.replace("$SRGB_OUTPUT", srgbOutput() ? "true" : "false");
+    fragmentShaderSource.replace("$DISPLAY_LUT", _displayLutTex ? "true" : "false");
+    fragmentShaderSource.replace("$FUSED_VIEWS", fusedViews ? "true" : "false");
+    if (isGLES) {
+        vertexShaderSource.prepend("#version 320 es\n");
+        fragmentShaderSource.prepend("#version 320 es\n"
+                "precision mediump float;\n");
+    } else {
+        vertexShaderSource.prepend("#version 330\n");
+        fragmentShaderSource.prepend("#version 330\n");
+    }
+    _displayPrg.removeAllShaders();
+    _displayPrg.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+    _displayPrg.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
+    _displayPrg.link();
+    _displayPrgOutputMode = outputMode;
+    _displayPrgFusedViews = fusedViews;
+}
+
+static bool isAnaglyphMode(OutputMode outputMode)
+{
+    return outputMode >= Output_Red_Cyan_Dubois && outputMode <= Output_Red_Blue_Monochrome;
+}
+
+// The size of the output area relative to the framebuffer size, so that the
+// output keeps its aspect ratio
+static void relativeOutputSize(OutputMode outputMode, int width, int height, float outputAspectRatio,
+        float* relWidth, float* relHeight)
+{
+    *relWidth = 1.0f;
+    *relHeight = 1.0f;
+    float screenAspectRatio = width / float(height);
+    if (outputMode == Output_HDMI_Frame_Pack)
+        screenAspectRatio = width / (height - height / 49.0f);
+    if (screenAspectRatio < outputAspectRatio)
+        *relHeight = screenAspectRatio / outputAspectRatio;
+    else
+        *relWidth = outputAspectRatio / screenAspectRatio;
+}
+
+bool OutputRenderer::renderViews(OutputMode& outputMode, int alternatingLastView,
+        int width, int height, const QQuaternion& surroundOrientation,
+        float* outputAspectRatio, bool* frameIsStereo)
+{
+    // A new frame invalidates the views; preRenderProcess() consumes this information
+    if (Bino::instance()->frameIsNew()) {
+        _viewValid[0] = false;
+        _viewValid[1] = false;
+    }
+
+    // Find out about the views we have
+    int viewCount, viewWidth, viewHeight;
+    float frameDisplayAspectRatio;
+    bool surround;
+    Bino::instance()->preRenderProcess(width, height, &viewCount, &viewWidth, &viewHeight, &frameDisplayAspectRatio, &surround);
+
+    // Adjust the stereo mode if necessary
+    *frameIsStereo = (viewCount == 2);
+    if (!*frameIsStereo)
+        outputMode = Output_Left;
+    if (outputMode == Output_Left_Right || outputMode == Output_Right_Left)
+        frameDisplayAspectRatio *= 2.0f;
+    else if (outputMode == Output_Top_Bottom || outputMode == Output_Bottom_Top || outputMode == Output_HDMI_Frame_Pack)
+        frameDisplayAspectRatio *= 0.5f;
+    *outputAspectRatio = frameDisplayAspectRatio;
+
+    // Anaglyph output without surround combines two lookups into the frame
+    // in display(), which saves two render passes and mipmap generations
+    bool fusedViews = (isAnaglyphMode(outputMode) && !surround);
+
+    // The quality governor may reduce the view resolution to meet the GPU budget
+    const RenderQuality& quality = Bino::instance()->renderQuality();
+    viewWidth = qMax(1, qRound(viewWidth * quality.resolutionScale));
+    viewHeight = qMax(1, qRound(viewHeight * quality.resolutionScale));
+
+    // Reduce the views to the resolution at which they are displayed in modes
+    // that show only half of their pixels. In the interleaved modes, each
+    // display pixel of a view then gets exactly one view texel: display()
+    // snaps the texture coordinate to texel centers in the interleaved
+    // dimension, so that pairs of display rows or columns share one texel,
+    // regardless of the interleaving phase given by the fragment offset.
+    float relWidth, relHeight;
+    relativeOutputSize(outputMode, width, height, frameDisplayAspectRatio, &relWidth, &relHeight);
+    int halfDisplayedWidth = (qCeil(width * relWidth) + 1) / 2;
+    int halfDisplayedHeight = (qCeil(height * relHeight) + 1) / 2;
+    _viewTexelSnapX = 0.0f;
+    _viewTexelSnapY = 0.0f;
+    if (outputMode == Output_Left_Right_Half || outputMode == Output_Right_Left_Half) {
+        viewWidth = qMin(viewWidth, halfDisplayedWidth);
+    } else if (outputMode == Output_Top_Bottom_Half || outputMode == Output_Bottom_Top_Half) {
+        viewHeight = qMin(viewHeight, halfDisplayedHeight);
+    } else if (outputMode == Output_Even_Odd_Rows) {
+        if (halfDisplayedHeight < viewHeight) {
+            viewHeight = halfDisplayedHeight;
+            _viewTexelSnapY = viewHeight;
+        }
+    } else if (outputMode == Output_Even_Odd_Columns || outputMode == Output_Checkerboard) {
+        // the checkerboard shows half of the columns of each view in every row
+        if (halfDisplayedWidth < viewWidth) {
+            viewWidth = halfDisplayedWidth;
+            _viewTexelSnapX = viewWidth;
+        }
+    }
+
+    // Changed parameters invalidate the views, too
+    bool swapEyes = Bino::instance()->swapEyes();
+    if (outputMode != _viewsOutputMode || width != _viewsWidth || height != _viewsHeight
+            || surroundOrientation != _viewsSurroundOrientation || swapEyes != _viewsSwapEyes
+            || fusedViews != _fusedViews) {
+        _viewValid[0] = false;
+        _viewValid[1] = false;
+        _fusedViews = fusedViews;
+        _viewsOutputMode = outputMode;
+        _viewsWidth = width;
+        _viewsHeight = height;
+        _viewsSurroundOrientation = surroundOrientation;
+        _viewsSwapEyes = swapEyes;
+    }
+    LOG_FIREHOSE("%s: %d views, %dx%d, %g, surround %s", Q_FUNC_INFO, viewCount, viewWidth, viewHeight, frameDisplayAspectRatio, surround ? "on" : "off");
+
+    // The view textures have the precision of the frame textures; they do not need alpha
+    unsigned int viewTexFormat = Bino::instance()->frameTextureFormat();
+    if (viewTexFormat == 0)
+        viewTexFormat = GL_RGB10_A2; // no frame yet
+    else if (viewTexFormat == GL_RGBA16)
+        viewTexFormat = GL_RGB16;
+
+    // Fill the view texture(s) as needed
+    bool viewsRendered = false;
+    for (int v = 0; v <= 1; v++) {
+        bool needThisView = true;
+        switch (outputMode) {
+        case Output_Left:
+            needThisView = (v == 0);
+            break;
+        case Output_Right:
+            needThisView = (v == 1);
+            break;
+        case Output_Alternating:
+            needThisView = (v != alternatingLastView);
+            break;
+        case Output_HDMI_Frame_Pack:
+        case Output_OpenGL_Stereo:
+        case Output_Left_Right:
+        case Output_Left_Right_Half:
+        case Output_Right_Left:
+        case Output_Right_Left_Half:
+        case Output_Top_Bottom:
+        case Output_Top_Bottom_Half:
+        case Output_Bottom_Top:
+        case Output_Bottom_Top_Half:
+        case Output_Even_Odd_Rows:
+        case Output_Even_Odd_Columns:
+        case Output_Checkerboard:
+        case Output_Red_Cyan_Dubois:
+        case Output_Red_Cyan_FullColor:
+        case Output_Red_Cyan_HalfColor:
+        case Output_Red_Cyan_Monochrome:
+        case Output_Green_Magenta_Dubois:
+        case Output_Green_Magenta_FullColor:
+        case Output_Green_Magenta_HalfColor:
+        case Output_Green_Magenta_Monochrome:
+        case Output_Amber_Blue_Dubois:
+        case Output_Amber_Blue_FullColor:
+        case Output_Amber_Blue_HalfColor:
+        case Output_Amber_Blue_Monochrome:
+        case Output_Red_Green_Monochrome:
+        case Output_Red_Blue_Monochrome:
+            break;
+        }
+        if (!needThisView || _viewValid[v])
+            continue;
+        if (_fusedViews) {
+            _viewValid[v] = true;
+            viewsRendered = true;
+            continue;
+        }
+        // prepare view texture
+        glBindTexture(GL_TEXTURE_2D, _viewTex[v]);
+        if (_viewTexWidth[v] != viewWidth || _viewTexHeight[v] != viewHeight || _viewTexFormat[v] != viewTexFormat) {
+            allocateIntermediateTexture(this, viewTexFormat, viewWidth, viewHeight);
+            if (_viewTexFormat[v] != viewTexFormat) {
+                LOG_INFO("view texture %d for output mode %s: %s, %.1f MiB at %dx%d", v, outputModeToString(outputMode),
+                        intermediateTextureFormatName(viewTexFormat),
+                        intermediateTextureMiB(viewTexFormat, viewWidth, viewHeight), viewWidth, viewHeight);
+            } else {
+                LOG_DEBUG("view texture %d resized to %dx%d: %.1f MiB", v, viewWidth, viewHeight,
+                        intermediateTextureMiB(viewTexFormat, viewWidth, viewHeight));
+            }
+            _viewTexWidth[v] = viewWidth;
+            _viewTexHeight[v] = viewHeight;
+            _viewTexFormat[v] = viewTexFormat;
+        }
+        // render view into view texture
+        LOG_FIREHOSE("%s: getting view %d for stereo mode %s", Q_FUNC_INFO, v, outputModeToString(outputMode));
+        QMatrix4x4 projectionMatrix;
+        QMatrix4x4 orientationMatrix;
+        QMatrix4x4 viewMatrix;
+        if (Bino::instance()->assumeSurroundMode() != Surround_Off) {
+            float verticalVieldOfView = qDegreesToRadians(50.0f);
+            float aspectRatio = float(width) / height;
+            float top = qTan(verticalVieldOfView * 0.5f);
+            float bottom = -top;
+            float right = top * aspectRatio;
+            float left = -right;
+            projectionMatrix.frustum(left, right, bottom, top, 1.0f, 100.0f);
+            orientationMatrix.rotate(surroundOrientation.inverted());
+        }
+        Bino::instance()->render(projectionMatrix, orientationMatrix, viewMatrix, v, viewWidth, viewHeight, _viewTex[v]);
+        // generate mipmaps for the view texture
+        glBindTexture(GL_TEXTURE_2D, _viewTex[v]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, quality.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        if (_haveAnisotropicFiltering)
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, quality.anisotropy);
+        if (quality.mipmaps) {
+            GpuProfiler::instance()->begin(GpuProfiler::Stage_ViewMipmaps);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            GpuProfiler::instance()->end(GpuProfiler::Stage_ViewMipmaps);
+        }
+        _viewValid[v] = true;
+        viewsRendered = true;
+    }
+    return viewsRendered;
+}
+
+void OutputRenderer::display(OutputMode outputMode, int leftRightView,
+        int width, int height, float outputAspectRatio,
+        float fragOffsetX, float fragOffsetY)
+{
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+    float relWidth, relHeight;
+    relativeOutputSize(outputMode, width, height, outputAspectRatio, &relWidth, &relHeight);
+    bool fusedViews = (_fusedViews && isAnaglyphMode(outputMode));
+    rebuildDisplayPrgIfNecessary((outputMode == Output_OpenGL_Stereo || outputMode == Output_Alternating)
+            ? Output_Left /* also covers Output_Right */ : outputMode, fusedViews);
+    glUseProgram(_displayPrg.programId());
+    _displayPrg.setUniformValue("view0", 0);
+    _displayPrg.setUniformValue("view1", 1);
+    _displayPrg.setUniformValue("relativeWidth", relWidth);
+    _displayPrg.setUniformValue("relativeHeight", relHeight);
+    _displayPrg.setUniformValue("fragOffsetX", fragOffsetX);
+    _displayPrg.setUniformValue("fragOffsetY", fragOffsetY);
+    _displayPrg.setUniformValue("viewTexelSnap", QVector2D(_viewTexelSnapX, _viewTexelSnapY));
+    _displayPrg.setUniformValue("outputModeLeftRightView", leftRightView);
+    _displayPrg.setUniformValue("toNonlinearLut", 2);
+    // always set the 3D sampler to its own unit so that it never shares one with a 2D sampler
+    _displayPrg.setUniformValue("displayLut", 3);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, _toNonlinearTex);
+    if (_displayLutTex) {
+        const CubeLut& displayLut = Bino::instance()->displayLut();
+        QVector3D domainMin(displayLut.domainMin[0], displayLut.domainMin[1], displayLut.domainMin[2]);
+        QVector3D domainMax(displayLut.domainMax[0], displayLut.domainMax[1], displayLut.domainMax[2]);
+        _displayPrg.setUniformValue("displayLutDomainMin", domainMin);
+        _displayPrg.setUniformValue("displayLutDomainFactor", QVector3D(1.0f, 1.0f, 1.0f) / (domainMax - domainMin));
+        _displayPrg.setUniformValue("displayLutSize", float(displayLut.size));
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, _displayLutTex);
+    }
+    if (fusedViews) {
+        // view0 and view1 are the frame textures that contain the views
+        for (int v = 0; v <= 1; v++) {
+            unsigned int frameTex;
+            float offsetX, factorX, offsetY, factorY;
+            Bino::instance()->viewSource(v, &frameTex, &offsetX, &factorX, &offsetY, &factorY);
+            _displayPrg.setUniformValue(v == 0 ? "viewSource0" : "viewSource1",
+                    QVector4D(offsetX, factorX, offsetY, factorY));
+            glActiveTexture(GL_TEXTURE0 + v);
+            glBindTexture(GL_TEXTURE_2D, frameTex);
+        }
+        _displayPrg.setUniformValue("subtitleTex", 4);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, Bino::instance()->subtitleTexture());
+    } else {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, _viewTex[0]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, _viewTex[1]);
+    }
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    if (srgbOutput() && !isGLES)
+        glEnable(GL_FRAMEBUFFER_SRGB);
+    glBindVertexArray(_quadVao);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    if (srgbOutput() && !isGLES)
+        glDisable(GL_FRAMEBUFFER_SRGB);
+    glActiveTexture(GL_TEXTURE0);
+}
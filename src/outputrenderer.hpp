@@ -0,0 +1,102 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QQuaternion>
+
+#include "modes.hpp"
+
+
+/* Renders the current frame of Bino in a given output mode: first the views
+ * that the output mode needs are rendered into view textures, then the views
+ * are combined into a framebuffer. This is shared by the GUI widget and the
+ * offscreen converter. All functions must be called with the OpenGL context
+ * current. */
+
+class OutputRenderer : protected QOpenGLExtraFunctions
+{
+private:
+    unsigned int _viewTex[2];
+    int _viewTexWidth[2], _viewTexHeight[2];
+    unsigned int _viewTexFormat[2];
+    bool _haveAnisotropicFiltering;
+    // for the interleaved modes: the view texture size in the interleaved
+    // dimension if the views were reduced to the displayed size, otherwise 0
+    float _viewTexelSnapX, _viewTexelSnapY;
+    bool _viewValid[2];
+    // the parameters that the valid views were rendered for
+    OutputMode _viewsOutputMode;
+    int _viewsWidth, _viewsHeight;
+    QQuaternion _viewsSurroundOrientation;
+    bool _viewsSwapEyes;
+    // whether display() samples the frame directly instead of view textures
+    bool _fusedViews;
+    unsigned int _quadVao;
+    unsigned int _toNonlinearTex;
+    unsigned int _displayLutTex;    // 0 if there is no display calibration LUT
+    bool _srgbOutput;
+    QOpenGLShaderProgram _displayPrg;
+    int _displayPrgOutputMode;
+    bool _displayPrgFusedViews;
+
+    void rebuildDisplayPrgIfNecessary(OutputMode outputMode, bool fusedViews);
+
+public:
+    OutputRenderer();
+
+    void initialize();
+
+    // Whether display() renders into an sRGB framebuffer, in which case the
+    // hardware encodes the linear RGB output. This is ignored when a display
+    // calibration LUT is used, since that LUT needs non-linear input.
+    void setSRGBOutput(bool srgbOutput);
+    // Whether display() needs an sRGB framebuffer, as set with setSRGBOutput()
+    bool srgbOutput() const;
+    // Memory used by the view textures, in MiB
+    double viewTextureMiB() const;
+
+    // Render the views for the given output mode into the view textures.
+    // For Output_Alternating, only the view that was not shown last is rendered.
+    // Views that are still valid, because neither the frame nor the parameters
+    // changed since they were rendered, are reused.
+    // Modes that display only half of the pixels of each view (the half
+    // width/height and the interleaved modes) get views at the resolution at
+    // which they are displayed, if that is lower than the frame resolution.
+    // The anaglyph modes without surround do not need view textures: display()
+    // samples both views directly from the frame in a single pass.
+    // The output mode is changed to Output_Left if the frame is not stereo.
+    // Returns whether any view was rendered, and sets the display aspect ratio
+    // of the complete output and whether the frame is stereo.
+    bool renderViews(OutputMode& outputMode, int alternatingLastView,
+            int width, int height, const QQuaternion& surroundOrientation,
+            float* outputAspectRatio, bool* frameIsStereo);
+
+    // Combine the views into the currently bound framebuffer. The view for
+    // Output_Left and Output_Right is selected with leftRightView.
+    // The fragment offset is the position of the lower left corner of the
+    // output on the screen, for the interleaved modes.
+    void display(OutputMode outputMode, int leftRightView,
+            int width, int height, float outputAspectRatio,
+            float fragOffsetX = 0.0f, float fragOffsetY = 0.0f);
+};
@@ -23,6 +23,7 @@
 #include <QCommandLineParser>
 
 #include "playlist.hpp"
+#include "readahead.hpp"
 #include "log.hpp"
 
 
@@ -46,6 +47,16 @@ bool PlaylistEntry::noMedia() const
     return url.isEmpty();
 }
 
+bool PlaylistEntry::operator==(const PlaylistEntry& e) const
+{
+    return url == e.url
+        && inputMode == e.inputMode
+        && surroundMode == e.surroundMode
+        && videoTrack == e.videoTrack
+        && audioTrack == e.audioTrack
+        && subtitleTrack == e.subtitleTrack;
+}
+
 QString PlaylistEntry::optionsToString() const
 {
     QString s;
@@ -188,6 +199,29 @@ void Playlist::emitMediaChanged()
     } else {
         emit mediaChanged(PlaylistEntry());
     }
+    scheduleReadAhead();
+}
+
+void Playlist::scheduleReadAhead()
+{
+    // Number of upcoming entries for which the read-ahead helper warms the cache
+    const int readAheadEntries = 2;
+
+    if (!ReadAhead::instance())
+        return;
+    QUrl current;
+    QList<QUrl> upcoming;
+    if (_currentIndex >= 0 && _currentIndex < length()) {
+        current = _entries[_currentIndex].url;
+        int index = _currentIndex;
+        for (int i = 0; i < readAheadEntries; i++) {
+            index = nextIndexAfter(index);
+            if (index < 0)
+                break;
+            upcoming.append(_entries[index].url);
+        }
+    }
+    ReadAhead::instance()->schedule(current, upcoming);
 }
 
 int Playlist::length() const
@@ -195,6 +229,42 @@ int Playlist::length() const
     return _entries.length();
 }
 
+int Playlist::currentIndex() const
+{
+    return _currentIndex;
+}
+
+int Playlist::nextIndex() const
+{
+    return nextIndexAfter(_currentIndex);
+}
+
+int Playlist::previousIndex() const
+{
+    if (_currentIndex < 0 || _currentIndex >= length())
+        return -1;
+    else if (_currentIndex == 0 && loopMode() == Loop_All)
+        return length() - 1;
+    else if (_currentIndex > 0)
+        return _currentIndex - 1;
+    else
+        return -1;
+}
+
+int Playlist::nextIndexAfter(int index) const
+{
+    if (index < 0 || index >= length())
+        return -1;
+    else if (loopMode() == Loop_One)
+        return index;
+    else if (index == length() - 1 && loopMode() == Loop_All)
+        return 0;
+    else if (index < length() - 1)
+        return index + 1;
+    else
+        return -1;
+}
+
 void Playlist::append(const PlaylistEntry& entry)
 {
     _entries.append(entry);
@@ -288,7 +358,10 @@ LoopMode Playlist::loopMode() const
 
 void Playlist::setLoopMode(LoopMode loopMode)
 {
-    _loopMode = loopMode;
+    if (_loopMode != loopMode) {
+        _loopMode = loopMode;
+        scheduleReadAhead();
+    }
 }
 
 void Playlist::mediaEnded()
@@ -302,6 +375,8 @@ void Playlist::mediaEnded()
     } else if (_currentIndex < length() - 1) {
         // start with next index
         setCurrentIndex(_currentIndex + 1);
+    } else {
+        emit finished();
     }
 }
 
@@ -48,6 +48,7 @@ public:
             int subtitleTrack = DefaultTrack);
 
     bool noMedia() const;
+    bool operator==(const PlaylistEntry& e) const;
     QString optionsToString() const;
     bool optionsFromString(const QString& s);
 };
@@ -67,6 +68,8 @@ private:
     int _currentIndex;
 
     void emitMediaChanged();
+    int nextIndexAfter(int index) const;
+    void scheduleReadAhead();
 
 public:
     Playlist();
@@ -82,6 +85,9 @@ public:
     const QList<PlaylistEntry>& entries() const;
 
     int length() const;
+    int currentIndex() const;
+    int nextIndex() const; // the index that mediaEnded() will switch to, or -1
+    int previousIndex() const; // the entry before the current one (wrapping only in Loop_All mode), or -1
     void append(const PlaylistEntry& entry);
     void insert(int index, const PlaylistEntry& entry);
     void remove(int index);
@@ -104,4 +110,6 @@ public slots:
 
 signals:
     void mediaChanged(PlaylistEntry entry);
+    // emitted when the last entry ended and there is nothing to continue with
+    void finished();
 };
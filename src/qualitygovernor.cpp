@@ -0,0 +1,194 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtMath>
+
+#include "qualitygovernor.hpp"
+#include "bino.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+static const int WindowFrames = 30;         // frames per measurement window
+static const int UpgradeDelayFrames = 120;  // minimum frames between a change and an upgrade
+static const double UpgradeThreshold = 0.7; // fraction of the budget below which quality is increased
+static const float ScaleStep = 0.1f;
+static const float FullAnisotropy = 4.0f;
+
+RenderQuality::RenderQuality() :
+    resolutionScale(1.0f),
+    anisotropy(FullAnisotropy),
+    mipmaps(true)
+{
+}
+
+bool RenderQuality::operator==(const RenderQuality& q) const
+{
+    return resolutionScale == q.resolutionScale && anisotropy == q.anisotropy && mipmaps == q.mipmaps;
+}
+
+bool RenderQuality::operator!=(const RenderQuality& q) const
+{
+    return !operator==(q);
+}
+
+QualityGovernor::QualityGovernor() :
+    _enabled(false),
+    _nextQuery(0),
+    _activeQuery(-1),
+    _budgetMs(0.0f),
+    _minScale(1.0f),
+    _maxScale(1.0f),
+    _scaleSteps(0),
+    _level(0),
+    _windowMs(0.0),
+    _windowFrames(0),
+    _framesSinceChange(0)
+{
+    for (int i = 0; i < QueryCount; i++) {
+        _queries[i] = 0;
+        _queryPending[i] = false;
+        _queryCounts[i] = false;
+    }
+}
+
+void QualityGovernor::initialize()
+{
+    _budgetMs = Bino::instance()->gpuBudget();
+    _minScale = Bino::instance()->minResolutionScale();
+    _maxScale = Bino::instance()->maxResolutionScale();
+    if (_budgetMs <= 0.0f)
+        return;
+    if (!checkTimerQueryAvailability()) {
+        LOG_WARNING("quality governor: GPU timer queries are not available, GPU budget is ignored");
+        return;
+    }
+    initializeOpenGLFunctions();
+    glGenQueries(QueryCount, _queries);
+    _scaleSteps = qCeil((_maxScale - _minScale) / ScaleStep - 0.001f);
+    _level = 0;
+    _enabled = true;
+    Bino::instance()->setRenderQuality(quality(_level));
+    LOG_INFO("quality governor: GPU budget %g ms per frame, resolution scale %g to %g",
+            _budgetMs, _minScale, _maxScale);
+}
+
+void QualityGovernor::cleanup()
+{
+    if (_enabled) {
+        glDeleteQueries(QueryCount, _queries);
+        _enabled = false;
+    }
+}
+
+int QualityGovernor::levelCount() const
+{
+    // full quality, no anisotropy, scale steps, no mipmaps
+    return 2 + _scaleSteps + 1;
+}
+
+RenderQuality QualityGovernor::quality(int level) const
+{
+    RenderQuality q;
+    q.resolutionScale = _maxScale;
+    if (level >= 1)
+        q.anisotropy = 1.0f;
+    if (level >= 2)
+        q.resolutionScale = qMax(_minScale, _maxScale - qMin(level - 1, _scaleSteps) * ScaleStep);
+    if (level >= 2 + _scaleSteps)
+        q.mipmaps = false;
+    return q;
+}
+
+void QualityGovernor::collectResults()
+{
+    for (int i = 0; i < QueryCount; i++) {
+        if (!_queryPending[i] || i == _activeQuery)
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint nsecs = 0;
+        glGetQueryObjectuiv(_queries[i], GL_QUERY_RESULT, &nsecs);
+        _queryPending[i] = false;
+        if (!_queryCounts[i])
+            continue;
+        _windowMs += nsecs / 1e6;
+        _windowFrames++;
+        _framesSinceChange++;
+        if (_windowFrames == WindowFrames) {
+            evaluate(_windowMs / _windowFrames);
+            _windowMs = 0.0;
+            _windowFrames = 0;
+        }
+    }
+}
+
+void QualityGovernor::evaluate(double averageMs)
+{
+    int newLevel = _level;
+    if (averageMs > _budgetMs && _level < levelCount() - 1) {
+        newLevel = _level + 1;
+    } else if (averageMs < UpgradeThreshold * _budgetMs && _level > 0
+            && _framesSinceChange >= UpgradeDelayFrames) {
+        newLevel = _level - 1;
+    }
+    if (newLevel == _level) {
+        LOG_DEBUG("quality governor: average GPU time %.2f ms, budget %g ms, keeping level %d",
+                averageMs, _budgetMs, _level);
+        return;
+    }
+    RenderQuality oldQ = quality(_level);
+    RenderQuality newQ = quality(newLevel);
+    LOG_INFO("quality governor: average GPU time %.2f ms %s budget %g ms: %s quality to level %d of %d "
+            "(resolution scale %g -> %g, anisotropy %g -> %g, mipmaps %s -> %s)",
+            averageMs, newLevel > _level ? "exceeds" : "is well below", _budgetMs,
+            newLevel > _level ? "reducing" : "increasing", newLevel, levelCount() - 1,
+            oldQ.resolutionScale, newQ.resolutionScale, oldQ.anisotropy, newQ.anisotropy,
+            oldQ.mipmaps ? "on" : "off", newQ.mipmaps ? "on" : "off");
+    _level = newLevel;
+    _framesSinceChange = 0;
+    Bino::instance()->setRenderQuality(newQ);
+}
+
+void QualityGovernor::beginFrame()
+{
+    if (!_enabled)
+        return;
+    collectResults();
+    // If the GPU lags so far behind that all queries are in flight, this
+    // frame is not measured
+    if (_queryPending[_nextQuery])
+        return;
+    _activeQuery = _nextQuery;
+    _nextQuery = (_nextQuery + 1) % QueryCount;
+    glBeginQuery(GL_TIME_ELAPSED, _queries[_activeQuery]);
+}
+
+void QualityGovernor::endFrame(bool frameCounts)
+{
+    if (!_enabled || _activeQuery < 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    _queryPending[_activeQuery] = true;
+    _queryCounts[_activeQuery] = frameCounts;
+    _activeQuery = -1;
+}
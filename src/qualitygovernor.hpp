@@ -0,0 +1,88 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+
+
+/* Settings that trade image quality for GPU time. They apply to the frame
+ * textures and to the view textures of the GUI output. */
+
+class RenderQuality
+{
+public:
+    float resolutionScale;      // scale factor for the frame and view texture sizes
+    float anisotropy;           // maximum anisotropy of texture filtering
+    bool mipmaps;               // whether mipmaps are generated for minification
+
+    RenderQuality();
+    bool operator==(const RenderQuality& q) const;
+    bool operator!=(const RenderQuality& q) const;
+};
+
+
+/* Measures the GPU time per frame with timer queries and adapts the render
+ * quality to a GPU time budget: when the average GPU time over a measurement
+ * window exceeds the budget, quality is reduced by one step; when it stays
+ * well below the budget for a while, quality is increased by one step again.
+ * The steps are, from best to cheapest: full quality, no anisotropic
+ * filtering, resolution scale reductions down to the configured minimum, and
+ * finally no mipmap generation. Every change is logged with its reason.
+ * The budget and the resolution scale bounds come from Bino.
+ * All functions must be called with the OpenGL context current. */
+
+class QualityGovernor : protected QOpenGLExtraFunctions
+{
+private:
+    static const int QueryCount = 4;
+
+    bool _enabled;
+    unsigned int _queries[QueryCount];
+    bool _queryPending[QueryCount];
+    bool _queryCounts[QueryCount];  // false for frames that did not render anything
+    int _nextQuery;
+    int _activeQuery;               // query of the current frame, or -1
+
+    float _budgetMs;
+    float _minScale, _maxScale;
+    int _scaleSteps;                // number of resolution scale reductions
+    int _level;                     // 0 is the best quality
+    double _windowMs;               // sum of GPU times in the current window
+    int _windowFrames;
+    int _framesSinceChange;
+
+    int levelCount() const;
+    RenderQuality quality(int level) const;
+    void collectResults();
+    void evaluate(double averageMs);
+
+public:
+    QualityGovernor();
+
+    // Set up timer queries if the governor is enabled in Bino
+    void initialize();
+    void cleanup();
+
+    // Bracket the GPU work of one frame. If the frame did not render
+    // anything, pass false to endFrame() so that it does not count.
+    void beginFrame();
+    void endFrame(bool frameCounts = true);
+};
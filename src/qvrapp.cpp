@@ -28,10 +28,14 @@
 
 #include "qvrapp.hpp"
 #include "bino.hpp"
+#include "gpuprofiler.hpp"
+#include "tracer.hpp"
 #include "tools.hpp"
 
 
-BinoQVRApp::BinoQVRApp()
+BinoQVRApp::BinoQVRApp() :
+    _swapPending(false),
+    _swapFrame(-1)
 {
 }
 
@@ -145,16 +149,49 @@ bool BinoQVRApp::initProcess(QVRProcess*)
         _devModelTextures.append(setupTex(QVRManager::deviceModelTexture(i)));
     }
 
-    return Bino::instance()->initProcess();
+    if (!Bino::instance()->initProcess())
+        return false;
+    _governor.initialize();
+    GpuProfiler::instance()->initialize();
+    return true;
+}
+
+void BinoQVRApp::exitProcess(QVRProcess*)
+{
+    if (_swapPending) {
+        Tracer::end("swap", _swapFrame);
+        _swapPending = false;
+    }
+    _governor.cleanup();
+    GpuProfiler::instance()->cleanup();
 }
 
 void BinoQVRApp::preRenderProcess(QVRProcess*)
 {
+    // QVR swaps the buffers of its windows between postRenderProcess() and
+    // the next preRenderProcess()
+    if (_swapPending) {
+        Tracer::end("swap", _swapFrame);
+        _swapPending = false;
+    }
+    _governor.beginFrame();
+    GpuProfiler::instance()->beginFrame();
     Bino::instance()->preRenderProcess();
 }
 
+void BinoQVRApp::postRenderProcess(QVRProcess*)
+{
+    _governor.endFrame();
+    GpuProfiler::instance()->endFrame();
+    _swapFrame = Bino::instance()->frameNumber();
+    Tracer::begin("swap", _swapFrame);
+    _swapPending = true;
+}
+
 void BinoQVRApp::render(QVRWindow*, const QVRRenderContext& context, const unsigned int* textures)
 {
+    qint64 frameNumber = Bino::instance()->frameNumber();
+    Tracer::begin("display", frameNumber);
     for (int view = 0; view < context.viewCount(); view++) {
         // Render Bino view
         QMatrix4x4 projectionMatrix = context.frustum(view).toMatrix4x4();
@@ -168,6 +205,7 @@ void BinoQVRApp::render(QVRWindow*, const QVRRenderContext& context, const unsig
         int texHeight = context.textureSize(view).height();
         Bino::instance()->render(projectionMatrix, orientationMatrix, viewMatrix, v, texWidth, texHeight, textures[view]);
         // Render VR device models (optional)
+        GpuProfiler::instance()->begin(GpuProfiler::Stage_VRDevices);
         glUseProgram(_prg.programId());
         for (int i = 0; i < QVRManager::deviceCount(); i++) {
             const QVRDevice& device = QVRManager::device(i);
@@ -189,10 +227,12 @@ void BinoQVRApp::render(QVRWindow*, const QVRRenderContext& context, const unsig
                 glDrawElements(GL_TRIANGLES, _devModelVaoIndices[vertexDataIndex], GL_UNSIGNED_SHORT, 0);
             }
         }
+        GpuProfiler::instance()->end(GpuProfiler::Stage_VRDevices);
     }
     // Invalidate depth attachment (to help OpenGL ES performance)
     const GLenum fboInvalidations[] = { GL_DEPTH_ATTACHMENT };
     glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, fboInvalidations);
+    Tracer::end("display", frameNumber);
 }
 
 void BinoQVRApp::keyPressEvent(const QVRRenderContext&, QKeyEvent* event)
@@ -27,17 +27,23 @@
 
 #include <qvr/app.hpp>
 
+#include "qualitygovernor.hpp"
+
 
 class BinoQVRApp : public QVRApp, protected QOpenGLExtraFunctions
 {
 private:
     /* Static per-process data for rendering */
     bool _haveAnisotropicFiltering;
+    QualityGovernor _governor;
     QOpenGLShaderProgram _prg;
     // Data to render device models
     QVector<unsigned int> _devModelVaos;
     QVector<unsigned int> _devModelVaoIndices;
     QVector<unsigned int> _devModelTextures;
+    // Tracing of the buffer swaps, which QVR does after postRenderProcess()
+    bool _swapPending;
+    qint64 _swapFrame;
 
     /* Helper function for texture loading */
     unsigned int setupTex(const QImage& img);
@@ -58,8 +64,10 @@ public:
     bool wantExit() override;
 
     bool initProcess(QVRProcess* p) override;
+    void exitProcess(QVRProcess* p) override;
 
     void preRenderProcess(QVRProcess* p) override;
+    void postRenderProcess(QVRProcess* p) override;
 
     void render(QVRWindow* w, const QVRRenderContext& c, const unsigned int* textures) override;
 
@@ -0,0 +1,521 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+
+#include <QFileInfo>
+#include <QRegularExpression>
+
+#include "rawvideo.hpp"
+#include "log.hpp"
+
+
+RawVideoFormat::RawVideoFormat() :
+    width(0),
+    height(0),
+    pixelFormat(QVideoFrameFormat::Format_Invalid),
+    fps(25.0f)
+{
+}
+
+bool RawVideoFormat::isValid() const
+{
+    return width > 0 && height > 0 && pixelFormat != QVideoFrameFormat::Format_Invalid && fps > 0.0f;
+}
+
+bool RawVideoFormat::parse(const QString& s, RawVideoFormat& format)
+{
+    QStringList parts = s.split(':');
+    if (parts.size() < 2 || parts.size() > 3)
+        return false;
+    QStringList size = parts[0].split('x');
+    if (size.size() != 2)
+        return false;
+    bool ok0, ok1;
+    format.width = size[0].toInt(&ok0);
+    format.height = size[1].toInt(&ok1);
+    if (!ok0 || !ok1)
+        return false;
+    QString pf = parts[1].toLower();
+    if (pf == "yuv420p")
+        format.pixelFormat = QVideoFrameFormat::Format_YUV420P;
+    else if (pf == "yuv422p")
+        format.pixelFormat = QVideoFrameFormat::Format_YUV422P;
+    else if (pf == "yv12")
+        format.pixelFormat = QVideoFrameFormat::Format_YV12;
+    else if (pf == "nv12")
+        format.pixelFormat = QVideoFrameFormat::Format_NV12;
+    else if (pf == "p010")
+        format.pixelFormat = QVideoFrameFormat::Format_P010;
+    else if (pf == "p016")
+        format.pixelFormat = QVideoFrameFormat::Format_P016;
+    else if (pf == "gray")
+        format.pixelFormat = QVideoFrameFormat::Format_Y8;
+    else if (pf == "gray16")
+        format.pixelFormat = QVideoFrameFormat::Format_Y16;
+    else if (pf == "rgba")
+        format.pixelFormat = QVideoFrameFormat::Format_RGBA8888;
+    else if (pf == "rgbx" || pf == "rgb0")
+        format.pixelFormat = QVideoFrameFormat::Format_RGBX8888;
+    else if (pf == "bgra")
+        format.pixelFormat = QVideoFrameFormat::Format_BGRA8888;
+    else if (pf == "bgrx" || pf == "bgr0")
+        format.pixelFormat = QVideoFrameFormat::Format_BGRX8888;
+    else if (pf == "argb")
+        format.pixelFormat = QVideoFrameFormat::Format_ARGB8888;
+    else if (pf == "xrgb" || pf == "0rgb")
+        format.pixelFormat = QVideoFrameFormat::Format_XRGB8888;
+    else if (pf == "abgr")
+        format.pixelFormat = QVideoFrameFormat::Format_ABGR8888;
+    else if (pf == "xbgr" || pf == "0bgr")
+        format.pixelFormat = QVideoFrameFormat::Format_XBGR8888;
+    else
+        return false;
+    if (parts.size() == 3) {
+        bool ok;
+        format.fps = parts[2].toFloat(&ok);
+        if (!ok)
+            return false;
+    }
+    return format.isValid();
+}
+
+RawVideo::RawVideo(const QString& fileName, const RawVideoFormat& format, QObject* parent) :
+    FrameSource(parent),
+    _fileName(fileName),
+    _format(format),
+    _data(nullptr),
+    _yuvValueRangeSmall(true),
+    _yuvSpace(VideoFrame::YUV_BT709),
+    _convert(false),
+    _chromaShiftX(0),
+    _chromaShiftY(0),
+    _sampleBits(8),
+    _planeCount(0),
+    _frameSize(0),
+    _currentFrame(-1),
+    _playing(false),
+    _clockFrame(0)
+{
+    _timer.setTimerType(Qt::PreciseTimer);
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, [=]() { tick(); });
+}
+
+RawVideo::~RawVideo()
+{
+    // The mapping is removed when the last frame referring to it is gone
+}
+
+bool RawVideo::isRawVideo(const QUrl& url)
+{
+    if (!url.isLocalFile())
+        return false;
+    QString suffix = QFileInfo(url.toLocalFile()).suffix().toLower();
+    return (suffix == "y4m" || suffix == "yuv" || suffix == "raw" || suffix == "rgb" || suffix == "rgba");
+}
+
+// Parse the stream header of a YUV4MPEG2 file, e.g.
+// "YUV4MPEG2 W1920 H1080 F30000:1001 Ip A1:1 C420jpeg\n"
+bool RawVideo::parseY4MHeader(qint64& headerSize)
+{
+    const qint64 maxHeaderSize = 1024;
+    qint64 searchSize = qMin(_file->size(), maxHeaderSize);
+    const uchar* nl = static_cast<const uchar*>(std::memchr(_data, '\n', searchSize));
+    if (!nl || std::memcmp(_data, "YUV4MPEG2 ", 10) != 0)
+        return false;
+    headerSize = nl - _data + 1;
+    QStringList params = QString::fromLatin1(reinterpret_cast<const char*>(_data), headerSize - 1).split(' ', Qt::SkipEmptyParts);
+    _format.pixelFormat = QVideoFrameFormat::Format_YUV420P; // default according to the specification
+    for (int i = 1; i < params.size(); i++) {
+        QChar tag = params[i][0];
+        QString value = params[i].mid(1);
+        if (tag == 'W') {
+            _format.width = value.toInt();
+        } else if (tag == 'H') {
+            _format.height = value.toInt();
+        } else if (tag == 'F') {
+            QStringList fraction = value.split(':');
+            if (fraction.size() == 2 && fraction[1].toInt() > 0)
+                _format.fps = fraction[0].toFloat() / fraction[1].toInt();
+        } else if (tag == 'C') {
+            // chroma subsampling and bits per sample, e.g. 420jpeg, 422, 444p10
+            static const QRegularExpression chromaRegExp("^(420|422|444)(?:p([0-9]+))?");
+            QRegularExpressionMatch m = chromaRegExp.match(value);
+            _convert = false;
+            if (m.hasMatch()) {
+                QString subsampling = m.captured(1);
+                int bits = (m.captured(2).isEmpty() ? 8 : m.captured(2).toInt());
+                if (bits == 8 && subsampling == "420") {
+                    _format.pixelFormat = QVideoFrameFormat::Format_YUV420P;
+                } else if (bits == 8 && subsampling == "422") {
+                    _format.pixelFormat = QVideoFrameFormat::Format_YUV422P;
+                } else if (bits >= 8 && bits <= 16) {
+                    _convert = true;
+                    _chromaShiftX = (subsampling == "444" ? 0 : 1);
+                    _chromaShiftY = (subsampling == "420" ? 1 : 0);
+                    _sampleBits = bits;
+                    // not used for converted frames, but marks the format as valid
+                    _format.pixelFormat = QVideoFrameFormat::Format_YUV420P;
+                } else {
+                    _format.pixelFormat = QVideoFrameFormat::Format_Invalid;
+                }
+            } else if (value == "mono") {
+                _format.pixelFormat = QVideoFrameFormat::Format_Y8;
+            } else if (value == "mono16") {
+                _format.pixelFormat = QVideoFrameFormat::Format_Y16;
+            } else {
+                _format.pixelFormat = QVideoFrameFormat::Format_Invalid;
+            }
+        } else if (tag == 'X') {
+            if (value == "COLORRANGE=FULL")
+                _yuvValueRangeSmall = false;
+        }
+    }
+    return true;
+}
+
+// Compute the plane layout of a frame from the format
+bool RawVideo::computeLayout()
+{
+    int w = _format.width;
+    int h = _format.height;
+    if (_convert) {
+        int sampleBytes = (_sampleBits > 8 ? 2 : 1);
+        int cw = (w + (1 << _chromaShiftX) - 1) >> _chromaShiftX;
+        int ch = (h + (1 << _chromaShiftY) - 1) >> _chromaShiftY;
+        _planeCount = 3;
+        _bytesPerLine[0] = w * sampleBytes;
+        _bytesPerLine[1] = _bytesPerLine[2] = cw * sampleBytes;
+        _bytesPerPlane[0] = w * h * sampleBytes;
+        _bytesPerPlane[1] = _bytesPerPlane[2] = cw * ch * sampleBytes;
+    } else {
+        switch (_format.pixelFormat) {
+        case QVideoFrameFormat::Format_YUV420P:
+        case QVideoFrameFormat::Format_YV12:
+            _planeCount = 3;
+            _bytesPerLine[0] = w;
+            _bytesPerLine[1] = _bytesPerLine[2] = w / 2;
+            _bytesPerPlane[0] = w * h;
+            _bytesPerPlane[1] = _bytesPerPlane[2] = (w / 2) * (h / 2);
+            break;
+        case QVideoFrameFormat::Format_YUV422P:
+            _planeCount = 3;
+            _bytesPerLine[0] = w;
+            _bytesPerLine[1] = _bytesPerLine[2] = w / 2;
+            _bytesPerPlane[0] = w * h;
+            _bytesPerPlane[1] = _bytesPerPlane[2] = (w / 2) * h;
+            break;
+        case QVideoFrameFormat::Format_NV12:
+            _planeCount = 2;
+            _bytesPerLine[0] = _bytesPerLine[1] = w;
+            _bytesPerPlane[0] = w * h;
+            _bytesPerPlane[1] = w * (h / 2);
+            break;
+        case QVideoFrameFormat::Format_P010:
+        case QVideoFrameFormat::Format_P016:
+            _planeCount = 2;
+            _bytesPerLine[0] = _bytesPerLine[1] = 2 * w;
+            _bytesPerPlane[0] = 2 * w * h;
+            _bytesPerPlane[1] = 2 * w * (h / 2);
+            break;
+        case QVideoFrameFormat::Format_Y8:
+            _planeCount = 1;
+            _bytesPerLine[0] = w;
+            _bytesPerPlane[0] = w * h;
+            break;
+        case QVideoFrameFormat::Format_Y16:
+            _planeCount = 1;
+            _bytesPerLine[0] = 2 * w;
+            _bytesPerPlane[0] = 2 * w * h;
+            break;
+        case QVideoFrameFormat::Format_RGBA8888:
+        case QVideoFrameFormat::Format_RGBX8888:
+        case QVideoFrameFormat::Format_BGRA8888:
+        case QVideoFrameFormat::Format_BGRX8888:
+        case QVideoFrameFormat::Format_ARGB8888:
+        case QVideoFrameFormat::Format_XRGB8888:
+        case QVideoFrameFormat::Format_ABGR8888:
+        case QVideoFrameFormat::Format_XBGR8888:
+            _planeCount = 1;
+            _bytesPerLine[0] = 4 * w;
+            _bytesPerPlane[0] = 4 * w * h;
+            break;
+        default:
+            return false;
+        }
+    }
+    // subsampled chroma requires even dimensions
+    if (!_convert && _planeCount > 1 && (w % 2 != 0 || h % 2 != 0))
+        return false;
+    _frameSize = 0;
+    for (int p = 0; p < _planeCount; p++)
+        _frameSize += _bytesPerPlane[p];
+    // the YUV matrix is not stored in the file, so guess it from the size
+    _yuvSpace = (h >= 720 ? VideoFrame::YUV_BT709 : VideoFrame::YUV_BT601);
+    return true;
+}
+
+bool RawVideo::open()
+{
+    _file = std::make_shared<QFile>(_fileName);
+    if (!_file->open(QIODevice::ReadOnly)) {
+        LOG_WARNING("%s", qPrintable(tr("%1: %2").arg(_fileName).arg(_file->errorString())));
+        return false;
+    }
+    qint64 size = _file->size();
+    _data = _file->map(0, size);
+    if (!_data) {
+        LOG_WARNING("%s", qPrintable(tr("%1: cannot map file: %2").arg(_fileName).arg(_file->errorString())));
+        return false;
+    }
+    bool isY4M = (QFileInfo(_fileName).suffix().toLower() == "y4m");
+    qint64 headerSize = 0;
+    if (isY4M && !parseY4MHeader(headerSize)) {
+        LOG_WARNING("%s", qPrintable(tr("%1: invalid YUV4MPEG2 header").arg(_fileName)));
+        return false;
+    }
+    if (!_format.isValid() || !computeLayout()) {
+        if (isY4M)
+            LOG_WARNING("%s", qPrintable(tr("%1: unsupported YUV4MPEG2 frame format").arg(_fileName)));
+        else
+            LOG_WARNING("%s", qPrintable(tr("%1: unknown raw video format, use --raw-format").arg(_fileName)));
+        return false;
+    }
+    _frameOffsets.clear();
+    if (isY4M) {
+        // every frame starts with a FRAME header that may contain parameters
+        qint64 pos = headerSize;
+        while (pos + 6 <= size && std::memcmp(_data + pos, "FRAME", 5) == 0) {
+            const uchar* nl = static_cast<const uchar*>(std::memchr(_data + pos, '\n', size - pos));
+            if (!nl)
+                break;
+            qint64 offset = nl - _data + 1;
+            if (offset + _frameSize > size)
+                break;
+            _frameOffsets.append(offset);
+            pos = offset + _frameSize;
+        }
+    } else {
+        for (qint64 offset = 0; offset + _frameSize <= size; offset += _frameSize)
+            _frameOffsets.append(offset);
+    }
+    if (_frameOffsets.isEmpty()) {
+        LOG_WARNING("%s", qPrintable(tr("%1: no frames found").arg(_fileName)));
+        return false;
+    }
+    if (_convert) {
+        LOG_WARNING("%s", qPrintable(tr("%1: YUV4MPEG2 layout with %2 bits per sample and %3 chroma is converted on the CPU")
+                    .arg(_fileName).arg(_sampleBits)
+                    .arg(_chromaShiftX == 0 ? "4:4:4" : _chromaShiftY == 0 ? "4:2:2" : "4:2:0")));
+        LOG_DEBUG("raw video %s: %dx%d, %d frames at %g fps", qPrintable(_fileName),
+                _format.width, _format.height, int(_frameOffsets.size()), _format.fps);
+    } else {
+        LOG_DEBUG("raw video %s: %dx%d %s, %d frames at %g fps", qPrintable(_fileName),
+                _format.width, _format.height,
+                qPrintable(QVideoFrameFormat::pixelFormatToString(_format.pixelFormat)),
+                int(_frameOffsets.size()), _format.fps);
+    }
+    seekToFrame(0);
+    return true;
+}
+
+QUrl RawVideo::url() const
+{
+    return QUrl::fromLocalFile(_fileName);
+}
+
+bool RawVideo::isPlaying() const
+{
+    return _playing;
+}
+
+bool RawVideo::isFinished() const
+{
+    return !_playing && frameCount() > 0 && _currentFrame == frameCount() - 1;
+}
+
+float RawVideo::fps() const
+{
+    return _format.fps;
+}
+
+int RawVideo::frameCount() const
+{
+    return _frameOffsets.size();
+}
+
+qint64 RawVideo::position() const
+{
+    return qMax(_currentFrame, 0) * 1000.0 / _format.fps;
+}
+
+qint64 RawVideo::duration() const
+{
+    return frameCount() * 1000.0 / _format.fps;
+}
+
+void RawVideo::play()
+{
+    if (_playing || frameCount() == 0)
+        return;
+    if (isFinished())
+        seekToFrame(0);
+    _playing = true;
+    resetClock();
+    scheduleTick();
+}
+
+void RawVideo::pause()
+{
+    _playing = false;
+    _timer.stop();
+}
+
+void RawVideo::seekToFrame(int index)
+{
+    if (frameCount() == 0)
+        return;
+    showFrame(qBound(0, index, frameCount() - 1));
+    // continue playback from here
+    resetClock();
+    scheduleTick();
+}
+
+void RawVideo::setPosition(qint64 milliseconds)
+{
+    seekToFrame(milliseconds * _format.fps / 1000.0);
+}
+
+void RawVideo::step(int frames)
+{
+    pause();
+    if (frameCount() == 0)
+        return;
+    int target = qBound(0, _currentFrame + frames, frameCount() - 1);
+    if (target != _currentFrame)
+        showFrame(target);
+}
+
+// Convert planar YUV data with the given chroma subsampling and bits per sample
+// (in little endian 16 bit words if more than 8) to a non-linear RGB image
+static QImage yuvToImage(const uchar* data, int w, int h, int shiftX, int shiftY, int bits,
+        bool valueRangeSmall, VideoFrame::YUVSpace yuvSpace)
+{
+    int sampleBytes = (bits > 8 ? 2 : 1);
+    int cw = (w + (1 << shiftX) - 1) >> shiftX;
+    int ch = (h + (1 << shiftY) - 1) >> shiftY;
+    const uchar* planes[3];
+    planes[0] = data;
+    planes[1] = planes[0] + qint64(w) * h * sampleBytes;
+    planes[2] = planes[1] + qint64(cw) * ch * sampleBytes;
+    float scale = (1 << bits) / 256.0f;
+    float yOffset = (valueRangeSmall ? 16.0f * scale : 0.0f);
+    float yRange = (valueRangeSmall ? 219.0f * scale : (1 << bits) - 1.0f);
+    float cOffset = 128.0f * scale;
+    float cRange = (valueRangeSmall ? 224.0f * scale : (1 << bits) - 1.0f);
+    float kr = 0.299f, kb = 0.114f;
+    if (yuvSpace == VideoFrame::YUV_BT709) {
+        kr = 0.2126f;
+        kb = 0.0722f;
+    } else if (yuvSpace == VideoFrame::YUV_BT2020) {
+        kr = 0.2627f;
+        kb = 0.0593f;
+    }
+    float kg = 1.0f - kr - kb;
+    auto sample = [=](int p, int lineWidth, int x, int y) -> float {
+        const uchar* s = planes[p] + (qint64(y) * lineWidth + x) * sampleBytes;
+        return (sampleBytes == 2 ? float(s[0] | (s[1] << 8)) : float(s[0]));
+    };
+    QImage image(w, h, bits > 8 ? QImage::Format_RGBX64 : QImage::Format_RGB32);
+    for (int y = 0; y < h; y++) {
+        QRgb* line32 = reinterpret_cast<QRgb*>(image.scanLine(y));
+        QRgba64* line64 = reinterpret_cast<QRgba64*>(image.scanLine(y));
+        for (int x = 0; x < w; x++) {
+            float Y = (sample(0, w, x, y) - yOffset) / yRange;
+            float U = (sample(1, cw, x >> shiftX, y >> shiftY) - cOffset) / cRange;
+            float V = (sample(2, cw, x >> shiftX, y >> shiftY) - cOffset) / cRange;
+            float r = qBound(0.0f, Y + 2.0f * (1.0f - kr) * V, 1.0f);
+            float b = qBound(0.0f, Y + 2.0f * (1.0f - kb) * U, 1.0f);
+            float g = qBound(0.0f, (Y - kr * r - kb * b) / kg, 1.0f);
+            if (bits > 8) {
+                line64[x] = QRgba64::fromRgba64(r * 65535.0f + 0.5f, g * 65535.0f + 0.5f, b * 65535.0f + 0.5f, 65535);
+            } else {
+                line32[x] = qRgb(r * 255.0f + 0.5f, g * 255.0f + 0.5f, b * 255.0f + 0.5f);
+            }
+        }
+    }
+    return image;
+}
+
+void RawVideo::showFrame(int index)
+{
+    _currentFrame = index;
+    if (_convert) {
+        emit imageReady(yuvToImage(_data + _frameOffsets[index], _format.width, _format.height,
+                    _chromaShiftX, _chromaShiftY, _sampleBits, _yuvValueRangeSmall, _yuvSpace));
+        return;
+    }
+    RawFrame frame;
+    frame.width = _format.width;
+    frame.height = _format.height;
+    frame.pixelFormat = _format.pixelFormat;
+    frame.yuvValueRangeSmall = _yuvValueRangeSmall;
+    frame.yuvSpace = _yuvSpace;
+    frame.planeCount = _planeCount;
+    uchar* bits = _data + _frameOffsets[index];
+    for (int p = 0; p < _planeCount; p++) {
+        frame.bytesPerLine[p] = _bytesPerLine[p];
+        frame.bytesPerPlane[p] = _bytesPerPlane[p];
+        frame.bits[p] = bits;
+        bits += _bytesPerPlane[p];
+    }
+    frame.owner = _file;
+    emit frameReady(frame);
+}
+
+void RawVideo::resetClock()
+{
+    _clock.start();
+    _clockFrame = _currentFrame;
+}
+
+// Start the timer for the frame after the current one. Its due time is
+// computed from the reference time, not from the previous tick.
+void RawVideo::scheduleTick()
+{
+    if (!_playing)
+        return;
+    double dueMs = (_currentFrame + 1 - _clockFrame) * 1000.0 / _format.fps;
+    qint64 waitMs = qRound64(dueMs - _clock.nsecsElapsed() / 1e6);
+    _timer.start(qMax(qint64(0), waitMs));
+}
+
+void RawVideo::tick()
+{
+    if (_currentFrame >= frameCount() - 1) {
+        pause();
+        emit finished();
+        return;
+    }
+    showFrame(_currentFrame + 1);
+    scheduleTick();
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <memory>
+
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QList>
+#include <QUrl>
+#include <QVideoFrameFormat>
+
+#include "framesource.hpp"
+#include "videoframe.hpp"
+
+
+/* The layout of raw video files without a header, as given on the command
+ * line in the form WIDTHxHEIGHT:FORMAT[:FPS]. */
+
+class RawVideoFormat
+{
+public:
+    int width;
+    int height;
+    QVideoFrameFormat::PixelFormat pixelFormat;
+    float fps;
+
+    RawVideoFormat();
+
+    bool isValid() const;
+    // Parse a format string; returns false if it is invalid
+    static bool parse(const QString& s, RawVideoFormat& format);
+};
+
+
+/* Plays uncompressed YUV4MPEG2 (.y4m) files and raw planar video files.
+ * The file is memory-mapped and the frames are handed to the video sink
+ * as pointers into the mapping, so that no decoder and no copy is involved
+ * before the texture upload. Every frame can be accessed directly by its
+ * index, which makes seeking and stepping exact and instant.
+ * YUV4MPEG2 layouts that have no matching pixel format (4:4:4 chroma, more
+ * than 8 bits per sample) are converted to images on the CPU instead. */
+
+class RawVideo : public FrameSource
+{
+Q_OBJECT
+
+private:
+    QString _fileName;
+    RawVideoFormat _format;
+    std::shared_ptr<QFile> _file; // owns the mapping; shared with the frames on screen
+    uchar* _data;
+    bool _yuvValueRangeSmall;
+    VideoFrame::YUVSpace _yuvSpace;
+    bool _convert;              // whether frames are converted to images
+    int _chromaShiftX;          // chroma subsampling of converted frames
+    int _chromaShiftY;
+    int _sampleBits;            // bits per sample of converted frames
+    int _planeCount;
+    int _bytesPerLine[3];
+    int _bytesPerPlane[3];
+    qint64 _frameSize;
+    QList<qint64> _frameOffsets;
+    int _currentFrame;          // index of the frame on screen, or -1
+    bool _playing;
+    QTimer _timer;              // single shot, for the next frame
+    QElapsedTimer _clock;       // playback time reference
+    int _clockFrame;            // index of the frame that was shown at the reference time
+
+    bool parseY4MHeader(qint64& headerSize);
+    bool computeLayout();
+    void showFrame(int index);
+    void resetClock();
+    void scheduleTick();
+    void tick();
+
+public:
+    RawVideo(const QString& fileName, const RawVideoFormat& format, QObject* parent = nullptr);
+    virtual ~RawVideo();
+
+    // Whether the URL refers to a local file that we handle as raw video,
+    // based on its file name extension
+    static bool isRawVideo(const QUrl& url);
+
+    // Map the file and find the frames. Returns false if that fails.
+    virtual bool open() override;
+
+    virtual QUrl url() const override;
+    virtual bool isPlaying() const override;
+    virtual bool isFinished() const override;
+    virtual qint64 position() const override;
+    virtual qint64 duration() const override;
+    virtual float fps() const override;
+
+    virtual void play() override;
+    virtual void pause() override;
+    virtual void setPosition(qint64 milliseconds) override;
+    virtual void step(int frames) override;
+
+    int frameCount() const;
+    void seekToFrame(int index);
+
+signals:
+    void frameReady(const RawFrame& frame);
+    // instead of frameReady() for converted frames
+    void imageReady(const QImage& image);
+};
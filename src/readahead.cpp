@@ -0,0 +1,218 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// for posix_fadvise(), mmap() and mincore():
+#if __has_include(<fcntl.h>) && __has_include(<unistd.h>) && __has_include(<sys/mman.h>)
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# define HAVE_POSIX_IO 1
+#endif
+
+#include <vector>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "readahead.hpp"
+#include "log.hpp"
+
+
+static ReadAhead* readAheadSingleton = nullptr;
+
+ReadAhead::ReadAhead(qint64 budget) :
+    _budget(budget),
+    _abort(false),
+    _generation(0),
+    _currentFileIsNew(false),
+    _statFilesWarmed(0),
+    _statBytesRequested(0),
+    _statFilesStarted(0),
+    _statFilesStartedWarm(0),
+    _statResidentSum(0.0)
+{
+    Q_ASSERT(!readAheadSingleton);
+    readAheadSingleton = this;
+}
+
+ReadAhead::~ReadAhead()
+{
+    _mutex.lock();
+    _abort = true;
+    _waitCondition.wakeOne();
+    _mutex.unlock();
+    wait();
+    if (_statFilesStarted > 0) {
+        LOG_INFO("read-ahead: %d files started, %d of them with a warm cache, %.1f%% of prefix data resident on average",
+                _statFilesStarted, _statFilesStartedWarm, 100.0 * _statResidentSum / _statFilesStarted);
+    }
+    if (_statFilesWarmed > 0) {
+        LOG_INFO("read-ahead: %d files warmed, %.1f MiB requested in total",
+                _statFilesWarmed, _statBytesRequested / (1024.0 * 1024.0));
+    }
+    readAheadSingleton = nullptr;
+}
+
+ReadAhead* ReadAhead::instance()
+{
+    return readAheadSingleton;
+}
+
+void ReadAhead::schedule(const QUrl& current, const QList<QUrl>& upcoming)
+{
+    if (_budget <= 0)
+        return;
+    QMutexLocker locker(&_mutex);
+    _generation++;
+    QString currentFile = current.isLocalFile() ? current.toLocalFile() : QString();
+    _currentFileIsNew = (currentFile != _currentFile);
+    _currentFile = currentFile;
+    _upcomingFiles.clear();
+    for (int i = 0; i < upcoming.size(); i++) {
+        if (upcoming[i].isLocalFile() && upcoming[i] != current
+                && !_upcomingFiles.contains(upcoming[i].toLocalFile())) {
+            _upcomingFiles.append(upcoming[i].toLocalFile());
+        }
+    }
+    if (!isRunning())
+        start(QThread::LowPriority);
+    _waitCondition.wakeOne();
+}
+
+// Measure how much of the beginning of a file is in the page cache.
+// Returns the fraction in [0,1], or -1 if this cannot be determined.
+static double residentFraction(const QString& fileName, qint64 length)
+{
+#if defined(HAVE_POSIX_IO)
+    if (length <= 0)
+        return -1.0;
+    int fd = ::open(qPrintable(fileName), O_RDONLY);
+    if (fd < 0)
+        return -1.0;
+    void* map = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return -1.0;
+    long pageSize = ::sysconf(_SC_PAGESIZE);
+    size_t pages = (length + pageSize - 1) / pageSize;
+#if defined(__linux__)
+    std::vector<unsigned char> vec(pages);
+#else
+    std::vector<char> vec(pages);
+#endif
+    double fraction = -1.0;
+    if (::mincore(map, length, vec.data()) == 0) {
+        size_t resident = 0;
+        for (size_t i = 0; i < pages; i++)
+            resident += (vec[i] & 1);
+        fraction = double(resident) / pages;
+    }
+    ::munmap(map, length);
+    return fraction;
+#else
+    Q_UNUSED(fileName);
+    Q_UNUSED(length);
+    return -1.0;
+#endif
+}
+
+void ReadAhead::check(const QString& fileName)
+{
+    qint64 length = qMin(QFileInfo(fileName).size(), _budget);
+    double fraction = residentFraction(fileName, length);
+    if (fraction < 0.0)
+        return;
+    _statFilesStarted++;
+    _statResidentSum += fraction;
+    if (fraction >= 0.99)
+        _statFilesStartedWarm++;
+    LOG_DEBUG("read-ahead: %.1f%% of the first %.1f MiB of %s were cached at start",
+            100.0 * fraction, length / (1024.0 * 1024.0), qPrintable(fileName));
+}
+
+void ReadAhead::warm(const QString& fileName, unsigned long long generation)
+{
+    qint64 length = qMin(QFileInfo(fileName).size(), _budget);
+    if (length <= 0)
+        return;
+    LOG_DEBUG("read-ahead: warming the first %.1f MiB of %s", length / (1024.0 * 1024.0), qPrintable(fileName));
+    _statFilesWarmed++;
+#if defined(HAVE_POSIX_IO) && defined(POSIX_FADV_WILLNEED)
+    Q_UNUSED(generation);
+    int fd = ::open(qPrintable(fileName), O_RDONLY);
+    if (fd >= 0) {
+        if (::posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED) == 0)
+            _statBytesRequested += length;
+        ::close(fd);
+        return;
+    }
+#endif
+    // Fallback: read the data ourselves so that it ends up in the cache,
+    // and stop early when the schedule changes
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    std::vector<char> buffer(1 << 20);
+    qint64 done = 0;
+    while (done < length) {
+        _mutex.lock();
+        bool stop = (_abort || _generation != generation);
+        _mutex.unlock();
+        if (stop)
+            break;
+        qint64 r = file.read(buffer.data(), qMin(qint64(buffer.size()), length - done));
+        if (r <= 0)
+            break;
+        done += r;
+    }
+    _statBytesRequested += done;
+}
+
+void ReadAhead::run()
+{
+    unsigned long long lastGeneration = 0;
+    for (;;) {
+        _mutex.lock();
+        while (!_abort && _generation == lastGeneration)
+            _waitCondition.wait(&_mutex);
+        if (_abort) {
+            _mutex.unlock();
+            break;
+        }
+        unsigned long long generation = _generation;
+        QString currentFile = _currentFileIsNew ? _currentFile : QString();
+        _currentFileIsNew = false;
+        QStringList upcomingFiles = _upcomingFiles;
+        _mutex.unlock();
+        lastGeneration = generation;
+
+        if (!currentFile.isEmpty())
+            check(currentFile);
+        for (int i = 0; i < upcomingFiles.size(); i++) {
+            _mutex.lock();
+            bool stop = (_abort || _generation != generation);
+            _mutex.unlock();
+            if (stop)
+                break;
+            warm(upcomingFiles[i], generation);
+        }
+    }
+}
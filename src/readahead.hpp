@@ -0,0 +1,70 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QUrl>
+
+
+/* Warm the page cache for the files of upcoming play list entries, so that
+ * their first seconds do not stutter on slow storage (spinning disks, NFS).
+ * The play list tells us which entries come next; a background thread then
+ * asks the operating system to read the beginning of these files. */
+
+class ReadAhead : public QThread
+{
+Q_OBJECT
+
+private:
+    qint64 _budget;             // maximum number of bytes to read ahead per file
+    QMutex _mutex;
+    QWaitCondition _waitCondition;
+    bool _abort;
+    unsigned long long _generation; // incremented by every call to schedule()
+    QString _currentFile;       // file that just started playing, for statistics
+    bool _currentFileIsNew;     // whether _currentFile still needs to be checked
+    QStringList _upcomingFiles; // files to warm, in order of priority
+
+    // statistics, only accessed by the thread
+    int _statFilesWarmed;
+    qint64 _statBytesRequested;
+    int _statFilesStarted;
+    int _statFilesStartedWarm;
+    double _statResidentSum;
+
+    void warm(const QString& fileName, unsigned long long generation);
+    void check(const QString& fileName);
+
+protected:
+    virtual void run() override;
+
+public:
+    ReadAhead(qint64 budget); // a budget of zero disables read-ahead
+    virtual ~ReadAhead();
+
+    static ReadAhead* instance();
+
+    // Called by the play list whenever the current entry changes.
+    void schedule(const QUrl& current, const QList<QUrl>& upcoming);
+};
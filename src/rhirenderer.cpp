@@ -0,0 +1,731 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef WITH_RHI
+
+#include <cstring>
+#include <utility>
+
+#include <QtMath>
+#include <QFile>
+#include <QFloat16>
+#include <QMatrix4x4>
+#include <QRectF>
+#include <QOffscreenSurface>
+#if QT_CONFIG(vulkan)
+# include <QVulkanInstance>
+#endif
+
+#include "rhirenderer.hpp"
+#include "cubelut.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+/* Uniform buffer layouts; these must match the std140 blocks in the shaders */
+
+class ColorUniforms
+{
+public:
+    qint32 planeFormat;
+    qint32 yuvValueRangeSmall;
+    qint32 yuvSpace;
+    qint32 linearInput;
+    qint32 swizzle;
+    qint32 padding[3];
+};
+
+class ViewUniforms
+{
+public:
+    float orientationMatrix[16];
+    float viewRect[4];
+    float projectionRight;
+    float projectionTop;
+    qint32 surroundDegrees;
+    qint32 padding;
+};
+
+class DisplayUniforms
+{
+public:
+    qint32 outputMode;
+    qint32 outputModeLeftRightView;
+    float relativeWidth;
+    float relativeHeight;
+    float fragOffsetX;
+    float fragOffsetY;
+    float outputHeight;
+    qint32 srgbOutput;
+    float viewTexelSnap[2];
+    qint32 fusedViews;
+    qint32 displayLutEnabled;
+    float viewSource[2][4];
+    float displayLutDomainMin[3];
+    float displayLutSize;
+    float displayLutDomainFactor[3];
+    qint32 viewFrame[2];
+    qint32 padding[3];
+};
+
+static QShader loadShader(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QShader();
+    return QShader::fromSerialized(file.readAll());
+}
+
+RhiRenderer::RhiRenderer() :
+    _vulkanInstance(nullptr),
+    _fallbackSurface(nullptr),
+    _rhi(nullptr),
+    _quadVbuf(nullptr),
+    _linearSampler(nullptr),
+    _mipmapSampler(nullptr),
+    _repeatSampler(nullptr),
+    _lutSampler(nullptr),
+    _intermediateFormat(QRhiTexture::RGBA16F),
+    _toLinearLut(nullptr),
+    _toNonlinearLut(nullptr),
+    _displayLut(nullptr),
+    _displayLutEnabled(false),
+    _displayLutDomainMin { 0.0f, 0.0f, 0.0f },
+    _displayLutDomainFactor { 1.0f, 1.0f, 1.0f },
+    _displayLutSize(1),
+    _srgbOutput(true),
+    _floatRp(nullptr),
+    _outputRp(nullptr),
+    _planeTex { { nullptr, nullptr, nullptr }, { nullptr, nullptr, nullptr } },
+    _frameTex { nullptr, nullptr },
+    _frameRt { nullptr, nullptr },
+    _colorUbuf { nullptr, nullptr },
+    _colorSrb { nullptr, nullptr },
+    _colorPipeline(nullptr),
+    _viewTex { nullptr, nullptr },
+    _viewRt { nullptr, nullptr },
+    _viewUbuf { nullptr, nullptr },
+    _viewSrb { nullptr, nullptr },
+    _viewSrbTex { nullptr, nullptr },
+    _viewSrbSampler { nullptr, nullptr },
+    _viewPipeline(nullptr),
+    _outputTex(nullptr),
+    _outputRt(nullptr),
+    _displayUbuf(nullptr),
+    _displaySrb(nullptr),
+    _displayPipeline(nullptr)
+{
+}
+
+RhiRenderer::~RhiRenderer()
+{
+    // all resources must be released before the QRhi
+    delete _displayPipeline;
+    delete _displaySrb;
+    delete _displayUbuf;
+    delete _outputRt;
+    delete _outputTex;
+    delete _viewPipeline;
+    delete _colorPipeline;
+    for (int i = 0; i < 2; i++) {
+        delete _viewSrb[i];
+        delete _viewUbuf[i];
+        delete _viewRt[i];
+        delete _viewTex[i];
+        delete _colorSrb[i];
+        delete _colorUbuf[i];
+        delete _frameRt[i];
+        delete _frameTex[i];
+        for (int p = 0; p < 3; p++)
+            delete _planeTex[i][p];
+    }
+    delete _outputRp;
+    delete _floatRp;
+    delete _displayLut;
+    delete _toNonlinearLut;
+    delete _toLinearLut;
+    delete _lutSampler;
+    delete _repeatSampler;
+    delete _mipmapSampler;
+    delete _linearSampler;
+    delete _quadVbuf;
+    delete _rhi;
+    delete _fallbackSurface;
+#if QT_CONFIG(vulkan)
+    delete _vulkanInstance;
+#endif
+}
+
+QRhiGraphicsPipeline* RhiRenderer::createPipeline(const QString& fragmentShader,
+        QRhiShaderResourceBindings* srb, QRhiRenderPassDescriptor* rp)
+{
+    QShader vs = loadShader(":/src/shader-rhi-quad.vert.qsb");
+    QShader fs = loadShader(fragmentShader);
+    if (!vs.isValid() || !fs.isValid()) {
+        LOG_FATAL("cannot load QRhi shader %s", qPrintable(fragmentShader));
+        return nullptr;
+    }
+    QRhiGraphicsPipeline* pipeline = _rhi->newGraphicsPipeline();
+    pipeline->setTopology(QRhiGraphicsPipeline::TriangleStrip);
+    pipeline->setShaderStages({
+            QRhiShaderStage(QRhiShaderStage::Vertex, vs),
+            QRhiShaderStage(QRhiShaderStage::Fragment, fs) });
+    QRhiVertexInputLayout inputLayout;
+    inputLayout.setBindings({ QRhiVertexInputBinding(4 * sizeof(float)) });
+    inputLayout.setAttributes({
+            QRhiVertexInputAttribute(0, 0, QRhiVertexInputAttribute::Float2, 0),
+            QRhiVertexInputAttribute(0, 1, QRhiVertexInputAttribute::Float2, 2 * sizeof(float)) });
+    pipeline->setVertexInputLayout(inputLayout);
+    pipeline->setShaderResourceBindings(srb);
+    pipeline->setRenderPassDescriptor(rp);
+    if (!pipeline->create()) {
+        delete pipeline;
+        return nullptr;
+    }
+    return pipeline;
+}
+
+// Upload the lookup texture for the sRGB transfer function, see createTransferFunctionTexture()
+static void uploadTransferFunctionLut(QRhiResourceUpdateBatch* updates, QRhiTexture* tex, bool toLinear)
+{
+    std::vector<float> values = transferFunctionValues(toLinear);
+    std::vector<qfloat16> halfValues(values.begin(), values.end());
+    QRhiTextureSubresourceUploadDescription data(halfValues.data(), halfValues.size() * sizeof(qfloat16));
+    updates->uploadTexture(tex, QRhiTextureUploadDescription(QRhiTextureUploadEntry(0, 0, data)));
+}
+
+bool RhiRenderer::initialize(API api, FramePrecision precision, const CubeLut& displayLut)
+{
+    if (api == API_Vulkan) {
+#if QT_CONFIG(vulkan)
+        _vulkanInstance = new QVulkanInstance;
+        _vulkanInstance->setExtensions(QRhiVulkanInitParams::preferredInstanceExtensions());
+        if (_vulkanInstance->create()) {
+            QRhiVulkanInitParams params;
+            params.inst = _vulkanInstance;
+            _rhi = QRhi::create(QRhi::Vulkan, &params);
+        }
+#endif
+    } else {
+        _fallbackSurface = QRhiGles2InitParams::newFallbackSurface();
+        QRhiGles2InitParams params;
+        params.fallbackSurface = _fallbackSurface;
+        _rhi = QRhi::create(QRhi::OpenGLES2, &params);
+    }
+    if (!_rhi) {
+        LOG_FATAL("%s", qPrintable(tr("Cannot initialize QRhi with %1.").arg(api == API_Vulkan ? "Vulkan" : "OpenGL")));
+        return false;
+    }
+    LOG_INFO("QRhi Backend:        %s", _rhi->backendName());
+    LOG_INFO("QRhi Device:         %s", _rhi->driverInfo().deviceName.constData());
+
+    // Quad geometry: x, y, s, t
+    static const float quad[] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+        +1.0f, -1.0f, 1.0f, 0.0f,
+        -1.0f, +1.0f, 0.0f, 1.0f,
+        +1.0f, +1.0f, 1.0f, 1.0f
+    };
+    _quadVbuf = _rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, sizeof(quad));
+    _quadVbuf->create();
+
+    // Samplers
+    _linearSampler = _rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
+            QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge);
+    _linearSampler->create();
+    _mipmapSampler = _rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::Linear,
+            QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge);
+    _mipmapSampler->create();
+    _repeatSampler = _rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
+            QRhiSampler::Repeat, QRhiSampler::ClampToEdge);
+    _repeatSampler->create();
+    _lutSampler = _rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
+            QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge);
+    _lutSampler->create();
+
+    // Lookup textures. Without a display LUT, a dummy is bound instead.
+    _displayLutEnabled = !displayLut.isEmpty();
+    _srgbOutput = !_displayLutEnabled;
+    if (_displayLutEnabled) {
+        if (!_rhi->isFeatureSupported(QRhi::ThreeDimensionalTextures)) {
+            LOG_FATAL("%s", qPrintable(tr("The QRhi backend does not support display LUTs.")));
+            return false;
+        }
+        _displayLutSize = displayLut.size;
+        for (int i = 0; i < 3; i++) {
+            _displayLutDomainMin[i] = displayLut.domainMin[i];
+            _displayLutDomainFactor[i] = 1.0f / (displayLut.domainMax[i] - displayLut.domainMin[i]);
+        }
+    }
+    _toLinearLut = _rhi->newTexture(QRhiTexture::R16F, QSize(TransferFunctionTextureSize, 1));
+    _toNonlinearLut = _rhi->newTexture(QRhiTexture::R16F, QSize(TransferFunctionTextureSize, 1));
+    // QRhi has no three-channel float format
+    _displayLut = _rhi->newTexture(QRhiTexture::RGBA16F, _displayLutSize, _displayLutSize, _displayLutSize,
+            1, QRhiTexture::ThreeDimensional);
+    if (!_toLinearLut->create() || !_toNonlinearLut->create() || !_displayLut->create()) {
+        LOG_FATAL("%s", qPrintable(tr("Cannot create the QRhi lookup textures.")));
+        return false;
+    }
+
+    // The frame and view textures hold linear RGB. QRhi has neither small
+    // floats nor 16 bit normalized RGBA, so half floats take the place of both.
+    _intermediateFormat = QRhiTexture::RGBA16F;
+    if (precision == Precision_10Bit && _rhi->isTextureFormatSupported(QRhiTexture::RGB10A2))
+        _intermediateFormat = QRhiTexture::RGB10A2;
+
+    // Textures and render targets; their sizes are set when rendering
+    QRhiTexture::Flags targetFlags = QRhiTexture::RenderTarget | QRhiTexture::MipMapped | QRhiTexture::UsedWithGenerateMips;
+    for (int i = 0; i < 2; i++) {
+        for (int p = 0; p < 3; p++) {
+            _planeTex[i][p] = _rhi->newTexture(QRhiTexture::R8, QSize(1, 1));
+            _planeTex[i][p]->create();
+        }
+        _frameTex[i] = _rhi->newTexture(_intermediateFormat, QSize(1, 1), 1, targetFlags);
+        _frameTex[i]->create();
+        _frameRt[i] = _rhi->newTextureRenderTarget(QRhiTextureRenderTargetDescription(QRhiColorAttachment(_frameTex[i])));
+        _viewTex[i] = _rhi->newTexture(_intermediateFormat, QSize(1, 1), 1, targetFlags);
+        _viewTex[i]->create();
+        _viewRt[i] = _rhi->newTextureRenderTarget(QRhiTextureRenderTargetDescription(QRhiColorAttachment(_viewTex[i])));
+    }
+    _floatRp = _frameRt[0]->newCompatibleRenderPassDescriptor();
+    for (int i = 0; i < 2; i++) {
+        _frameRt[i]->setRenderPassDescriptor(_floatRp);
+        _frameRt[i]->create();
+        _viewRt[i]->setRenderPassDescriptor(_floatRp);
+        _viewRt[i]->create();
+    }
+    QRhiTexture::Flags outputFlags = QRhiTexture::RenderTarget | QRhiTexture::UsedAsTransferSource;
+    if (_srgbOutput)
+        outputFlags |= QRhiTexture::sRGB;
+    _outputTex = _rhi->newTexture(QRhiTexture::RGBA8, QSize(1, 1), 1, outputFlags);
+    _outputTex->create();
+    _outputRt = _rhi->newTextureRenderTarget(QRhiTextureRenderTargetDescription(QRhiColorAttachment(_outputTex)));
+    _outputRp = _outputRt->newCompatibleRenderPassDescriptor();
+    _outputRt->setRenderPassDescriptor(_outputRp);
+    _outputRt->create();
+
+    // Uniform buffers and shader resource bindings
+    for (int i = 0; i < 2; i++) {
+        _colorUbuf[i] = _rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, sizeof(ColorUniforms));
+        _colorUbuf[i]->create();
+        _colorSrb[i] = _rhi->newShaderResourceBindings();
+        _colorSrb[i]->setBindings({
+                QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::FragmentStage, _colorUbuf[i]),
+                QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, _planeTex[i][0], _linearSampler),
+                QRhiShaderResourceBinding::sampledTexture(2, QRhiShaderResourceBinding::FragmentStage, _planeTex[i][1], _linearSampler),
+                QRhiShaderResourceBinding::sampledTexture(3, QRhiShaderResourceBinding::FragmentStage, _planeTex[i][2], _linearSampler),
+                QRhiShaderResourceBinding::sampledTexture(4, QRhiShaderResourceBinding::FragmentStage, _toLinearLut, _lutSampler) });
+        _colorSrb[i]->create();
+        _viewUbuf[i] = _rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, sizeof(ViewUniforms));
+        _viewUbuf[i]->create();
+        _viewSrb[i] = _rhi->newShaderResourceBindings();
+        _viewSrbTex[i] = _frameTex[0];
+        _viewSrbSampler[i] = _mipmapSampler;
+        _viewSrb[i]->setBindings({
+                QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::FragmentStage, _viewUbuf[i]),
+                QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, _viewSrbTex[i], _viewSrbSampler[i]) });
+        _viewSrb[i]->create();
+    }
+    _displayUbuf = _rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, sizeof(DisplayUniforms));
+    _displayUbuf->create();
+    _displaySrb = _rhi->newShaderResourceBindings();
+    _displaySrb->setBindings({
+            QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::FragmentStage, _displayUbuf),
+            QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, _viewTex[0], _mipmapSampler),
+            QRhiShaderResourceBinding::sampledTexture(2, QRhiShaderResourceBinding::FragmentStage, _viewTex[1], _mipmapSampler),
+            QRhiShaderResourceBinding::sampledTexture(3, QRhiShaderResourceBinding::FragmentStage, _frameTex[0], _mipmapSampler),
+            QRhiShaderResourceBinding::sampledTexture(4, QRhiShaderResourceBinding::FragmentStage, _frameTex[1], _mipmapSampler),
+            QRhiShaderResourceBinding::sampledTexture(5, QRhiShaderResourceBinding::FragmentStage, _toNonlinearLut, _lutSampler),
+            QRhiShaderResourceBinding::sampledTexture(6, QRhiShaderResourceBinding::FragmentStage, _displayLut, _lutSampler) });
+    _displaySrb->create();
+
+    // Pipelines
+    _colorPipeline = createPipeline(":/src/shader-rhi-color.frag.qsb", _colorSrb[0], _floatRp);
+    _viewPipeline = createPipeline(":/src/shader-rhi-view.frag.qsb", _viewSrb[0], _floatRp);
+    _displayPipeline = createPipeline(":/src/shader-rhi-display.frag.qsb", _displaySrb, _outputRp);
+    if (!_colorPipeline || !_viewPipeline || !_displayPipeline) {
+        LOG_FATAL("%s", qPrintable(tr("Cannot create the QRhi pipelines.")));
+        return false;
+    }
+
+    // Upload the quad geometry and the lookup textures
+    QRhiCommandBuffer* cb;
+    if (_rhi->beginOffscreenFrame(&cb) != QRhi::FrameOpSuccess)
+        return false;
+    QRhiResourceUpdateBatch* updates = _rhi->nextResourceUpdateBatch();
+    updates->uploadStaticBuffer(_quadVbuf, quad);
+    uploadTransferFunctionLut(updates, _toLinearLut, true);
+    uploadTransferFunctionLut(updates, _toNonlinearLut, false);
+    // The .cube data is in red-fastest order, which is the x, y, z order of
+    // the 3D texture; each slice is uploaded as one layer
+    int n = _displayLutSize;
+    std::vector<qfloat16> lutData(size_t(n) * n * n * 4, qfloat16(1.0f));
+    for (size_t i = 0; _displayLutEnabled && i < size_t(n) * n * n; i++) {
+        for (int c = 0; c < 3; c++)
+            lutData[4 * i + c] = qfloat16(displayLut.data[3 * i + c]);
+    }
+    QVarLengthArray<QRhiTextureUploadEntry> lutSlices;
+    for (int z = 0; z < n; z++) {
+        QRhiTextureSubresourceUploadDescription data(lutData.data() + size_t(z) * n * n * 4,
+                size_t(n) * n * 4 * sizeof(qfloat16));
+        lutSlices.append(QRhiTextureUploadEntry(z, 0, data));
+    }
+    QRhiTextureUploadDescription lutDesc;
+    lutDesc.setEntries(lutSlices.cbegin(), lutSlices.cend());
+    updates->uploadTexture(_displayLut, lutDesc);
+    cb->resourceUpdate(updates);
+    _rhi->endOffscreenFrame();
+    return true;
+}
+
+bool RhiRenderer::resizeTarget(QRhiTexture* tex, QRhiTextureRenderTarget* rt, const QSize& size)
+{
+    if (tex->pixelSize() == size)
+        return true;
+    tex->setPixelSize(size);
+    return tex->create() && rt->create();
+}
+
+void RhiRenderer::drawQuad(QRhiCommandBuffer* cb, QRhiRenderTarget* rt, QRhiGraphicsPipeline* pipeline,
+        QRhiShaderResourceBindings* srb, QRhiResourceUpdateBatch* updates,
+        QRhiResourceUpdateBatch* postUpdates)
+{
+    cb->beginPass(rt, Qt::black, { 1.0f, 0 }, updates);
+    cb->setGraphicsPipeline(pipeline);
+    QSize size = rt->pixelSize();
+    cb->setViewport(QRhiViewport(0, 0, size.width(), size.height()));
+    cb->setShaderResources(srb);
+    const QRhiCommandBuffer::VertexInput vertexInput(_quadVbuf, 0);
+    cb->setVertexInput(0, 1, &vertexInput);
+    cb->draw(4);
+    cb->endPass(postUpdates);
+}
+
+bool RhiRenderer::convertFrame(QRhiCommandBuffer* cb, const VideoFrame& frame, int f)
+{
+    // 1. Get the frame data into plane textures, as in Bino::convertFrameToTexture()
+    int w = frame.width;
+    int h = frame.height;
+    int planeFormat = 1; // see shader-rhi-color.frag
+    int planeCount = 1;
+    int swizzle = 0;
+    bool linearInput = false;
+    QRhiTexture::Format texFormat[3] = { QRhiTexture::RGBA8, QRhiTexture::R8, QRhiTexture::R8 };
+    int bytesPerPixel[3] = { 4, 1, 1 };
+    QSize planeSize[3] = { QSize(w, h), QSize(w / 2, h / 2), QSize(w / 2, h / 2) };
+    const uchar* planeData[3] = { nullptr, nullptr, nullptr };
+    int bytesPerLine[3] = { 0, 0, 0 };
+    QImage img;
+    if (frame.storage == VideoFrame::Storage_Image) {
+        if (frame.image.format() == QImage::Format_RGBX16FPx4) {
+            // half float data, e.g. from OpenEXR image sequences; this is linear RGB
+            img = frame.image;
+            texFormat[0] = QRhiTexture::RGBA16F;
+            bytesPerPixel[0] = 8;
+            linearInput = true;
+        } else if (frame.image.format() == QImage::Format_RGBX64) {
+            // 16 bit data; QRhi has no 16 bit normalized RGBA format, but half float suffices
+            img = frame.image.convertToFormat(QImage::Format_RGBX16FPx4);
+            texFormat[0] = QRhiTexture::RGBA16F;
+            bytesPerPixel[0] = 8;
+        } else {
+            img = frame.image.convertToFormat(QImage::Format_RGB32);
+            swizzle = 2; // BGRA in memory
+        }
+        planeData[0] = img.constBits();
+        bytesPerLine[0] = img.bytesPerLine();
+    } else {
+        for (int p = 0; p < 3; p++) {
+            planeData[p] = (frame.storage == VideoFrame::Storage_Mapped ? frame.mappedBits[p] : frame.bits[p].data());
+            bytesPerLine[p] = frame.bytesPerLine[p];
+        }
+        if (frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888_Premultiplied
+                || frame.pixelFormat == QVideoFrameFormat::Format_XRGB8888) {
+            swizzle = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888_Premultiplied
+                || frame.pixelFormat == QVideoFrameFormat::Format_BGRX8888) {
+            swizzle = 2;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_ABGR8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_XBGR8888) {
+            swizzle = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_RGBA8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_RGBX8888) {
+            swizzle = 0;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV420P
+                || frame.pixelFormat == QVideoFrameFormat::Format_YUV422P
+                || frame.pixelFormat == QVideoFrameFormat::Format_YV12) {
+            texFormat[0] = QRhiTexture::R8;
+            bytesPerPixel[0] = 1;
+            if (frame.pixelFormat == QVideoFrameFormat::Format_YUV422P)
+                planeSize[1] = planeSize[2] = QSize(w / 2, h);
+            planeFormat = (frame.pixelFormat == QVideoFrameFormat::Format_YV12 ? 3 : 2);
+            planeCount = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_NV12) {
+            texFormat[0] = QRhiTexture::R8;
+            bytesPerPixel[0] = 1;
+            texFormat[1] = QRhiTexture::RG8;
+            bytesPerPixel[1] = 2;
+            planeFormat = 4;
+            planeCount = 2;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_P010
+                || frame.pixelFormat == QVideoFrameFormat::Format_P016) {
+            texFormat[0] = QRhiTexture::R16;
+            bytesPerPixel[0] = 2;
+            texFormat[1] = QRhiTexture::RG16;
+            bytesPerPixel[1] = 4;
+            planeFormat = 4;
+            planeCount = 2;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y8) {
+            texFormat[0] = QRhiTexture::R8;
+            bytesPerPixel[0] = 1;
+            planeFormat = 5;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y16) {
+            texFormat[0] = QRhiTexture::R16;
+            bytesPerPixel[0] = 2;
+            planeFormat = 5;
+        } else {
+            LOG_FATAL("Unhandled pixel format");
+            return false;
+        }
+    }
+    QRhiResourceUpdateBatch* updates = _rhi->nextResourceUpdateBatch();
+    for (int p = 0; p < planeCount; p++) {
+        QRhiTexture* tex = _planeTex[f][p];
+        if (tex->format() != texFormat[p] || tex->pixelSize() != planeSize[p]) {
+            tex->setFormat(texFormat[p]);
+            tex->setPixelSize(planeSize[p]);
+            if (!_rhi->isTextureFormatSupported(texFormat[p]) || !tex->create()) {
+                LOG_FATAL("%s", qPrintable(tr("The QRhi backend does not support the pixel format of this video.")));
+                updates->release();
+                return false;
+            }
+        }
+        // do not read beyond the last line, which might not be padded
+        int lineSize = planeSize[p].width() * bytesPerPixel[p];
+        QRhiTextureSubresourceUploadDescription data(planeData[p],
+                bytesPerLine[p] * (planeSize[p].height() - 1) + lineSize);
+        data.setDataStride(bytesPerLine[p]);
+        updates->uploadTexture(tex, QRhiTextureUploadDescription(QRhiTextureUploadEntry(0, 0, data)));
+    }
+
+    // 2. Convert plane textures into linear RGB in the frame texture
+    if (!resizeTarget(_frameTex[f], _frameRt[f], QSize(w, h))) {
+        updates->release();
+        return false;
+    }
+    ColorUniforms uniforms = { planeFormat, frame.yuvValueRangeSmall ? 1 : 0, int(frame.yuvSpace),
+        linearInput ? 1 : 0, swizzle, { 0, 0, 0 } };
+    updates->updateDynamicBuffer(_colorUbuf[f], 0, sizeof(uniforms), &uniforms);
+    QRhiResourceUpdateBatch* mipmaps = _rhi->nextResourceUpdateBatch();
+    mipmaps->generateMips(_frameTex[f]);
+    drawQuad(cb, _frameRt[f], _colorPipeline, _colorSrb[f], updates, mipmaps);
+    return true;
+}
+
+bool RhiRenderer::render(const VideoFrame& frame, const VideoFrame& extFrame, bool frameIsNew,
+        OutputMode outputMode, bool swapEyes, int width, int height,
+        const QQuaternion& surroundOrientation, QByteArray& rgba)
+{
+    if (width <= 0 || height <= 0 || frame.width <= 0 || frame.height <= 0)
+        return false;
+
+    // Find the views in the frame, as in Bino::frameGeometry() and Bino::render().
+    // The view rectangles are relative to the frame, with y pointing down.
+    int viewCount = 2;
+    int viewWidth = frame.width;
+    int viewHeight = frame.height;
+    int viewFrame[2] = { 0, 0 };
+    QRectF viewRect[2] = { QRectF(0.0, 0.0, 1.0, 1.0), QRectF(0.0, 0.0, 1.0, 1.0) };
+    float aspectRatio = frame.aspectRatio;
+    bool alternating = false;
+    switch (frame.inputMode) {
+    case Input_Unknown:
+    case Input_Mono:
+        viewCount = 1;
+        break;
+    case Input_Top_Bottom:
+    case Input_Bottom_Top:
+        aspectRatio *= 2.0f;
+        [[fallthrough]];
+    case Input_Top_Bottom_Half:
+    case Input_Bottom_Top_Half:
+        viewHeight /= 2;
+        viewRect[0] = QRectF(0.0, 0.0, 1.0, 0.5);
+        viewRect[1] = QRectF(0.0, 0.5, 1.0, 0.5);
+        if (frame.inputMode == Input_Bottom_Top || frame.inputMode == Input_Bottom_Top_Half)
+            std::swap(viewRect[0], viewRect[1]);
+        break;
+    case Input_Left_Right:
+    case Input_Right_Left:
+        aspectRatio /= 2.0f;
+        [[fallthrough]];
+    case Input_Left_Right_Half:
+    case Input_Right_Left_Half:
+        viewWidth /= 2;
+        viewRect[0] = QRectF(0.0, 0.0, 0.5, 1.0);
+        viewRect[1] = QRectF(0.5, 0.0, 0.5, 1.0);
+        if (frame.inputMode == Input_Right_Left || frame.inputMode == Input_Right_Left_Half)
+            std::swap(viewRect[0], viewRect[1]);
+        break;
+    case Input_Alternating_LR:
+    case Input_Alternating_RL:
+        alternating = true;
+        viewFrame[frame.inputMode == Input_Alternating_LR ? 1 : 0] = 1;
+        break;
+    }
+    if (frame.surroundMode == Surround_180)
+        aspectRatio *= 2.0f;
+    if (swapEyes) {
+        std::swap(viewRect[0], viewRect[1]);
+        std::swap(viewFrame[0], viewFrame[1]);
+    }
+    if (viewWidth <= 0 || viewHeight <= 0)
+        return false;
+
+    // Adjust the output mode and aspect ratio, as in OutputRenderer
+    int leftRightView = 0;
+    if (viewCount == 1 || outputMode == Output_OpenGL_Stereo || outputMode == Output_Alternating)
+        outputMode = Output_Left;
+    if (outputMode == Output_Right)
+        leftRightView = 1;
+    if (outputMode == Output_Left_Right || outputMode == Output_Right_Left)
+        aspectRatio *= 2.0f;
+    else if (outputMode == Output_Top_Bottom || outputMode == Output_Bottom_Top || outputMode == Output_HDMI_Frame_Pack)
+        aspectRatio *= 0.5f;
+    float relWidth = 1.0f;
+    float relHeight = 1.0f;
+    float screenAspectRatio = width / float(height);
+    if (outputMode == Output_HDMI_Frame_Pack)
+        screenAspectRatio = width / (height - height / 49.0f);
+    if (screenAspectRatio < aspectRatio)
+        relHeight = screenAspectRatio / aspectRatio;
+    else
+        relWidth = aspectRatio / screenAspectRatio;
+
+    // Reduce the views to the resolution at which they are displayed in modes
+    // that show only half of their pixels, and snap to view texels in the
+    // interleaved modes, as in OutputRenderer::renderViews()
+    int halfDisplayedWidth = (qCeil(width * relWidth) + 1) / 2;
+    int halfDisplayedHeight = (qCeil(height * relHeight) + 1) / 2;
+    float viewTexelSnap[2] = { 0.0f, 0.0f };
+    if (outputMode == Output_Left_Right_Half || outputMode == Output_Right_Left_Half) {
+        viewWidth = qMin(viewWidth, halfDisplayedWidth);
+    } else if (outputMode == Output_Top_Bottom_Half || outputMode == Output_Bottom_Top_Half) {
+        viewHeight = qMin(viewHeight, halfDisplayedHeight);
+    } else if (outputMode == Output_Even_Odd_Rows) {
+        if (halfDisplayedHeight < viewHeight) {
+            viewHeight = halfDisplayedHeight;
+            viewTexelSnap[1] = viewHeight;
+        }
+    } else if (outputMode == Output_Even_Odd_Columns || outputMode == Output_Checkerboard) {
+        if (halfDisplayedWidth < viewWidth) {
+            viewWidth = halfDisplayedWidth;
+            viewTexelSnap[0] = viewWidth;
+        }
+    }
+
+    QRhiCommandBuffer* cb;
+    if (_rhi->beginOffscreenFrame(&cb) != QRhi::FrameOpSuccess) {
+        LOG_FATAL("%s", qPrintable(tr("Cannot render a QRhi frame.")));
+        return false;
+    }
+
+    // Convert new frames
+    bool ok = true;
+    if (frameIsNew) {
+        ok = convertFrame(cb, frame, 0);
+        if (ok && alternating)
+            ok = convertFrame(cb, extFrame, 1);
+    }
+
+    // Render the views that the output mode needs. Anaglyph output without
+    // surround looks the views up in the frame textures instead.
+    int surroundDegrees = (frame.surroundMode == Surround_360 ? 360 : frame.surroundMode == Surround_180 ? 180 : 0);
+    bool fusedViews = (outputMode >= Output_Red_Cyan_Dubois && outputMode <= Output_Red_Blue_Monochrome
+            && surroundDegrees == 0);
+    QMatrix4x4 orientationMatrix;
+    orientationMatrix.rotate(surroundOrientation.inverted());
+    float projectionTop = qTan(qDegreesToRadians(50.0f) * 0.5f);
+    float projectionRight = projectionTop * width / height;
+    for (int v = 0; ok && !fusedViews && v < 2; v++) {
+        if (outputMode == Output_Left && v != 0)
+            continue;
+        if (outputMode == Output_Right && v != 1)
+            continue;
+        ok = resizeTarget(_viewTex[v], _viewRt[v], QSize(viewWidth, viewHeight));
+        if (!ok)
+            break;
+        // surround video must not use mipmaps, see Bino::render()
+        QRhiTexture* frameTex = _frameTex[viewFrame[v]];
+        QRhiSampler* sampler = (surroundDegrees == 360 ? _repeatSampler
+                : surroundDegrees == 180 ? _linearSampler : _mipmapSampler);
+        if (frameTex != _viewSrbTex[v] || sampler != _viewSrbSampler[v]) {
+            _viewSrb[v]->setBindings({
+                    QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::FragmentStage, _viewUbuf[v]),
+                    QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, frameTex, sampler) });
+            _viewSrb[v]->create();
+            _viewSrbTex[v] = frameTex;
+            _viewSrbSampler[v] = sampler;
+        }
+        ViewUniforms uniforms;
+        std::memcpy(uniforms.orientationMatrix, orientationMatrix.constData(), sizeof(uniforms.orientationMatrix));
+        uniforms.viewRect[0] = viewRect[v].x();
+        uniforms.viewRect[1] = viewRect[v].y();
+        uniforms.viewRect[2] = viewRect[v].width();
+        uniforms.viewRect[3] = viewRect[v].height();
+        uniforms.projectionRight = projectionRight;
+        uniforms.projectionTop = projectionTop;
+        uniforms.surroundDegrees = surroundDegrees;
+        uniforms.padding = 0;
+        QRhiResourceUpdateBatch* updates = _rhi->nextResourceUpdateBatch();
+        updates->updateDynamicBuffer(_viewUbuf[v], 0, sizeof(uniforms), &uniforms);
+        QRhiResourceUpdateBatch* mipmaps = _rhi->nextResourceUpdateBatch();
+        mipmaps->generateMips(_viewTex[v]);
+        drawQuad(cb, _viewRt[v], _viewPipeline, _viewSrb[v], updates, mipmaps);
+    }
+
+    // Combine the views and read back the result
+    if (ok)
+        ok = resizeTarget(_outputTex, _outputRt, QSize(width, height));
+    if (ok) {
+        DisplayUniforms uniforms = { int(outputMode), leftRightView, relWidth, relHeight,
+            0.0f, 0.0f, float(height), _srgbOutput ? 1 : 0,
+            { viewTexelSnap[0], viewTexelSnap[1] }, fusedViews ? 1 : 0, _displayLutEnabled ? 1 : 0,
+            { { float(viewRect[0].x()), float(viewRect[0].width()), float(viewRect[0].y()), float(viewRect[0].height()) },
+              { float(viewRect[1].x()), float(viewRect[1].width()), float(viewRect[1].y()), float(viewRect[1].height()) } },
+            { _displayLutDomainMin[0], _displayLutDomainMin[1], _displayLutDomainMin[2] }, float(_displayLutSize),
+            { _displayLutDomainFactor[0], _displayLutDomainFactor[1], _displayLutDomainFactor[2] },
+            { viewFrame[0], viewFrame[1] }, { 0, 0, 0 } };
+        QRhiResourceUpdateBatch* updates = _rhi->nextResourceUpdateBatch();
+        updates->updateDynamicBuffer(_displayUbuf, 0, sizeof(uniforms), &uniforms);
+        QRhiResourceUpdateBatch* readback = _rhi->nextResourceUpdateBatch();
+        readback->readBackTexture(QRhiReadbackDescription(_outputTex), &_readback);
+        drawQuad(cb, _outputRt, _displayPipeline, _displaySrb, updates, readback);
+    }
+    // the readback is complete when an offscreen frame ends
+    _rhi->endOffscreenFrame();
+    if (ok)
+        rgba = _readback.data;
+    return ok;
+}
+
+#endif
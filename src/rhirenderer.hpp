@@ -0,0 +1,134 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef WITH_RHI
+
+#include <QCoreApplication>
+#include <QByteArray>
+#include <QQuaternion>
+#include <rhi/qrhi.h>
+
+#include "modes.hpp"
+#include "videoframe.hpp"
+
+class QVulkanInstance;
+class QOffscreenSurface;
+class CubeLut;
+
+
+/* Renders the current frame of Bino in a given output mode with QRhi instead
+ * of raw OpenGL, so that Vulkan can be used, with OpenGL as a fallback. The
+ * passes are the same as in the OpenGL path: the frame planes are converted
+ * to linear RGB in a frame texture, the views are extracted into view
+ * textures, and the views are combined into the output, which is read back.
+ * The shaders are compiled to all QRhi shading languages at build time; the
+ * constants that are substituted into the OpenGL shaders at run time are
+ * uniforms here, so that each pass needs only a single pipeline. Changes to
+ * the OpenGL shaders must be mirrored in the shader-rhi-* files.
+ * This is only used by the offscreen converter, which replaces OutputRenderer
+ * with it; the window and VR outputs always use OpenGL. Subtitles, the quality
+ * governor, and the OpenGL stereo and alternating output modes are not
+ * supported. */
+
+class RhiRenderer
+{
+Q_DECLARE_TR_FUNCTIONS(RhiRenderer)
+
+public:
+    enum API {
+        API_Vulkan,
+        API_OpenGL
+    };
+
+private:
+    QVulkanInstance* _vulkanInstance;
+    QOffscreenSurface* _fallbackSurface;
+    QRhi* _rhi;
+    QRhiBuffer* _quadVbuf;
+    QRhiSampler* _linearSampler;    // no mipmaps, clamp to edge
+    QRhiSampler* _mipmapSampler;    // mipmaps, clamp to edge
+    QRhiSampler* _repeatSampler;    // no mipmaps, horizontal wraparound for 360° video
+    QRhiSampler* _lutSampler;       // no mipmaps, clamp to edge in all dimensions
+    // the format of the frame and view textures, from the frame precision
+    QRhiTexture::Format _intermediateFormat;
+    // lookup textures for the sRGB transfer function and the display LUT
+    QRhiTexture* _toLinearLut;
+    QRhiTexture* _toNonlinearLut;
+    QRhiTexture* _displayLut;       // a dummy if there is no display LUT
+    bool _displayLutEnabled;
+    float _displayLutDomainMin[3];
+    float _displayLutDomainFactor[3];
+    int _displayLutSize;
+    // without display LUT, the output texture is sRGB and the hardware
+    // converts linear RGB to non-linear RGB, as in the OpenGL converter
+    bool _srgbOutput;
+    // render pass descriptors shared by all render targets of the same format
+    QRhiRenderPassDescriptor* _floatRp;
+    QRhiRenderPassDescriptor* _outputRp;
+    // color conversion pass, for the frame and the extended frame
+    QRhiTexture* _planeTex[2][3];
+    QRhiTexture* _frameTex[2];
+    QRhiTextureRenderTarget* _frameRt[2];
+    QRhiBuffer* _colorUbuf[2];
+    QRhiShaderResourceBindings* _colorSrb[2];
+    QRhiGraphicsPipeline* _colorPipeline;
+    // view pass, for the left and right view
+    QRhiTexture* _viewTex[2];
+    QRhiTextureRenderTarget* _viewRt[2];
+    QRhiBuffer* _viewUbuf[2];
+    QRhiShaderResourceBindings* _viewSrb[2];
+    QRhiTexture* _viewSrbTex[2];    // the resources that the view bindings currently use
+    QRhiSampler* _viewSrbSampler[2];
+    QRhiGraphicsPipeline* _viewPipeline;
+    // display pass
+    QRhiTexture* _outputTex;
+    QRhiTextureRenderTarget* _outputRt;
+    QRhiBuffer* _displayUbuf;
+    QRhiShaderResourceBindings* _displaySrb;
+    QRhiGraphicsPipeline* _displayPipeline;
+    QRhiReadbackResult _readback;
+
+    QRhiGraphicsPipeline* createPipeline(const QString& fragmentShader,
+            QRhiShaderResourceBindings* srb, QRhiRenderPassDescriptor* rp);
+    bool resizeTarget(QRhiTexture* tex, QRhiTextureRenderTarget* rt, const QSize& size);
+    bool convertFrame(QRhiCommandBuffer* cb, const VideoFrame& frame, int f);
+    void drawQuad(QRhiCommandBuffer* cb, QRhiRenderTarget* rt, QRhiGraphicsPipeline* pipeline,
+            QRhiShaderResourceBindings* srb, QRhiResourceUpdateBatch* updates,
+            QRhiResourceUpdateBatch* postUpdates);
+
+public:
+    RhiRenderer();
+    ~RhiRenderer();
+
+    // Create the QRhi and all resources. Returns false on failure.
+    bool initialize(API api, FramePrecision precision, const CubeLut& displayLut);
+
+    // Render the output with the given size and read it back as RGBA with
+    // 8 bits per channel and lines top to bottom. The frames are converted
+    // again only if they are new; the extended frame is only used for
+    // alternating input. Returns false on failure.
+    bool render(const VideoFrame& frame, const VideoFrame& extFrame, bool frameIsNew,
+            OutputMode outputMode, bool swapEyes, int width, int height,
+            const QQuaternion& surroundOrientation, QByteArray& rgba);
+};
+
+#endif
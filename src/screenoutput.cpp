@@ -0,0 +1,349 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QWindow>
+
+#include "screenoutput.hpp"
+#include "bino.hpp"
+#include "gpuprofiler.hpp"
+#include "tracer.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+/* These might not be defined in OpenGL ES environments.
+ * Define them here to fix compilation. */
+#ifndef GL_BACK_LEFT
+# define GL_BACK_LEFT 0x0402
+#endif
+#ifndef GL_BACK_RIGHT
+# define GL_BACK_RIGHT 0x0403
+#endif
+
+
+ScreenOutput::ScreenOutput(OutputMode outputMode, bool framebufferPreserved) :
+    _outputMode(outputMode),
+    _openGLStereo(QSurfaceFormat::defaultFormat().stereo()),
+    _framebufferPreserved(framebufferPreserved),
+    _alternatingLastView(1),
+    _alternating(false),
+    _outputValid(false),
+    _outputOutputMode(outputMode),
+    _outputWidth(0),
+    _outputHeight(0),
+    _outputFragOffsetX(0.0f),
+    _outputFragOffsetY(0.0f),
+    _inSurroundMovement(false),
+    _surroundHorizontalAngleBase(0.0f),
+    _surroundVerticalAngleBase(0.0f),
+    _surroundHorizontalAngleCurrent(0.0f),
+    _surroundVerticalAngleCurrent(0.0f),
+    _hudVisible(false),
+    _shmOutput(nullptr),
+    _presentPending(false),
+    _presentStart(0),
+    _presentFrame(-1),
+    _statPresents(0),
+    _statPresentNsecs(0),
+    _statPresentMaxNsecs(0)
+{
+    _presentTimer.start();
+}
+
+ScreenOutput::~ScreenOutput()
+{
+    logStatistics();
+}
+
+bool ScreenOutput::isOpenGLStereo() const
+{
+    return _openGLStereo;
+}
+
+OutputMode ScreenOutput::outputMode() const
+{
+    return _outputMode;
+}
+
+void ScreenOutput::setOutputMode(enum OutputMode mode)
+{
+    _outputMode = mode;
+}
+
+bool ScreenOutput::hudVisible() const
+{
+    return _hudVisible;
+}
+
+void ScreenOutput::setHudVisible(bool visible)
+{
+    if (visible && !_hudVisible)
+        _hud.reset();
+    _hudVisible = visible;
+    GpuProfiler::instance()->setEnabled(visible);
+}
+
+bool ScreenOutput::initialize(QOpenGLContext* context, QWindow* window, QString* errorMessage)
+{
+    bool contextIsOk = (context->isValid()
+            && (context->format().majorVersion() > 3
+                || (context->format().majorVersion() == 3 && context->format().minorVersion() >= 2)));
+    if (!contextIsOk) {
+        *errorMessage = QCoreApplication::translate("Widget", "Insufficient OpenGL capabilities.");
+        return false;
+    }
+    if (QSurfaceFormat::defaultFormat().stereo() && !context->format().stereo()) {
+        *errorMessage = QCoreApplication::translate("Widget", "OpenGL stereo mode is not available on this system.");
+        return false;
+    }
+
+    bool isGLES = context->isOpenGLES();
+    bool haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+    initializeOpenGLFunctions();
+    bool isCoreProfile = (context->format().profile() == QSurfaceFormat::CoreProfile);
+
+    QString variantString = isGLES ? "OpenGL ES" : "OpenGL";
+    if (!isGLES)
+        variantString += isCoreProfile ? " core profile" : " compatibility profile";
+    LOG_INFO("OpenGL Variant:      %s", qPrintable(variantString));
+    LOG_INFO("OpenGL Version:      %s", getOpenGLString(this, GL_VERSION));
+    LOG_INFO("OpenGL GLSL Version: %s", getOpenGLString(this, GL_SHADING_LANGUAGE_VERSION));
+    LOG_INFO("OpenGL Vendor:       %s", getOpenGLString(this, GL_VENDOR));
+    LOG_INFO("OpenGL Renderer:     %s", getOpenGLString(this, GL_RENDERER));
+    LOG_INFO("OpenGL AnisoTexFilt: %s", haveAnisotropicFiltering ? "yes" : "no");
+    LOG_INFO("OpenGL SwapInterval: %d", context->format().swapInterval());
+
+    // Renderer
+    _renderer.initialize();
+
+    // Scheduler for Output_Alternating
+    if (window)
+        _scheduler.initialize(context, window);
+
+    // Output to other processes
+    if (!Bino::instance()->shmOutputName().isEmpty()) {
+        _shmOutput = new ShmOutput(Bino::instance()->shmOutputName());
+        _shmOutput->initialize();
+    }
+
+    // Initialize Bino
+    Bino::instance()->initProcess();
+    _governor.initialize();
+    GpuProfiler::instance()->initialize();
+    _outputValid = false;
+    return true;
+}
+
+void ScreenOutput::cleanup()
+{
+    _governor.cleanup();
+    GpuProfiler::instance()->cleanup();
+    _hud.cleanup();
+    delete _shmOutput;
+    _shmOutput = nullptr;
+}
+
+void ScreenOutput::invalidate()
+{
+    _outputValid = false;
+}
+
+void ScreenOutput::paint(unsigned int framebuffer, int width, int height, float fragOffsetX, float fragOffsetY)
+{
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+    qint64 paintStart = _presentTimer.nsecsElapsed();
+    _governor.beginFrame();
+    GpuProfiler::instance()->beginFrame();
+
+    if (_hudVisible)
+        _hud.paintStarted(Bino::instance()->frameIsNew());
+
+    // Fill the view texture(s) as needed
+    OutputMode outputMode = _outputMode;
+    QQuaternion surroundOrientation = QQuaternion::fromEulerAngles(
+            (_surroundVerticalAngleBase + _surroundVerticalAngleCurrent),
+            (_surroundHorizontalAngleBase + _surroundHorizontalAngleCurrent), 0.0f);
+    float outputAspectRatio;
+    bool frameIsStereo;
+    if (outputMode == Output_Alternating)
+        _alternatingLastView = (_scheduler.nextView() == 0 ? 1 : 0);
+    bool viewsRendered = _renderer.renderViews(outputMode, _alternatingLastView, width, height, surroundOrientation,
+            &outputAspectRatio, &frameIsStereo);
+    bool wasAlternating = _alternating;
+    _alternating = (_outputMode == Output_Alternating && frameIsStereo);
+    if (_alternating && !wasAlternating)
+        _scheduler.reset();
+
+    // Keep the current output if nothing changed and the surface preserves
+    // its framebuffer between paints
+    if (_framebufferPreserved && _outputValid && !viewsRendered && !_alternating && !_hudVisible
+            && outputMode == _outputOutputMode && width == _outputWidth && height == _outputHeight
+            && fragOffsetX == _outputFragOffsetX && fragOffsetY == _outputFragOffsetY) {
+        LOG_FIREHOSE("%s: nothing changed, keeping the current output", Q_FUNC_INFO);
+        _governor.endFrame(false);
+        GpuProfiler::instance()->endFrame();
+        return;
+    }
+    _outputValid = true;
+    _outputOutputMode = outputMode;
+    _outputWidth = width;
+    _outputHeight = height;
+    _outputFragOffsetX = fragOffsetX;
+    _outputFragOffsetY = fragOffsetY;
+
+    // Put the views on screen in the current mode
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    qint64 frameNumber = Bino::instance()->frameNumber();
+    Tracer::begin("display", frameNumber);
+    GpuProfiler::instance()->begin(GpuProfiler::Stage_Display);
+    LOG_FIREHOSE("lower left surface corner in screen coordinates: x=%g y=%g", fragOffsetX, fragOffsetY);
+    if (_openGLStereo) {
+        LOG_FIREHOSE("screen output draw mode: opengl stereo");
+        GLenum bufferBackLeft = GL_BACK_LEFT;
+        GLenum bufferBackRight = GL_BACK_RIGHT;
+        if (outputMode == Output_OpenGL_Stereo) {
+            glDrawBuffers(1, &bufferBackLeft);
+            _renderer.display(outputMode, 0, width, height, outputAspectRatio, fragOffsetX, fragOffsetY);
+            glDrawBuffers(1, &bufferBackRight);
+            _renderer.display(outputMode, 1, width, height, outputAspectRatio, fragOffsetX, fragOffsetY);
+        } else {
+            if (outputMode == Output_Alternating)
+                outputMode = (_alternatingLastView == 0 ? Output_Right : Output_Left);
+            int leftRightView = (outputMode == Output_Left ? 0 : 1);
+            glDrawBuffers(1, &bufferBackLeft);
+            _renderer.display(outputMode, leftRightView, width, height, outputAspectRatio, fragOffsetX, fragOffsetY);
+            glDrawBuffers(1, &bufferBackRight);
+            _renderer.display(outputMode, leftRightView, width, height, outputAspectRatio, fragOffsetX, fragOffsetY);
+        }
+    } else {
+        LOG_FIREHOSE("screen output draw mode: normal");
+        if (outputMode == Output_Alternating)
+            outputMode = (_alternatingLastView == 0 ? Output_Right : Output_Left);
+        int leftRightView = (outputMode == Output_Left ? 0 : 1);
+        _renderer.display(outputMode, leftRightView, width, height, outputAspectRatio, fragOffsetX, fragOffsetY);
+    }
+    GpuProfiler::instance()->end(GpuProfiler::Stage_Display);
+    Tracer::end("display", frameNumber);
+    _governor.endFrame();
+    GpuProfiler::instance()->endFrame();
+
+    // Send the result to other processes
+    if (_shmOutput)
+        _shmOutput->capture(framebuffer, width, height);
+
+    // Draw the performance overlay on top; other processes do not get it
+    if (_hudVisible) {
+        _hud.prepare(Bino::instance()->frameTextureMiB() + _renderer.viewTextureMiB(),
+                _alternating ? &_scheduler : nullptr);
+        if (_openGLStereo) {
+            GLenum bufferBackLeft = GL_BACK_LEFT;
+            GLenum bufferBackRight = GL_BACK_RIGHT;
+            glDrawBuffers(1, &bufferBackLeft);
+            _hud.draw(width, height);
+            glDrawBuffers(1, &bufferBackRight);
+            _hud.draw(width, height);
+        } else {
+            _hud.draw(width, height);
+        }
+    }
+
+    // The present latency is measured from the start of this function until swapped()
+    if (!_presentPending) {
+        _presentFrame = frameNumber;
+        Tracer::begin("swap", _presentFrame);
+    }
+    _presentPending = true;
+    _presentStart = paintStart;
+    LOG_FIREHOSE("%s: CPU time for this frame: %g ms", Q_FUNC_INFO, frameTimer.nsecsElapsed() / 1e6);
+}
+
+bool ScreenOutput::swapped()
+{
+    if (_presentPending) {
+        qint64 latency = _presentTimer.nsecsElapsed() - _presentStart;
+        _statPresents++;
+        _statPresentNsecs += latency;
+        _statPresentMaxNsecs = qMax(_statPresentMaxNsecs, latency);
+        _presentPending = false;
+        Tracer::end("swap", _presentFrame);
+        Bino::instance()->framePresented();
+        LOG_FIREHOSE("%s: present latency %g ms", Q_FUNC_INFO, latency / 1e6);
+    }
+    if (_hudVisible)
+        _hud.swapped();
+    if (_alternating)
+        _scheduler.swapped();
+    return _alternating;
+}
+
+void ScreenOutput::startSurroundMovement(const QPointF& pos)
+{
+    _inSurroundMovement = true;
+    _surroundMovementStart = pos;
+    _surroundHorizontalAngleCurrent = 0.0f;
+    _surroundVerticalAngleCurrent = 0.0f;
+}
+
+void ScreenOutput::stopSurroundMovement()
+{
+    _inSurroundMovement = false;
+    _surroundHorizontalAngleBase += _surroundHorizontalAngleCurrent;
+    _surroundVerticalAngleBase += _surroundVerticalAngleCurrent;
+    _surroundHorizontalAngleCurrent = 0.0f;
+    _surroundVerticalAngleCurrent = 0.0f;
+}
+
+bool ScreenOutput::moveSurround(const QPointF& pos, int width, int height)
+{
+    if (!_inSurroundMovement)
+        return false;
+    // position delta
+    QPointF posDelta = pos - _surroundMovementStart;
+    // horizontal angle delta
+    float dx = posDelta.x();
+    float xf = dx / width; // in [-1,+1]
+    _surroundHorizontalAngleCurrent = xf * 180.0f;
+    // vertical angle
+    float dy = posDelta.y();
+    float yf = dy / height; // in [-1,+1]
+    _surroundVerticalAngleCurrent = yf * 90.0f;
+    return true;
+}
+
+void ScreenOutput::resetSurround()
+{
+    _inSurroundMovement = false;
+    _surroundHorizontalAngleBase = 0.0f;
+    _surroundVerticalAngleBase = 0.0f;
+    _surroundHorizontalAngleCurrent = 0.0f;
+    _surroundVerticalAngleCurrent = 0.0f;
+}
+
+void ScreenOutput::logStatistics() const
+{
+    _scheduler.logStatistics();
+    if (_statPresents == 0)
+        return;
+    LOG_INFO("screen output: %llu frames presented, present latency %.2f ms average, %.2f ms maximum",
+            _statPresents, _statPresentNsecs / 1e6 / _statPresents, _statPresentMaxNsecs / 1e6);
+}
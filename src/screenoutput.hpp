@@ -0,0 +1,122 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QElapsedTimer>
+#include <QQuaternion>
+#include <QPointF>
+
+#include "modes.hpp"
+#include "outputrenderer.hpp"
+#include "alternatingscheduler.hpp"
+#include "qualitygovernor.hpp"
+#include "hud.hpp"
+#include "shmoutput.hpp"
+
+class QOpenGLContext;
+class QWindow;
+
+
+/* The on-screen OpenGL output shared by Widget (a QOpenGLWidget that is
+ * composited into the main window) and DirectWindow (a QOpenGLWindow that
+ * swaps its own buffers). It renders the views with OutputRenderer, puts
+ * them into the framebuffer in the current output mode, drives the
+ * Output_Alternating scheduler and the shared memory output, and measures
+ * the present latency, i.e. the time from the start of painting until the
+ * buffer swap is done.
+ * All functions except the surround movement functions must be called with
+ * the OpenGL context current. */
+
+class ScreenOutput : protected QOpenGLExtraFunctions
+{
+private:
+    OutputMode _outputMode;
+    bool _openGLStereo;       // is the surface in quad-buffered stereo mode?
+    bool _framebufferPreserved; // whether the framebuffer content survives a swap
+    int _alternatingLastView; // last view displayed in Mode_Alternating (0 or 1)
+    bool _alternating;        // whether the last output alternated between two views
+    AlternatingScheduler _scheduler; // chooses the view for Output_Alternating
+
+    // The parameters that the current output was displayed for. If neither
+    // they nor the views changed, paint() keeps the current output.
+    bool _outputValid;
+    OutputMode _outputOutputMode;
+    int _outputWidth, _outputHeight;
+    float _outputFragOffsetX, _outputFragOffsetY;
+
+    bool _inSurroundMovement;
+    QPointF _surroundMovementStart;
+    float _surroundHorizontalAngleBase;
+    float _surroundVerticalAngleBase;
+    float _surroundHorizontalAngleCurrent;
+    float _surroundVerticalAngleCurrent;
+
+    OutputRenderer _renderer;
+    QualityGovernor _governor;
+    Hud _hud;
+    bool _hudVisible;
+    ShmOutput* _shmOutput;
+
+    // present latency statistics
+    QElapsedTimer _presentTimer;
+    bool _presentPending;     // whether a painted frame waits for its swap
+    qint64 _presentStart;     // time at which painting of that frame started
+    qint64 _presentFrame;     // number of that frame, for tracing
+    unsigned long long _statPresents;
+    qint64 _statPresentNsecs;
+    qint64 _statPresentMaxNsecs;
+
+public:
+    ScreenOutput(OutputMode outputMode, bool framebufferPreserved);
+    ~ScreenOutput();
+
+    bool isOpenGLStereo() const;
+    OutputMode outputMode() const;
+    void setOutputMode(OutputMode mode);
+    // The performance overlay. While it is visible, the GPU profiler is enabled.
+    bool hudVisible() const;
+    void setHudVisible(bool visible);
+
+    // Initialize for the given context and window. Returns false and sets
+    // the error message if the context is not sufficient.
+    bool initialize(QOpenGLContext* context, QWindow* window, QString* errorMessage);
+    // Free OpenGL resources; the context must be current
+    void cleanup();
+    // The framebuffer was recreated, e.g. after a resize
+    void invalidate();
+    // Paint into the given framebuffer of the given size in pixels.
+    // The fragment offset is the lower left corner in screen coordinates.
+    void paint(unsigned int framebuffer, int width, int height, float fragOffsetX, float fragOffsetY);
+    // Report that the buffer swap was done. Returns true if the surface
+    // needs to be repainted immediately (for Output_Alternating).
+    bool swapped();
+
+    // Surround video orientation changes via mouse movement; the size is
+    // the size of the surface. moveSurround() returns true if a repaint is
+    // needed.
+    void startSurroundMovement(const QPointF& pos);
+    void stopSurroundMovement();
+    bool moveSurround(const QPointF& pos, int width, int height);
+    void resetSurround();
+
+    void logStatistics() const;
+};
@@ -38,20 +38,23 @@ const int YUV_AdobeRGB = 3;
 const int YUV_BT2020 = 4;
 const int yuvSpace = $YUV_SPACE;
 
+const bool linearInput = $LINEAR_INPUT;
+
 smooth in vec2 vtexcoord;
 
 layout(location = 0) out vec4 fcolor;
 
-float to_linear(float x)
-{
-    const float c0 = 0.077399380805; // 1.0 / 12.92
-    const float c1 = 0.947867298578; // 1.0 / 1.055;
-    return (x <= 0.04045 ? (x * c0) : pow((x + 0.055) * c1, 2.4));
-}
+uniform sampler2D toLinearLut;
+const float lutSize = 4096.0; // see createTransferFunctionTexture() in tools.cpp
 
+// non-linear RGB to linear RGB, via a lookup texture instead of pow()
 vec3 rgb_to_linear(vec3 rgb)
 {
-    return vec3(to_linear(rgb.r), to_linear(rgb.g), to_linear(rgb.b));
+    highp vec3 tc = clamp(rgb, 0.0, 1.0) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;
+    return vec3(
+            texture(toLinearLut, vec2(tc.r, 0.5)).r,
+            texture(toLinearLut, vec2(tc.g, 0.5)).r,
+            texture(toLinearLut, vec2(tc.b, 0.5)).r);
 }
 
 void main(void)
@@ -133,6 +136,7 @@ void main(void)
         rgb = (m * vec4(yuv, 1.0)).rgb;
     }
 
-    rgb = rgb_to_linear(rgb);
+    if (!linearInput)
+        rgb = rgb_to_linear(rgb);
     fcolor = vec4(rgb, 1.0);
 }
@@ -25,6 +25,10 @@ uniform float relativeWidth;
 uniform float relativeHeight;
 uniform float fragOffsetX;
 uniform float fragOffsetY;
+// For the interleaved modes: the view texture size in the interleaved
+// dimension if the views have the displayed resolution, otherwise 0.
+// Pairs of display rows or columns then share one view texel.
+uniform vec2 viewTexelSnap;
 
 // This must be the same as OutputMode from modes.hpp:
 const int Output_Left = 0;
@@ -68,23 +72,68 @@ smooth in vec2 vtexcoord;
 layout(location = 0) out vec4 fcolor;
 
 
+float snap_to_texel(float t, float texSize)
+{
+    return texSize > 0.0 ? (floor(t * texSize) + 0.5) / texSize : t;
+}
+
+// In the single pass anaglyph path, view0 and view1 are the frame textures
+// that contain the views, and the views are looked up as in
+// shader-view.frag.glsl, including the subtitle overlay.
+const bool fusedViews = $FUSED_VIEWS;
+uniform vec4 viewSource0; // offset x, factor x, offset y, factor y
+uniform vec4 viewSource1;
+uniform sampler2D subtitleTex;
+
+vec3 frame_view(sampler2D frameTex, vec4 viewSource, float tx, float ty)
+{
+    if (tx < 0.0 || tx > 1.0 || ty < 0.0 || ty > 1.0)
+        return vec3(0.0, 0.0, 0.0);
+    float vtx = viewSource.x + viewSource.y * tx;
+    float vty = viewSource.z + viewSource.w * ty;
+    vec3 rgb = texture(frameTex, vec2(vtx, 1.0 - vty)).rgb;
+    vec4 sub = texture(subtitleTex, vec2(tx, 1.0 - ty)).rgba;
+    return mix(rgb, sub.rgb, sub.a);
+}
+
 // linear RGB to luminance, as used by Mitsuba2 and pbrt
 float rgb_to_lum(vec3 rgb)
 {
     return dot(rgb, vec3(0.212671, 0.715160, 0.072169));
 }
 
-// linear RGB to non-linear RGB
-float to_nonlinear(float x)
+uniform sampler2D toNonlinearLut;
+const float lutSize = 4096.0; // see createTransferFunctionTexture() in tools.cpp
+
+// linear RGB to non-linear RGB, via a lookup texture instead of pow()
+vec3 rgb_to_nonlinear(vec3 rgb)
 {
-    const float c0 = 0.416666666667; // 1.0 / 2.4
-    return (x <= 0.0031308 ? (x * 12.92) : (1.055 * pow(x, c0) - 0.055));
+    highp vec3 tc = clamp(rgb, 0.0, 1.0) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;
+    return vec3(
+            texture(toNonlinearLut, vec2(tc.r, 0.5)).r,
+            texture(toNonlinearLut, vec2(tc.g, 0.5)).r,
+            texture(toNonlinearLut, vec2(tc.b, 0.5)).r);
 }
-vec3 rgb_to_nonlinear(vec3 rgb)
+
+// The optional 3D LUT for display calibration maps non-linear RGB
+// to the corrected non-linear RGB.
+const bool displayLutEnabled = $DISPLAY_LUT;
+uniform highp sampler3D displayLut;
+uniform vec3 displayLutDomainMin;
+uniform vec3 displayLutDomainFactor; // 1 / (max - min)
+uniform float displayLutSize;
+
+vec3 apply_display_lut(vec3 rgb)
 {
-    return vec3(to_nonlinear(rgb.r), to_nonlinear(rgb.g), to_nonlinear(rgb.b));
+    highp vec3 tc = clamp((rgb - displayLutDomainMin) * displayLutDomainFactor, 0.0, 1.0);
+    tc = tc * ((displayLutSize - 1.0) / displayLutSize) + 0.5 / displayLutSize;
+    return texture(displayLut, tc).rgb;
 }
 
+// If the output goes to an sRGB framebuffer, the hardware converts
+// linear RGB to non-linear RGB when writing.
+const bool srgbOutput = $SRGB_OUTPUT;
+
 void main(void)
 {
     float tx = (vtexcoord.x - 0.5 * (1.0 - relativeWidth )) / relativeWidth;
@@ -149,6 +198,7 @@ void main(void)
                 rgb = texture(view0, vec2(tx, 2.0 * ty)).rgb;
         }
     } else if (outputMode == Output_Even_Odd_Rows) {
+        ty = snap_to_texel(ty, viewTexelSnap.y);
         float fragmentY = gl_FragCoord.y - 0.5 + fragOffsetY;
         if (mod(fragmentY, 2.0) < 0.5) {
             rgb = texture(view0, vec2(tx, ty)).rgb;
@@ -156,6 +206,7 @@ void main(void)
             rgb = texture(view1, vec2(tx, ty)).rgb;
         }
     } else if (outputMode == Output_Even_Odd_Columns) {
+        tx = snap_to_texel(tx, viewTexelSnap.x);
         float fragmentX = gl_FragCoord.x - 0.5 + fragOffsetX;
         if (mod(fragmentX, 2.0) < 0.5) {
             rgb = texture(view0, vec2(tx, ty)).rgb;
@@ -163,6 +214,7 @@ void main(void)
             rgb = texture(view1, vec2(tx, ty)).rgb;
         }
     } else if (outputMode == Output_Checkerboard) {
+        tx = snap_to_texel(tx, viewTexelSnap.x);
         float fragmentX = gl_FragCoord.x - 0.5 + fragOffsetX;
         float fragmentY = gl_FragCoord.y - 0.5 + fragOffsetY;
         if (abs(mod(fragmentX, 2.0) - mod(fragmentY, 2.0)) < 0.5) {
@@ -171,8 +223,14 @@ void main(void)
             rgb = texture(view1, vec2(tx, ty)).rgb;
         }
     } else {
-        vec3 rgb0 = texture(view0, vec2(tx, ty)).rgb;
-        vec3 rgb1 = texture(view1, vec2(tx, ty)).rgb;
+        vec3 rgb0, rgb1;
+        if (fusedViews) {
+            rgb0 = frame_view(view0, viewSource0, tx, ty);
+            rgb1 = frame_view(view1, viewSource1, tx, ty);
+        } else {
+            rgb0 = texture(view0, vec2(tx, ty)).rgb;
+            rgb1 = texture(view1, vec2(tx, ty)).rgb;
+        }
         if (outputMode == Output_Red_Cyan_Dubois) {
             // Source of this matrix: http://www.site.uottawa.ca/~edubois/anaglyph/LeastSquaresHowToPhotoshop.pdf
             mat3 m0 = mat3(
@@ -230,5 +288,10 @@ void main(void)
             rgb = vec3(rgb_to_lum(rgb0), 0.0, rgb_to_lum(rgb1));
         }
     }
-    fcolor = vec4(rgb_to_nonlinear(rgb), 1.0);
+    if (!srgbOutput) {
+        rgb = rgb_to_nonlinear(rgb);
+        if (displayLutEnabled)
+            rgb = apply_display_lut(rgb);
+    }
+    fcolor = vec4(rgb, 1.0);
 }
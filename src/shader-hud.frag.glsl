@@ -0,0 +1,31 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+uniform sampler2D atlas; // glyph coverage in the red channel
+
+smooth in vec2 vtexcoord;
+smooth in vec4 vcolor;
+
+layout(location = 0) out vec4 fcolor;
+
+void main(void)
+{
+    fcolor = vec4(vcolor.rgb, vcolor.a * texture(atlas, vtexcoord).r);
+}
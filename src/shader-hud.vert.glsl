@@ -0,0 +1,36 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+uniform vec2 surface_size; // in pixels
+
+layout(location = 0) in vec2 position; // in pixels, origin at the top left
+layout(location = 1) in vec2 texcoord;
+layout(location = 2) in vec4 color;
+
+smooth out vec2 vtexcoord;
+smooth out vec4 vcolor;
+
+void main(void)
+{
+    vtexcoord = texcoord;
+    vcolor = color;
+    vec2 ndc = position / surface_size * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
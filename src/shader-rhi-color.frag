@@ -0,0 +1,157 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#version 440
+
+// This is shader-color.frag.glsl for QRhi. The constants that are
+// substituted into the OpenGL shader are uniforms here; they are the same for
+// all fragments of a draw call, so the branches do not diverge.
+
+layout(location = 0) in vec2 vtexcoord;
+
+layout(location = 0) out vec4 fcolor;
+
+layout(std140, binding = 0) uniform buf {
+    int planeFormat;
+    int yuvValueRangeSmall;
+    int yuvSpace;
+    int linearInput;
+    int swizzle;        // for Format_RGB: 0 = rgb, 1 = gba, 2 = bgr, 3 = abg
+} ubuf;
+
+layout(binding = 1) uniform sampler2D plane0;
+layout(binding = 2) uniform sampler2D plane1;
+layout(binding = 3) uniform sampler2D plane2;
+layout(binding = 4) uniform sampler2D toLinearLut;
+
+const int Format_RGB = 1;
+const int Format_YUVp = 2;
+const int Format_YVUp = 3;
+const int Format_YUVsp = 4;
+const int Format_Y = 5;
+
+const int YUV_BT601 = 1;
+const int YUV_BT709 = 2;
+const int YUV_AdobeRGB = 3;
+const int YUV_BT2020 = 4;
+
+const float lutSize = 4096.0; // see createTransferFunctionTexture() in tools.cpp
+
+// non-linear RGB to linear RGB, via a lookup texture instead of pow()
+vec3 rgb_to_linear(vec3 rgb)
+{
+    highp vec3 tc = clamp(rgb, 0.0, 1.0) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;
+    return vec3(
+            texture(toLinearLut, vec2(tc.r, 0.5)).r,
+            texture(toLinearLut, vec2(tc.g, 0.5)).r,
+            texture(toLinearLut, vec2(tc.b, 0.5)).r);
+}
+
+void main(void)
+{
+    vec3 rgb = vec3(0.0, 1.0, 0.0);
+    if (ubuf.planeFormat == Format_RGB) {
+        vec4 c = texture(plane0, vtexcoord);
+        if (ubuf.swizzle == 1)
+            rgb = c.gba;
+        else if (ubuf.swizzle == 2)
+            rgb = c.bgr;
+        else if (ubuf.swizzle == 3)
+            rgb = c.abg;
+        else
+            rgb = c.rgb;
+    } else if (ubuf.planeFormat == Format_Y) {
+        rgb = texture(plane0, vtexcoord).rrr;
+    } else {
+        vec3 yuv;
+        if (ubuf.planeFormat == Format_YUVp) {
+            yuv = vec3(
+                    texture(plane0, vtexcoord).r,
+                    texture(plane1, vtexcoord).r,
+                    texture(plane2, vtexcoord).r);
+        } else if (ubuf.planeFormat == Format_YVUp) {
+            yuv = vec3(
+                    texture(plane0, vtexcoord).r,
+                    texture(plane2, vtexcoord).r,
+                    texture(plane1, vtexcoord).r);
+        } else {
+            yuv = vec3(
+                    texture(plane0, vtexcoord).r,
+                    texture(plane1, vtexcoord).rg);
+        }
+        bool yuvValueRangeSmall = (ubuf.yuvValueRangeSmall != 0);
+        mat4 m;
+        // The same matrices as in shader-color.frag.glsl
+        if (ubuf.yuvSpace == YUV_AdobeRGB) {
+            m = mat4(
+                    1.0, 1.0, 1.0, 0.0,
+                    0.0, -0.344, 1.772, 0.0,
+                    1.402, -0.714, 0.0, 0.0,
+                    -0.701, 0.529, -0.886, 1.0);
+        } else if (ubuf.yuvSpace == YUV_BT709) {
+            if (yuvValueRangeSmall) {
+                m = mat4(
+                        1.1644, 1.1644, 1.1644, 0.0,
+                        0.0, -0.5329, 2.1124, 0.0,
+                        1.7928, -0.2132, 0.0, 0.0,
+                        -0.9731, 0.3015, -1.1335, 1.0);
+            } else {
+                m = mat4(
+                        1.0, 1.0, 1.0, 0.0,
+                        0.0, -0.187324, 1.8556, 0.0,
+                        1.5748, -0.468124, 0.0, 0.0,
+                        -0.8774, 0.327724, -0.9278, 1.0);
+            }
+        } else if (ubuf.yuvSpace == YUV_BT2020) {
+            if (yuvValueRangeSmall) {
+                m = mat4(
+                        1.1644, 1.1644, 1.1644, 0.0,
+                        0.0, -0.1874, 2.1418, 0.0,
+                        1.6787, -0.6511, 0.0, 0.0,
+                        -0.9158, 0.3478, -1.1483, 1.0);
+            } else {
+                m = mat4(
+                        1.0, 1.0, 1.0, 0.0,
+                        0.0, -0.2801, 1.8814, 0.0,
+                        1.4746, -0.91666, 0.0, 0.0,
+                        -0.7373, 0.5984, -0.9407, 1.0);
+            }
+        } else {
+            if (yuvValueRangeSmall) {
+                m = mat4(
+                        1.164, 1.164, 1.164, 0.0,
+                        0.0, -0.392, 2.017, 0.0,
+                        1.596, -0.813, 0.0, 0.0,
+                        -0.8708, 0.5296, -1.081, 1.0);
+            } else {
+                m = mat4(
+                        1.0, 1.0, 1.0, 0.0,
+                        0.0, -0.1646, 1.42, 0.0,
+                        1.772, -0.57135, 0.0, 0.0,
+                        -0.886, 0.36795, -0.71, 1.0);
+            }
+        }
+        rgb = (m * vec4(yuv, 1.0)).rgb;
+    }
+
+    if (ubuf.linearInput == 0)
+        rgb = rgb_to_linear(rgb);
+    fcolor = vec4(rgb, 1.0);
+}
@@ -0,0 +1,258 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#version 440
+
+// This is shader-display.frag.glsl for QRhi. The output mode and the other
+// constants of the OpenGL shader are uniforms instead; they are the same for
+// all fragments, so the branches do not diverge. Texture coordinates are
+// computed with y pointing up, as in the OpenGL shader, and flipped when
+// sampling the view textures, whose first row is the top of the view.
+// Subtitles are not supported.
+
+layout(location = 0) in vec2 vtexcoord;
+
+layout(location = 0) out vec4 fcolor;
+
+layout(std140, binding = 0) uniform buf {
+    int outputMode;
+    int outputModeLeftRightView;
+    float relativeWidth;
+    float relativeHeight;
+    float fragOffsetX;
+    float fragOffsetY;
+    float outputHeight;
+    int srgbOutput;         // the hardware converts linear RGB to non-linear RGB
+    vec2 viewTexelSnap;     // see shader-display.frag.glsl
+    int fusedViews;         // sample the views from the frame textures
+    int displayLutEnabled;
+    vec4 viewSource0;       // offset x, factor x, offset y, factor y; y points down
+    vec4 viewSource1;
+    vec3 displayLutDomainMin;
+    float displayLutSize;
+    vec3 displayLutDomainFactor; // 1 / (max - min)
+    int viewFrame0;         // the frame texture that contains the view
+    int viewFrame1;
+} ubuf;
+
+layout(binding = 1) uniform sampler2D view0;
+layout(binding = 2) uniform sampler2D view1;
+layout(binding = 3) uniform sampler2D frame0;
+layout(binding = 4) uniform sampler2D frame1;
+layout(binding = 5) uniform sampler2D toNonlinearLut;
+layout(binding = 6) uniform highp sampler3D displayLut;
+
+// This must be the same as OutputMode from modes.hpp:
+const int Output_Left = 0;
+const int Output_Right = 1;
+const int Output_OpenGL_Stereo = 2;
+const int Output_Alternating = 3;
+const int Output_HDMI_Frame_Pack = 4;
+const int Output_Left_Right = 5;
+const int Output_Left_Right_Half = 6;
+const int Output_Right_Left = 7;
+const int Output_Right_Left_Half = 8;
+const int Output_Top_Bottom = 9;
+const int Output_Top_Bottom_Half = 10;
+const int Output_Bottom_Top = 11;
+const int Output_Bottom_Top_Half = 12;
+const int Output_Even_Odd_Rows = 13;
+const int Output_Even_Odd_Columns = 14;
+const int Output_Checkerboard = 15;
+const int Output_Red_Cyan_Dubois = 16;
+const int Output_Red_Cyan_FullColor = 17;
+const int Output_Red_Cyan_HalfColor = 18;
+const int Output_Red_Cyan_Monochrome = 19;
+const int Output_Green_Magenta_Dubois = 20;
+const int Output_Green_Magenta_FullColor = 21;
+const int Output_Green_Magenta_HalfColor = 22;
+const int Output_Green_Magenta_Monochrome = 23;
+const int Output_Amber_Blue_Dubois = 24;
+const int Output_Amber_Blue_FullColor = 25;
+const int Output_Amber_Blue_HalfColor = 26;
+const int Output_Amber_Blue_Monochrome = 27;
+const int Output_Red_Green_Monochrome = 28;
+const int Output_Red_Blue_Monochrome = 29;
+
+// linear RGB to luminance, as used by Mitsuba2 and pbrt
+float rgb_to_lum(vec3 rgb)
+{
+    return dot(rgb, vec3(0.212671, 0.715160, 0.072169));
+}
+
+const float lutSize = 4096.0; // see createTransferFunctionTexture() in tools.cpp
+
+// linear RGB to non-linear RGB, via a lookup texture instead of pow()
+vec3 rgb_to_nonlinear(vec3 rgb)
+{
+    highp vec3 tc = clamp(rgb, 0.0, 1.0) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;
+    return vec3(
+            texture(toNonlinearLut, vec2(tc.r, 0.5)).r,
+            texture(toNonlinearLut, vec2(tc.g, 0.5)).r,
+            texture(toNonlinearLut, vec2(tc.b, 0.5)).r);
+}
+
+// The optional 3D LUT for display calibration maps non-linear RGB
+// to the corrected non-linear RGB.
+vec3 apply_display_lut(vec3 rgb)
+{
+    highp vec3 tc = clamp((rgb - ubuf.displayLutDomainMin) * ubuf.displayLutDomainFactor, 0.0, 1.0);
+    tc = tc * ((ubuf.displayLutSize - 1.0) / ubuf.displayLutSize) + 0.5 / ubuf.displayLutSize;
+    return texture(displayLut, tc).rgb;
+}
+
+float snap_to_texel(float t, float texSize)
+{
+    return texSize > 0.0 ? (floor(t * texSize) + 0.5) / texSize : t;
+}
+
+// Sample a view with y pointing up; black outside of the view, like the
+// border color of the OpenGL view textures. In the single pass anaglyph
+// path, the view is looked up in the frame texture that contains it.
+vec3 view(int v, vec2 t)
+{
+    vec2 tc = vec2(t.x, 1.0 - t.y);
+    vec3 rgb;
+    if (ubuf.fusedViews != 0) {
+        vec4 s = (v == 0 ? ubuf.viewSource0 : ubuf.viewSource1);
+        vec2 ftc = vec2(s.x + s.y * tc.x, s.z + s.w * tc.y);
+        int f = (v == 0 ? ubuf.viewFrame0 : ubuf.viewFrame1);
+        rgb = (f == 0 ? texture(frame0, ftc).rgb : texture(frame1, ftc).rgb);
+    } else {
+        rgb = (v == 0 ? texture(view0, tc).rgb : texture(view1, tc).rgb);
+    }
+    bool inside = (t.x >= 0.0 && t.x <= 1.0 && t.y >= 0.0 && t.y <= 1.0);
+    return inside ? rgb : vec3(0.0);
+}
+
+void main(void)
+{
+    int outputMode = ubuf.outputMode;
+    float tx = (vtexcoord.x - 0.5 * (1.0 - ubuf.relativeWidth)) / ubuf.relativeWidth;
+    float ty = (1.0 - vtexcoord.y - 0.5 * (1.0 - ubuf.relativeHeight)) / ubuf.relativeHeight;
+    // fragment coordinates relative to the lower left corner, as in OpenGL
+    float fragmentX = gl_FragCoord.x - 0.5 + ubuf.fragOffsetX;
+    float fragmentY = ubuf.outputHeight - 0.5 - gl_FragCoord.y + ubuf.fragOffsetY;
+    vec3 rgb = vec3(0.0, 0.0, 0.0);
+    if (outputMode == Output_HDMI_Frame_Pack) {
+        // see shader-display.frag.glsl
+        const float blankPortion = 1.0 / 49.0;
+        const float a = 0.5 + 0.5 * blankPortion;
+        const float b = 0.5 - 0.5 * blankPortion;
+        if (ty >= a) {
+            rgb = view(0, vec2(tx, (ty - a) / (1.0 - a)));
+        } else if (ty < b) {
+            rgb = view(1, vec2(tx, ty / b));
+        }
+    } else if (outputMode == Output_Left || outputMode == Output_Right) {
+        rgb = view(ubuf.outputModeLeftRightView, vec2(tx, ty));
+    } else if (outputMode == Output_Left_Right || outputMode == Output_Left_Right_Half) {
+        if (tx < 0.5)
+            rgb = view(0, vec2(2.0 * tx, ty));
+        else
+            rgb = view(1, vec2(2.0 * tx - 1.0, ty));
+    } else if (outputMode == Output_Right_Left || outputMode == Output_Right_Left_Half) {
+        if (tx < 0.5)
+            rgb = view(1, vec2(2.0 * tx, ty));
+        else
+            rgb = view(0, vec2(2.0 * tx - 1.0, ty));
+    } else if (outputMode == Output_Top_Bottom || outputMode == Output_Top_Bottom_Half) {
+        if (ty >= 0.5)
+            rgb = view(0, vec2(tx, 2.0 * ty - 1.0));
+        else
+            rgb = view(1, vec2(tx, 2.0 * ty));
+    } else if (outputMode == Output_Bottom_Top || outputMode == Output_Bottom_Top_Half) {
+        if (ty >= 0.5)
+            rgb = view(1, vec2(tx, 2.0 * ty - 1.0));
+        else
+            rgb = view(0, vec2(tx, 2.0 * ty));
+    } else if (outputMode == Output_Even_Odd_Rows) {
+        ty = snap_to_texel(ty, ubuf.viewTexelSnap.y);
+        rgb = view(mod(fragmentY, 2.0) < 0.5 ? 0 : 1, vec2(tx, ty));
+    } else if (outputMode == Output_Even_Odd_Columns) {
+        tx = snap_to_texel(tx, ubuf.viewTexelSnap.x);
+        rgb = view(mod(fragmentX, 2.0) < 0.5 ? 0 : 1, vec2(tx, ty));
+    } else if (outputMode == Output_Checkerboard) {
+        tx = snap_to_texel(tx, ubuf.viewTexelSnap.x);
+        rgb = view(abs(mod(fragmentX, 2.0) - mod(fragmentY, 2.0)) < 0.5 ? 0 : 1, vec2(tx, ty));
+    } else {
+        vec3 rgb0 = view(0, vec2(tx, ty));
+        vec3 rgb1 = view(1, vec2(tx, ty));
+        if (outputMode == Output_Red_Cyan_Dubois) {
+            mat3 m0 = mat3(
+                    0.437, -0.062, -0.048,
+                    0.449, -0.062, -0.050,
+                    0.164, -0.024, -0.017);
+            mat3 m1 = mat3(
+                    -0.011,  0.377, -0.026,
+                    -0.032,  0.761, -0.093,
+                    -0.007,  0.009,  1.234);
+            rgb = m0 * rgb0 + m1 * rgb1;
+        } else if (outputMode == Output_Red_Cyan_FullColor) {
+            rgb = vec3(rgb0.r, rgb1.g, rgb1.b);
+        } else if (outputMode == Output_Red_Cyan_HalfColor) {
+            rgb = vec3(rgb_to_lum(rgb0), rgb1.g, rgb1.b);
+        } else if (outputMode == Output_Red_Cyan_Monochrome) {
+            rgb = vec3(rgb_to_lum(rgb0), rgb_to_lum(rgb1), rgb_to_lum(rgb1));
+        } else if (outputMode == Output_Green_Magenta_Dubois) {
+            mat3 m0 = mat3(
+                    -0.062,  0.284, -0.015,
+                    -0.158,  0.668, -0.027,
+                    -0.039,  0.143,  0.021);
+            mat3 m1 = mat3(
+                    0.529, -0.016,  0.009,
+                    0.705, -0.015,  0.075,
+                    0.024, -0.065,  0.937);
+            rgb = m0 * rgb0 + m1 * rgb1;
+        } else if (outputMode == Output_Green_Magenta_FullColor) {
+            rgb = vec3(rgb1.r, rgb0.g, rgb1.b);
+        } else if (outputMode == Output_Green_Magenta_HalfColor) {
+            rgb = vec3(rgb1.r, rgb_to_lum(rgb0), rgb1.b);
+        } else if (outputMode == Output_Green_Magenta_Monochrome) {
+            rgb = vec3(rgb_to_lum(rgb1), rgb_to_lum(rgb0), rgb_to_lum(rgb1));
+        } else if (outputMode == Output_Amber_Blue_Dubois) {
+            mat3 m0 = mat3(
+                    1.062, -0.026, -0.038,
+                    -0.205,  0.908, -0.173,
+                    0.299,  0.068,  0.022);
+            mat3 m1 = mat3(
+                    -0.016,  0.006,  0.094,
+                    -0.123,  0.062,  0.185,
+                    -0.017, -0.017,  0.911);
+            rgb = m0 * rgb0 + m1 * rgb1;
+        } else if (outputMode == Output_Amber_Blue_FullColor) {
+            rgb = vec3(rgb0.r, rgb0.g, rgb1.b);
+        } else if (outputMode == Output_Amber_Blue_HalfColor) {
+            rgb = vec3(rgb_to_lum(rgb0), rgb_to_lum(rgb0), rgb1.b);
+        } else if (outputMode == Output_Amber_Blue_Monochrome) {
+            rgb = vec3(rgb_to_lum(rgb0), rgb_to_lum(rgb0), rgb_to_lum(rgb1));
+        } else if (outputMode == Output_Red_Green_Monochrome) {
+            rgb = vec3(rgb_to_lum(rgb0), rgb_to_lum(rgb1), 0.0);
+        } else if (outputMode == Output_Red_Blue_Monochrome) {
+            rgb = vec3(rgb_to_lum(rgb0), 0.0, rgb_to_lum(rgb1));
+        }
+    }
+    if (ubuf.srgbOutput == 0) {
+        rgb = rgb_to_nonlinear(rgb);
+        if (ubuf.displayLutEnabled != 0)
+            rgb = apply_display_lut(rgb);
+    }
+    fcolor = vec4(rgb, 1.0);
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#version 440
+
+// Full screen quad for all QRhi passes. The texture coordinate (0,0) is at
+// normalized device coordinate (-1,-1), which is the first row of the render
+// target with every QRhi backend, and the first row of an uploaded texture is
+// sampled at t=0. Therefore the first row is always the top of the image.
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 texcoord;
+
+layout(location = 0) out vec2 vtexcoord;
+
+void main(void)
+{
+    vtexcoord = texcoord;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#version 440
+
+// This is shader-view.frag.glsl for QRhi. Instead of rendering the screen
+// geometry, a full screen quad is drawn into the view texture; for surround
+// video, the viewing direction of each fragment is computed from the
+// projection parameters. Subtitles are not supported.
+
+layout(location = 0) in vec2 vtexcoord;
+
+layout(location = 0) out vec4 fcolor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 orientationMatrix;
+    vec4 viewRect;          // offset x, offset y, factor x, factor y; y points down
+    float projectionRight;  // half extent of the view frustum at distance 1
+    float projectionTop;
+    int surroundDegrees;
+} ubuf;
+
+layout(binding = 1) uniform sampler2D frameTex;
+
+const float pi = 3.14159265358979323846;
+
+void main(void)
+{
+    vec2 tc;
+    if (ubuf.surroundDegrees > 0) {
+        vec3 p = vec3((2.0 * vtexcoord.x - 1.0) * ubuf.projectionRight,
+                (1.0 - 2.0 * vtexcoord.y) * ubuf.projectionTop, -1.0);
+        vec3 dir = normalize((vec4(p, 0.0) * ubuf.orientationMatrix).xyz);
+        float theta = asin(clamp(-dir.y, -1.0, 1.0));
+        float phi = atan(dir.x, -dir.z);
+        float tmp = (ubuf.surroundDegrees == 360 ? 2.0 * pi : pi);
+        tc = vec2(phi / tmp + 0.5, theta / pi + 0.5);
+    } else {
+        tc = vtexcoord;
+    }
+    vec3 rgb = texture(frameTex, ubuf.viewRect.xy + ubuf.viewRect.zw * tc).rgb;
+    fcolor = vec4(rgb, 1.0);
+}
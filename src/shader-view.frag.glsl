@@ -36,15 +36,17 @@ const float pi = 3.14159265358979323846;
 
 layout(location = 0) out vec4 fcolor;
 
-// linear RGB to non-linear RGB
-float to_nonlinear(float x)
-{
-    const float c0 = 0.416666666667; // 1.0 / 2.4
-    return (x <= 0.0031308 ? (x * 12.92) : (1.055 * pow(x, c0) - 0.055));
-}
+uniform sampler2D toNonlinearLut;
+const float lutSize = 4096.0; // see createTransferFunctionTexture() in tools.cpp
+
+// linear RGB to non-linear RGB, via a lookup texture instead of pow()
 vec3 rgb_to_nonlinear(vec3 rgb)
 {
-    return vec3(to_nonlinear(rgb.r), to_nonlinear(rgb.g), to_nonlinear(rgb.b));
+    highp vec3 tc = clamp(rgb, 0.0, 1.0) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;
+    return vec3(
+            texture(toNonlinearLut, vec2(tc.r, 0.5)).r,
+            texture(toNonlinearLut, vec2(tc.g, 0.5)).r,
+            texture(toNonlinearLut, vec2(tc.b, 0.5)).r);
 }
 
 void main(void)
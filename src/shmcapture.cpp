@@ -0,0 +1,285 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if __has_include(<sys/mman.h>) && __has_include(<sys/stat.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define HAVE_POSIX_SHM 1
+#endif
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "shmcapture.hpp"
+#include "shmframes.hpp"
+#include "log.hpp"
+
+
+ShmCapture::ShmCapture(const QString& name, QObject* parent) :
+    QThread(parent),
+    _name(name.startsWith('/') ? name : QString('/') + name),
+    _stopRequested(false),
+    _deliveryPending(false),
+    _statSkippedFrames(0),
+    _frameDuration(0),
+    _statFramesShown(0),
+    _statLateFrames(0),
+    _statLatencySum(0),
+    _statLatencyMax(0)
+{
+}
+
+ShmCapture::~ShmCapture()
+{
+    stopCapture();
+    logStatistics();
+}
+
+void ShmCapture::stopCapture()
+{
+    _deliveryMutex.lock();
+    _stopRequested = true;
+    _deliveryDone.wakeAll();
+    _deliveryMutex.unlock();
+    wait();
+}
+
+#if defined(HAVE_POSIX_SHM)
+
+// The layout of a ring, validated when connecting to it.
+// It is kept here so that a misbehaving producer cannot make us read
+// outside of the mapping by changing the header later.
+class RingLayout
+{
+public:
+    int width;
+    int height;
+    QVideoFrameFormat::PixelFormat pixelFormat;
+    bool fullRange;
+    int planeCount;
+    int srcBytesPerLine[3];
+    int dstBytesPerLine[3];
+    int planeHeight[3];
+    quint64 planeOffset[3];
+    quint64 slotCount;
+    quint64 slotSize;
+    quint64 slotsOffset;
+    qint64 frameDuration;
+    size_t frameSize;
+};
+
+static bool getRingLayout(const uchar* map, size_t mapSize, RingLayout& layout)
+{
+    const ShmFramesHeader* header = reinterpret_cast<const ShmFramesHeader*>(map);
+    if (header->magic != ShmFramesMagic || header->version != ShmFramesVersion)
+        return false;
+    layout.width = header->width;
+    layout.height = header->height;
+    layout.fullRange = (header->flags & ShmFrames_FullRange);
+    if (!shmFramesLayout(header->pixelFormat, layout.width, layout.height,
+                layout.pixelFormat, layout.planeCount, layout.dstBytesPerLine, layout.planeHeight)
+            || header->planeCount != quint32(layout.planeCount))
+        return false;
+    layout.slotCount = header->slotCount;
+    layout.slotSize = header->slotSize;
+    layout.slotsOffset = header->slotsOffset;
+    layout.frameDuration = header->frameDuration;
+    // All values come from the producer; check them without overflows
+    if (layout.slotCount < 1 || layout.slotsOffset < sizeof(ShmFramesHeader)
+            || layout.slotSize < sizeof(ShmFramesSlot)
+            || layout.slotsOffset > mapSize
+            || layout.slotSize > (mapSize - layout.slotsOffset) / layout.slotCount)
+        return false;
+    layout.frameSize = 0;
+    for (int p = 0; p < layout.planeCount; p++) {
+        layout.srcBytesPerLine[p] = header->bytesPerLine[p];
+        layout.planeOffset[p] = header->planeOffset[p];
+        if (layout.srcBytesPerLine[p] < layout.dstBytesPerLine[p]
+                || layout.planeOffset[p] < sizeof(ShmFramesSlot)
+                || layout.planeOffset[p] > layout.slotSize
+                || quint64(layout.srcBytesPerLine[p]) * layout.planeHeight[p] > layout.slotSize - layout.planeOffset[p])
+            return false;
+        layout.frameSize += size_t(layout.dstBytesPerLine[p]) * layout.planeHeight[p];
+    }
+    return true;
+}
+
+static uchar* mapRing(const QByteArray& name, size_t& mapSize, RingLayout& layout)
+{
+    int fd = shm_open(name.constData(), O_RDWR, 0);
+    if (fd < 0)
+        return nullptr;
+    uchar* map = nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ShmFramesHeader)) {
+        void* ptr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED) {
+            map = static_cast<uchar*>(ptr);
+            mapSize = st.st_size;
+        }
+    }
+    close(fd);
+    if (map && !getRingLayout(map, mapSize, layout)) {
+        munmap(map, mapSize);
+        map = nullptr;
+    }
+    return map;
+}
+
+#endif
+
+void ShmCapture::run()
+{
+#if defined(HAVE_POSIX_SHM)
+    const qint64 reconnectTimeout = 1000000000; // nanoseconds without new frames
+    QByteArray name = _name.toLocal8Bit();
+    uchar* map = nullptr;
+    size_t mapSize = 0;
+    RingLayout layout;
+    quint64 lastSequence = 0;
+    qint64 lastFrameTime = 0;
+    bool warned = false;
+    while (!_stopRequested) {
+        if (!map) {
+            map = mapRing(name, mapSize, layout);
+            if (!map) {
+                if (!warned) {
+                    LOG_WARNING("%s", qPrintable(tr("Waiting for a producer on shared memory %1").arg(_name)));
+                    warned = true;
+                }
+                msleep(100);
+                continue;
+            }
+            LOG_DEBUG("shared memory capture: connected to %s, %dx%d %s, %d slots", qPrintable(_name),
+                    layout.width, layout.height,
+                    qPrintable(QVideoFrameFormat::pixelFormatToString(layout.pixelFormat)),
+                    int(layout.slotCount));
+            lastSequence = 0;
+            lastFrameTime = shmFramesTime();
+        }
+        ShmFramesHeader* header = reinterpret_cast<ShmFramesHeader*>(map);
+        quint32 futexValue = header->futex.load(std::memory_order_acquire);
+        quint64 sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence == lastSequence || _deliveryPending) {
+            if (shmFramesTime() - lastFrameTime > reconnectTimeout) {
+                // the producer might have restarted with a new ring under the same name
+                munmap(map, mapSize);
+                map = nullptr;
+            } else if (_deliveryPending) {
+                // wait until the main thread took the previous frame;
+                // the timeout lets us check for a restarted producer
+                _deliveryMutex.lock();
+                if (_deliveryPending && !_stopRequested)
+                    _deliveryDone.wait(&_deliveryMutex, 100);
+                _deliveryMutex.unlock();
+            } else {
+                shmFramesWait(&header->futex, futexValue, 100);
+            }
+            continue;
+        }
+        if (lastSequence > 0 && sequence > lastSequence + 1)
+            _statSkippedFrames += sequence - lastSequence - 1;
+        lastSequence = sequence;
+        lastFrameTime = shmFramesTime();
+
+        // Copy the frame out of its slot, removing line padding
+        const uchar* slotData = map + layout.slotsOffset + ((sequence - 1) % layout.slotCount) * layout.slotSize;
+        const ShmFramesSlot* slot = reinterpret_cast<const ShmFramesSlot*>(slotData);
+        if (slot->sequence.load(std::memory_order_acquire) != sequence) {
+            _statSkippedFrames++;
+            continue;
+        }
+        qint64 timestamp = slot->timestamp;
+        std::shared_ptr<std::vector<uchar>> buffer = std::make_shared<std::vector<uchar>>(layout.frameSize);
+        RawFrame frame;
+        frame.width = layout.width;
+        frame.height = layout.height;
+        frame.pixelFormat = layout.pixelFormat;
+        frame.yuvValueRangeSmall = !layout.fullRange;
+        frame.yuvSpace = (layout.height >= 720 ? VideoFrame::YUV_BT709 : VideoFrame::YUV_BT601);
+        frame.planeCount = layout.planeCount;
+        uchar* dst = buffer->data();
+        for (int p = 0; p < layout.planeCount; p++) {
+            const uchar* src = slotData + layout.planeOffset[p];
+            frame.bytesPerLine[p] = layout.dstBytesPerLine[p];
+            frame.bytesPerPlane[p] = layout.dstBytesPerLine[p] * layout.planeHeight[p];
+            frame.bits[p] = dst;
+            if (layout.srcBytesPerLine[p] == layout.dstBytesPerLine[p]) {
+                std::memcpy(dst, src, frame.bytesPerPlane[p]);
+            } else {
+                for (int y = 0; y < layout.planeHeight[p]; y++)
+                    std::memcpy(dst + y * layout.dstBytesPerLine[p], src + y * layout.srcBytesPerLine[p], layout.dstBytesPerLine[p]);
+            }
+            dst += frame.bytesPerPlane[p];
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) != sequence) {
+            // the producer overwrote the slot while we copied it
+            _statSkippedFrames++;
+            continue;
+        }
+        frame.owner = buffer;
+        header->readSequence.store(sequence, std::memory_order_release);
+
+        _deliveryPending = true;
+        qint64 frameDuration = layout.frameDuration;
+        QMetaObject::invokeMethod(this, [=]() { deliver(frame, timestamp, frameDuration); }, Qt::QueuedConnection);
+    }
+    if (map)
+        munmap(map, mapSize);
+#else
+    LOG_WARNING("%s", qPrintable(tr("Shared memory capture is not supported on this platform")));
+#endif
+}
+
+void ShmCapture::deliver(const RawFrame& frame, qint64 timestamp, qint64 frameDuration)
+{
+    _deliveryMutex.lock();
+    _deliveryPending = false;
+    _deliveryDone.wakeAll();
+    _deliveryMutex.unlock();
+    _frameDuration = frameDuration;
+    emit frameReady(frame, timestamp);
+}
+
+void ShmCapture::framePresented(qint64 timestamp)
+{
+    qint64 latency = shmFramesTime() - timestamp;
+    LOG_FIREHOSE("shared memory capture: latency %g ms", latency / 1e6);
+    _statFramesShown++;
+    _statLatencySum += latency;
+    _statLatencyMax = qMax(_statLatencyMax, latency);
+    if (_frameDuration > 0 && latency > _frameDuration)
+        _statLateFrames++;
+}
+
+void ShmCapture::logStatistics()
+{
+    if (_statFramesShown == 0)
+        return;
+    LOG_INFO("shared memory capture %s: %d frames shown, %llu skipped; latency %.2f ms average, %.2f ms maximum; "
+            "%d frames with latency above one frame period",
+            qPrintable(_name), _statFramesShown, static_cast<unsigned long long>(_statSkippedFrames.load()),
+            _statLatencySum / 1e6 / _statFramesShown, _statLatencyMax / 1e6, _statLateFrames);
+}
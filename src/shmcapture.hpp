@@ -0,0 +1,79 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "videoframe.hpp"
+
+
+/* Receives frames from an external producer process through a shared memory
+ * frame ring (see shmframes.hpp). A thread waits for new frames and copies
+ * the newest one out of the ring, so that the producer can never modify a
+ * frame while it is uploaded. Frames are delivered in the main thread via
+ * frameReady(). Frames that arrive while the main thread is still busy with
+ * the previous one are skipped, so that latency does not accumulate; the
+ * thread sleeps until that delivery is done. */
+
+class ShmCapture : public QThread
+{
+Q_OBJECT
+
+private:
+    QString _name;
+    std::atomic<bool> _stopRequested;
+    std::atomic<bool> _deliveryPending;
+    QMutex _deliveryMutex;
+    QWaitCondition _deliveryDone; // signalled when _deliveryPending or _stopRequested change
+    std::atomic<quint64> _statSkippedFrames; // written by the thread
+    // statistics, only used in the main thread
+    qint64 _frameDuration;
+    int _statFramesShown;
+    int _statLateFrames;
+    qint64 _statLatencySum;
+    qint64 _statLatencyMax;
+
+    void deliver(const RawFrame& frame, qint64 timestamp, qint64 frameDuration);
+    void logStatistics();
+
+protected:
+    void run() override;
+
+public:
+    ShmCapture(const QString& name, QObject* parent = nullptr);
+    virtual ~ShmCapture();
+
+    // Stop the thread and wait for it
+    void stopCapture();
+
+    // Report that the buffer swap of the frame with the given producer
+    // timestamp is done. This measures the latency from the producer to
+    // the screen.
+    void framePresented(qint64 timestamp);
+
+signals:
+    void frameReady(const RawFrame& frame, qint64 timestamp);
+};
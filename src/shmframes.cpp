@@ -0,0 +1,125 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ctime>
+#include <climits>
+
+#if defined(__linux__)
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# define HAVE_FUTEX 1
+#endif
+
+#include <QThread>
+#include <QElapsedTimer>
+
+#include "shmframes.hpp"
+
+
+qint64 shmFramesTime()
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    static QElapsedTimer timer;
+    if (!timer.isValid())
+        timer.start();
+    return timer.nsecsElapsed();
+#endif
+}
+
+void shmFramesWait(std::atomic<quint32>* futex, quint32 oldValue, int timeout)
+{
+#if defined(HAVE_FUTEX)
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    // the futex is shared between processes, so FUTEX_PRIVATE_FLAG must not be used
+    syscall(SYS_futex, reinterpret_cast<quint32*>(futex), FUTEX_WAIT, oldValue, &ts, nullptr, 0);
+#else
+    // poll instead
+    QElapsedTimer timer;
+    timer.start();
+    while (futex->load(std::memory_order_acquire) == oldValue && timer.elapsed() < timeout)
+        QThread::usleep(500);
+#endif
+}
+
+void shmFramesWake(std::atomic<quint32>* futex)
+{
+    futex->fetch_add(1, std::memory_order_release);
+#if defined(HAVE_FUTEX)
+    syscall(SYS_futex, reinterpret_cast<quint32*>(futex), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+bool shmFramesLayout(quint32 pixelFormat, int width, int height,
+        QVideoFrameFormat::PixelFormat& qtPixelFormat, int& planeCount,
+        int bytesPerLine[3], int planeHeight[3])
+{
+    switch (pixelFormat) {
+    case ShmFrames_YUV420P:
+    case ShmFrames_YV12:
+        qtPixelFormat = (pixelFormat == ShmFrames_YV12 ? QVideoFrameFormat::Format_YV12 : QVideoFrameFormat::Format_YUV420P);
+        planeCount = 3;
+        bytesPerLine[0] = width;
+        bytesPerLine[1] = bytesPerLine[2] = width / 2;
+        planeHeight[0] = height;
+        planeHeight[1] = planeHeight[2] = height / 2;
+        break;
+    case ShmFrames_YUV422P:
+        qtPixelFormat = QVideoFrameFormat::Format_YUV422P;
+        planeCount = 3;
+        bytesPerLine[0] = width;
+        bytesPerLine[1] = bytesPerLine[2] = width / 2;
+        planeHeight[0] = planeHeight[1] = planeHeight[2] = height;
+        break;
+    case ShmFrames_NV12:
+    case ShmFrames_P016:
+        qtPixelFormat = (pixelFormat == ShmFrames_P016 ? QVideoFrameFormat::Format_P016 : QVideoFrameFormat::Format_NV12);
+        planeCount = 2;
+        bytesPerLine[0] = bytesPerLine[1] = (pixelFormat == ShmFrames_P016 ? 2 : 1) * width;
+        planeHeight[0] = height;
+        planeHeight[1] = height / 2;
+        break;
+    case ShmFrames_Gray:
+    case ShmFrames_Gray16:
+        qtPixelFormat = (pixelFormat == ShmFrames_Gray16 ? QVideoFrameFormat::Format_Y16 : QVideoFrameFormat::Format_Y8);
+        planeCount = 1;
+        bytesPerLine[0] = (pixelFormat == ShmFrames_Gray16 ? 2 : 1) * width;
+        planeHeight[0] = height;
+        break;
+    case ShmFrames_RGBA:
+    case ShmFrames_BGRA:
+        qtPixelFormat = (pixelFormat == ShmFrames_BGRA ? QVideoFrameFormat::Format_BGRA8888 : QVideoFrameFormat::Format_RGBA8888);
+        planeCount = 1;
+        bytesPerLine[0] = 4 * width;
+        planeHeight[0] = height;
+        break;
+    default:
+        return false;
+    }
+    // subsampled chroma requires even dimensions
+    return width > 0 && height > 0 && (planeCount == 1 || (width % 2 == 0 && height % 2 == 0));
+}
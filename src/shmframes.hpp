@@ -0,0 +1,128 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+
+#include <QtGlobal>
+#include <QVideoFrameFormat>
+
+
+/* Shared memory frame rings, used to exchange frames with other processes on
+ * the same machine: Bino reads frames from a ring with --capture-shm and
+ * writes its output to a ring with --output-shm.
+ *
+ * A ring is a POSIX shared memory object (see shm_open()) that starts with a
+ * ShmFramesHeader. It contains slotCount slots of slotSize bytes each,
+ * starting at slotsOffset. Each slot starts with a ShmFramesSlot, and the
+ * planes of its frame are at the planeOffset positions relative to the start
+ * of the slot. All values are in native byte order.
+ *
+ * There is exactly one producer per ring. It fills the complete header
+ * before publishing the first frame. To publish frame number n (n = 1, 2, ...), it
+ * 1. stores 0 in the sequence of slot (n - 1) % slotCount, followed by a
+ *    release fence,
+ * 2. writes the frame data and the timestamp into that slot,
+ * 3. stores n in the sequence of the slot,
+ * 4. stores n in the sequence of the header,
+ * 5. increments the futex word of the header and wakes all waiters on it.
+ *
+ * A consumer waits on the futex word (FUTEX_WAIT on Linux), reads the header
+ * sequence n, and copies the frame from slot (n - 1) % slotCount. If the
+ * slot sequence is not n before or after copying, the producer has overwritten
+ * the slot in the meantime and the copy must be discarded. Afterwards, the
+ * consumer stores n in readSequence. The producer never waits for consumers;
+ * it only uses readSequence to count frames that were overwritten before
+ * anyone read them in droppedFrames.
+ *
+ * Timestamps are CLOCK_MONOTONIC nanoseconds, taken when the producer has
+ * finished creating the frame, so that consumers can measure the latency
+ * from the producer. */
+
+enum ShmFramesPixelFormat : quint32
+{
+    ShmFrames_YUV420P = 1,  // three planes: Y, U and V with half width and height
+    ShmFrames_YUV422P = 2,  // three planes: Y, U and V with half width
+    ShmFrames_YV12 = 3,     // like YUV420P, but with V before U
+    ShmFrames_NV12 = 4,     // two planes: Y, interleaved UV with half width and height
+    ShmFrames_P016 = 5,     // like NV12, but with 16 bit per component
+    ShmFrames_Gray = 6,     // one plane with 8 bit per pixel
+    ShmFrames_Gray16 = 7,   // one plane with 16 bit per pixel
+    ShmFrames_RGBA = 8,     // one plane with 8 bit per component in memory order R, G, B, A
+    ShmFrames_BGRA = 9      // one plane with 8 bit per component in memory order B, G, R, A
+};
+
+enum ShmFramesFlags : quint32
+{
+    ShmFrames_FullRange = 1     // YUV values use the full range instead of the video range
+};
+
+const quint32 ShmFramesMagic = 0x4d485342;  // "BSHM" in little endian
+const quint32 ShmFramesVersion = 1;
+
+struct ShmFramesHeader
+{
+    quint32 magic;              // ShmFramesMagic
+    quint32 version;            // ShmFramesVersion
+    quint32 width;
+    quint32 height;
+    quint32 pixelFormat;        // ShmFramesPixelFormat
+    quint32 planeCount;
+    quint32 bytesPerLine[3];
+    quint32 planeOffset[3];     // relative to the start of a slot
+    quint32 slotCount;
+    quint32 flags;              // ShmFramesFlags
+    quint64 slotSize;
+    quint64 slotsOffset;        // relative to the start of the shared memory
+    quint64 frameDuration;      // in nanoseconds, or 0 if unknown
+    std::atomic<quint32> futex;
+    quint32 reserved1;
+    std::atomic<quint64> sequence;      // number of the latest complete frame, 0 if none
+    std::atomic<quint64> readSequence;  // written by consumers: number of the latest frame read
+    std::atomic<quint64> droppedFrames; // written by the producer
+};
+
+struct ShmFramesSlot
+{
+    std::atomic<quint64> sequence;  // number of the frame in this slot, 0 while it is written
+    qint64 timestamp;               // CLOCK_MONOTONIC nanoseconds
+};
+
+static_assert(std::atomic<quint32>::is_always_lock_free && std::atomic<quint64>::is_always_lock_free,
+        "shared memory frame rings require lock-free atomics");
+
+// Current CLOCK_MONOTONIC time in nanoseconds
+qint64 shmFramesTime();
+
+// Wait until the futex word is not oldValue anymore, or until the timeout
+// (in milliseconds) expired
+void shmFramesWait(std::atomic<quint32>* futex, quint32 oldValue, int timeout);
+
+// Increment the futex word and wake all waiters
+void shmFramesWake(std::atomic<quint32>* futex);
+
+// Get the Qt pixel format, the plane count, and the number of bytes per line
+// and lines of each plane without padding for a frame in the given format.
+// Returns false if the format or size is not valid.
+bool shmFramesLayout(quint32 pixelFormat, int width, int height,
+        QVideoFrameFormat::PixelFormat& qtPixelFormat, int& planeCount,
+        int bytesPerLine[3], int planeHeight[3]);
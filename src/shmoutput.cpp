@@ -0,0 +1,244 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if __has_include(<sys/mman.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define HAVE_POSIX_SHM 1
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#include "shmoutput.hpp"
+#include "shmframes.hpp"
+#include "log.hpp"
+
+
+ShmOutput::ShmOutput(const QString& name, int slotCount) :
+    _name(name.startsWith('/') ? name : QString('/') + name),
+    _slotCount(slotCount),
+    _map(nullptr),
+    _mapSize(0),
+    _width(0),
+    _height(0),
+    _sequence(0),
+    _pboWidth(0),
+    _pboHeight(0),
+    _nextPbo(0),
+    _statFramesSent(0),
+    _statReadbacksSkipped(0)
+{
+    for (int i = 0; i < PboCount; i++) {
+        _pbos[i] = 0;
+        _fences[i] = nullptr;
+        _timestamps[i] = 0;
+    }
+}
+
+ShmOutput::~ShmOutput()
+{
+    for (int i = 0; i < PboCount; i++)
+        if (_fences[i])
+            glDeleteSync(_fences[i]);
+    if (_pbos[0])
+        glDeleteBuffers(PboCount, _pbos);
+    if (_map) {
+        const ShmFramesHeader* header = reinterpret_cast<const ShmFramesHeader*>(_map);
+        LOG_INFO("shared memory output %s: %llu frames sent, %llu dropped by lagging consumers, %llu read backs skipped",
+                qPrintable(_name), static_cast<unsigned long long>(_statFramesSent),
+                static_cast<unsigned long long>(header->droppedFrames.load()),
+                static_cast<unsigned long long>(_statReadbacksSkipped));
+    }
+    destroyRing();
+#if defined(HAVE_POSIX_SHM)
+    shm_unlink(qPrintable(_name));
+#endif
+}
+
+void ShmOutput::initialize()
+{
+    initializeOpenGLFunctions();
+    glGenBuffers(PboCount, _pbos);
+#if !defined(HAVE_POSIX_SHM)
+    LOG_WARNING("%s", qPrintable(QObject::tr("Shared memory output is not supported on this platform")));
+#endif
+}
+
+bool ShmOutput::createRing(int width, int height)
+{
+    destroyRing();
+#if defined(HAVE_POSIX_SHM)
+    QByteArray name = _name.toLocal8Bit();
+    // Remove an old ring of a different size; consumers still have it mapped,
+    // and they will find the new ring when the old one stays idle
+    shm_unlink(name.constData());
+    int fd = shm_open(name.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        LOG_WARNING("%s", qPrintable(QObject::tr("Cannot create shared memory %1: %2").arg(_name).arg(strerror(errno))));
+        return false;
+    }
+    const size_t alignment = 64;
+    size_t bytesPerLine = 4 * size_t(width);
+    size_t planeOffset = (sizeof(ShmFramesSlot) + alignment - 1) / alignment * alignment;
+    size_t slotSize = (planeOffset + bytesPerLine * height + alignment - 1) / alignment * alignment;
+    size_t slotsOffset = 4096;
+    size_t mapSize = slotsOffset + _slotCount * slotSize;
+    void* ptr = MAP_FAILED;
+    if (ftruncate(fd, mapSize) == 0)
+        ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        LOG_WARNING("%s", qPrintable(QObject::tr("Cannot map shared memory %1: %2").arg(_name).arg(strerror(errno))));
+        shm_unlink(name.constData());
+        return false;
+    }
+    _map = static_cast<unsigned char*>(ptr);
+    _mapSize = mapSize;
+    _width = width;
+    _height = height;
+    _sequence = 0;
+
+    // The memory is zero-initialized; fill the header and set the magic number last
+    ShmFramesHeader* header = reinterpret_cast<ShmFramesHeader*>(_map);
+    header->version = ShmFramesVersion;
+    header->width = width;
+    header->height = height;
+    header->pixelFormat = ShmFrames_RGBA;
+    header->planeCount = 1;
+    header->bytesPerLine[0] = bytesPerLine;
+    header->planeOffset[0] = planeOffset;
+    header->slotCount = _slotCount;
+    header->flags = ShmFrames_FullRange;
+    header->slotSize = slotSize;
+    header->slotsOffset = slotsOffset;
+    header->frameDuration = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ShmFramesMagic;
+    LOG_DEBUG("shared memory output: created %s for %dx%d frames with %d slots", qPrintable(_name), width, height, _slotCount);
+    return true;
+#else
+    Q_UNUSED(width);
+    Q_UNUSED(height);
+    return false;
+#endif
+}
+
+void ShmOutput::destroyRing()
+{
+#if defined(HAVE_POSIX_SHM)
+    if (_map) {
+        munmap(_map, _mapSize);
+        _map = nullptr;
+        _mapSize = 0;
+    }
+#endif
+}
+
+// Copy a complete read back into the next slot of the ring. OpenGL delivers
+// the lines bottom to top, while the ring stores them top to bottom.
+void ShmOutput::sendFrame(const unsigned char* data, qint64 timestamp)
+{
+    ShmFramesHeader* header = reinterpret_cast<ShmFramesHeader*>(_map);
+    quint64 sequence = ++_sequence;
+    unsigned char* slotData = _map + header->slotsOffset + ((sequence - 1) % _slotCount) * header->slotSize;
+    ShmFramesSlot* slot = reinterpret_cast<ShmFramesSlot*>(slotData);
+
+    // Count the frame that is overwritten now as dropped if no consumer read it,
+    // but only once a consumer has shown up at all
+    quint64 readSequence = header->readSequence.load(std::memory_order_acquire);
+    if (readSequence > 0 && sequence > quint64(_slotCount) && sequence - _slotCount > readSequence)
+        header->droppedFrames.fetch_add(1, std::memory_order_relaxed);
+
+    slot->sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t bytesPerLine = header->bytesPerLine[0];
+    unsigned char* dst = slotData + header->planeOffset[0];
+    for (int y = 0; y < _height; y++)
+        std::memcpy(dst + y * bytesPerLine, data + (_height - 1 - y) * bytesPerLine, bytesPerLine);
+    slot->timestamp = timestamp;
+    slot->sequence.store(sequence, std::memory_order_release);
+    header->sequence.store(sequence, std::memory_order_release);
+    shmFramesWake(&header->futex);
+    _statFramesSent++;
+}
+
+// Send all read backs that the GPU has completed, oldest first
+void ShmOutput::finishReadbacks()
+{
+    for (int k = 0; k < PboCount; k++) {
+        int i = (_nextPbo + k) % PboCount;
+        if (!_fences[i])
+            continue;
+        GLenum status = glClientWaitSync(_fences[i], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break; // later read backs cannot be complete either
+        glDeleteSync(_fences[i]);
+        _fences[i] = nullptr;
+        if (!_map)
+            continue;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[i]);
+        const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * _pboWidth * _pboHeight, GL_MAP_READ_BIT);
+        if (data) {
+            sendFrame(static_cast<const unsigned char*>(data), _timestamps[i]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+void ShmOutput::capture(unsigned int framebuffer, int width, int height)
+{
+    finishReadbacks();
+    if (width != _pboWidth || height != _pboHeight) {
+        // discard pending read backs and resize everything
+        for (int i = 0; i < PboCount; i++) {
+            if (_fences[i]) {
+                glDeleteSync(_fences[i]);
+                _fences[i] = nullptr;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, 4 * width * height, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        _pboWidth = width;
+        _pboHeight = height;
+        _nextPbo = 0;
+        createRing(width, height);
+    }
+    if (!_map)
+        return;
+    int i = _nextPbo;
+    if (_fences[i]) {
+        // The GPU is more than PboCount frames behind; skip this frame
+        // instead of waiting
+        _statReadbacksSkipped++;
+        return;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[i]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _timestamps[i] = shmFramesTime();
+    _nextPbo = (i + 1) % PboCount;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <QString>
+#include <QOpenGLExtraFunctions>
+
+
+/* Sends the final output of the widget, i.e. what is on screen, to other
+ * processes through a shared memory frame ring (see shmframes.hpp).
+ * The framebuffer is read back asynchronously into a ring of pixel buffer
+ * objects, and a fence tells when the data of a buffer is available. Data is
+ * only copied into shared memory once the GPU has finished, so the render loop
+ * never waits for the GPU or for consumers.
+ * All functions must be called with the OpenGL context current. */
+
+class ShmOutput : protected QOpenGLExtraFunctions
+{
+private:
+    static const int PboCount = 3;
+
+    QString _name;
+    int _slotCount;
+    // the shared memory ring
+    unsigned char* _map;
+    size_t _mapSize;
+    int _width, _height;
+    quint64 _sequence;
+    // the pixel buffer object ring
+    unsigned int _pbos[PboCount];
+    GLsync _fences[PboCount];
+    qint64 _timestamps[PboCount];
+    int _pboWidth, _pboHeight;
+    int _nextPbo;
+    // statistics
+    quint64 _statFramesSent;
+    quint64 _statReadbacksSkipped;
+
+    bool createRing(int width, int height);
+    void destroyRing();
+    void finishReadbacks();
+    void sendFrame(const unsigned char* data, qint64 timestamp);
+
+public:
+    ShmOutput(const QString& name, int slotCount = 4);
+    ~ShmOutput();
+
+    void initialize();
+
+    // Start reading back the given framebuffer, and send earlier
+    // read backs that are complete. Never blocks.
+    void capture(unsigned int framebuffer, int width, int height);
+};
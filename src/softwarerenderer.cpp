@@ -0,0 +1,575 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <QThread>
+#include <QRect>
+
+#include "softwarerenderer.hpp"
+#include "log.hpp"
+
+
+// Fixed-point YUV to RGB conversion with the same matrices as shader-color.frag.glsl
+static const int YUVShift = 14;
+
+class YUVMatrix
+{
+public:
+    int y, ug, ub, vr, vg, offR, offG, offB;
+
+    YUVMatrix(float y_, float ug_, float ub_, float vr_, float vg_, float offR_, float offG_, float offB_)
+    {
+        const float s = (1 << YUVShift);
+        y = std::lround(y_ * s);
+        ug = std::lround(ug_ * s);
+        ub = std::lround(ub_ * s);
+        vr = std::lround(vr_ * s);
+        vg = std::lround(vg_ * s);
+        // offsets apply to values in [0,1], our values are in [0,255]; also add rounding
+        offR = std::lround(offR_ * 255.0f * s) + (1 << (YUVShift - 1));
+        offG = std::lround(offG_ * 255.0f * s) + (1 << (YUVShift - 1));
+        offB = std::lround(offB_ * 255.0f * s) + (1 << (YUVShift - 1));
+    }
+};
+
+static YUVMatrix yuvMatrix(VideoFrame::YUVSpace yuvSpace, bool valueRangeSmall)
+{
+    if (yuvSpace == VideoFrame::YUV_AdobeRgb)
+        return YUVMatrix(1.0f, -0.344f, 1.772f, 1.402f, -0.714f, -0.701f, 0.529f, -0.886f);
+    else if (yuvSpace == VideoFrame::YUV_BT709 && valueRangeSmall)
+        return YUVMatrix(1.1644f, -0.5329f, 2.1124f, 1.7928f, -0.2132f, -0.9731f, 0.3015f, -1.1335f);
+    else if (yuvSpace == VideoFrame::YUV_BT709)
+        return YUVMatrix(1.0f, -0.187324f, 1.8556f, 1.5748f, -0.468124f, -0.8774f, 0.327724f, -0.9278f);
+    else if (yuvSpace == VideoFrame::YUV_BT2020 && valueRangeSmall)
+        return YUVMatrix(1.1644f, -0.1874f, 2.1418f, 1.6787f, -0.6511f, -0.9158f, 0.3478f, -1.1483f);
+    else if (yuvSpace == VideoFrame::YUV_BT2020)
+        return YUVMatrix(1.0f, -0.2801f, 1.8814f, 1.4746f, -0.91666f, -0.7373f, 0.5984f, -0.9407f);
+    else if (valueRangeSmall)
+        return YUVMatrix(1.164f, -0.392f, 2.017f, 1.596f, -0.813f, -0.8708f, 0.5296f, -1.081f);
+    else
+        return YUVMatrix(1.0f, -0.1646f, 1.42f, 1.772f, -0.57135f, -0.886f, 0.36795f, -0.71f);
+}
+
+static inline quint32 packRGB(int r, int g, int b)
+{
+    r = r < 0 ? 0 : r > 255 ? 255 : r;
+    g = g < 0 ? 0 : g > 255 ? 255 : g;
+    b = b < 0 ? 0 : b > 255 ? 255 : b;
+    return 0xff000000u | (quint32(r) << 16) | (quint32(g) << 8) | quint32(b);
+}
+
+// Convert one row of YUV data; chroma is horizontally subsampled by two and
+// uvStep is 1 for planar and 2 for semi-planar data. 16 bit data is reduced to 8 bit.
+template<typename T>
+static void yuvRow(const T* yRow, const T* uRow, const T* vRow, int uvStep,
+        int width, const YUVMatrix& m, quint32* dst)
+{
+    const int shift = (sizeof(T) == 2 ? 8 : 0);
+    for (int x = 0; x < width; x++) {
+        int yy = (int(yRow[x]) >> shift) * m.y;
+        int u = (int(uRow[(x >> 1) * uvStep]) >> shift);
+        int v = (int(vRow[(x >> 1) * uvStep]) >> shift);
+        int r = (yy + m.vr * v + m.offR) >> YUVShift;
+        int g = (yy + m.ug * u + m.vg * v + m.offG) >> YUVShift;
+        int b = (yy + m.ub * u + m.offB) >> YUVShift;
+        dst[x] = packRGB(r, g, b);
+    }
+}
+
+template<typename T>
+static void grayRow(const T* yRow, int width, quint32* dst)
+{
+    const int shift = (sizeof(T) == 2 ? 8 : 0);
+    for (int x = 0; x < width; x++) {
+        quint32 v = (quint32(yRow[x]) >> shift);
+        dst[x] = 0xff000000u | (v << 16) | (v << 8) | v;
+    }
+}
+
+static void rgbRow(const uchar* src, int width, int ro, int go, int bo, quint32* dst)
+{
+    for (int x = 0; x < width; x++) {
+        const uchar* p = src + 4 * x;
+        dst[x] = 0xff000000u | (quint32(p[ro]) << 16) | (quint32(p[go]) << 8) | quint32(p[bo]);
+    }
+}
+
+SoftwareRenderer::SoftwareRenderer()
+{
+    for (int i = 0; i < 256; i++) {
+        float x = i / 255.0f;
+        _toLinear[i] = (x <= 0.04045f ? x / 12.92f : std::pow((x + 0.055f) / 1.055f, 2.4f));
+    }
+    for (int i = 0; i < 4096; i++) {
+        float x = i / 4095.0f;
+        float y = (x <= 0.0031308f ? x * 12.92f : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f);
+        _toNonlinear[i] = std::lround(y * 255.0f);
+    }
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+    _threadPool.waitForDone();
+}
+
+void SoftwareRenderer::parallelFor(int n, const std::function<void (int begin, int end)>& f)
+{
+    int tasks = qBound(1, QThread::idealThreadCount(), n);
+    int chunk = (n + tasks - 1) / tasks;
+    for (int t = 1; t < tasks; t++) {
+        int begin = t * chunk;
+        int end = qMin(n, begin + chunk);
+        if (begin < end)
+            _threadPool.start([=, &f]() { f(begin, end); });
+    }
+    // the calling thread does the first chunk
+    f(0, qMin(n, chunk));
+    _threadPool.waitForDone();
+}
+
+void SoftwareRenderer::convertImage(const QImage& src, QImage& img)
+{
+    if (src.format() == QImage::Format_RGB32) {
+        img = src; // no copy
+    } else if (src.format() == QImage::Format_RGBX16FPx4) {
+        // linear RGB
+        QImage fimg = src.convertToFormat(QImage::Format_RGBX32FPx4);
+        img = QImage(fimg.width(), fimg.height(), QImage::Format_RGB32);
+        uchar* bits = img.bits(); // detach once, not in the threads
+        qsizetype bpl = img.bytesPerLine();
+        parallelFor(img.height(), [&](int begin, int end) {
+                for (int y = begin; y < end; y++) {
+                    const float* s = reinterpret_cast<const float*>(fimg.constScanLine(y));
+                    quint32* d = reinterpret_cast<quint32*>(bits + y * bpl);
+                    for (int x = 0; x < img.width(); x++) {
+                        int v[3];
+                        for (int c = 0; c < 3; c++)
+                            v[c] = _toNonlinear[int(qBound(0.0f, s[4 * x + c], 1.0f) * 4095.0f + 0.5f)];
+                        d[x] = 0xff000000u | (quint32(v[0]) << 16) | (quint32(v[1]) << 8) | quint32(v[2]);
+                    }
+                }
+                });
+    } else {
+        img = src.convertToFormat(QImage::Format_RGB32);
+    }
+}
+
+void SoftwareRenderer::convertFrame(const VideoFrame& frame, QImage& img)
+{
+    if (frame.storage == VideoFrame::Storage_Image) {
+        convertImage(frame.image, img);
+        return;
+    }
+
+    const uchar* planes[3];
+    for (int p = 0; p < 3; p++) {
+        planes[p] = (p >= frame.planeCount ? nullptr
+                : frame.storage == VideoFrame::Storage_Mapped ? frame.mappedBits[p]
+                : frame.bits[p].data());
+    }
+    const int* bpl = frame.bytesPerLine;
+    int w = frame.width;
+    // the image must not share its data, e.g. with a still image
+    if (img.width() != w || img.height() != frame.height || img.format() != QImage::Format_RGB32 || !img.isDetached())
+        img = QImage(w, frame.height, QImage::Format_RGB32);
+    YUVMatrix m = yuvMatrix(frame.yuvSpace, frame.yuvValueRangeSmall);
+    QVideoFrameFormat::PixelFormat pf = frame.pixelFormat;
+    uchar* bits = img.bits(); // detach once, not in the threads
+    qsizetype imgBpl = img.bytesPerLine();
+    parallelFor(frame.height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                quint32* dst = reinterpret_cast<quint32*>(bits + y * imgBpl);
+                const uchar* row0 = planes[0] + y * bpl[0];
+                if (pf == QVideoFrameFormat::Format_ARGB8888
+                        || pf == QVideoFrameFormat::Format_ARGB8888_Premultiplied
+                        || pf == QVideoFrameFormat::Format_XRGB8888) {
+                    rgbRow(row0, w, 1, 2, 3, dst);
+                } else if (pf == QVideoFrameFormat::Format_BGRA8888
+                        || pf == QVideoFrameFormat::Format_BGRA8888_Premultiplied
+                        || pf == QVideoFrameFormat::Format_BGRX8888) {
+                    rgbRow(row0, w, 2, 1, 0, dst);
+                } else if (pf == QVideoFrameFormat::Format_ABGR8888
+                        || pf == QVideoFrameFormat::Format_XBGR8888) {
+                    rgbRow(row0, w, 3, 2, 1, dst);
+                } else if (pf == QVideoFrameFormat::Format_RGBA8888
+                        || pf == QVideoFrameFormat::Format_RGBX8888) {
+                    rgbRow(row0, w, 0, 1, 2, dst);
+                } else if (pf == QVideoFrameFormat::Format_YUV420P || pf == QVideoFrameFormat::Format_YV12) {
+                    int u = (pf == QVideoFrameFormat::Format_YUV420P ? 1 : 2);
+                    int v = (pf == QVideoFrameFormat::Format_YUV420P ? 2 : 1);
+                    yuvRow(row0, planes[u] + (y / 2) * bpl[u], planes[v] + (y / 2) * bpl[v], 1, w, m, dst);
+                } else if (pf == QVideoFrameFormat::Format_YUV422P) {
+                    yuvRow(row0, planes[1] + y * bpl[1], planes[2] + y * bpl[2], 1, w, m, dst);
+                } else if (pf == QVideoFrameFormat::Format_NV12) {
+                    const uchar* uv = planes[1] + (y / 2) * bpl[1];
+                    yuvRow(row0, uv, uv + 1, 2, w, m, dst);
+                } else if (pf == QVideoFrameFormat::Format_P010 || pf == QVideoFrameFormat::Format_P016) {
+                    const quint16* uv = reinterpret_cast<const quint16*>(planes[1] + (y / 2) * bpl[1]);
+                    yuvRow(reinterpret_cast<const quint16*>(row0), uv, uv + 1, 2, w, m, dst);
+                } else if (pf == QVideoFrameFormat::Format_Y8) {
+                    grayRow(row0, w, dst);
+                } else if (pf == QVideoFrameFormat::Format_Y16) {
+                    grayRow(reinterpret_cast<const quint16*>(row0), w, dst);
+                }
+            }
+            });
+}
+
+void SoftwareRenderer::updateFrame(const VideoFrame& frame, const VideoFrame& extFrame)
+{
+    convertFrame(frame, _frameImg[0]);
+    if (frame.inputMode == Input_Alternating_LR || frame.inputMode == Input_Alternating_RL)
+        convertFrame(extFrame, _frameImg[1]);
+    else
+        _frameImg[1] = QImage();
+}
+
+enum Combine {
+    Combine_Copy,         // view 0 only
+    Combine_Rows,
+    Combine_Columns,
+    Combine_Checkerboard,
+    Combine_Anaglyph
+};
+
+// A rectangle of the output that is filled from one or two views
+class RenderRegion
+{
+public:
+    QRect dst;
+    Combine combine;
+    const QImage* img[2];
+    QRect src[2];
+    std::vector<int> xmap[2]; // source column for each destination column
+
+    RenderRegion(const QRect& d, Combine c, const QImage* img0, const QRect& src0,
+            const QImage* img1 = nullptr, const QRect& src1 = QRect()) :
+        dst(d), combine(c), img { img0, img1 }, src { src0, src1 }
+    {
+        for (int v = 0; v < 2; v++) {
+            if (!img[v])
+                continue;
+            xmap[v].resize(dst.width());
+            for (int x = 0; x < dst.width(); x++)
+                xmap[v][x] = src[v].x() + qMin(src[v].width() - 1,
+                        int((2 * qint64(x) + 1) * src[v].width() / (2 * qint64(dst.width()))));
+        }
+    }
+
+    // the source row for a destination row
+    const quint32* srcRow(int v, int y) const
+    {
+        int sy = src[v].y() + qMin(src[v].height() - 1,
+                int((2 * qint64(y - dst.y()) + 1) * src[v].height() / (2 * qint64(dst.height()))));
+        return reinterpret_cast<const quint32*>(img[v]->constScanLine(sy));
+    }
+};
+
+// Anaglyph matrices in row-major order; the shader has them in column-major order
+static void transposed(const float* glsl, float* m)
+{
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            m[3 * r + c] = glsl[3 * c + r];
+}
+
+static void anaglyphMatrices(OutputMode mode, float* m0, float* m1)
+{
+    // linear RGB to luminance, as in shader-display.frag.glsl
+    const float lum[3] = { 0.212671f, 0.715160f, 0.072169f };
+    const float red[3] = { 1.0f, 0.0f, 0.0f };
+    const float green[3] = { 0.0f, 1.0f, 0.0f };
+    const float blue[3] = { 0.0f, 0.0f, 1.0f };
+    const float zero[3] = { 0.0f, 0.0f, 0.0f };
+    // the rows of the output: which view and which coefficients
+    const float* rows0[3] = { zero, zero, zero };
+    const float* rows1[3] = { zero, zero, zero };
+    if (mode == Output_Red_Cyan_Dubois) {
+        const float a[9] = { 0.437f, -0.062f, -0.048f, 0.449f, -0.062f, -0.050f, 0.164f, -0.024f, -0.017f };
+        const float b[9] = { -0.011f, 0.377f, -0.026f, -0.032f, 0.761f, -0.093f, -0.007f, 0.009f, 1.234f };
+        transposed(a, m0);
+        transposed(b, m1);
+        return;
+    } else if (mode == Output_Green_Magenta_Dubois) {
+        const float a[9] = { -0.062f, 0.284f, -0.015f, -0.158f, 0.668f, -0.027f, -0.039f, 0.143f, 0.021f };
+        const float b[9] = { 0.529f, -0.016f, 0.009f, 0.705f, -0.015f, 0.075f, 0.024f, -0.065f, 0.937f };
+        transposed(a, m0);
+        transposed(b, m1);
+        return;
+    } else if (mode == Output_Amber_Blue_Dubois) {
+        const float a[9] = { 1.062f, -0.026f, -0.038f, -0.205f, 0.908f, -0.173f, 0.299f, 0.068f, 0.022f };
+        const float b[9] = { -0.016f, 0.006f, 0.094f, -0.123f, 0.062f, 0.185f, -0.017f, -0.017f, 0.911f };
+        transposed(a, m0);
+        transposed(b, m1);
+        return;
+    } else if (mode == Output_Red_Cyan_FullColor) {
+        rows0[0] = red; rows1[1] = green; rows1[2] = blue;
+    } else if (mode == Output_Red_Cyan_HalfColor) {
+        rows0[0] = lum; rows1[1] = green; rows1[2] = blue;
+    } else if (mode == Output_Red_Cyan_Monochrome) {
+        rows0[0] = lum; rows1[1] = lum; rows1[2] = lum;
+    } else if (mode == Output_Green_Magenta_FullColor) {
+        rows1[0] = red; rows0[1] = green; rows1[2] = blue;
+    } else if (mode == Output_Green_Magenta_HalfColor) {
+        rows1[0] = red; rows0[1] = lum; rows1[2] = blue;
+    } else if (mode == Output_Green_Magenta_Monochrome) {
+        rows1[0] = lum; rows0[1] = lum; rows1[2] = lum;
+    } else if (mode == Output_Amber_Blue_FullColor) {
+        rows0[0] = red; rows0[1] = green; rows1[2] = blue;
+    } else if (mode == Output_Amber_Blue_HalfColor) {
+        rows0[0] = lum; rows0[1] = lum; rows1[2] = blue;
+    } else if (mode == Output_Amber_Blue_Monochrome) {
+        rows0[0] = lum; rows0[1] = lum; rows1[2] = lum;
+    } else if (mode == Output_Red_Green_Monochrome) {
+        rows0[0] = lum; rows1[1] = lum;
+    } else if (mode == Output_Red_Blue_Monochrome) {
+        rows0[0] = lum; rows1[2] = lum;
+    }
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            m0[3 * r + c] = rows0[r][c];
+            m1[3 * r + c] = rows1[r][c];
+        }
+    }
+}
+
+const QImage& SoftwareRenderer::render(const VideoFrame& frame, OutputMode outputMode, bool swapEyes,
+        int width, int height, int fragOffsetX, int fragOffsetY)
+{
+    if (_outputImg.width() != width || _outputImg.height() != height)
+        _outputImg = QImage(width, height, QImage::Format_RGB32);
+    if (width <= 0 || height <= 0 || _frameImg[0].isNull())
+        return _outputImg;
+
+    // Find the views in the frame, as in Bino::preRenderProcess() and Bino::render()
+    int w = _frameImg[0].width();
+    int h = _frameImg[0].height();
+    int viewCount = 2;
+    int viewImg[2] = { 0, 0 };
+    QRect viewRect[2] = { QRect(0, 0, w, h), QRect(0, 0, w, h) };
+    float aspectRatio = frame.aspectRatio;
+    switch (frame.inputMode) {
+    case Input_Unknown:
+    case Input_Mono:
+        viewCount = 1;
+        break;
+    case Input_Top_Bottom:
+    case Input_Bottom_Top:
+        aspectRatio *= 2.0f;
+        [[fallthrough]];
+    case Input_Top_Bottom_Half:
+    case Input_Bottom_Top_Half:
+        viewRect[0] = QRect(0, 0, w, h / 2);
+        viewRect[1] = QRect(0, h / 2, w, h / 2);
+        if (frame.inputMode == Input_Bottom_Top || frame.inputMode == Input_Bottom_Top_Half)
+            std::swap(viewRect[0], viewRect[1]);
+        break;
+    case Input_Left_Right:
+    case Input_Right_Left:
+        aspectRatio /= 2.0f;
+        [[fallthrough]];
+    case Input_Left_Right_Half:
+    case Input_Right_Left_Half:
+        viewRect[0] = QRect(0, 0, w / 2, h);
+        viewRect[1] = QRect(w / 2, 0, w / 2, h);
+        if (frame.inputMode == Input_Right_Left || frame.inputMode == Input_Right_Left_Half)
+            std::swap(viewRect[0], viewRect[1]);
+        break;
+    case Input_Alternating_LR:
+    case Input_Alternating_RL:
+        if (!_frameImg[1].isNull() && _frameImg[1].size() == _frameImg[0].size())
+            viewImg[frame.inputMode == Input_Alternating_LR ? 1 : 0] = 1;
+        break;
+    }
+    if (frame.surroundMode == Surround_180)
+        aspectRatio *= 2.0f;
+    if (swapEyes) {
+        std::swap(viewRect[0], viewRect[1]);
+        std::swap(viewImg[0], viewImg[1]);
+    }
+    if (viewRect[0].isEmpty() || viewRect[1].isEmpty())
+        return _outputImg;
+    const QImage* view0 = &_frameImg[viewImg[0]];
+    const QImage* view1 = &_frameImg[viewImg[1]];
+
+    // Adjust the output mode and aspect ratio, as in OutputRenderer
+    int leftRightView = 0;
+    if (viewCount == 1 || outputMode == Output_OpenGL_Stereo || outputMode == Output_Alternating)
+        outputMode = Output_Left;
+    if (outputMode == Output_Right)
+        leftRightView = 1;
+    if (outputMode == Output_Left_Right || outputMode == Output_Right_Left)
+        aspectRatio *= 2.0f;
+    else if (outputMode == Output_Top_Bottom || outputMode == Output_Bottom_Top || outputMode == Output_HDMI_Frame_Pack)
+        aspectRatio *= 0.5f;
+    float relWidth = 1.0f;
+    float relHeight = 1.0f;
+    float screenAspectRatio = width / float(height);
+    if (outputMode == Output_HDMI_Frame_Pack)
+        screenAspectRatio = width / (height - height / 49.0f);
+    if (screenAspectRatio < aspectRatio)
+        relHeight = screenAspectRatio / aspectRatio;
+    else
+        relWidth = aspectRatio / screenAspectRatio;
+    int cw = qMax(1, qRound(width * relWidth));
+    int ch = qMax(1, qRound(height * relHeight));
+    QRect content((width - cw) / 2, (height - ch) / 2, cw, ch);
+
+    // Set up the regions of the output
+    std::vector<RenderRegion> regions;
+    QRect leftHalf(content.x(), content.y(), cw / 2, ch);
+    QRect rightHalf(content.x() + cw / 2, content.y(), cw - cw / 2, ch);
+    QRect topHalf(content.x(), content.y(), cw, ch / 2);
+    QRect bottomHalf(content.x(), content.y() + ch / 2, cw, ch - ch / 2);
+    switch (outputMode) {
+    case Output_Left:
+    case Output_Right:
+    case Output_OpenGL_Stereo:
+    case Output_Alternating:
+        regions.emplace_back(content, Combine_Copy,
+                leftRightView == 0 ? view0 : view1, viewRect[leftRightView]);
+        break;
+    case Output_HDMI_Frame_Pack:
+        {
+            int viewHeight = qRound(ch * (0.5f - 0.5f / 49.0f));
+            regions.emplace_back(QRect(content.x(), content.y(), cw, viewHeight),
+                    Combine_Copy, view0, viewRect[0]);
+            regions.emplace_back(QRect(content.x(), content.y() + ch - viewHeight, cw, viewHeight),
+                    Combine_Copy, view1, viewRect[1]);
+        }
+        break;
+    case Output_Left_Right:
+    case Output_Left_Right_Half:
+        regions.emplace_back(leftHalf, Combine_Copy, view0, viewRect[0]);
+        regions.emplace_back(rightHalf, Combine_Copy, view1, viewRect[1]);
+        break;
+    case Output_Right_Left:
+    case Output_Right_Left_Half:
+        regions.emplace_back(leftHalf, Combine_Copy, view1, viewRect[1]);
+        regions.emplace_back(rightHalf, Combine_Copy, view0, viewRect[0]);
+        break;
+    case Output_Top_Bottom:
+    case Output_Top_Bottom_Half:
+        regions.emplace_back(topHalf, Combine_Copy, view0, viewRect[0]);
+        regions.emplace_back(bottomHalf, Combine_Copy, view1, viewRect[1]);
+        break;
+    case Output_Bottom_Top:
+    case Output_Bottom_Top_Half:
+        regions.emplace_back(topHalf, Combine_Copy, view1, viewRect[1]);
+        regions.emplace_back(bottomHalf, Combine_Copy, view0, viewRect[0]);
+        break;
+    case Output_Even_Odd_Rows:
+        regions.emplace_back(content, Combine_Rows, view0, viewRect[0], view1, viewRect[1]);
+        break;
+    case Output_Even_Odd_Columns:
+        regions.emplace_back(content, Combine_Columns, view0, viewRect[0], view1, viewRect[1]);
+        break;
+    case Output_Checkerboard:
+        regions.emplace_back(content, Combine_Checkerboard, view0, viewRect[0], view1, viewRect[1]);
+        break;
+    case Output_Red_Cyan_Dubois:
+    case Output_Red_Cyan_FullColor:
+    case Output_Red_Cyan_HalfColor:
+    case Output_Red_Cyan_Monochrome:
+    case Output_Green_Magenta_Dubois:
+    case Output_Green_Magenta_FullColor:
+    case Output_Green_Magenta_HalfColor:
+    case Output_Green_Magenta_Monochrome:
+    case Output_Amber_Blue_Dubois:
+    case Output_Amber_Blue_FullColor:
+    case Output_Amber_Blue_HalfColor:
+    case Output_Amber_Blue_Monochrome:
+    case Output_Red_Green_Monochrome:
+    case Output_Red_Blue_Monochrome:
+        regions.emplace_back(content, Combine_Anaglyph, view0, viewRect[0], view1, viewRect[1]);
+        break;
+    }
+    float m0[9], m1[9];
+    anaglyphMatrices(outputMode, m0, m1);
+
+    // Render the output rows in parallel
+    uchar* bits = _outputImg.bits(); // detach once, not in the threads
+    qsizetype bpl = _outputImg.bytesPerLine();
+    parallelFor(height, [&](int begin, int end) {
+            std::vector<quint32> row0(width), row1(width);
+            std::vector<float> lin(3 * width);
+            for (int y = begin; y < end; y++) {
+                quint32* dst = reinterpret_cast<quint32*>(bits + y * bpl);
+                std::fill(dst, dst + width, 0xff000000u);
+                // the fragment coordinates as in shader-display.frag.glsl
+                int fragY = fragOffsetY + (height - 1 - y);
+                for (const RenderRegion& region : regions) {
+                    if (y < region.dst.top() || y > region.dst.bottom())
+                        continue;
+                    int dw = region.dst.width();
+                    quint32* d = dst + region.dst.x();
+                    int fragX = fragOffsetX + region.dst.x();
+                    int v = 0;
+                    if (region.combine == Combine_Rows)
+                        v = (fragY & 1);
+                    // gather the source pixels
+                    const quint32* s = region.srcRow(v, y);
+                    const int* xmap = region.xmap[v].data();
+                    if (region.combine == Combine_Copy || region.combine == Combine_Rows) {
+                        for (int x = 0; x < dw; x++)
+                            d[x] = s[xmap[x]];
+                        continue;
+                    }
+                    const quint32* s1 = region.srcRow(1, y);
+                    const int* xmap1 = region.xmap[1].data();
+                    for (int x = 0; x < dw; x++) {
+                        row0[x] = s[xmap[x]];
+                        row1[x] = s1[xmap1[x]];
+                    }
+                    if (region.combine == Combine_Columns || region.combine == Combine_Checkerboard) {
+                        int parity = (region.combine == Combine_Columns ? fragX : fragX + fragY) & 1;
+                        for (int x = 0; x < dw; x++)
+                            d[x] = (((x + parity) & 1) ? row1[x] : row0[x]);
+                    } else {
+                        // anaglyph: combine in linear RGB
+                        for (int x = 0; x < dw; x++) {
+                            float r0 = _toLinear[(row0[x] >> 16) & 0xff];
+                            float g0 = _toLinear[(row0[x] >> 8) & 0xff];
+                            float b0 = _toLinear[row0[x] & 0xff];
+                            float r1 = _toLinear[(row1[x] >> 16) & 0xff];
+                            float g1 = _toLinear[(row1[x] >> 8) & 0xff];
+                            float b1 = _toLinear[row1[x] & 0xff];
+                            lin[3 * x + 0] = m0[0] * r0 + m0[1] * g0 + m0[2] * b0 + m1[0] * r1 + m1[1] * g1 + m1[2] * b1;
+                            lin[3 * x + 1] = m0[3] * r0 + m0[4] * g0 + m0[5] * b0 + m1[3] * r1 + m1[4] * g1 + m1[5] * b1;
+                            lin[3 * x + 2] = m0[6] * r0 + m0[7] * g0 + m0[8] * b0 + m1[6] * r1 + m1[7] * g1 + m1[8] * b1;
+                        }
+                        for (int x = 0; x < dw; x++) {
+                            int r = int(std::min(std::max(lin[3 * x + 0], 0.0f), 1.0f) * 4095.0f + 0.5f);
+                            int g = int(std::min(std::max(lin[3 * x + 1], 0.0f), 1.0f) * 4095.0f + 0.5f);
+                            int b = int(std::min(std::max(lin[3 * x + 2], 0.0f), 1.0f) * 4095.0f + 0.5f);
+                            d[x] = 0xff000000u | (quint32(_toNonlinear[r]) << 16)
+                                | (quint32(_toNonlinear[g]) << 8) | quint32(_toNonlinear[b]);
+                        }
+                    }
+                }
+            }
+            });
+    return _outputImg;
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <functional>
+
+#include <QThreadPool>
+#include <QImage>
+
+#include "modes.hpp"
+#include "videoframe.hpp"
+
+
+/* Renders the current frame of Bino into a QImage without OpenGL, for systems
+ * that lack OpenGL 3.2. Frames are converted to 8 bit RGB once when they change;
+ * views are then extracted according to the input mode and composed in the
+ * output mode with nearest neighbor scaling. All stages are split into bands
+ * of rows that are processed in parallel. The inner loops work on whole rows
+ * with fixed-point or table-based arithmetic and no per-pixel branches on the
+ * frame format, so that the compiler can vectorize them.
+ * Surround video, subtitles, and the OpenGL stereo and alternating output
+ * modes are not supported: surround video is shown flat, and the last two
+ * output modes show the left view. */
+
+class SoftwareRenderer
+{
+private:
+    QThreadPool _threadPool;
+    QImage _frameImg[2];        // the converted frames, Format_RGB32, non-linear RGB
+    float _toLinear[256];       // non-linear 8 bit value to linear value
+    unsigned char _toNonlinear[4096]; // linear value in 12 bit to non-linear 8 bit value
+    QImage _outputImg;
+
+    void parallelFor(int n, const std::function<void (int begin, int end)>& f);
+    void convertFrame(const VideoFrame& frame, QImage& img);
+    void convertImage(const QImage& src, QImage& img);
+
+public:
+    SoftwareRenderer();
+    ~SoftwareRenderer();
+
+    // Convert the given frames (the second one is only used for alternating input)
+    void updateFrame(const VideoFrame& frame, const VideoFrame& extFrame);
+
+    // Render the output with the given size in device pixels. The fragment offset
+    // is the position of the lower left corner of the output on the screen, as
+    // in OutputRenderer::display(), for the interleaved modes.
+    const QImage& render(const VideoFrame& frame, OutputMode outputMode, bool swapEyes,
+            int width, int height, int fragOffsetX, int fragOffsetY);
+};
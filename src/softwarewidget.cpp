@@ -0,0 +1,96 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QGuiApplication>
+#include <QScreen>
+#include <QPainter>
+#include <QElapsedTimer>
+
+#include "softwarewidget.hpp"
+#include "bino.hpp"
+#include "log.hpp"
+
+
+static const QSize SizeBase(16, 9);
+
+SoftwareWidget::SoftwareWidget(OutputMode outputMode, QWidget* parent) :
+    QWidget(parent),
+    _sizeHint(0.5f * SizeBase),
+    _outputMode(outputMode)
+{
+    // we paint every pixel ourselves
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMinimumSize(8, 8);
+    setFocusPolicy(Qt::StrongFocus);
+    QSize screenSize = QGuiApplication::primaryScreen()->availableSize();
+    QSize maxSize = 0.75f * screenSize;
+    _sizeHint = SizeBase.scaled(maxSize, Qt::KeepAspectRatio);
+    connect(Bino::instance(), &Bino::newVideoFrame, [=]() { update(); });
+    connect(Bino::instance(), &Bino::toggleFullscreen, [=]() { emit toggleFullscreen(); });
+    setFocus();
+}
+
+OutputMode SoftwareWidget::outputMode() const
+{
+    return _outputMode;
+}
+
+void SoftwareWidget::setOutputMode(OutputMode mode)
+{
+    _outputMode = mode;
+}
+
+QSize SoftwareWidget::sizeHint() const
+{
+    return _sizeHint;
+}
+
+void SoftwareWidget::paintEvent(QPaintEvent*)
+{
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    const VideoFrame* frame;
+    const VideoFrame* extFrame;
+    if (Bino::instance()->softwareRenderProcess(&frame, &extFrame))
+        _renderer.updateFrame(*frame, *extFrame);
+
+    // Support for HighDPI output
+    qreal dpr = devicePixelRatioF();
+    int width = qRound(this->width() * dpr);
+    int height = qRound(this->height() * dpr);
+
+    // the same fragment offset as in Widget::paintGL()
+    QPoint globalLowerLeft = mapToGlobal(QPoint(0, height - 1));
+    int fragOffsetX = globalLowerLeft.x();
+    int fragOffsetY = screen()->geometry().height() - 1 - globalLowerLeft.y();
+    const QImage& img = _renderer.render(*frame, _outputMode, Bino::instance()->swapEyes(),
+            width, height, fragOffsetX, fragOffsetY);
+    // the image has device pixels, so this does not scale
+    QPainter painter(this);
+    painter.drawImage(QRectF(rect()), img);
+    LOG_FIREHOSE("%s: CPU time for this frame: %g ms", Q_FUNC_INFO, frameTimer.nsecsElapsed() / 1e6);
+}
+
+void SoftwareWidget::keyPressEvent(QKeyEvent* e)
+{
+    Bino::instance()->keyPressEvent(e);
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <QWidget>
+
+#include "modes.hpp"
+#include "softwarerenderer.hpp"
+
+
+/* The counterpart of Widget for systems without OpenGL 3.2: the output is
+ * rendered on the CPU by SoftwareRenderer and painted as an image. */
+
+class SoftwareWidget : public QWidget
+{
+Q_OBJECT
+
+private:
+    QSize _sizeHint;
+    OutputMode _outputMode;
+    SoftwareRenderer _renderer;
+
+public:
+    SoftwareWidget(OutputMode outputMode, QWidget* parent = nullptr);
+
+    OutputMode outputMode() const;
+    void setOutputMode(OutputMode mode);
+
+    virtual QSize sizeHint() const override;
+    virtual void paintEvent(QPaintEvent* e) override;
+    virtual void keyPressEvent(QKeyEvent* e) override;
+
+signals:
+    void toggleFullscreen();
+};
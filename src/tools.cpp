@@ -18,6 +18,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <vector>
+#include <cmath>
+
 #include <QFile>
 #include <QTextStream>
 #include <QOpenGLContext>
@@ -40,6 +43,91 @@ bool checkTextureAnisotropicFilterAvailability()
         || QOpenGLContext::currentContext()->hasExtension("GL_EXT_texture_filter_anisotropic");
 }
 
+bool checkTimerQueryAvailability()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (context->isOpenGLES())
+        return context->hasExtension("GL_EXT_disjoint_timer_query");
+    return context->format().version() >= qMakePair(3, 3)
+        || context->hasExtension("GL_ARB_timer_query");
+}
+
+std::vector<float> transferFunctionValues(bool toLinear)
+{
+    std::vector<float> values(TransferFunctionTextureSize);
+    for (int i = 0; i < TransferFunctionTextureSize; i++) {
+        double x = i / (TransferFunctionTextureSize - 1.0);
+        double y;
+        if (toLinear)
+            y = (x <= 0.04045 ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4));
+        else
+            y = (x <= 0.0031308 ? x * 12.92 : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055);
+        values[i] = y;
+    }
+    return values;
+}
+
+unsigned int createTransferFunctionTexture(QOpenGLExtraFunctions* gl, bool toLinear)
+{
+    std::vector<float> values = transferFunctionValues(toLinear);
+    // 16 bit normalized values are exact enough even for 10 bit output,
+    // but OpenGL ES only has the half float variant
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    unsigned int tex;
+    gl->glGenTextures(1, &tex);
+    gl->glBindTexture(GL_TEXTURE_2D, tex);
+    gl->glTexImage2D(GL_TEXTURE_2D, 0, isGLES ? GL_R16F : GL_R16,
+            TransferFunctionTextureSize, 1, 0, GL_RED, GL_FLOAT, values.data());
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return tex;
+}
+
+void allocateIntermediateTexture(QOpenGLExtraFunctions* gl, GLenum internalFormat, int w, int h)
+{
+    switch (internalFormat) {
+    case GL_R11F_G11F_B10F:
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, nullptr);
+        break;
+    case GL_RGB10_A2:
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullptr);
+        break;
+    case GL_RGBA16F:
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        break;
+    default: // GL_RGB16, GL_RGBA16
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_SHORT, nullptr);
+        break;
+    }
+}
+
+const char* intermediateTextureFormatName(GLenum internalFormat)
+{
+    switch (internalFormat) {
+    case GL_R11F_G11F_B10F:
+        return "R11F_G11F_B10F";
+    case GL_RGB10_A2:
+        return "RGB10_A2";
+    case GL_RGB16:
+        return "RGB16";
+    case GL_RGBA16:
+        return "RGBA16";
+    case GL_RGBA16F:
+        return "RGBA16F";
+    }
+    return "unknown";
+}
+
+double intermediateTextureMiB(GLenum internalFormat, int w, int h)
+{
+    // GL_RGB16 is usually padded to 64 bits per pixel
+    int bytesPerPixel = (internalFormat == GL_R11F_G11F_B10F || internalFormat == GL_RGB10_A2) ? 4 : 8;
+    // mipmaps add one third
+    return double(w) * h * bytesPerPixel * 4.0 / 3.0 / (1024.0 * 1024.0);
+}
+
 const char* getOpenGLString(QOpenGLExtraFunctions* gl, GLenum p)
 {
     return reinterpret_cast<const char*>(gl->glGetString(p));
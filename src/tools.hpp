@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <QString>
 
 // Read a complete file into a QString (without error checking;
@@ -43,5 +45,38 @@ QString readFile(const char* fileName);
 #endif
 bool checkTextureAnisotropicFilterAvailability();
 
+// GPU timer queries (OpenGL 3.3 or GL_ARB_timer_query, or
+// GL_EXT_disjoint_timer_query on OpenGL ES)
+#ifndef GL_TIME_ELAPSED
+# define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_TIMESTAMP
+# define GL_TIMESTAMP 0x8E28
+#endif
+bool checkTimerQueryAvailability();
+
+// GL_FRAMEBUFFER_SRGB is missing from OpenGL ES headers; on OpenGL ES,
+// writing to sRGB framebuffers always encodes
+#ifndef GL_FRAMEBUFFER_SRGB
+# define GL_FRAMEBUFFER_SRGB 0x8DB9
+#endif
+
+// Create a 1D lookup texture (as a 2D texture of height 1, for OpenGL ES)
+// for the sRGB transfer function: from non-linear to linear RGB if
+// toLinear is true, from linear to non-linear RGB otherwise. The shaders
+// sample it at clamp(x, 0, 1) * (N - 1) / N + 0.5 / N with this size N.
+const int TransferFunctionTextureSize = 4096;
+unsigned int createTransferFunctionTexture(QOpenGLExtraFunctions* gl, bool toLinear);
+// The values of that texture, e.g. for QRhi
+std::vector<float> transferFunctionValues(bool toLinear);
+
+// Allocate storage for a 2D texture with one of the internal formats used for
+// intermediate linear RGB data (GL_R11F_G11F_B10F, GL_RGB10_A2, GL_RGB16,
+// GL_RGBA16, GL_RGBA16F), and get the name and the memory size of such a
+// texture, including mipmaps
+void allocateIntermediateTexture(QOpenGLExtraFunctions* gl, GLenum internalFormat, int w, int h);
+const char* intermediateTextureFormatName(GLenum internalFormat);
+double intermediateTextureMiB(GLenum internalFormat, int w, int h);
+
 // Shortcut to get a string from OpenGL
 const char* getOpenGLString(QOpenGLExtraFunctions* gl, GLenum p);
@@ -0,0 +1,249 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QDir>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "tracer.hpp"
+#include "log.hpp"
+
+
+static Tracer* tracerSingleton = nullptr;
+static std::atomic<bool> tracingEnabled(false);
+static std::atomic<int> appendsInFlight(0);   // threads that are in append()
+
+Tracer::Tracer(const QString& fileName) :
+    _pid(QCoreApplication::applicationPid()),
+    _abort(false),
+    _eventCount(0),
+    _firstEvent(true)
+{
+    Q_ASSERT(!tracerSingleton);
+    tracerSingleton = this;
+    if (fileName.isEmpty())
+        return;
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARNING("%s", qPrintable(tr("Cannot open %1: %2").arg(fileName).arg(_file.errorString())));
+        return;
+    }
+    _file.write("{\"traceEvents\":[\n");
+    tracingEnabled = true;
+    start(QThread::LowPriority);
+}
+
+Tracer::~Tracer()
+{
+    if (_file.isOpen()) {
+        // After this, no thread enters append() anymore; wait for those
+        // that are still in it
+        tracingEnabled = false;
+        while (appendsInFlight.load() > 0)
+            QThread::yieldCurrentThread();
+        _mutex.lock();
+        _abort = true;
+        _waitCondition.wakeOne();
+        _mutex.unlock();
+        wait();
+        // Write what is left, including the chunks that are not full yet.
+        // The chunks are not freed since the thread local buffers of threads
+        // that are still running refer to them.
+        QMutexLocker locker(&_mutex);
+        for (int i = 0; i < _fullChunks.size(); i++)
+            write(_fullChunks[i]);
+        for (int i = 0; i < _threadBuffers.size(); i++)
+            write(_threadBuffers[i]->chunk);
+        // Metadata events that name the process and the threads; the names
+        // are arbitrary strings, so let QJsonDocument escape them
+        QByteArray metadata;
+        QJsonObject processName;
+        processName["name"] = "process_name";
+        processName["ph"] = "M";
+        processName["pid"] = _pid;
+        processName["args"] = QJsonObject { { "name", QCoreApplication::applicationName() } };
+        metadata += ",\n" + QJsonDocument(processName).toJson(QJsonDocument::Compact);
+        for (int i = 0; i < _threadBuffers.size(); i++) {
+            QJsonObject threadName;
+            threadName["name"] = "thread_name";
+            threadName["ph"] = "M";
+            threadName["pid"] = _pid;
+            threadName["tid"] = _threadBuffers[i]->tid;
+            threadName["args"] = QJsonObject { { "name", _threadBuffers[i]->name } };
+            metadata += ",\n" + QJsonDocument(threadName).toJson(QJsonDocument::Compact);
+        }
+        if (_firstEvent)
+            metadata.remove(0, 2); // no leading comma
+        _file.write(metadata);
+        _file.write("\n],\n\"displayTimeUnit\":\"ms\"}\n");
+        _file.close();
+        LOG_INFO("tracing: %lld events written to %s", _eventCount, qPrintable(_file.fileName()));
+    }
+    tracerSingleton = nullptr;
+}
+
+Tracer* Tracer::instance()
+{
+    return tracerSingleton;
+}
+
+QString Tracer::childFileName(const QString& fileName)
+{
+    if (fileName.isEmpty())
+        return fileName;
+    QFileInfo fileInfo(fileName);
+    QString name = fileInfo.completeBaseName() + '-' + QString::number(QCoreApplication::applicationPid());
+    if (!fileInfo.suffix().isEmpty())
+        name += '.' + fileInfo.suffix();
+    return fileInfo.dir().filePath(name);
+}
+
+void Tracer::trace(const char* name, char phase, qint64 frame)
+{
+    // Announce the append before checking again, so that the destructor
+    // either sees it or this thread sees that tracing was disabled
+    appendsInFlight.fetch_add(1);
+    if (tracingEnabled.load())
+        tracerSingleton->append(name, phase, frame);
+    appendsInFlight.fetch_sub(1);
+}
+
+void Tracer::begin(const char* name, qint64 frame)
+{
+    if (tracingEnabled.load(std::memory_order_relaxed))
+        trace(name, 'B', frame);
+}
+
+void Tracer::end(const char* name, qint64 frame)
+{
+    if (tracingEnabled.load(std::memory_order_relaxed))
+        trace(name, 'E', frame);
+}
+
+// must be called with _mutex locked
+Tracer::Chunk* Tracer::freeChunk()
+{
+    Chunk* chunk;
+    if (_freeChunks.isEmpty()) {
+        chunk = new Chunk;
+    } else {
+        chunk = _freeChunks.takeLast();
+    }
+    chunk->count.store(0, std::memory_order_relaxed);
+    return chunk;
+}
+
+Tracer::ThreadBuffer* Tracer::threadBuffer()
+{
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        QMutexLocker locker(&_mutex);
+        buffer = new ThreadBuffer;
+        buffer->tid = _threadBuffers.size() + 1;
+        QThread* thread = QThread::currentThread();
+        buffer->name = thread->objectName();
+        if (buffer->name.isEmpty()) {
+            buffer->name = (thread == QCoreApplication::instance()->thread()
+                    ? QString("main") : QString("thread %1").arg(buffer->tid));
+        }
+        buffer->chunk = freeChunk();
+        buffer->chunk->tid = buffer->tid;
+        _threadBuffers.append(buffer);
+    }
+    return buffer;
+}
+
+void Tracer::append(const char* name, char phase, qint64 frame)
+{
+    ThreadBuffer* buffer = threadBuffer();
+    Chunk* chunk = buffer->chunk;
+    int i = chunk->count.load(std::memory_order_relaxed);
+    Event& event = chunk->events[i];
+    event.name = name;
+    event.phase = phase;
+    event.nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    event.frame = frame;
+    // publish the event to the destructor, which may write incomplete chunks
+    chunk->count.store(i + 1, std::memory_order_release);
+    if (i + 1 == ChunkSize) {
+        QMutexLocker locker(&_mutex);
+        _fullChunks.append(chunk);
+        buffer->chunk = freeChunk();
+        buffer->chunk->tid = buffer->tid;
+        _waitCondition.wakeOne();
+    }
+}
+
+void Tracer::write(const Chunk* chunk)
+{
+    int count = chunk->count.load(std::memory_order_acquire);
+    QByteArray data;
+    data.reserve(count * 100);
+    char line[256];
+    for (int i = 0; i < count; i++) {
+        const Event& event = chunk->events[i];
+        int n;
+        if (event.frame >= 0) {
+            n = std::snprintf(line, sizeof(line),
+                    "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%lld,\"tid\":%d,\"args\":{\"frame\":%lld}}",
+                    _firstEvent ? "" : ",\n", event.name, event.phase, event.nsecs / 1e3,
+                    static_cast<long long>(_pid), chunk->tid, static_cast<long long>(event.frame));
+        } else {
+            n = std::snprintf(line, sizeof(line),
+                    "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%lld,\"tid\":%d}",
+                    _firstEvent ? "" : ",\n", event.name, event.phase, event.nsecs / 1e3,
+                    static_cast<long long>(_pid), chunk->tid);
+        }
+        data.append(line, qBound(0, n, int(sizeof(line)) - 1));
+        _firstEvent = false;
+    }
+    _file.write(data);
+    _eventCount += count;
+}
+
+void Tracer::run()
+{
+    for (;;) {
+        _mutex.lock();
+        while (!_abort && _fullChunks.isEmpty())
+            _waitCondition.wait(&_mutex);
+        if (_abort) {
+            _mutex.unlock();
+            break;
+        }
+        QVector<Chunk*> chunks;
+        chunks.swap(_fullChunks);
+        _mutex.unlock();
+
+        for (int i = 0; i < chunks.size(); i++)
+            write(chunks[i]);
+
+        _mutex.lock();
+        _freeChunks.append(chunks);
+        _mutex.unlock();
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QString>
+#include <QFile>
+
+
+/* Records begin and end events of the stages of the frame pipeline and writes
+ * them to a file in the Chrome trace event JSON format, which can be viewed in
+ * chrome://tracing and in the Perfetto UI (ui.perfetto.dev).
+ * Each thread appends its events to its own buffer without locking. Full
+ * buffers are handed to a background thread that writes them to the file, so
+ * that tracing does not do file I/O on the threads that are traced.
+ * Timestamps come from the monotonic system clock, so that the traces of the
+ * main process and the QVR child processes can be merged.
+ * Event names must be string literals. A frame number of -1 means that the
+ * event does not refer to a specific frame.
+ * When tracing is disabled, begin() and end() return immediately. The
+ * destructor disables tracing and waits until no thread is appending an event
+ * anymore, so threads that are still running at exit (e.g. those of the
+ * multimedia backend) never touch a destroyed Tracer. */
+
+class Tracer : public QThread
+{
+Q_OBJECT
+
+private:
+    class Event
+    {
+    public:
+        const char* name;
+        char phase;             // 'B' or 'E'
+        qint64 nsecs;           // monotonic clock
+        qint64 frame;
+    };
+
+    static const int ChunkSize = 1024;
+
+    class Chunk
+    {
+    public:
+        int tid;
+        std::atomic<int> count; // only written by the thread that owns the chunk
+        Event events[ChunkSize];
+    };
+
+    class ThreadBuffer
+    {
+    public:
+        int tid;
+        QString name;
+        Chunk* chunk;           // the chunk that the thread currently appends to
+    };
+
+    QFile _file;
+    qint64 _pid;
+    QMutex _mutex;
+    QWaitCondition _waitCondition;
+    bool _abort;
+    QVector<Chunk*> _fullChunks;    // waiting to be written
+    QVector<Chunk*> _freeChunks;    // written and ready for reuse
+    QVector<ThreadBuffer*> _threadBuffers;
+    // only accessed by the writer thread while it runs:
+    qint64 _eventCount;
+    bool _firstEvent;
+
+    ThreadBuffer* threadBuffer();
+    Chunk* freeChunk();
+    void append(const char* name, char phase, qint64 frame);
+    static void trace(const char* name, char phase, qint64 frame);
+    void write(const Chunk* chunk);
+
+protected:
+    virtual void run() override;
+
+public:
+    Tracer(const QString& fileName); // an empty file name disables tracing
+    virtual ~Tracer();
+
+    static Tracer* instance();
+
+    // The file name used by QVR child processes: the process id is appended
+    // to the base name of the main process' trace file
+    static QString childFileName(const QString& fileName);
+
+    static void begin(const char* name, qint64 frame = -1);
+    static void end(const char* name, qint64 frame = -1);
+};
@@ -19,10 +19,17 @@
  */
 
 #include "videoframe.hpp"
+#include "contenthash.hpp"
+#include "tracer.hpp"
 #include "log.hpp"
 
 
-VideoFrame::VideoFrame()
+static VideoFrame::HashMode hashMode = VideoFrame::Hash_Full;
+static const int HashSampleRowStride = 8;
+
+VideoFrame::VideoFrame() :
+    hash(0),
+    number(-1)
 {
     update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
 }
@@ -32,6 +39,8 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
     if (qframe.isMapped())
         qframe.unmap();
     qframe = frame;
+    stillImage = false;
+    mappedDataOwner.reset();
 
     bool valid = (qframe.isValid() && qframe.pixelFormat() != QVideoFrameFormat::Format_Invalid);
     if (valid) {
@@ -41,42 +50,7 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
         aspectRatio = float(width) / height;
         LOG_FIREHOSE("videoframe receives new %dx%d frame with pixel format %s", width, height,
                 qPrintable(QVideoFrameFormat::pixelFormatToString(qframe.pixelFormat())));
-        if (im == Input_Unknown) {
-            if (aspectRatio >= 3.0f)
-                im = Input_Left_Right;
-            else if (aspectRatio < 1.0f)
-                im = Input_Top_Bottom;
-            else
-                im = Input_Mono;
-            LOG_FIREHOSE("videoframe guesses input mode from aspect ratio %g: %s", aspectRatio, inputModeToString(im));
-        }
-        inputMode = im;
-        if (sm == Surround_Unknown) {
-            if (width == height && (inputMode == Input_Top_Bottom || inputMode == Input_Bottom_Top))
-                sm = Surround_360;
-            else if (width == 2 * height && inputMode == Input_Mono)
-                sm = Surround_360;
-            else if (width == 2 * height && (inputMode == Input_Top_Bottom_Half || inputMode == Input_Bottom_Top_Half))
-                sm = Surround_360;
-            else if (width == 2 * height && (inputMode == Input_Left_Right_Half || inputMode == Input_Right_Left_Half))
-                sm = Surround_360;
-            else if (width == 4 * height && (inputMode == Input_Left_Right || inputMode == Input_Right_Left))
-                sm = Surround_360;
-            else if (2 * width == height && (inputMode == Input_Top_Bottom || inputMode == Input_Bottom_Top))
-                sm = Surround_180;
-            else if (width == height && inputMode == Input_Mono)
-                sm = Surround_180;
-            else if (width == height && (inputMode == Input_Top_Bottom_Half || inputMode == Input_Bottom_Top_Half))
-                sm = Surround_180;
-            else if (width == height && (inputMode == Input_Left_Right_Half || inputMode == Input_Right_Left_Half))
-                sm = Surround_180;
-            else if (width == 2 * height && (inputMode == Input_Left_Right || inputMode == Input_Right_Left))
-                sm = Surround_180;
-            else
-                sm = Surround_Off;
-            LOG_FIREHOSE("videoframe guesses surround mode %s from frame size", surroundModeToString(sm));
-        }
-        surroundMode = sm;
+        setModes(im, sm);
         bool fallbackToImage = true;
         if (       qframe.pixelFormat() == QVideoFrameFormat::Format_ARGB8888
                 || qframe.pixelFormat() == QVideoFrameFormat::Format_ARGB8888_Premultiplied
@@ -141,7 +115,9 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
                 yuvSpace = YUV_AdobeRgb;
                 break;
             }
+            Tracer::begin("map", number);
             qframe.map(QVideoFrame::ReadOnly);
+            Tracer::end("map", number);
             planeCount = qframe.planeCount();
             for (int p = 0; p < planeCount; p++) {
                 bytesPerLine[p] = qframe.bytesPerLine(p);
@@ -163,16 +139,195 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
         aspectRatio = 1.0f;
         subtitle = QString();
     }
+    updateHash();
+}
+
+void VideoFrame::update(InputMode im, SurroundMode sm, const QImage& img, bool newSrc)
+{
+    if (img.isNull()) {
+        update(im, sm, QVideoFrame(), newSrc);
+        return;
+    }
+    if (qframe.isMapped())
+        qframe.unmap();
+    qframe = QVideoFrame();
+    stillImage = true;
+    mappedDataOwner.reset();
+
+    width = img.width();
+    height = img.height();
+    aspectRatio = float(width) / height;
+    if (newSrc)
+        LOG_DEBUG("videoframe receives new %dx%d still image", width, height);
+    setModes(im, sm);
+    storage = Storage_Image;
+    pixelFormat = QVideoFrameFormat::pixelFormatFromImageFormat(QImage::Format_RGB32);
+    yuvValueRangeSmall = false;
+    yuvSpace = YUV_AdobeRgb;
+    planeCount = 0;
+    // this is a no-op (and thus does not copy) if the image is already in the right format
+    image = img.convertToFormat(preferredImageFormat(img.format()));
+    subtitle = QString();
+    updateHash();
+}
+
+void VideoFrame::update(InputMode im, SurroundMode sm, const RawFrame& raw, bool newSrc)
+{
+    if (qframe.isMapped())
+        qframe.unmap();
+    qframe = QVideoFrame();
+    stillImage = false;
+    mappedDataOwner = raw.owner;
+
+    width = raw.width;
+    height = raw.height;
+    aspectRatio = float(width) / height;
+    if (newSrc)
+        LOG_DEBUG("videoframe receives new %dx%d raw frame with pixel format %s", width, height,
+                qPrintable(QVideoFrameFormat::pixelFormatToString(raw.pixelFormat)));
+    setModes(im, sm);
+    storage = Storage_Mapped;
+    pixelFormat = raw.pixelFormat;
+    yuvValueRangeSmall = raw.yuvValueRangeSmall;
+    yuvSpace = raw.yuvSpace;
+    planeCount = raw.planeCount;
+    for (int p = 0; p < planeCount; p++) {
+        bytesPerLine[p] = raw.bytesPerLine[p];
+        bytesPerPlane[p] = raw.bytesPerPlane[p];
+        mappedBits[p] = raw.bits[p];
+    }
+    image = QImage();
+    subtitle = QString();
+    updateHash();
+}
+
+QImage::Format VideoFrame::preferredImageFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        return QImage::Format_RGBX16FPx4;
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+    case QImage::Format_Grayscale16:
+    case QImage::Format_BGR30:
+    case QImage::Format_A2BGR30_Premultiplied:
+    case QImage::Format_RGB30:
+    case QImage::Format_A2RGB30_Premultiplied:
+        return QImage::Format_RGBX64;
+    default:
+        return QImage::Format_RGB32;
+    }
+}
+
+void VideoFrame::setHashMode(HashMode mode)
+{
+    hashMode = mode;
+}
+
+// hash one plane of data, either completely or only every HashSampleRowStride'th row
+static quint64 planeHash(const uchar* data, int bytesPerLine, int bytesPerPlane, quint64 seed)
+{
+    if (hashMode == VideoFrame::Hash_Full || bytesPerLine <= 0)
+        return contentHash(data, bytesPerPlane, seed);
+    int rows = bytesPerPlane / bytesPerLine;
+    quint64 h = seed;
+    for (int r = 0; r < rows; r += HashSampleRowStride)
+        h = contentHash(data + size_t(r) * bytesPerLine, bytesPerLine, h);
+    if (rows > 0 && (rows - 1) % HashSampleRowStride != 0) // always include the last row
+        h = contentHash(data + size_t(rows - 1) * bytesPerLine, bytesPerLine, h);
+    return h;
+}
+
+void VideoFrame::updateHash()
+{
+    if (hashMode == Hash_Off) {
+        hash = 0;
+        return;
+    }
+    // the properties that influence rendering
+    bool isImage = (storage == Storage_Image);
+    const int properties[] = {
+        int(inputMode), int(surroundMode), width, height, int(storage),
+        isImage ? int(image.format()) : int(pixelFormat),
+        isImage ? 0 : int(yuvValueRangeSmall),
+        isImage ? 0 : int(yuvSpace)
+    };
+    quint64 h = contentHash(properties, sizeof(properties));
+    h = contentHash(subtitle.utf16(), subtitle.size() * sizeof(char16_t), h);
+    // the data, plane by plane
+    if (isImage) {
+        h = planeHash(image.constBits(), image.bytesPerLine(), image.sizeInBytes(), h);
+    } else {
+        for (int p = 0; p < planeCount; p++) {
+            const uchar* data = (storage == Storage_Mapped ? mappedBits[p] : bits[p].data());
+            if (data)
+                h = planeHash(data, bytesPerLine[p], bytesPerPlane[p], h);
+        }
+    }
+    hash = (h == 0 ? 1 : h); // 0 means unknown
+}
+
+void VideoFrame::setModes(InputMode im, SurroundMode sm)
+{
+    if (im == Input_Unknown) {
+        if (aspectRatio >= 3.0f)
+            im = Input_Left_Right;
+        else if (aspectRatio < 1.0f)
+            im = Input_Top_Bottom;
+        else
+            im = Input_Mono;
+        LOG_FIREHOSE("videoframe guesses input mode from aspect ratio %g: %s", aspectRatio, inputModeToString(im));
+    }
+    inputMode = im;
+    if (sm == Surround_Unknown) {
+        if (width == height && (inputMode == Input_Top_Bottom || inputMode == Input_Bottom_Top))
+            sm = Surround_360;
+        else if (width == 2 * height && inputMode == Input_Mono)
+            sm = Surround_360;
+        else if (width == 2 * height && (inputMode == Input_Top_Bottom_Half || inputMode == Input_Bottom_Top_Half))
+            sm = Surround_360;
+        else if (width == 2 * height && (inputMode == Input_Left_Right_Half || inputMode == Input_Right_Left_Half))
+            sm = Surround_360;
+        else if (width == 4 * height && (inputMode == Input_Left_Right || inputMode == Input_Right_Left))
+            sm = Surround_360;
+        else if (2 * width == height && (inputMode == Input_Top_Bottom || inputMode == Input_Bottom_Top))
+            sm = Surround_180;
+        else if (width == height && inputMode == Input_Mono)
+            sm = Surround_180;
+        else if (width == height && (inputMode == Input_Top_Bottom_Half || inputMode == Input_Bottom_Top_Half))
+            sm = Surround_180;
+        else if (width == height && (inputMode == Input_Left_Right_Half || inputMode == Input_Right_Left_Half))
+            sm = Surround_180;
+        else if (width == 2 * height && (inputMode == Input_Left_Right || inputMode == Input_Right_Left))
+            sm = Surround_180;
+        else
+            sm = Surround_Off;
+        LOG_FIREHOSE("videoframe guesses surround mode %s from frame size", surroundModeToString(sm));
+    }
+    surroundMode = sm;
 }
 
 void VideoFrame::reUpdate()
 {
-    update(inputMode, surroundMode, qframe, false);
+    if (mappedDataOwner) {
+        setModes(inputMode, surroundMode);
+        updateHash();
+    } else if (stillImage) {
+        update(inputMode, surroundMode, image, false);
+    } else {
+        update(inputMode, surroundMode, qframe, false);
+    }
 }
 
 void VideoFrame::invalidate()
 {
-    if (qframe.isValid())
+    if (qframe.isValid() || stillImage || mappedDataOwner)
         update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
 }
 
@@ -184,6 +339,7 @@ QDataStream &operator<<(QDataStream& ds, const VideoFrame& f)
     ds << f.width;
     ds << f.height;
     ds << f.aspectRatio;
+    ds << f.number;
     switch (f.storage) {
     case VideoFrame::Storage_Mapped:
     case VideoFrame::Storage_Copied:
@@ -202,6 +358,8 @@ QDataStream &operator<<(QDataStream& ds, const VideoFrame& f)
         }
         break;
     case VideoFrame::Storage_Image:
+        ds << static_cast<int>(VideoFrame::Storage_Image);
+        ds << static_cast<int>(f.image.format());
         ds.writeRawData(reinterpret_cast<const char*>(f.image.bits()), f.image.sizeInBytes());
         break;
     }
@@ -220,6 +378,7 @@ QDataStream &operator>>(QDataStream& ds, VideoFrame& f)
     ds >> f.width;
     ds >> f.height;
     ds >> f.aspectRatio;
+    ds >> f.number;
     ds >> tmp;
     f.storage = static_cast<enum VideoFrame::Storage>(tmp);
     switch (f.storage) {
@@ -257,7 +416,8 @@ QDataStream &operator>>(QDataStream& ds, VideoFrame& f)
             f.mappedBits[p] = nullptr;
             f.bits[p].clear();
         }
-        f.image = QImage(f.width, f.height, QImage::Format_RGB32);
+        ds >> tmp;
+        f.image = QImage(f.width, f.height, static_cast<QImage::Format>(tmp));
         ds.readRawData(reinterpret_cast<char*>(f.image.bits()), f.image.sizeInBytes());
         break;
     }
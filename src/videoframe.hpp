@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include <QtCore>
 #include <QVideoFrame>
 #include <QImage>
@@ -27,6 +29,8 @@
 #include "modes.hpp"
 
 
+class RawFrame;
+
 class VideoFrame
 {
 Q_DECLARE_TR_FUNCTIONS(VideoFrame)
@@ -50,6 +54,13 @@ public:
         Storage_Image   // QImage
     };
 
+    // How the content hash is computed:
+    enum HashMode {
+        Hash_Off,       // not at all; every frame counts as new
+        Hash_Sampled,   // from every eighth row of each plane
+        Hash_Full       // from all data
+    };
+
     enum YUVSpace {
         // see shader-color.frag.glsl
         YUV_BT601 = 1,
@@ -64,6 +75,8 @@ public:
     InputMode inputMode;
     /* The surround mode of this frame: */
     SurroundMode surroundMode;
+    /* Whether this frame was created from a still image instead of a QVideoFrame: */
+    bool stillImage;
     /* The subtitle: */
     QString subtitle;
     /* The following can mirror the data of QVideoFrame: */
@@ -80,16 +93,55 @@ public:
     int bytesPerPlane[3];
     // for mapped data:
     uchar* mappedBits[3];
+    std::shared_ptr<void> mappedDataOwner; // keeps mapped data alive that does not belong to qframe
     // for copied data:
     std::vector<uchar> bits[3];
-    // for QImage data:
+    // for QImage data (Format_RGB32, or Format_RGBX64 or Format_RGBX16FPx4 for still images
+    // with higher precision; the latter are assumed to contain linear RGB):
     QImage image;
+    /* Hash of the content and properties, computed by update(); 0 if unknown.
+     * Frames with the same nonzero hash look the same. */
+    quint64 hash;
+    /* Sequence number assigned by the video sink, to follow frames through
+     * the pipeline in traces: */
+    qint64 number;
 
     VideoFrame();
 
     void update(InputMode im, SurroundMode ts, const QVideoFrame& frame, bool newSrc);
+    void update(InputMode im, SurroundMode ts, const QImage& img, bool newSrc);
+    void update(InputMode im, SurroundMode ts, const RawFrame& raw, bool newSrc);
+    // The image format that update() converts the given format to. Decoder threads
+    // can use this to convert images before they reach the main thread.
+    static QImage::Format preferredImageFormat(QImage::Format format);
+    // Set how update() computes the content hash (default Hash_Full)
+    static void setHashMode(HashMode mode);
     void reUpdate();
     void invalidate();
+
+private:
+    // set inputMode and surroundMode, guessing unknown modes from the frame size
+    void setModes(InputMode im, SurroundMode sm);
+    // compute the hash from the current data
+    void updateHash();
+};
+
+/* Frame data in memory that does not belong to a QVideoFrame, e.g. in a
+ * memory-mapped raw video file. The VideoFrame keeps a reference to the owner
+ * of the memory for as long as it uses the data. */
+class RawFrame
+{
+public:
+    int width;
+    int height;
+    QVideoFrameFormat::PixelFormat pixelFormat;
+    bool yuvValueRangeSmall;
+    enum VideoFrame::YUVSpace yuvSpace;
+    int planeCount;
+    int bytesPerLine[3];
+    int bytesPerPlane[3];
+    uchar* bits[3];
+    std::shared_ptr<void> owner;
 };
 
 QDataStream &operator<<(QDataStream& ds, const VideoFrame& frame);
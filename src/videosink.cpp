@@ -21,11 +21,16 @@
 #include <QUrl>
 
 #include "videosink.hpp"
+#include "tracer.hpp"
 #include "log.hpp"
 
 
 VideoSink::VideoSink(VideoFrame* frame, VideoFrame* extFrame, bool* frameIsNew) :
+    contentChanged(false),
+    skippedFrameCounter(0),
     frameCounter(0),
+    totalFrameCounter(0),
+    totalSkippedFrameCounter(0),
     fileFormatIsMPO(false),
     frame(frame),
     extFrame(extFrame),
@@ -37,10 +42,25 @@ VideoSink::VideoSink(VideoFrame* frame, VideoFrame* extFrame, bool* frameIsNew)
     connect(this, SIGNAL(videoFrameChanged(const QVideoFrame&)), this, SLOT(processNewFrame(const QVideoFrame&)));
 }
 
+VideoSink::~VideoSink()
+{
+    logStatistics();
+}
+
+void VideoSink::logStatistics()
+{
+    if (skippedFrameCounter > 0) {
+        LOG_INFO("video sink: %llu of %llu frames were identical to their predecessor and not uploaded again",
+                skippedFrameCounter, frameCounter);
+    }
+}
+
 // called whenever a new media URL is played:
 void VideoSink::newUrl(const QUrl& url, InputMode im, SurroundMode sm)
 {
+    logStatistics();
     frameCounter = 0;
+    skippedFrameCounter = 0;
     fileFormatIsMPO = false;
 
     LOG_DEBUG("initial input mode for %s: %s", qPrintable(url.toString()), inputModeToString(im));
@@ -114,18 +134,9 @@ void VideoSink::newUrl(const QUrl& url, InputMode im, SurroundMode sm)
     }
 }
 
-void VideoSink::processNewFrame(const QVideoFrame& frame)
+// decide whether the next frame is the extended frame in alternating stereo:
+bool VideoSink::nextFrameIsExtFrame()
 {
-    // Workaround a glitch in the MPO file format:
-    // Gstreamer reads three frames from such files, the first two being the left
-    // view and the last one being the right view.
-    // We therefore ignore the first frame to get a proper left-right pair.
-    if (fileFormatIsMPO && frameCounter == 0) {
-        LOG_DEBUG("video sink ignores first frame from MPO file to work around glitch");
-        frameCounter++;
-        return;
-    }
-
     bool updateExtFrame;
     if (inputMode == Input_Alternating_LR || inputMode == Input_Alternating_RL) {
         if (needExtFrame) {
@@ -142,16 +153,116 @@ void VideoSink::processNewFrame(const QVideoFrame& frame)
         updateExtFrame = false;
         needExtFrame = false;
     }
-    if (updateExtFrame) {
+    return updateExtFrame;
+}
+
+// compare the content hashes of frame and extFrame with their previous values
+void VideoSink::noteHashes(quint64 oldFrameHash, quint64 oldExtFrameHash)
+{
+    if (oldFrameHash == 0 || oldFrameHash != frame->hash
+            || oldExtFrameHash == 0 || oldExtFrameHash != extFrame->hash) {
+        contentChanged = true;
+    }
+}
+
+void VideoSink::frameDone()
+{
+    if (!needExtFrame) {
+        if (contentChanged || frameCounter == 0) {
+            LOG_FIREHOSE("video sink signals that new frame is complete");
+            *frameIsNew = true;
+        } else {
+            // The renderers keep the textures of the previous frame, and
+            // the VR child processes do not receive the frame again.
+            LOG_FIREHOSE("video sink skips frame that is identical to its predecessor");
+            skippedFrameCounter++;
+            totalSkippedFrameCounter++;
+        }
+        totalFrameCounter++;
+        contentChanged = false;
+        // still signal the frame, e.g. for the converter to write it
+        emit newVideoFrame();
+    }
+    frameCounter++;
+}
+
+void VideoSink::processNewFrame(const QVideoFrame& frame)
+{
+    // Workaround a glitch in the MPO file format, for MPO files that are not
+    // handled by the image source (e.g. remote files):
+    // Gstreamer reads three frames from such files, the first two being the left
+    // view and the last one being the right view.
+    // We therefore ignore the first frame to get a proper left-right pair.
+    if (fileFormatIsMPO && frameCounter == 0) {
+        LOG_DEBUG("video sink ignores first frame from MPO file to work around glitch");
+        frameCounter++;
+        return;
+    }
+
+    qint64 number = totalFrameCounter;
+    Tracer::begin("sink", number);
+    quint64 oldFrameHash = this->frame->hash;
+    quint64 oldExtFrameHash = this->extFrame->hash;
+    if (nextFrameIsExtFrame()) {
+        this->extFrame->number = number;
         this->extFrame->update(inputMode, surroundMode, frame, frameCounter == 0);
     } else {
+        this->frame->number = number;
         this->frame->update(inputMode, surroundMode, frame, frameCounter == 0);
         this->extFrame->invalidate();
     }
-    if (!needExtFrame) {
-        LOG_FIREHOSE("video sink signals that new frame is complete");
-        *frameIsNew = true;
-        emit newVideoFrame();
+    noteHashes(oldFrameHash, oldExtFrameHash);
+    frameDone();
+    Tracer::end("sink", number);
+}
+
+// called instead of processNewFrame() for frames of raw video files;
+// the frame data stays in the memory-mapped file:
+void VideoSink::processNewRawFrame(const RawFrame& frame)
+{
+    qint64 number = totalFrameCounter;
+    Tracer::begin("sink", number);
+    quint64 oldFrameHash = this->frame->hash;
+    quint64 oldExtFrameHash = this->extFrame->hash;
+    if (nextFrameIsExtFrame()) {
+        this->extFrame->number = number;
+        this->extFrame->update(inputMode, surroundMode, frame, frameCounter == 0);
+    } else {
+        this->frame->number = number;
+        this->frame->update(inputMode, surroundMode, frame, frameCounter == 0);
+        this->extFrame->invalidate();
     }
-    frameCounter++;
+    noteHashes(oldFrameHash, oldExtFrameHash);
+    frameDone();
+    Tracer::end("sink", number);
+}
+
+// called instead of processNewFrame() for still images that do not go through QMediaPlayer;
+// extImage is the second view of a multi picture object:
+void VideoSink::processNewImage(const QImage& image, const QImage& extImage)
+{
+    qint64 number = totalFrameCounter;
+    Tracer::begin("sink", number);
+    // The image source delivers both views of MPO files at once. If it could
+    // not extract a second view, the file is shown as a single image.
+    if (fileFormatIsMPO && extImage.isNull() && inputMode == Input_Alternating_LR) {
+        LOG_DEBUG("video sink shows MPO file without second view as mono image");
+        inputMode = Input_Mono;
+    }
+    quint64 oldFrameHash = this->frame->hash;
+    quint64 oldExtFrameHash = this->extFrame->hash;
+    LOG_FIREHOSE("video sink updates standard frame from still image");
+    this->frame->number = number;
+    this->frame->update(inputMode, surroundMode, image, frameCounter == 0);
+    if (!extImage.isNull() && (inputMode == Input_Alternating_LR || inputMode == Input_Alternating_RL)) {
+        LOG_FIREHOSE("video sink updates extended frame from still image");
+        this->extFrame->number = number;
+        this->extFrame->update(inputMode, surroundMode, extImage, frameCounter == 0);
+    } else {
+        this->extFrame->invalidate();
+    }
+    needExtFrame = false;
+    noteHashes(oldFrameHash, oldExtFrameHash);
+    frameDone();
+    Tracer::end("sink", number);
 }
@@ -31,8 +31,19 @@ class VideoSink : public QVideoSink
 {
 Q_OBJECT
 
+private:
+    bool contentChanged;  // whether frame or extFrame changed since the last complete frame
+    unsigned long long skippedFrameCounter; // number of frames identical to their predecessor
+
+    bool nextFrameIsExtFrame();
+    void noteHashes(quint64 oldFrameHash, quint64 oldExtFrameHash);
+    void frameDone();
+    void logStatistics();
+
 public:
     unsigned long long frameCounter; // number of frames seen for this URL
+    unsigned long long totalFrameCounter; // number of complete frames seen since startup
+    unsigned long long totalSkippedFrameCounter; // number of those identical to their predecessor
     bool fileFormatIsMPO; // flag to work around MPO glitches
     VideoFrame* frame;    // target video frame
     VideoFrame* extFrame; // extension to target video frame, for alternating stereo
@@ -42,8 +53,11 @@ public:
     SurroundMode surroundMode; // surround mode of the current media
 
     VideoSink(VideoFrame* frame, VideoFrame* extFrame, bool* frameIsNew);
+    virtual ~VideoSink();
 
     void newUrl(const QUrl& url, InputMode inputMode, SurroundMode surroundMode);
+    void processNewImage(const QImage& image, const QImage& extImage = QImage());
+    void processNewRawFrame(const RawFrame& frame);
 
 public Q_SLOTS:
     void processNewFrame(const QVideoFrame& frame);
@@ -21,45 +21,30 @@
 #pragma once
 
 #include <QOpenGLWidget>
-#include <QOpenGLExtraFunctions>
 
 #include "modes.hpp"
 #include "bino.hpp"
+#include "screenoutput.hpp"
 
 
-class Widget : public QOpenGLWidget, protected QOpenGLExtraFunctions
+class Widget : public QOpenGLWidget
 {
 Q_OBJECT
 
 private:
     QSize _sizeHint;
     int _width, _height;
-
-    OutputMode _outputMode;
-    bool _openGLStereo;       // is this widget in quad-buffered stereo mode?
-    int _alternatingLastView; // last view displayed in Mode_Alternating (0 or 1)
-
-    bool _inSurroundMovement;
-    QPointF _surroundMovementStart;
-    float _surroundHorizontalAngleBase;
-    float _surroundVerticalAngleBase;
-    float _surroundHorizontalAngleCurrent;
-    float _surroundVerticalAngleCurrent;
-
-    unsigned int _viewTex[2];
-    int _viewTexWidth[2], _viewTexHeight[2];
-    unsigned int _quadVao;
-    QOpenGLShaderProgram _displayPrg;
-    int _displayPrgOutputMode;
-
-    void rebuildDisplayPrgIfNecessary(OutputMode outputMode);
+    ScreenOutput _output;
 
 public:
     Widget(OutputMode outputMode, QWidget* parent = nullptr);
+    virtual ~Widget();
 
     bool isOpenGLStereo() const;
     OutputMode outputMode() const;
     void setOutputMode(OutputMode mode);
+    bool hudVisible() const;
+    void setHudVisible(bool visible);
 
     virtual QSize sizeHint() const override;
     virtual void initializeGL() override;